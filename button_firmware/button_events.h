@@ -0,0 +1,162 @@
+/**
+ * @file    button_events.h
+ * @brief   Button events (SOS, cancel), how they are carried in the payload and their broadcast profiles
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): the button encodes with it, host
+ *          tools decode with it.
+ *
+ *          Several buttons share the one EXT1 wake mask (any low). After the wake,
+ *          esp_sleep_get_ext1_wakeup_status() tells which pin(s) woke the chip, and
+ *          buttonEventFromWake() turns that into the event of this press.
+ *
+ *          Payload: still the 8 bytes (code u32 BE | timestamp u32 BE), so gateways and
+ *          receivers keep working. The event type is the top nibble of the timestamp word
+ *          and the rolling code is generated over the stamped word, so the event type is
+ *          authenticated with the code. SOS is event 0.
+ *
+ *          Timestamp word [32 bits]:
+ *            31     rolling code scheme: 0 = ROLLING_CODE_SCHEME_V1, 1 = V2 (rolling_code.h)
+ *            30-28  event type
+ *            27     clock synced: bits 26-0 are seconds since BUTTON_CLOCK_EPOCH_UNIX,
+ *                   else seconds since power-on (device_clock.h)
+ *            26-0   device clock, 1 s resolution, wraps after 4.25 years
+ *          Firmware before the device clock sent microseconds since boot: bit 27 clear,
+ *          so a verifier treats those like an unsynced clock. Firmware before the schemes
+ *          had bit 31 clear: V1, which is what it sends. The scheme bit is covered by the
+ *          code like the event, so a scheme can't be claimed for another's code.
+ *
+ *          Broadcast profile per event: SOS broadcasts for the field configured beacon time,
+ *          a cancel only for a short burst (BUTTON_CANCEL_BEACON_MS). Both keep the same
+ *          advertising interval, which the gateways' scan scheduler is tuned to, so a cancel
+ *          costs about BUTTON_CANCEL_BEACON_MS / beacon time of an SOS (1/5 by default).
+*/
+
+#ifndef BUTTON_EVENTS_H
+#define BUTTON_EVENTS_H
+
+#include <stdint.h>
+
+/* ============= Events ============= */
+enum class ButtonEvent : uint8_t {
+  SOS = 0,     /**< Help needed (the original, single button) */
+  CANCEL = 1,  /**< Previous SOS no longer needed */
+  COUNT
+};
+
+#define BUTTON_EVENT_SHIFT 28
+#define BUTTON_EVENT_BITS 0x7u                   /**< Event type: bits 30-28 */
+#define BUTTON_EVENT_TIMESTAMP_MASK 0x0FFFFFFFu  /**< Timestamp bits left in the stamped word */
+#define BUTTON_SCHEME_BIT 0x80000000u            /**< Bit 31: the code is of scheme V2 */
+
+/* ============= Device Clock ============= */
+#define BUTTON_CLOCK_SYNCED_BIT 0x08000000u  /**< Bit 27: clock set from a wall clock */
+#define BUTTON_CLOCK_MASK 0x07FFFFFFu        /**< Bits 26-0: device clock in seconds */
+#define BUTTON_CLOCK_EPOCH_UNIX 1704067200u  /**< 2024-01-01 00:00:00 UTC */
+
+/* ============= Cancel Profile ============= */
+#define BUTTON_CANCEL_BEACON_MS 2000  /**< Short burst: enough adverts for a gateway to catch one */
+
+
+/**
+ * @brief Broadcast parameters of one event
+ */
+typedef struct {
+  uint32_t beacon_ms;         /**< Broadcast duration */
+  uint16_t adv_min_interval;  /**< Units of 0.625ms */
+  uint16_t adv_max_interval;  /**< Units of 0.625ms */
+  bool ieee802154;            /**< Also send over 802.15.4 (if configured) */
+} broadcast_profile_t;
+
+
+/**
+ * @brief Put the event type into the timestamp word
+ */
+static inline uint32_t buttonEventStamp(const uint32_t timestamp, const ButtonEvent event) {
+  return (timestamp & BUTTON_EVENT_TIMESTAMP_MASK) | ((uint32_t)event << BUTTON_EVENT_SHIFT);
+}
+
+/**
+ * @brief Event type of a received timestamp word
+ * @return ButtonEvent ButtonEvent::COUNT for a type this version doesn't know
+ */
+static inline ButtonEvent buttonEventOf(const uint32_t stamped) {
+  const uint8_t type = (stamped >> BUTTON_EVENT_SHIFT) & BUTTON_EVENT_BITS;
+  return type < (uint8_t)ButtonEvent::COUNT ? (ButtonEvent)type : ButtonEvent::COUNT;
+}
+
+/**
+ * @brief Put the rolling code scheme into the timestamp word (after buttonEventStamp())
+ * @param scheme ROLLING_CODE_SCHEME_V1 / V2
+ */
+static inline uint32_t buttonSchemeStamp(const uint32_t stamped, const uint8_t scheme) {
+  return scheme == 2 ? stamped | BUTTON_SCHEME_BIT : stamped & ~BUTTON_SCHEME_BIT;
+}
+
+/**
+ * @brief Rolling code scheme of a received timestamp word (ROLLING_CODE_SCHEME_V1 / V2)
+ */
+static inline uint8_t buttonSchemeOf(const uint32_t stamped) {
+  return (stamped & BUTTON_SCHEME_BIT) ? 2 : 1;
+}
+
+/**
+ * @brief Timestamp word of the device clock (before buttonEventStamp())
+ * @param seconds Seconds since BUTTON_CLOCK_EPOCH_UNIX if synced, else since power-on
+ */
+static inline uint32_t buttonClockWord(const uint32_t seconds, const bool synced) {
+  return (seconds & BUTTON_CLOCK_MASK) | (synced ? BUTTON_CLOCK_SYNCED_BIT : 0);
+}
+
+static inline bool buttonClockSynced(const uint32_t stamped) {
+  return (stamped & BUTTON_CLOCK_SYNCED_BIT) != 0;
+}
+
+/**
+ * @brief Device clock of `a` minus that of `b`, in seconds (timestamp words)
+ * @return int32_t Modulo the 27-bit wrap: valid for clocks within +-2.1 years of each other
+ */
+static inline int32_t buttonClockDiff(const uint32_t a, const uint32_t b) {
+  const uint32_t diff = (a - b) & BUTTON_CLOCK_MASK;
+  return diff & (BUTTON_CLOCK_SYNCED_BIT >> 1) ? (int32_t)diff - (int32_t)BUTTON_CLOCK_SYNCED_BIT : (int32_t)diff;
+}
+
+/**
+ * @brief How old a synced timestamp word is at `now_unix`, in seconds
+ * @return int32_t Negative if it lies in the future
+ */
+static inline int32_t buttonClockAge(const uint32_t stamped, const uint64_t now_unix) {
+  return buttonClockDiff((uint32_t)(now_unix - BUTTON_CLOCK_EPOCH_UNIX), stamped);
+}
+
+static inline const char* buttonEventName(const ButtonEvent event) {
+  switch (event) {
+    case ButtonEvent::SOS: return "SOS";
+    case ButtonEvent::CANCEL: return "CANCEL";
+    default: return "UNKNOWN";
+  }
+}
+
+/**
+ * @brief Event of this wake from the EXT1 wake status
+ * @param wake_mask   esp_sleep_get_ext1_wakeup_status()
+ * @param cancel_mask Pin mask of the cancel button
+ * @return ButtonEvent CANCEL only if the cancel button alone woke the chip. Anything else
+ *         (SOS pin, both pressed, no EXT1 wake at all) is an SOS: never lose a call for help.
+ */
+static inline ButtonEvent buttonEventFromWake(const uint64_t wake_mask, const uint64_t cancel_mask) {
+  return (wake_mask != 0 && (wake_mask & ~cancel_mask) == 0) ? ButtonEvent::CANCEL : ButtonEvent::SOS;
+}
+
+/**
+ * @brief Broadcast profile of an event
+ * @param sos The SOS profile (field configuration)
+ */
+static inline broadcast_profile_t buttonEventProfile(const ButtonEvent event, const broadcast_profile_t& sos) {
+  if (event != ButtonEvent::CANCEL) {
+    return sos;
+  }
+  broadcast_profile_t cancel = sos;
+  cancel.beacon_ms = sos.beacon_ms < BUTTON_CANCEL_BEACON_MS ? sos.beacon_ms : BUTTON_CANCEL_BEACON_MS;
+  return cancel;
+}
+
+#endif  // BUTTON_EVENTS_H
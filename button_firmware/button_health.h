@@ -0,0 +1,111 @@
+/**
+ * @file    button_health.h
+ * @brief   Stuck button detection: wake sources at sleep entry, with a timer backoff
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): the firmware runs it before
+ *          every deep sleep, host_tools/button/stuck_sim.cpp runs the same code.
+ *
+ *          EXT1 wakes on a low level (ESP_EXT1_WAKEUP_ANY_LOW), not on an edge. A button
+ *          line that stays low (debris, a squeezed enclosure, moisture) wakes the chip
+ *          again right after it sleeps: a full boot and SOS beacon, over and over, until the
+ *          battery is empty.
+ *
+ *          At sleep entry the firmware reads the button lines (after giving a held press
+ *          BUTTON_STUCK_RELEASE_WAIT_MS to end) and buttonHealthPlan() decides:
+ *          - a line still low is stuck: it leaves the EXT1 mask, the other buttons keep
+ *            waking the chip. A timer wake checks the line again, after
+ *            BUTTON_STUCK_BACKOFF_MIN_S, doubling up to BUTTON_STUCK_BACKOFF_MAX_S.
+ *          - a stuck line that reads high again is back in the EXT1 mask.
+ *          A new stuck line and the release of all of them are reported once each
+ *          (diagnostics event). The state is part of the health data (diag_data,
+ *          maintenance HEALTH record).
+ *
+ *          The first wake of a stuck button looks like a press and sends its beacon: a
+ *          stuck line can't be told from a real press until it stays low.
+ *
+ *          A press that starts as a timer wake fires (device clock, stuck line check) wakes
+ *          the chip on the timer, and EXT1 never reports it. The timer path reads the lines
+ *          once; buttonHealthTimerWakePress() takes any line that isn't stuck and reads low
+ *          as the press. The wake then goes on as a button wake (beacon, release wait),
+ *          instead of sleeping through the press or waiting it out as a stuck line.
+ */
+
+#ifndef BUTTON_HEALTH_H
+#define BUTTON_HEALTH_H
+
+#include <stdint.h>
+
+/* ============= Stuck Button Configuration ============= */
+#define BUTTON_STUCK_RELEASE_WAIT_MS 2000  /**< A press held past the beacon gets this long to end */
+#define BUTTON_STUCK_BACKOFF_MIN_S 15      /**< First check of a stuck line */
+#define BUTTON_STUCK_BACKOFF_MAX_S 600     /**< Bounds how long a released line stays unarmed */
+
+/**
+ * @brief Stuck button state (RTC memory, in diag_data)
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t stuck_mask;     /**< GPIO mask of the buttons found stuck at the last sleep entry */
+  uint32_t backoff_s;      /**< Timer wake interval while stuck */
+  uint32_t episode_wake;   /**< Wake counter when the current episode began */
+  uint16_t episodes;       /**< Episodes since RTC init */
+  uint16_t checks;         /**< Timer checks in the current episode */
+} button_health_t;
+
+/**
+ * @brief Wake sources for the next deep sleep
+ */
+typedef struct {
+  uint64_t ext1_mask;  /**< Buttons armed for EXT1 (any low), 0 = none */
+  uint32_t timer_s;    /**< Stuck line check, 0 = none */
+  int8_t report;       /**< +1 a button got stuck, -1 all stuck buttons released, 0 no change */
+} button_wake_plan_t;
+
+
+/**
+ * @brief Decide the wake sources at sleep entry and update the health state
+ * @param health    State kept across deep sleep
+ * @param wake_mask All button GPIOs
+ * @param low_mask  Button GPIOs reading low now
+ * @param wake      Wake counter (start of an episode)
+ */
+static inline button_wake_plan_t buttonHealthPlan(button_health_t& health, const uint64_t wake_mask,
+                                                  const uint64_t low_mask, const uint32_t wake) {
+  const uint32_t stuck = (uint32_t)(low_mask & wake_mask);
+  button_wake_plan_t plan = { wake_mask & ~(uint64_t)stuck, 0, 0 };
+
+  if (stuck == 0) {
+    plan.report = health.stuck_mask ? -1 : 0;
+    health.stuck_mask = 0;
+    health.backoff_s = 0;
+    return plan;
+  }
+  if (stuck & ~health.stuck_mask) {
+    // A new stuck line: report it, check again soon
+    plan.report = 1;
+    if (health.stuck_mask == 0) {
+      health.episodes++;
+      health.episode_wake = wake;
+      health.checks = 0;
+    }
+    health.backoff_s = BUTTON_STUCK_BACKOFF_MIN_S;
+  } else {
+    health.checks++;
+    health.backoff_s = health.backoff_s * 2 > BUTTON_STUCK_BACKOFF_MAX_S ? BUTTON_STUCK_BACKOFF_MAX_S : health.backoff_s * 2;
+  }
+  health.stuck_mask = stuck;
+  plan.timer_s = health.backoff_s;
+  return plan;
+}
+
+/**
+ * @brief Press seen on a timer wake
+ * @param health    State kept across deep sleep
+ * @param wake_mask All button GPIOs
+ * @param low_mask  Button GPIOs reading low at the wake
+ * @return uint64_t Button GPIOs pressed (as the EXT1 wake status would read), 0 = none
+ */
+static inline uint64_t buttonHealthTimerWakePress(const button_health_t& health, const uint64_t wake_mask,
+                                                  const uint64_t low_mask) {
+  return low_mask & wake_mask & ~(uint64_t)health.stuck_mask;
+}
+
+#endif  // BUTTON_HEALTH_H
@@ -0,0 +1,130 @@
+/**
+ * @file    device_clock.h
+ * @brief   Device clock that keeps running through deep sleep, for the payload timestamp
+ * @details esp_timer restarts on every wake, so its timestamp only said "a few hundred ms
+ *          since boot". This clock counts on the RTC timer instead: it runs from the
+ *          slow clock, in deep sleep too. Its state is RTC_DATA_ATTR, so it survives deep
+ *          sleep only: power-on and every other reset (panic, watchdog, the restart into an
+ *          update) start it over from the RTC timer, unsynced.
+ *
+ *          Drift compensation: slow clock ticks are converted with the slow clock
+ *          calibration (period against the XTAL, measured by ESP-IDF at every boot, deep
+ *          sleep wakes included). The RC slow clock is off by up to 5% and drifts with
+ *          temperature, so one nominal period would be off by hours per day. A sleep
+ *          interval is converted with the mean of the calibration before it (last update,
+ *          taken just before sleep) and after it (this wake): a temperature change during
+ *          the sleep is split between both ends instead of being charged to one.
+ *          Presses alone are days apart, far too few calibrations, so a timer wake about
+ *          every DEVICE_CLOCK_CAL_WAKE_S (jittered, so it can't alias with a daily
+ *          temperature cycle) only updates the clock and sleeps again.
+ *          host_tools/clock/clock_sim.cpp: within 9 min after a year (2 min after a month)
+ *          of indoor, worn or outdoor temperatures, against hours with the calibration of
+ *          the waking press alone. 24 short wakes a day add ~2.5% to the sleep current.
+ *
+ *          Sync: the maintenance channel sets the wall clock (authenticated, domain
+ *          "HBCLK"). Until then, and again after a power loss or any other reset, the
+ *          clock is unsynced and the timestamp word says so (button_events.h), so a
+ *          verifier doesn't apply its time window to it. Sync again after an update.
+ *
+ *          Payload: deviceClockWord(), 1 s resolution (presses are seconds apart).
+ *
+ * @note  Before deep sleep: deviceClockUpdate() closes the awake interval with this wake's
+ *        calibration, deviceClockWakeS() is the time to the next calibration wake. The timer
+ *        is shared with the stuck button check (button_health.h): the sooner one is armed,
+ *        and every timer wake calibrates.
+*/
+
+#ifndef DEVICE_CLOCK_H
+#define DEVICE_CLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_random.h>
+#include <esp_sleep.h>
+#include "soc/rtc.h"
+#include "esp_private/esp_clk.h"
+#include "button_events.h"
+
+#define DEVICE_CLOCK_MAGIC 0xC10C0001  /**< Validates the RTC state (bump on device_clock_t change) */
+#define DEVICE_CLOCK_AUTH_DOMAIN "HBCLK"
+#define DEVICE_CLOCK_CAL_WAKE_S 3600   /**< Mean time between calibration wakes (0.5x - 1.5x) */
+
+/**
+ * @brief Clock state, in RTC memory
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t cal;             /**< Slow clock period at the last update, us Q13.19 */
+  uint64_t last_ticks;      /**< RTC timer at the last update */
+  uint64_t elapsed_us;      /**< RTC timer time, tracked from the last reset on */
+  int64_t offset_us;        /**< Synced: elapsed_us + offset_us = us since BUTTON_CLOCK_EPOCH_UNIX */
+  uint8_t synced;
+} device_clock_t;
+
+RTC_DATA_ATTR static device_clock_t device_clock; /**< Persists across deep sleep */
+
+
+/**
+ * @brief Advance the clock to now
+ * @details Cheap (a register read and a multiplication), called by every read of the clock.
+ */
+static void deviceClockUpdate(void) {
+  const uint64_t ticks = rtc_time_get();
+  const uint32_t cal = esp_clk_slowclk_cal_get();
+
+  if (device_clock.magic != DEVICE_CLOCK_MAGIC) {
+    // Power-on or reset: RTC memory is fresh, count from the RTC timer
+    memset(&device_clock, 0, sizeof(device_clock));
+    device_clock.magic = DEVICE_CLOCK_MAGIC;
+    device_clock.elapsed_us = rtc_time_slowclk_to_us(ticks, cal);
+  } else if (ticks > device_clock.last_ticks) {
+    const uint32_t mean_cal = (uint32_t)(((uint64_t)device_clock.cal + cal) / 2);
+    device_clock.elapsed_us += rtc_time_slowclk_to_us(ticks - device_clock.last_ticks, mean_cal);
+  }
+  device_clock.last_ticks = ticks;
+  device_clock.cal = cal;
+}
+
+/**
+ * @brief Set the wall clock
+ * @param unix_s Seconds since 1970-01-01 UTC
+ */
+static void deviceClockSync(const uint64_t unix_s) {
+  deviceClockUpdate();
+  device_clock.offset_us = (int64_t)(unix_s - BUTTON_CLOCK_EPOCH_UNIX) * 1000000 - (int64_t)device_clock.elapsed_us;
+  device_clock.synced = 1;
+}
+
+/**
+ * @return uint32_t Seconds since BUTTON_CLOCK_EPOCH_UNIX if synced, else RTC timer time
+ */
+static uint32_t deviceClockSeconds(void) {
+  deviceClockUpdate();
+  const int64_t us = (int64_t)device_clock.elapsed_us + (device_clock.synced ? device_clock.offset_us : 0);
+  return us > 0 ? (uint32_t)(us / 1000000) : 0;
+}
+
+/**
+ * @brief Timestamp word of this press (event type still to be stamped)
+ */
+static uint32_t deviceClockWord(void) {
+  const uint32_t seconds = deviceClockSeconds();
+  return buttonClockWord(seconds, device_clock.synced != 0);
+}
+
+/**
+ * @return uint32_t Seconds to the next calibration wake (timer, alongside the button wake)
+ */
+static uint32_t deviceClockWakeS(void) {
+  return DEVICE_CLOCK_CAL_WAKE_S / 2 + esp_random() % DEVICE_CLOCK_CAL_WAKE_S;
+}
+
+/**
+ * @return bool true if this wake is a timer wake (calibration, stuck button check), not a press
+ */
+static bool deviceClockCalibrationWake(void) {
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+#endif  // DEVICE_CLOCK_H
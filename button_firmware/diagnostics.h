@@ -0,0 +1,305 @@
+/**
+ * @file    diagnostics.h
+ * @brief   Wake timeline, energy accounting and event ring kept in RTC memory
+ * @details All data lives in one RTC_DATA_ATTR struct, so recording costs a few
+ *          memory writes and survives deep sleep. It is read out in maintenance mode,
+ *          and its history is kept in the flash diagnostic log (diag_log_store.h).
+ *          - Timeline: esp_timer timestamp of each wake phase of the last wake
+ *          - Energy:   estimated charge per wake from phase durations x nominal currents,
+ *                      with each radio's frames, airtime and share of the charge
+ *          - Events:   small ring of notable events (boot, SOS, errors, crashes ...)
+ *          - Health:   stuck button state (button_health.h)
+ *          - Marker:   optional GPIO toggled at every phase, for a power analyzer's
+ *                      digital input (host_tools/power_phases aligns the trace to it)
+*/
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include "button_health.h"
+
+/* ============= Diagnostics Configuration ============= */
+#define DIAG_DATA_MAGIC 0xD1A60004   /**< Validates RTC diagnostics memory (bump on layout change) */
+#define DIAG_EVENT_RING_SIZE 16      /**< Number of events kept (power of two) */
+#define DIAG_MARKER_PIN -1           /**< Phase marker GPIO for bench captures, -1 = off (a free pin, not a button) */
+
+#if DIAG_MARKER_PIN >= 0
+#include <driver/gpio.h>
+#endif
+
+/**
+ * @brief Nominal currents used for energy estimation (uA)
+ * @note  Estimates for ESP32-H2 at 96MHz, TX -12dBm. host_tools/power_phases measures them
+ *        from a power analyzer capture: replace them with its values.
+ */
+#define DIAG_CURRENT_ACTIVE_UA 15000  /**< CPU active, radio off */
+#define DIAG_CURRENT_ADV_UA 16500     /**< CPU active + advertising at 25-50ms interval */
+#define DIAG_CURRENT_802154_TX_UA 20000 /**< 802.15.4 transmitting, on top of CPU active */
+#define DIAG_CURRENT_SLEEP_UA 5       /**< Deep sleep (POWER_OPTIMIZATION.md) */
+
+#define DIAG_BOOT_US 25000            /**< Wake edge -> esp_timer start (ROM, bootloader): power_phases' "boot before the app" */
+
+#define DIAG_BLE_ADV_CHANNELS 3       /**< PDUs per advertising event */
+#define DIAG_BLE_ADV_DELAY_US 5000    /**< Mean advDelay added to every advertising interval */
+
+/**
+ * @brief Phases of one wake, in order of the wake sequence
+ * @note  BLE comes up in parallel with the local setup: BLE_READY may be before BLE_WAIT
+ */
+enum class WakePhase : uint8_t {
+  SETUP_START = 0, /**< Entry of setup() */
+  CLOCKS_DONE,     /**< optimizeClocks() finished */
+  BLE_START,       /**< BLE start requested */
+  PINS_DONE,       /**< Peripherals, button + unused pins configured */
+  BLE_WAIT,        /**< First use of the radio waits for BLE (async start only) */
+  BLE_READY,       /**< setupBLE() finished */
+  ADV_START,       /**< Advertising started */
+  IEEE_START,      /**< 802.15.4 transport started (only if enabled) */
+  IEEE_STOP,       /**< 802.15.4 transport stopped */
+  ADV_STOP,        /**< Advertising stopped */
+  SLEEP_ENTRY,     /**< Right before esp_deep_sleep_start() */
+  COUNT
+};
+
+/**
+ * @brief Event types stored in the event ring
+ */
+enum class DiagEvent : uint8_t {
+  NONE = 0,
+  BOOT,         /**< arg: esp_reset_reason_t */
+  FACTORY,      /**< Factory session entered */
+  SOS,          /**< SOS beacon broadcast */
+  ERROR,        /**< arg: ErrorCode */
+  CRASH,        /**< Core dump summary captured */
+  MAINTENANCE,  /**< Maintenance mode entered */
+  SELFTEST,     /**< arg: self-test pass mask */
+  CANCEL,       /**< Cancel beacon broadcast (second button) */
+  STUCK_BUTTON  /**< arg: stuck buttons, bit 0 SOS, bit 1 cancel; 0 = released */
+};
+
+typedef struct __attribute__((packed)) {
+  uint32_t wake;  /**< Wake counter at the time of the event */
+  DiagEvent type;
+  uint8_t arg;
+  uint16_t reserved;
+} diag_event_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t phase_us[static_cast<int>(WakePhase::COUNT)]; /**< esp_timer time of each phase, 0 = not reached */
+} wake_timeline_t;
+
+/**
+ * @brief Radios with their own account
+ */
+enum class DiagRadio : uint8_t {
+  BLE = 0,
+  IEEE802154,
+  COUNT
+};
+
+typedef struct __attribute__((packed)) {
+  uint32_t tx_frames;        /**< Frames on air (BLE: advertising PDUs, estimated) */
+  uint32_t tx_failed;        /**< Frames not sent: busy channel, lost radio arbitration */
+  uint32_t airtime_ms;       /**< Total time on air (ms) */
+  uint32_t charge_uc;        /**< This radio's share of total_charge_uc (uC) */
+} radio_account_t;
+
+typedef struct __attribute__((packed)) {
+  uint64_t total_charge_uc;  /**< Estimated charge since RTC init (uC) */
+  uint32_t last_wake_uc;     /**< Estimated charge of the last wake (uC) */
+  uint32_t active_ms;        /**< Total awake time (ms) */
+  uint32_t adv_ms;           /**< Total advertising time (ms) */
+  radio_account_t radio[static_cast<int>(DiagRadio::COUNT)];
+} energy_account_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t wakes;             /**< Number of wakes since RTC init */
+  wake_timeline_t timeline;   /**< Timeline of the current/last wake */
+  energy_account_t energy;
+  uint16_t event_head;        /**< Next write slot */
+  uint16_t event_count;
+  diag_event_t events[DIAG_EVENT_RING_SIZE];
+  button_health_t health;     /**< Stuck buttons */
+} diag_data_t;
+
+RTC_DATA_ATTR static diag_data_t diag_data; /**< Persists across deep sleep */
+static uint32_t diag_radio_wake_uc = 0;     /**< Radio charge of this wake not in the phase estimate */
+
+
+#if DIAG_MARKER_PIN >= 0
+static uint8_t diag_marker_level = 0;
+#endif
+
+/**
+ * @brief Phase marker: high from setup(), toggled at every mark, low and held from the sleep entry
+ * @details A mark whose toggle would leave the level low before the sleep entry gives no
+ *          sleep edge; host_tools/power_phases expects the same edges from the timeline.
+ */
+static inline void diagMarker(const WakePhase phase) {
+#if DIAG_MARKER_PIN >= 0
+  const gpio_num_t pin = static_cast<gpio_num_t>(DIAG_MARKER_PIN);
+  if (phase == WakePhase::SETUP_START) {
+    gpio_hold_dis(pin);
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    diag_marker_level = 1;
+  } else if (phase == WakePhase::SLEEP_ENTRY) {
+    diag_marker_level = 0;
+  } else {
+    diag_marker_level ^= 1;
+  }
+  gpio_set_level(pin, diag_marker_level);
+  if (phase == WakePhase::SLEEP_ENTRY) {
+    gpio_hold_en(pin);
+  }
+#else
+  (void)phase;
+#endif
+}
+
+/**
+ * @brief Validate RTC diagnostics memory and start a new wake timeline
+ * @note  Call first thing in setup()
+ */
+static void diagInit(void) {
+  const uint32_t now = (uint32_t)esp_timer_get_time();
+  if (diag_data.magic != DIAG_DATA_MAGIC) {
+    memset(&diag_data, 0, sizeof(diag_data));
+    diag_data.magic = DIAG_DATA_MAGIC;
+  }
+  diag_data.wakes++;
+  memset(&diag_data.timeline, 0, sizeof(diag_data.timeline));
+  diag_data.timeline.phase_us[static_cast<int>(WakePhase::SETUP_START)] = now;
+  diagMarker(WakePhase::SETUP_START);
+}
+
+/**
+ * @brief Record the current time for a wake phase
+ */
+static inline void diagMark(const WakePhase phase) {
+  diag_data.timeline.phase_us[static_cast<int>(phase)] = (uint32_t)esp_timer_get_time();
+  diagMarker(phase);
+}
+
+/**
+ * @brief Time of a wake phase in the current timeline (0 = not reached yet)
+ */
+static inline uint32_t diagPhase(const WakePhase phase) {
+  return diag_data.timeline.phase_us[static_cast<int>(phase)];
+}
+
+/**
+ * @brief Milliseconds since the wake edge (the press): the press age of the v3 advert (adv_format.h)
+ * @note  esp_timer starts with the app; DIAG_BOOT_US adds the ROM and bootloader before it
+ */
+static inline uint32_t diagWakeAgeMs(void) {
+  return (uint32_t)((esp_timer_get_time() + DIAG_BOOT_US) / 1000);
+}
+
+/**
+ * @brief Append an event to the ring (oldest entry is overwritten)
+ */
+static void diagEvent(const DiagEvent type, const uint8_t arg = 0) {
+  diag_event_t& ev = diag_data.events[diag_data.event_head];
+  ev.wake = diag_data.wakes;
+  ev.type = type;
+  ev.arg = arg;
+  ev.reserved = 0;
+  diag_data.event_head = (diag_data.event_head + 1) & (DIAG_EVENT_RING_SIZE - 1);
+  if (diag_data.event_count < DIAG_EVENT_RING_SIZE) {
+    diag_data.event_count++;
+  }
+}
+
+/**
+ * @brief Account frames sent by a radio during this wake
+ * @param airtime_us Time on air of these frames
+ * @param tx_ua      Current while transmitting, on top of CPU active
+ */
+static void diagRadioTx(const DiagRadio radio, const uint32_t frames, const uint32_t failed, const uint32_t airtime_us,
+                        const uint32_t tx_ua) {
+  radio_account_t& acc = diag_data.energy.radio[static_cast<int>(radio)];
+  const uint32_t charge_uc = (uint32_t)(((uint64_t)airtime_us * tx_ua) / 1000000ULL);
+  acc.tx_frames += frames;
+  acc.tx_failed += failed;
+  acc.airtime_ms += airtime_us / 1000;
+  acc.charge_uc += charge_uc;
+  diag_radio_wake_uc += charge_uc;
+}
+
+/**
+ * @brief Close the energy account of this wake from the timeline
+ * @details Advertising time (ADV_START -> ADV_STOP) is charged at DIAG_CURRENT_ADV_UA,
+ *          the remaining awake time at DIAG_CURRENT_ACTIVE_UA. The difference during
+ *          advertising is the BLE radio's share; its PDUs are estimated from the
+ *          advertising interval. 802.15.4 frames (diagRadioTx()) are charged on top.
+ * @param adv_interval_us Mean configured advertising interval
+ * @param adv_pdu_us Time on air of one advertising PDU (advPduUs() of the advert, adv_format.h)
+ * @note  Call right before diagMark(WakePhase::SLEEP_ENTRY) / deep sleep
+ */
+static void diagCloseWake(const uint32_t adv_interval_us, const uint32_t adv_pdu_us) {
+  const uint32_t now = (uint32_t)esp_timer_get_time();
+  const uint32_t adv_start = diagPhase(WakePhase::ADV_START);
+  const uint32_t adv_stop = diagPhase(WakePhase::ADV_STOP);
+  const uint32_t adv_us = (adv_start && adv_stop) ? adv_stop - adv_start : 0;
+  const uint32_t active_us = now - adv_us;  // esp_timer starts at 0 on every boot
+
+  // uA * us = pC -> / 1e6 = uC
+  const uint64_t charge_uc = ((uint64_t)active_us * DIAG_CURRENT_ACTIVE_UA + (uint64_t)adv_us * DIAG_CURRENT_ADV_UA) / 1000000ULL
+                             + diag_radio_wake_uc;
+
+  radio_account_t& ble = diag_data.energy.radio[static_cast<int>(DiagRadio::BLE)];
+  const uint32_t ble_pdus = adv_us / (adv_interval_us + DIAG_BLE_ADV_DELAY_US) * DIAG_BLE_ADV_CHANNELS;
+  ble.tx_frames += ble_pdus;
+  ble.airtime_ms += ble_pdus * adv_pdu_us / 1000;
+  ble.charge_uc += (uint32_t)(((uint64_t)adv_us * (DIAG_CURRENT_ADV_UA - DIAG_CURRENT_ACTIVE_UA)) / 1000000ULL);
+  diag_radio_wake_uc = 0;
+
+  diag_data.energy.last_wake_uc = (uint32_t)charge_uc;
+  diag_data.energy.total_charge_uc += charge_uc;
+  diag_data.energy.active_ms += now / 1000;
+  diag_data.energy.adv_ms += adv_us / 1000;
+}
+
+/**
+ * @brief BLE start time hidden behind the local setup (us)
+ * @details BLE_START -> BLE_READY is the BLE start, BLE_WAIT -> BLE_READY the part the wake
+ *          waited for. The rest ran in parallel with the local setup: the critical path
+ *          saved against starting BLE in sequence. On one core both share the CPU, so
+ *          this is an upper bound; BLE_START_ASYNC 0 gives the sequential timeline.
+ */
+static uint32_t diagBleOverlap(void) {
+  const uint32_t start = diagPhase(WakePhase::BLE_START);
+  const uint32_t wait = diagPhase(WakePhase::BLE_WAIT);
+  const uint32_t ready = diagPhase(WakePhase::BLE_READY);
+  if (start == 0 || wait == 0 || ready == 0) {
+    return 0;  // Not started yet, or started in sequence (no wait)
+  }
+  return (wait < ready ? wait : ready) - start;
+}
+
+/**
+ * @brief Print the timeline of the current wake (esp_timer us since boot)
+ */
+static void diagPrintTimeline(void) {
+  static const char* const names[] = { "setup", "clocks", "ble_start", "pins", "ble_wait", "ble", "adv_start",
+                                       "ieee_start", "ieee_stop", "adv_stop", "sleep" };
+  DEBUG_VERBOSE_F("\n[DIAG] Wake #%lu timeline (us):", diag_data.wakes);
+  for (int i = 0; i < static_cast<int>(WakePhase::COUNT); i++) {
+    const uint32_t t = diagPhase(static_cast<WakePhase>(i));
+    if (t) {
+      DEBUG_VERBOSE_F(" %s=%lu", names[i], t);
+    }
+  }
+  const uint32_t ble_start = diagPhase(WakePhase::BLE_START), ble_ready = diagPhase(WakePhase::BLE_READY);
+  if (ble_start && ble_ready) {
+    DEBUG_VERBOSE_F("\n[DIAG] BLE start %lu us, %lu us of it in parallel with the local setup", ble_ready - ble_start,
+                    diagBleOverlap());
+  }
+}
+
+#endif  // DIAGNOSTICS_H
@@ -0,0 +1,357 @@
+/**
+ * @file    maintenance.h
+ * @brief   Connectable maintenance mode exposing diagnostics over a GATT service
+ * @details Entered with a press pattern (MAINT_PRESS_COUNT presses within
+ *          MAINT_PATTERN_WINDOW_MS, the wake press included, press_pattern.h) while the
+ *          SOS beacon runs. The SOS beacon itself is not changed: the full BEACON_TIME_MS window
+ *          is broadcast first, maintenance mode follows it instead of deep sleep.
+ *
+ *          The GATT service is only created in maintenance mode. All characteristics
+ *          are read-only snapshots taken when the session starts. With an ATT MTU of
+ *          MAINT_ATT_MTU, every characteristic (and the complete DUMP) fits a single read.
+ *
+ *          Service  4d41494e-0000-4a45-4e4e-594645520000
+ *            ...01  RTC_DATA   rtc_data_t (seed masked)
+ *            ...02  ENERGY     energy_account_t
+ *            ...03  TIMELINE   wakes + wake_timeline_t of the last wake
+ *            ...04  EVENTS     head, count + diag_event_t[DIAG_EVENT_RING_SIZE]
+ *            ...05  CRASH      crash_summary_t
+ *            ...06  HEALTH     button_health_t (stuck buttons, button_health.h)
+ *            ...0F  DUMP       [version][type len value]... of all of the above, and of
+ *                              tx_link_t (record type 7, MaintRecord::LINK): no characteristic
+ *                              of its own here, see LINK (...15)
+ *            ...10  CHALLENGE  8 random bytes, new for every session and after each write
+ *            ...11  CONFIG     read: config_record_t, write: config_record_t + 16B tag
+ *                              (see maint_auth.h for the authentication)
+ *            ...12  OTA_CONTROL \ firmware update with compressed deltas,
+ *            ...13  OTA_DATA    / see ota_update.h
+ *            ...14  CLOCK      read: device clock seconds u32 + synced u8,
+ *                              write: unix seconds u32 + 16B tag (domain "HBCLK", device_clock.h)
+ *            ...15  LINK       read: tx_link_t (closed-loop TX power, tx_power.h),
+ *                              write: tx_feedback_t (gateway RSSI of recent presses) + 16B tag
+ *                              (domain "HBLNK")
+ *            ...16  LOG        read: next pages of the flash diagnostic log, empty at the end
+ *                              (diag_log_store.h)
+ *
+ * @note  Include after debug_log.h, debug_led.h, diagnostics.h, crash_summary.h, field_config.h,
+ *        ota_update.h, device_clock.h and diag_log_store.h
+*/
+
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLEUtils.h>
+#include "driver/gpio.h"
+#include "press_pattern.h"
+
+/* ============= Maintenance Configuration ============= */
+#define MAINT_TIMEOUT_MS 120000          /**< Session ends after this, connected or not */
+#define MAINT_ATT_MTU 517                /**< Max ATT MTU: the full DUMP fits one read */
+#define MAINT_DUMP_VERSION 1
+
+#define MAINT_SERVICE_UUID "4d41494e-0000-4a45-4e4e-594645520000"
+#define MAINT_CHAR_RTC_UUID "4d41494e-0001-4a45-4e4e-594645520000"
+#define MAINT_CHAR_ENERGY_UUID "4d41494e-0002-4a45-4e4e-594645520000"
+#define MAINT_CHAR_TIMELINE_UUID "4d41494e-0003-4a45-4e4e-594645520000"
+#define MAINT_CHAR_EVENTS_UUID "4d41494e-0004-4a45-4e4e-594645520000"
+#define MAINT_CHAR_CRASH_UUID "4d41494e-0005-4a45-4e4e-594645520000"
+#define MAINT_CHAR_HEALTH_UUID "4d41494e-0006-4a45-4e4e-594645520000"
+#define MAINT_CHAR_DUMP_UUID "4d41494e-000f-4a45-4e4e-594645520000"
+#define MAINT_CHAR_CHALLENGE_UUID "4d41494e-0010-4a45-4e4e-594645520000"
+#define MAINT_CHAR_CONFIG_UUID "4d41494e-0011-4a45-4e4e-594645520000"
+#define MAINT_CHAR_CLOCK_UUID "4d41494e-0014-4a45-4e4e-594645520000"
+#define MAINT_CHAR_LINK_UUID "4d41494e-0015-4a45-4e4e-594645520000"
+#define MAINT_LINK_AUTH_DOMAIN "HBLNK"
+
+/**
+ * @brief Record types in the DUMP characteristic
+ */
+enum class MaintRecord : uint8_t {
+  RTC_DATA = 1,
+  ENERGY = 2,
+  TIMELINE = 3,
+  EVENTS = 4,
+  CRASH = 5,
+  HEALTH = 6,
+  LINK = 7
+};
+
+
+/* ============= Press Pattern Detection ============= */
+static press_pattern_t maint_pattern = {};
+
+/**
+ * @brief Start watching for the press pattern (press_pattern.h)
+ * @param wake_press The wake press was on the polled button: it counts as the first press
+ */
+static void maintenancePatternBegin(const bool wake_press) {
+  pressPatternBegin(maint_pattern, wake_press);
+}
+
+/**
+ * @brief Sample the button and count presses (falling edges)
+ * @details Call every few ms while the beacon is running. Cheap: one GPIO read.
+ */
+static void maintenancePatternPoll(const gpio_num_t pin) {
+  if (maint_pattern.detected) {
+    return;
+  }
+  if (pressPatternStep(maint_pattern, gpio_get_level(pin) == 0, millis())) {
+    DEBUG_VERBOSE("\n[MAINT] Press pattern detected, maintenance mode after beacon 🔧");
+  }
+}
+
+/**
+ * @brief True if the maintenance press pattern was seen during this wake
+ */
+static bool maintenanceRequested(void) {
+  return maint_pattern.detected;
+}
+
+
+/* ============= GATT Service ============= */
+static volatile bool maint_connected = false;
+static volatile bool maint_session_done = false;
+
+class MaintServerCallbacks : public BLEServerCallbacks {
+  void onConnect(BLEServer* server) override {
+    maint_connected = true;
+    DEBUG_VERBOSE("\n[MAINT] Client connected");
+  }
+  void onDisconnect(BLEServer* server) override {
+    maint_connected = false;
+    maint_session_done = true;  // One client per session
+    DEBUG_VERBOSE("\n[MAINT] Client disconnected");
+  }
+};
+
+/**
+ * @brief Authenticated configuration writes
+ * @details The tag covers the session challenge (maint_auth.h), renewed after every write attempt.
+ */
+class MaintConfigCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* chr) override {
+    String value = chr->getValue();
+    const uint8_t* data = (const uint8_t*)value.c_str();
+
+    if (value.length() != sizeof(config_record_t) + CONFIG_AUTH_TAG_LEN) {
+      DEBUG_VERBOSE_F("\n[MAINT] Config write rejected: bad length %d", (int)value.length());
+    } else {
+      config_record_t rec;
+      memcpy(&rec, data, sizeof(rec));
+      if (!configVerifyAuth(&rec, data + sizeof(rec), maint_challenge)) {
+        DEBUG_VERBOSE("\n[MAINT] Config write rejected: authentication failed ❌");
+      } else if (!configStore(&rec)) {
+        DEBUG_VERBOSE("\n[MAINT] Config write rejected: invalid record ❌");
+      } else {
+        DEBUG_VERBOSE("\n[MAINT] Config updated 👏🏼");
+      }
+    }
+
+    // Always reflect the active configuration and move on to a new challenge
+    config_record_t current;
+    configToRecord(&current);
+    chr->setValue((uint8_t*)&current, sizeof(current));
+    maintRenewChallenge();
+  }
+};
+
+/**
+ * @brief Device clock value as read on the CLOCK characteristic
+ */
+static void maintClockValue(BLECharacteristic* chr) {
+  uint8_t value[5];
+  const uint32_t seconds = deviceClockSeconds();
+  memcpy(value, &seconds, 4);
+  value[4] = device_clock.synced;
+  chr->setValue(value, sizeof(value));
+}
+
+/**
+ * @brief Authenticated clock sync
+ * @details Same challenge as the configuration writes, domain DEVICE_CLOCK_AUTH_DOMAIN.
+ */
+class MaintClockCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* chr) override {
+    String value = chr->getValue();
+    const uint8_t* data = (const uint8_t*)value.c_str();
+
+    if (value.length() != sizeof(uint32_t) + MAINT_AUTH_TAG_LEN) {
+      DEBUG_VERBOSE_F("\n[MAINT] Clock write rejected: bad length %d", (int)value.length());
+    } else if (!maintAuthVerify(DEVICE_CLOCK_AUTH_DOMAIN, maint_challenge, data, sizeof(uint32_t), data + sizeof(uint32_t))) {
+      DEBUG_VERBOSE("\n[MAINT] Clock write rejected: authentication failed ❌");
+    } else {
+      uint32_t unix_s;
+      memcpy(&unix_s, data, sizeof(unix_s));
+      deviceClockSync(unix_s);
+      DEBUG_VERBOSE_F("\n[MAINT] Clock synced: %u s since the epoch 👏🏼", (unsigned)deviceClockSeconds());
+    }
+
+    maintClockValue(chr);
+    maintRenewChallenge();
+  }
+};
+
+/**
+ * @brief Authenticated gateway feedback for the closed-loop TX power
+ * @details Same challenge as the configuration writes, domain MAINT_LINK_AUTH_DOMAIN. The
+ *          estimate is stored in NVS right away, so a power loss doesn't lose it.
+ */
+class MaintLinkCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* chr) override {
+    String value = chr->getValue();
+    const uint8_t* data = (const uint8_t*)value.c_str();
+    tx_feedback_t fb;
+
+    if (value.length() != sizeof(tx_feedback_t) + MAINT_AUTH_TAG_LEN) {
+      DEBUG_VERBOSE_F("\n[MAINT] Link write rejected: bad length %d", (int)value.length());
+    } else if (!maintAuthVerify(MAINT_LINK_AUTH_DOMAIN, maint_challenge, data, sizeof(tx_feedback_t),
+                                data + sizeof(tx_feedback_t))) {
+      DEBUG_VERBOSE("\n[MAINT] Link write rejected: authentication failed ❌");
+    } else {
+      memcpy(&fb, data, sizeof(fb));
+      if (!txPowerFeedbackValid(fb)) {
+        DEBUG_VERBOSE("\n[MAINT] Link write rejected: settings out of range");
+      } else {
+        const uint8_t matched = txPowerFeedback(tx_link, fb);
+        const bool stored = configStoreLink();
+        DEBUG_VERBOSE_F("\n[MAINT] Link: %d of %d reports matched, path loss %d dB%s", matched, fb.count, tx_link.loss_db,
+                        stored ? "" : " (NVS write failed)");
+      }
+    }
+
+    chr->setValue((uint8_t*)&tx_link, sizeof(tx_link_t));
+    maintRenewChallenge();
+  }
+};
+
+/**
+ * @brief Append one [type][len][value] record to the dump buffer
+ * @return size_t New write offset
+ */
+static size_t maintDumpAppend(uint8_t* buf, size_t offset, size_t cap, const MaintRecord type, const void* data, size_t len) {
+  if (len > 0xFF || offset + 2 + len > cap) {
+    return offset;
+  }
+  buf[offset++] = static_cast<uint8_t>(type);
+  buf[offset++] = (uint8_t)len;
+  memcpy(buf + offset, data, len);
+  return offset + len;
+}
+
+/**
+ * @brief Create a read-only characteristic holding a snapshot value
+ */
+static BLECharacteristic* maintAddReadOnly(BLEService* service, const char* uuid, const void* data, size_t len) {
+  BLECharacteristic* chr = service->createCharacteristic(uuid, BLECharacteristic::PROPERTY_READ);
+  chr->setValue((uint8_t*)data, len);
+  return chr;
+}
+
+/**
+ * @brief Run one maintenance session: GATT service + connectable advertising
+ * @param name     Device name, sent in the scan response (maintenance mode only)
+ * @param rtc      Pointer to rtc_data (copied, the seed is masked)
+ * @param rtc_len  sizeof(rtc_data)
+ * @param seed_offset Offset of the seed field inside rtc_data, zeroed in the snapshot
+ * @details Returns after a client disconnects or MAINT_TIMEOUT_MS. The caller then
+ *          proceeds to deep sleep as usual.
+ */
+static void maintenanceRun(const char* name, const void* rtc, size_t rtc_len, size_t seed_offset) {
+  DEBUG_VERBOSE("\n[MAINT] Entering maintenance mode 🔧");
+  diagEvent(DiagEvent::MAINTENANCE);
+
+  // ** Snapshots - values don't change during the session
+  static uint8_t rtc_snapshot[64];
+  rtc_len = rtc_len > sizeof(rtc_snapshot) ? sizeof(rtc_snapshot) : rtc_len;
+  memcpy(rtc_snapshot, rtc, rtc_len);
+  if (seed_offset + sizeof(uint32_t) <= rtc_len) {
+    memset(rtc_snapshot + seed_offset, 0, sizeof(uint32_t));  // Never expose the seed
+  }
+
+  static uint8_t timeline[sizeof(uint32_t) + sizeof(wake_timeline_t)];
+  memcpy(timeline, &diag_data.wakes, sizeof(uint32_t));
+  memcpy(timeline + sizeof(uint32_t), &diag_data.timeline, sizeof(wake_timeline_t));
+
+  static uint8_t events[2 * sizeof(uint16_t) + sizeof(diag_data.events)];
+  memcpy(events, &diag_data.event_head, sizeof(uint16_t));
+  memcpy(events + sizeof(uint16_t), &diag_data.event_count, sizeof(uint16_t));
+  memcpy(events + 2 * sizeof(uint16_t), diag_data.events, sizeof(diag_data.events));
+
+  static uint8_t dump[MAINT_ATT_MTU - 3];
+  size_t dump_len = 0;
+  dump[dump_len++] = MAINT_DUMP_VERSION;
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::RTC_DATA, rtc_snapshot, rtc_len);
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::ENERGY, &diag_data.energy, sizeof(energy_account_t));
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::TIMELINE, timeline, sizeof(timeline));
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::EVENTS, events, sizeof(events));
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::CRASH, &crash_summary, sizeof(crash_summary_t));
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::HEALTH, &diag_data.health, sizeof(button_health_t));
+  dump_len = maintDumpAppend(dump, dump_len, sizeof(dump), MaintRecord::LINK, &tx_link, sizeof(tx_link_t));
+
+  // ** Service - exists only in this mode
+  BLEDevice::setMTU(MAINT_ATT_MTU);
+  BLEServer* server = BLEDevice::createServer();
+  server->setCallbacks(new MaintServerCallbacks());
+  BLEService* service = server->createService(BLEUUID(MAINT_SERVICE_UUID), 32);
+
+  maintAddReadOnly(service, MAINT_CHAR_RTC_UUID, rtc_snapshot, rtc_len);
+  maintAddReadOnly(service, MAINT_CHAR_ENERGY_UUID, &diag_data.energy, sizeof(energy_account_t));
+  maintAddReadOnly(service, MAINT_CHAR_TIMELINE_UUID, timeline, sizeof(timeline));
+  maintAddReadOnly(service, MAINT_CHAR_EVENTS_UUID, events, sizeof(events));
+  maintAddReadOnly(service, MAINT_CHAR_CRASH_UUID, &crash_summary, sizeof(crash_summary_t));
+  maintAddReadOnly(service, MAINT_CHAR_HEALTH_UUID, &diag_data.health, sizeof(button_health_t));
+  maintAddReadOnly(service, MAINT_CHAR_DUMP_UUID, dump, dump_len);
+
+  BLECharacteristic* challenge_chr = service->createCharacteristic(MAINT_CHAR_CHALLENGE_UUID, BLECharacteristic::PROPERTY_READ);
+  BLECharacteristic* config_chr = service->createCharacteristic(MAINT_CHAR_CONFIG_UUID,
+                                                               BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+  config_record_t current;
+  configToRecord(&current);
+  config_chr->setValue((uint8_t*)&current, sizeof(current));
+  config_chr->setCallbacks(new MaintConfigCallbacks());
+  BLECharacteristic* clock_chr = service->createCharacteristic(MAINT_CHAR_CLOCK_UUID,
+                                                              BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+  maintClockValue(clock_chr);
+  clock_chr->setCallbacks(new MaintClockCallbacks());
+  BLECharacteristic* link_chr = service->createCharacteristic(MAINT_CHAR_LINK_UUID,
+                                                             BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+  link_chr->setValue((uint8_t*)&tx_link, sizeof(tx_link_t));
+  link_chr->setCallbacks(new MaintLinkCallbacks());
+  maintAuthBegin(challenge_chr);
+  otaAddService(service);
+  diagLogAddService(service);
+  service->start();
+
+  // ** Connectable advertising with the service UUID
+  BLEAdvertising* adv = BLEDevice::getAdvertising();
+  BLEAdvertisementData advData;
+  advData.setFlags(0x06);  // General discoverable, BR/EDR not supported
+  advData.setCompleteServices(BLEUUID(MAINT_SERVICE_UUID));
+  BLEAdvertisementData scanData;
+  scanData.setName(name);
+  adv->setAdvertisementData(advData);
+  adv->setScanResponseData(scanData);
+  adv->setScanResponse(true);
+  esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, device_config.tx_power);  // Not the press's closed-loop level
+  adv->start();
+
+  DEBUG_VERBOSE_F("\n[MAINT] GATT service up, dump %d bytes, waiting %d secs ...", (int)dump_len, MAINT_TIMEOUT_MS / 1000);
+
+  const uint32_t start = millis();
+  while (!maint_session_done && millis() - start < MAINT_TIMEOUT_MS) {
+    BLINK_YELLOW_LED(maint_connected ? 100 : 500);
+    delay(10);
+  }
+
+  adv->stop();
+  adv->setScanResponse(false);
+  DEBUG_VERBOSE("\n[MAINT] Leaving maintenance mode");
+  otaSessionEnd();  // Doesn't return after a completed firmware update
+}
+
+#endif  // MAINTENANCE_H
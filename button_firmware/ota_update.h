@@ -0,0 +1,438 @@
+/**
+ * @file    ota_update.h
+ * @brief   Firmware update over the maintenance GATT service with compressed binary deltas
+ * @details Only a delta against the running image is sent (ota_delta.h, built with
+ *          host_tools/hb_delta). It is decoded while it streams in and written to the
+ *          other A/B app slot, so the running image is never touched.
+ *
+ *          Characteristics (added to the maintenance service):
+ *            ...12  OTA_CONTROL  write: command, read/notify: ota_status_t
+ *                     0x01 BEGIN  header[76] + tag[16] (maint_auth.h, domain "HBOTA")
+ *                                 + signature[64] (release key, see below)
+ *                     0x02 END    verify + switch boot slot, restart after the session
+ *                     0x03 ABORT
+ *            ...13  OTA_DATA     write without response: seq u16 LE | delta bytes
+ *          Chunks must arrive in order. Anything but `next_seq` is dropped and the client
+ *          resends from the `next_seq` it reads from the status (go-back-N).
+ *
+ *          Integrity: the header carries the SHA-256 of the base and of the target image.
+ *          It is signed with the release key: ECDSA P-256 over SHA-256(header), r | s, checked
+ *          against OTA_SIGNING_PUBLIC_KEY (secrets.h). The device key tag only says who may
+ *          start an update on this unit, the signature what may be installed: a leaked device
+ *          key (or fleet constant) doesn't get an image past it. BEGIN is refused unless the
+ *          signature is good and the running image matches the base, END unless BEGIN saw a
+ *          good signature and the written image matches the signed target hash.
+ *
+ *          Rollback: the new image boots with an NVS marker. Every non deep sleep boot
+ *          counts an attempt, the image is confirmed as soon as the hardware and BLE came
+ *          up. After OTA_MAX_BOOT_ATTEMPTS unconfirmed boots the previous slot is restored.
+ *          With CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE the bootloader rollback is used too.
+ *          The restart clears RTC memory, so the updated image learns that the unit is
+ *          provisioned from NVS (configProvisioned(), set here at END as well).
+ *
+ * @note  Needs a partition table with two app slots (ota_0 / ota_1)
+ * @note  Include after field_config.h, before maintenance.h
+*/
+
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <nvs.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <BLE2902.h>
+#include "mbedtls/sha256.h"
+#include "mbedtls/ecdsa.h"
+#include "ota_delta.h"
+#include "secrets.h"
+
+/* ============= OTA Configuration ============= */
+#define OTA_MAX_BOOT_ATTEMPTS 3      /**< Unconfirmed boots before rolling back */
+#define OTA_NVS_NAMESPACE "ota"
+#define OTA_NVS_KEY "state"
+#define OTA_STATE_MAGIC 0x07A5EED1
+#define OTA_AUTH_DOMAIN "HBOTA"
+#define OTA_SIGNATURE_LEN 64         /**< ECDSA P-256 r | s, big endian */
+
+#define MAINT_CHAR_OTA_CONTROL_UUID "4d41494e-0012-4a45-4e4e-594645520000"
+#define MAINT_CHAR_OTA_DATA_UUID "4d41494e-0013-4a45-4e4e-594645520000"
+
+enum class OtaCommand : uint8_t {
+  BEGIN = 0x01,
+  END = 0x02,
+  ABORT = 0x03
+};
+
+enum class OtaState : uint8_t {
+  IDLE = 0,
+  RECEIVING,
+  DONE,       /**< Verified, boot slot switched, restart pending */
+  FAILED
+};
+
+enum class OtaError : uint8_t {
+  NONE = 0,
+  AUTH,       /**< Bad tag */
+  HEADER,     /**< Bad header / length */
+  BASE,       /**< Running image doesn't match the delta base */
+  PARTITION,  /**< No update slot / esp_ota_begin failed */
+  DECODE,     /**< DeltaDecoder error */
+  VERIFY,     /**< Target hash or esp_ota_end failed */
+  STATE,      /**< Command not valid now */
+  SIGNATURE   /**< Header not signed with the release key */
+};
+
+/**
+ * @brief OTA_CONTROL read value [8 bytes]
+ */
+typedef struct __attribute__((packed)) {
+  OtaState state;
+  OtaError error;
+  uint16_t next_seq;   /**< Next expected OTA_DATA sequence number */
+  uint32_t produced;   /**< Target bytes written so far */
+} ota_status_t;
+
+/**
+ * @brief Pending image marker in NVS (RTC memory layout may differ between images)
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t attempts;
+  uint32_t previous_addr;  /**< Flash address of the slot to roll back to */
+} ota_boot_state_t;
+
+
+/* ============= Boot Validation ============= */
+/**
+ * @brief Keep the image in PENDING_VERIFY when the bootloader rollback is enabled
+ * @details Overrides the weak Arduino core default (which confirms right away)
+ */
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+static bool otaStateLoad(ota_boot_state_t* st) {
+  nvs_handle_t handle;
+  size_t len = sizeof(*st);
+  bool ok = false;
+  if (nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    ok = nvs_get_blob(handle, OTA_NVS_KEY, st, &len) == ESP_OK && len == sizeof(*st) && st->magic == OTA_STATE_MAGIC;
+    nvs_close(handle);
+  }
+  return ok;
+}
+
+static bool otaStateStore(const ota_boot_state_t* st) {
+  nvs_handle_t handle;
+  if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = st ? nvs_set_blob(handle, OTA_NVS_KEY, st, sizeof(*st)) : nvs_erase_key(handle, OTA_NVS_KEY);
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+
+/**
+ * @brief Count a boot attempt of a freshly installed image, roll back if needed
+ * @return bool true if this image still awaits confirmation (first boots after an update)
+ * @note  Call early in setup(), skipped on deep sleep wakes (one NVS read otherwise)
+ */
+static bool otaBootCheck(void) {
+  if (esp_reset_reason() == ESP_RST_DEEPSLEEP) {
+    return false;
+  }
+  ota_boot_state_t st;
+  if (!otaStateLoad(&st)) {
+    return false;
+  }
+
+  st.attempts++;
+  DEBUG_VERBOSE_F("\n[OTA] New image, boot attempt %lu/%d", st.attempts, OTA_MAX_BOOT_ATTEMPTS);
+  if (st.attempts > OTA_MAX_BOOT_ATTEMPTS) {
+    const esp_partition_t* previous = nullptr;
+    const esp_partition_t* slot = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, nullptr);
+    for (int i = 0; i < 2 && slot; i++) {
+      if (slot->address == st.previous_addr) {
+        previous = slot;
+      }
+      slot = esp_ota_get_next_update_partition(slot);
+    }
+    otaStateStore(nullptr);
+    if (previous && esp_ota_set_boot_partition(previous) == ESP_OK) {
+      DEBUG_VERBOSE("\n[OTA] Image never confirmed, rolling back ⏪");
+      DEBUG_FLUSH();
+      esp_restart();
+    }
+    return false;
+  }
+  otaStateStore(&st);
+  return true;
+}
+
+/**
+ * @brief Confirm the running image (cancels rollback)
+ */
+static void otaConfirm(void) {
+  esp_ota_mark_app_valid_cancel_rollback();
+  otaStateStore(nullptr);
+  DEBUG_VERBOSE("\n[OTA] New image confirmed 👏🏼");
+}
+
+
+/* ============= Update Session ============= */
+/**
+ * @brief Decoder I/O on flash: base = running slot, target = update slot (+ SHA-256)
+ */
+class FlashDeltaIo : public DeltaIo {
+public:
+  bool readBase(uint32_t offset, uint8_t* buf, size_t len) override {
+    return esp_partition_read(base, offset, buf, len) == ESP_OK;
+  }
+  bool writeTarget(const uint8_t* buf, size_t len) override {
+    mbedtls_sha256_update(&sha, buf, len);
+    return esp_ota_write(handle, buf, len) == ESP_OK;
+  }
+
+  const esp_partition_t* base = nullptr;
+  const esp_partition_t* target = nullptr;
+  esp_ota_handle_t handle = 0;
+  mbedtls_sha256_context sha;
+};
+
+static struct {
+  ota_status_t status;
+  DeltaHeader header;
+  FlashDeltaIo io;
+  DeltaDecoder* decoder;     /**< ~21KB, heap allocated in maintenance mode only */
+  BLECharacteristic* control_chr;
+  bool signed_header;        /**< BEGIN verified the release signature of `header` */
+  bool restart;              /**< Restart into the new image after the session */
+} ota = {};
+
+static void otaPublish(void) {
+  ota.control_chr->setValue((uint8_t*)&ota.status, sizeof(ota.status));
+  ota.control_chr->notify();
+}
+
+static void otaFail(const OtaError error) {
+  if (ota.status.state == OtaState::RECEIVING) {
+    esp_ota_abort(ota.io.handle);
+    mbedtls_sha256_free(&ota.io.sha);
+  }
+  delete ota.decoder;
+  ota.decoder = nullptr;
+  ota.status.state = OtaState::FAILED;
+  ota.status.error = error;
+  DEBUG_VERBOSE_F("\n[OTA] Update failed, error %d ❌", static_cast<int>(error));
+}
+
+/**
+ * @brief SHA-256 of the first `len` bytes of a partition
+ */
+static bool otaHashPartition(const esp_partition_t* part, uint32_t len, uint8_t* out) {
+  static uint8_t buf[1024];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  bool ok = len <= part->size;
+  for (uint32_t off = 0; ok && off < len; off += sizeof(buf)) {
+    const uint32_t n = len - off < sizeof(buf) ? len - off : sizeof(buf);
+    ok = esp_partition_read(part, off, buf, n) == ESP_OK;
+    mbedtls_sha256_update(&sha, buf, n);
+  }
+  mbedtls_sha256_finish(&sha, out);
+  mbedtls_sha256_free(&sha);
+  return ok;
+}
+
+/**
+ * @brief Check the release signature of an update header
+ * @param header    OTA_DELTA_HEADER_LEN bytes
+ * @param signature OTA_SIGNATURE_LEN bytes, r | s
+ * @return bool true if it verifies against OTA_SIGNING_PUBLIC_KEY
+ */
+static bool otaVerifySignature(const uint8_t* header, const uint8_t* signature) {
+  static const uint8_t public_key[] = OTA_SIGNING_PUBLIC_KEY;  // 0x04 | X | Y
+  uint8_t hash[32];
+  mbedtls_sha256(header, OTA_DELTA_HEADER_LEN, hash, 0);
+
+  mbedtls_ecp_group grp;
+  mbedtls_ecp_point q;
+  mbedtls_mpi r, s;
+  mbedtls_ecp_group_init(&grp);
+  mbedtls_ecp_point_init(&q);
+  mbedtls_mpi_init(&r);
+  mbedtls_mpi_init(&s);
+  const bool ok = mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1) == 0 &&
+                  mbedtls_ecp_point_read_binary(&grp, &q, public_key, sizeof(public_key)) == 0 &&
+                  mbedtls_ecp_check_pubkey(&grp, &q) == 0 &&
+                  mbedtls_mpi_read_binary(&r, signature, OTA_SIGNATURE_LEN / 2) == 0 &&
+                  mbedtls_mpi_read_binary(&s, signature + OTA_SIGNATURE_LEN / 2, OTA_SIGNATURE_LEN / 2) == 0 &&
+                  mbedtls_ecdsa_verify(&grp, hash, sizeof(hash), &q, &r, &s) == 0;
+  mbedtls_mpi_free(&s);
+  mbedtls_mpi_free(&r);
+  mbedtls_ecp_point_free(&q);
+  mbedtls_ecp_group_free(&grp);
+  return ok;
+}
+
+static void otaBegin(const uint8_t* data, size_t len) {
+  if (ota.status.state == OtaState::RECEIVING) {
+    return otaFail(OtaError::STATE);
+  }
+  ota.status = {};
+  ota.signed_header = false;
+  if (len != OTA_DELTA_HEADER_LEN + MAINT_AUTH_TAG_LEN + OTA_SIGNATURE_LEN || !ota.header.parse(data, OTA_DELTA_HEADER_LEN)) {
+    return otaFail(OtaError::HEADER);
+  }
+  const bool authentic = maintAuthVerify(OTA_AUTH_DOMAIN, maint_challenge, data, OTA_DELTA_HEADER_LEN,
+                                         data + OTA_DELTA_HEADER_LEN);
+  maintRenewChallenge();
+  if (!authentic) {
+    return otaFail(OtaError::AUTH);
+  }
+  if (!otaVerifySignature(data, data + OTA_DELTA_HEADER_LEN + MAINT_AUTH_TAG_LEN)) {
+    return otaFail(OtaError::SIGNATURE);
+  }
+  ota.signed_header = true;
+
+  ota.io.base = esp_ota_get_running_partition();
+  ota.io.target = esp_ota_get_next_update_partition(nullptr);
+  if (!ota.io.target || ota.header.target_size > ota.io.target->size) {
+    return otaFail(OtaError::PARTITION);
+  }
+  uint8_t digest[32];
+  if (!otaHashPartition(ota.io.base, ota.header.base_size, digest) || memcmp(digest, ota.header.base_sha256, 32) != 0) {
+    return otaFail(OtaError::BASE);
+  }
+  if (esp_ota_begin(ota.io.target, OTA_WITH_SEQUENTIAL_WRITES, &ota.io.handle) != ESP_OK) {
+    return otaFail(OtaError::PARTITION);
+  }
+
+  mbedtls_sha256_init(&ota.io.sha);
+  mbedtls_sha256_starts(&ota.io.sha, 0);
+  ota.decoder = new DeltaDecoder();
+  ota.decoder->begin(&ota.io, ota.header);
+  ota.status.state = OtaState::RECEIVING;
+  DEBUG_VERBOSE_F("\n[OTA] Receiving delta: %lu -> %lu bytes into %s", ota.header.base_size, ota.header.target_size, ota.io.target->label);
+}
+
+static void otaEnd(void) {
+  if (ota.status.state != OtaState::RECEIVING) {
+    return otaFail(OtaError::STATE);
+  }
+  const DeltaStatus result = ota.decoder->finish();
+  ota.status.produced = ota.decoder->bytesProduced();
+  if (result != DeltaStatus::OK) {
+    return otaFail(OtaError::DECODE);
+  }
+  if (!ota.signed_header) {
+    return otaFail(OtaError::SIGNATURE);
+  }
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&ota.io.sha, digest);
+  if (memcmp(digest, ota.header.target_sha256, 32) != 0) {  // Signed target hash
+    return otaFail(OtaError::VERIFY);
+  }
+  ota.status.state = OtaState::DONE;  // esp_ota_end() consumed the handle from here on
+  mbedtls_sha256_free(&ota.io.sha);
+  delete ota.decoder;
+  ota.decoder = nullptr;
+  if (esp_ota_end(ota.io.handle) != ESP_OK || esp_ota_set_boot_partition(ota.io.target) != ESP_OK) {
+    ota.status.state = OtaState::FAILED;
+    ota.status.error = OtaError::VERIFY;
+    return;
+  }
+
+  const ota_boot_state_t st = { OTA_STATE_MAGIC, 0, ota.io.base->address };
+  otaStateStore(&st);
+  configMarkProvisioned();  // Updates run in maintenance mode of a provisioned unit (maybe by an image before the flag)
+  ota.restart = true;
+  DEBUG_VERBOSE("\n[OTA] Image verified, restarting into it after the session 👏🏼");
+}
+
+class OtaControlCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* chr) override {
+    String value = chr->getValue();
+    const uint8_t* data = (const uint8_t*)value.c_str();
+    if (value.length() == 0) {
+      return;
+    }
+    switch (static_cast<OtaCommand>(data[0])) {
+      case OtaCommand::BEGIN:
+        otaBegin(data + 1, value.length() - 1);
+        break;
+      case OtaCommand::END:
+        otaEnd();
+        break;
+      case OtaCommand::ABORT:
+        if (ota.status.state == OtaState::RECEIVING) {
+          otaFail(OtaError::NONE);
+        }
+        ota.status.state = OtaState::IDLE;
+        break;
+      default:
+        otaFail(OtaError::STATE);
+        break;
+    }
+    otaPublish();
+  }
+};
+
+class OtaDataCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* chr) override {
+    String value = chr->getValue();
+    const uint8_t* data = (const uint8_t*)value.c_str();
+    if (ota.status.state != OtaState::RECEIVING || value.length() < 2) {
+      return;
+    }
+    const uint16_t seq = (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+    if (seq != ota.status.next_seq) {
+      return;  // Lost a chunk before this one: wait for the resend
+    }
+    if (ota.decoder->feed(data + 2, value.length() - 2) != DeltaStatus::OK) {
+      otaFail(OtaError::DECODE);
+      otaPublish();
+      return;
+    }
+    ota.status.next_seq++;
+    ota.status.produced = ota.decoder->bytesProduced();
+    ota.control_chr->setValue((uint8_t*)&ota.status, sizeof(ota.status));
+  }
+};
+
+/**
+ * @brief Add the OTA characteristics to the maintenance service
+ */
+static void otaAddService(BLEService* service) {
+  ota.status = {};
+  ota.restart = false;
+  ota.control_chr = service->createCharacteristic(MAINT_CHAR_OTA_CONTROL_UUID,
+                                                  BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+  ota.control_chr->addDescriptor(new BLE2902());  // CCCD: clients subscribe to the status notifications
+  ota.control_chr->setValue((uint8_t*)&ota.status, sizeof(ota.status));
+  ota.control_chr->setCallbacks(new OtaControlCallbacks());
+  BLECharacteristic* data_chr = service->createCharacteristic(MAINT_CHAR_OTA_DATA_UUID, BLECharacteristic::PROPERTY_WRITE_NR);
+  data_chr->setCallbacks(new OtaDataCallbacks());
+}
+
+/**
+ * @brief Leave the session: drop an unfinished update, restart into a finished one
+ */
+static void otaSessionEnd(void) {
+  if (ota.status.state == OtaState::RECEIVING) {
+    otaFail(OtaError::NONE);
+  }
+  if (ota.restart) {
+    DEBUG_VERBOSE("\n[OTA] Restarting into the new image ...");
+    DEBUG_FLUSH();
+    esp_restart();
+  }
+}
+
+#endif  // OTA_UPDATE_H
@@ -0,0 +1,70 @@
+/**
+ * @file    press_pattern.h
+ * @brief   Maintenance press pattern: MAINT_PRESS_COUNT presses within MAINT_PATTERN_WINDOW_MS
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): maintenance.h samples the SOS
+ *          button with it while the beacon runs, host_tools/button/press_pattern_sim.cpp
+ *          runs the same code.
+ *
+ *          The wake press is the first press of the pattern: pressPatternBegin() counts it
+ *          at the wake (millis() 0), so the pattern is the wake press and MAINT_PRESS_COUNT - 1
+ *          more within MAINT_PATTERN_WINDOW_MS of it. The line is sampled from the beacon
+ *          start on, a few hundred ms into the wake. A press counts on its falling edge:
+ *          a wake press still held at the first sample isn't counted again.
+ *          A window that runs out starts over at the next press.
+ */
+
+#ifndef PRESS_PATTERN_H
+#define PRESS_PATTERN_H
+
+#include <stdint.h>
+
+/* ============= Press Pattern Configuration ============= */
+#define MAINT_PRESS_COUNT 5              /**< Presses needed to enter maintenance mode, the wake press included */
+#define MAINT_PATTERN_WINDOW_MS 3000     /**< Window in which all presses must happen */
+#define MAINT_DEBOUNCE_MS 50             /**< Minimum time between two counted presses */
+
+/**
+ * @brief Pattern state of one wake
+ */
+typedef struct {
+  uint32_t first_ms;   /**< Time of the first press in the current window */
+  uint32_t last_ms;    /**< Time of the last counted press */
+  uint8_t presses;
+  bool was_low;
+  bool detected;
+} press_pattern_t;
+
+/**
+ * @brief Start the pattern of a wake
+ * @param wake_press The wake was a press of the sampled button: it is the first press, at 0 ms
+ */
+static inline void pressPatternBegin(press_pattern_t& p, const bool wake_press) {
+  p = {};
+  p.presses = wake_press ? 1 : 0;
+  p.was_low = wake_press;  // A wake press still held is not a new falling edge
+}
+
+/**
+ * @brief One sample of the button line
+ * @param low    The line reads low (pressed)
+ * @param now_ms Time since the wake
+ * @return bool true once the pattern is complete
+ */
+static inline bool pressPatternStep(press_pattern_t& p, const bool low, const uint32_t now_ms) {
+  if (p.detected) {
+    return true;
+  }
+  if (low && !p.was_low && (p.presses == 0 || now_ms - p.last_ms >= MAINT_DEBOUNCE_MS)) {
+    if (p.presses == 0 || now_ms - p.first_ms > MAINT_PATTERN_WINDOW_MS) {
+      p.presses = 0;
+      p.first_ms = now_ms;
+    }
+    p.presses++;
+    p.last_ms = now_ms;
+    p.detected = p.presses >= MAINT_PRESS_COUNT;
+  }
+  p.was_low = low;
+  return p.detected;
+}
+
+#endif  // PRESS_PATTERN_H
@@ -0,0 +1,211 @@
+/**
+ * @file    rolling_code.h
+ * @brief   Rolling code core: seed derivation, code generation and the beacon payload
+ * @details Header only, portable C++ (no Arduino / ESP-IDF dependency). The one
+ *          implementation of the algorithm: the button generates with it
+ *          (generateSeed() / generateRollingCode() in button_firmware.ino), and the host
+ *          verifier, fleet provisioning tool, simulators and PRF benchmark
+ *          (host_tools/) use the same header, so a receiver can't drift from the firmware.
+ *
+ *          Policies:
+ *            Seed policy:  static constexpr uint32_t derive(product_key, batch_id, mac[6])
+ *            Mixer policy: template <W> static constexpr W mix(W seed, W timestamp)
+ *                          W = uint32_t, or any type with wrapping 32-bit lanes and the
+ *                          operators ^ * >> (GCC vector types: one seed per lane)
+ *          RollingCode<Seed, Mixer> puts them together and adds the batch entry points a
+ *          verifier needs: codes of many seeds for one timestamp, and the search for the
+ *          seed of a received code. Their loops are plain and branch free, so the compiler
+ *          vectorizes them; Mixer::mix<vector type> is there for hand-vectorized callers.
+ *
+ *          Everything that takes scalars is constexpr: the test vectors at the end of this
+ *          file are checked at compile time, in the firmware and in every host tool.
+ *
+ *          Schemes: a fleet changes its algorithm by firmware update, so old and new buttons
+ *          are on air side by side for months. Each algorithm is a numbered scheme
+ *          (ROLLING_CODE_SCHEME_*), the button sends its scheme in the timestamp word
+ *          (button_events.h) and a verifier keeps the seeds of both (rc_verifier.h).
+ *            V1  RollingCodeV1: SeedV1 + MixerV1, the deployed buttons
+ *            V2  RollingCodeV2: SeedV2 (all six MAC bytes) + MixerV1
+ *
+ *          Payload [8 bytes]: code u32 BE | timestamp u32 BE (timestamp top nibble: event
+ *          type, button_events.h).
+*/
+
+#ifndef ROLLING_CODE_H
+#define ROLLING_CODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rolling_code {
+
+/* ============= Payload ============= */
+#define ROLLING_CODE_PAYLOAD_LEN 8
+
+static inline constexpr void encodePayload(uint32_t code, uint32_t timestamp, uint8_t* out) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (uint8_t)(code >> (24 - 8 * i));
+    out[4 + i] = (uint8_t)(timestamp >> (24 - 8 * i));
+  }
+}
+
+static inline constexpr uint32_t payloadCode(const uint8_t* payload) {
+  return ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) | ((uint32_t)payload[2] << 8) | payload[3];
+}
+
+static inline constexpr uint32_t payloadTimestamp(const uint8_t* payload) {
+  return payloadCode(payload + 4);
+}
+
+
+/* ============= Seed Policies ============= */
+/**
+ * @brief Seed of the deployed firmware: product key, batch ID and custom MAC bytes 0-3
+ * @note  MAC bytes 4-5 are not used: sequentially burned MACs share a seed
+ *        (host_tools/rolling_code/PRF_RESULTS.md)
+ */
+struct SeedV1 {
+  static constexpr uint32_t derive(uint32_t product_key, uint16_t batch_id, const uint8_t* mac) {
+    uint32_t seed = product_key;
+    seed ^= (uint32_t)batch_id << 16;
+    seed ^= ((uint32_t)mac[0] << 24) | ((uint32_t)mac[1] << 16) | ((uint32_t)mac[2] << 8) | mac[3];
+    return seed;
+  }
+};
+
+
+/**
+ * @brief Seed of scheme V2: SeedV1 with MAC bytes 4-5 spread over the word
+ * @details Buttons whose MACs differ in bytes 4-5 only get distinct seeds
+ */
+struct SeedV2 {
+  static constexpr uint32_t derive(uint32_t product_key, uint16_t batch_id, const uint8_t* mac) {
+    return SeedV1::derive(product_key, batch_id, mac) ^ ((((uint32_t)mac[4] << 8) | mac[5]) * 0x9E3779B1u);
+  }
+};
+
+
+/* ============= Mixer Policies ============= */
+/**
+ * @brief Mixer of the deployed firmware: multiply / xorshift rounds over seed ^ timestamp
+ */
+struct MixerV1 {
+  template <typename W>
+  static constexpr W mix(W seed, W timestamp) {
+    W mixed = (seed ^ timestamp) * 0x7FFF;  // Prime1 multiplication
+    mixed = mixed ^ (mixed >> 13);          // First diffusion
+    mixed = mixed * 0x5C4D;                 // Prime2 multiplication
+    mixed = mixed ^ (mixed >> 17);          // Second diffusion
+    mixed = mixed * seed;                   // Additional mixing
+    mixed = mixed ^ (mixed >> 16);          // Final diffusion
+    return mixed;
+  }
+};
+
+
+/* ============= Rolling Code ============= */
+template <typename SeedPolicy, typename MixerPolicy>
+struct RollingCode {
+  typedef SeedPolicy Seed;
+  typedef MixerPolicy Mixer;
+
+  static constexpr uint32_t seed(uint32_t product_key, uint16_t batch_id, const uint8_t* mac) {
+    return SeedPolicy::derive(product_key, batch_id, mac);
+  }
+
+  static constexpr uint32_t code(uint32_t seed, uint32_t timestamp) {
+    return MixerPolicy::template mix<uint32_t>(seed, timestamp);
+  }
+
+  /**
+   * @brief Codes of n seeds for one timestamp
+   */
+  static void codeBatch(const uint32_t* __restrict seeds, size_t n, uint32_t timestamp, uint32_t* __restrict out) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = MixerPolicy::template mix<uint32_t>(seeds[i], timestamp);
+    }
+  }
+
+  /**
+   * @brief First seed whose code for `timestamp` is `code`
+   * @return size_t Its index, or n if none
+   * @details Blocks of 64 seeds are compared without branching, the first matching
+   *          block is then scanned.
+   */
+  static size_t find(const uint32_t* seeds, size_t n, uint32_t timestamp, uint32_t code) {
+    const size_t block = 64;
+    size_t i = 0;
+    for (; i + block <= n; i += block) {
+      uint32_t hit = 0;
+      for (size_t j = 0; j < block; j++) {
+        hit |= MixerPolicy::template mix<uint32_t>(seeds[i + j], timestamp) == code;
+      }
+      if (hit) {
+        break;
+      }
+    }
+    for (; i < n; i++) {
+      if (MixerPolicy::template mix<uint32_t>(seeds[i], timestamp) == code) {
+        return i;
+      }
+    }
+    return n;
+  }
+};
+
+typedef RollingCode<SeedV1, MixerV1> RollingCodeV1;  /**< What deployed buttons send */
+typedef RollingCode<SeedV2, MixerV1> RollingCodeV2;  /**< Next scheme */
+
+
+/* ============= Schemes ============= */
+#define ROLLING_CODE_SCHEME_V1 1  /**< RollingCodeV1 */
+#define ROLLING_CODE_SCHEME_V2 2  /**< RollingCodeV2 */
+
+/**
+ * @brief Rolling code of a scheme, at compile time (firmware: ROLLING_CODE_SCHEME)
+ */
+template <int Scheme> struct SchemeOf;
+template <> struct SchemeOf<ROLLING_CODE_SCHEME_V1> { typedef RollingCodeV1 type; };
+template <> struct SchemeOf<ROLLING_CODE_SCHEME_V2> { typedef RollingCodeV2 type; };
+
+/**
+ * @brief Seed of a scheme chosen at run time (host tools)
+ */
+static inline constexpr uint32_t schemeSeed(uint8_t scheme, uint32_t product_key, uint16_t batch_id, const uint8_t* mac) {
+  return scheme == ROLLING_CODE_SCHEME_V2 ? RollingCodeV2::seed(product_key, batch_id, mac)
+                                          : RollingCodeV1::seed(product_key, batch_id, mac);
+}
+
+static inline constexpr uint32_t schemeCode(uint8_t scheme, uint32_t seed, uint32_t timestamp) {
+  return scheme == ROLLING_CODE_SCHEME_V2 ? RollingCodeV2::code(seed, timestamp) : RollingCodeV1::code(seed, timestamp);
+}
+
+static inline size_t schemeFind(uint8_t scheme, const uint32_t* seeds, size_t n, uint32_t timestamp, uint32_t code) {
+  return scheme == ROLLING_CODE_SCHEME_V2 ? RollingCodeV2::find(seeds, n, timestamp, code)
+                                          : RollingCodeV1::find(seeds, n, timestamp, code);
+}
+
+
+/* ============= Compile-Time Test Vectors ============= */
+namespace vectors {
+constexpr uint8_t mac[6] = { 0x24, 0x6F, 0x28, 0xA1, 0xB2, 0xC3 };
+static_assert(RollingCodeV1::seed(0x12345678, 0x0042, mac) == 0x36197ED9, "SeedV1 vector");
+static_assert(RollingCodeV1::code(0x36197ED9, 0x00000000) == 0x4D6AE474, "MixerV1 vector, timestamp 0");
+static_assert(RollingCodeV1::code(0x36197ED9, 0x0001E240) == 0x912EFE17, "MixerV1 vector, SOS");
+static_assert(RollingCodeV1::code(0x36197ED9, 0x10002A3F) == 0xFE5A5B94, "MixerV1 vector, cancel event");
+static_assert(RollingCodeV1::code(0xDEADBEEF, 0x00030D40) == 0xB1E60407, "MixerV1 vector");
+static_assert(RollingCodeV2::seed(0x12345678, 0x0042, mac) == 0x20C7BD0A, "SeedV2 vector");
+static_assert(schemeCode(ROLLING_CODE_SCHEME_V2, 0x20C7BD0A, 0x0001E240) == RollingCodeV1::code(0x20C7BD0A, 0x0001E240),
+              "Scheme V2 mixer");
+
+constexpr uint32_t payloadRoundTrip(uint32_t code, uint32_t timestamp) {
+  uint8_t p[ROLLING_CODE_PAYLOAD_LEN] = {};
+  encodePayload(code, timestamp, p);
+  return p[0] == 0x91 && p[7] == 0x40 ? payloadCode(p) ^ payloadTimestamp(p) : 0;
+}
+static_assert(payloadRoundTrip(0x912EFE17, 0x0001E240) == (0x912EFE17u ^ 0x0001E240u), "Payload layout");
+}  // namespace vectors
+
+}  // namespace rolling_code
+
+#endif  // ROLLING_CODE_H
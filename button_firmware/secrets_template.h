@@ -13,4 +13,10 @@
 // Custom BLE manufacturer ID - Replace with actual values
 #define MANUFACTURER_ID 0x0000U
 
+// Public release key of firmware updates (ota_update.h): uncompressed P-256 point, 0x04 | X | Y.
+// Updates are refused until it is set. The private key stays on the release machine:
+//   openssl ecparam -name prime256v1 -genkey -noout -out ota_signing_key.pem
+//   openssl ec -in ota_signing_key.pem -pubout -outform DER | tail -c 65 | xxd -i
+#define OTA_SIGNING_PUBLIC_KEY { 0x00 }
+
 #endif  // SECRETS_H
\ No newline at end of file
@@ -0,0 +1,268 @@
+/**
+ * @file    adv_format.h
+ * @brief   SOS beacon advert layouts: v1 (name + payload), v2 (airtime-minimal) and v3 (v2 + press age)
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): the button builds its advert with
+ *          it, the gateway (gateway_core.h) and the host tools decode both versions with the
+ *          same code. Kept identical in button_firmware/ and gateway_firmware/.
+ *
+ *          v1 [30 bytes of advertising data]:
+ *            complete local name PRODUCT_NAME (18 B) | manufacturer data = payload[8]
+ *            payload = rolling code u32 BE | timestamp word u32 BE (rolling_code.h)
+ *            Also accepted: manufacturer data = MANUFACTURER_ID (LE) | payload[8], no name.
+ *          More than half of every v1 PDU is the constant name.
+ *
+ *          v2 [14 bytes of advertising data, one manufacturer data structure]:
+ *            MANUFACTURER_ID u16 LE
+ *            header u8         version (bits 7-4) = 2 | timestamp word bits 31-28 (scheme, event type)
+ *            rolling code u32 BE
+ *            counter u32 BE    timestamp word bits 27-0 (synced bit, device clock) << 4 | health (bits 3-0)
+ *            device hint u8    advHint() of the seed: the verifier searches 1/256 of the fleet
+ *          The top nibble moves to the header, which frees the counter's top nibble for the
+ *          health bits, so the full timestamp word (and with it the code) is unchanged from v1.
+ *          No name: the maintenance service sends it in its scan response.
+ *
+ *          v3 [15 bytes]: v2 with version 3 | age u8
+ *            age               advAge() of the ms since the wake edge (the press), stamped when
+ *                              the advert is set and again every few 100 ms while it is on air.
+ *                              The first advert a gateway hears gives the press-to-air latency.
+ *
+ *          Health, the hint and the age are not covered by the rolling code: the health bits
+ *          are a hint to the backend, never a verdict, and the age is a measurement. The hint
+ *          is static, like the button's advertising address.
+ */
+
+#ifndef ADV_FORMAT_H
+#define ADV_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* ============= Advert Layout ============= */
+#define ADV_FORMAT_V1 1
+#define ADV_FORMAT_V2 2
+#define ADV_FORMAT_V3 3
+#define ADV_MAX_LEN 31                  /**< Legacy advertising data */
+#define ADV_V1_PAYLOAD_LEN 8            /**< code | timestamp word */
+#define ADV_V2_MFG_LEN 12               /**< Manufacturer data of a v2 advert */
+#define ADV_V2_LEN (2 + ADV_V2_MFG_LEN)
+#define ADV_V3_MFG_LEN 13               /**< v2 + age */
+#define ADV_V3_LEN (2 + ADV_V3_MFG_LEN)
+#define ADV_TYPE_NAME 0x09              /**< Complete local name */
+#define ADV_TYPE_MFG 0xFF               /**< Manufacturer specific data */
+
+/* ============= Health Bits (v2) ============= */
+#define ADV_HEALTH_STUCK 0x1            /**< A button line was stuck at the last sleep entry (button_health.h) */
+#define ADV_HEALTH_CRASH 0x2            /**< A crash summary waits for the factory / maintenance session */
+#define ADV_HEALTH_ERROR 0x4            /**< An error was recorded since power-on (rtc_data.lastError) */
+#define ADV_HEALTH_LINK 0x8             /**< TX power at the closed loop's ceiling (tx_power.h) */
+
+/* ============= Press Age (v3) ============= */
+#define ADV_AGE_UNIT_MS 4               /**< Age code: 3-bit exponent, 5-bit mantissa of 4 ms units */
+#define ADV_AGE_MAX 0xFE                /**< 15.9 s and older */
+#define ADV_AGE_NONE 0xFF               /**< Not carried (v1, v2, 802.15.4) */
+
+/* ============= Airtime ============= */
+#define ADV_PDU_OVERHEAD 16             /**< Preamble 1 | access address 4 | header 2 | AdvA 6 | CRC 3 */
+#define ADV_US_PER_BYTE 8               /**< 1M PHY */
+
+/**
+ * @brief One decoded beacon advert, any version
+ */
+typedef struct {
+  uint8_t format;      /**< ADV_FORMAT_V1 / V2 / V3 */
+  uint32_t code;       /**< Rolling code */
+  uint32_t timestamp;  /**< Timestamp word: scheme | event | synced | device clock (button_events.h) */
+  uint8_t hint;        /**< v2, v3: advHint() of the seed, 0 for v1 */
+  uint8_t health;      /**< v2, v3: ADV_HEALTH_* bits, 0 for v1 */
+  uint8_t age;         /**< v3: advAge() of the press, ADV_AGE_NONE before v3 */
+} adv_beacon_t;
+
+
+/**
+ * @brief Time on air of one legacy advertising PDU at 1M PHY
+ * @param adv_len Bytes of advertising data
+ */
+static inline constexpr uint32_t advPduUs(const size_t adv_len) {
+  return (uint32_t)((ADV_PDU_OVERHEAD + adv_len) * ADV_US_PER_BYTE);
+}
+
+/**
+ * @brief Bytes of advertising data of a beacon
+ * @param name PRODUCT_NAME (v1 only)
+ */
+static inline size_t advLen(const uint8_t format, const char* name) {
+  if (format == ADV_FORMAT_V3) {
+    return ADV_V3_LEN;
+  }
+  return format == ADV_FORMAT_V2 ? ADV_V2_LEN : 2 + strlen(name) + 2 + ADV_V1_PAYLOAD_LEN;
+}
+
+/**
+ * @brief Device hint of a seed: its top byte after a multiplicative hash
+ */
+static inline constexpr uint8_t advHint(const uint32_t seed) {
+  return (uint8_t)((seed * 0x9E3779B1u) >> 24);
+}
+
+/**
+ * @brief Age code of a press: 4 ms steps to 252 ms, then within 1/32 (rounded down), ADV_AGE_MAX from 15.9 s
+ * @param ms Milliseconds since the wake edge
+ */
+static inline uint8_t advAge(const uint32_t ms) {
+  const uint32_t units = ms / ADV_AGE_UNIT_MS;
+  if (units < 32) {
+    return (uint8_t)units;
+  }
+  uint32_t exp = 1;
+  while ((units >> (exp - 1)) >= 64) {
+    exp++;
+  }
+  const uint32_t code = (exp << 5) | ((units >> (exp - 1)) - 32);
+  return exp > 7 || code > ADV_AGE_MAX ? ADV_AGE_MAX : (uint8_t)code;
+}
+
+/**
+ * @brief Milliseconds of an age code (the lower end of its step)
+ */
+static inline constexpr uint32_t advAgeMs(const uint8_t age) {
+  return ((age >> 5) ? (32u + (age & 0x1F)) << ((age >> 5) - 1) : age) * ADV_AGE_UNIT_MS;
+}
+
+static inline void advPutBe32(uint8_t* p, const uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+static inline uint32_t advGetBe32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief v1 payload (code | timestamp word, as in the 802.15.4 frame) as a beacon
+ */
+static inline void advFromPayload(const uint8_t* payload, adv_beacon_t* out) {
+  out->format = ADV_FORMAT_V1;
+  out->code = advGetBe32(payload);
+  out->timestamp = advGetBe32(payload + 4);
+  out->hint = 0;
+  out->health = 0;
+  out->age = ADV_AGE_NONE;
+}
+
+/* ============= Encoder ============= */
+/**
+ * @brief v1 advertising data: name | payload
+ * @param out ADV_MAX_LEN bytes
+ * @return size_t Bytes written, 0 if the name doesn't fit
+ */
+static inline size_t advBuildV1(const char* name, const uint8_t* payload, uint8_t* out) {
+  const size_t name_len = strlen(name);
+  if (advLen(ADV_FORMAT_V1, name) > ADV_MAX_LEN) {
+    return 0;
+  }
+  out[0] = (uint8_t)(name_len + 1);
+  out[1] = ADV_TYPE_NAME;
+  memcpy(out + 2, name, name_len);
+  uint8_t* mfg = out + 2 + name_len;
+  mfg[0] = ADV_V1_PAYLOAD_LEN + 1;
+  mfg[1] = ADV_TYPE_MFG;
+  memcpy(mfg + 2, payload, ADV_V1_PAYLOAD_LEN);
+  return advLen(ADV_FORMAT_V1, name);
+}
+
+/**
+ * @brief v2 advertising data
+ * @param out ADV_V2_LEN bytes
+ * @return size_t ADV_V2_LEN
+ */
+static inline size_t advBuildV2(const uint16_t manufacturer_id, const adv_beacon_t& beacon, uint8_t* out) {
+  out[0] = ADV_V2_MFG_LEN + 1;
+  out[1] = ADV_TYPE_MFG;
+  out[2] = (uint8_t)manufacturer_id;
+  out[3] = (uint8_t)(manufacturer_id >> 8);
+  out[4] = (uint8_t)((ADV_FORMAT_V2 << 4) | (beacon.timestamp >> 28));
+  advPutBe32(out + 5, beacon.code);
+  advPutBe32(out + 9, (beacon.timestamp << 4) | (beacon.health & 0xF));
+  out[13] = beacon.hint;
+  return ADV_V2_LEN;
+}
+
+/**
+ * @brief v3 advertising data: v2 with the press age
+ * @param out ADV_V3_LEN bytes
+ * @return size_t ADV_V3_LEN
+ */
+static inline size_t advBuildV3(const uint16_t manufacturer_id, const adv_beacon_t& beacon, uint8_t* out) {
+  advBuildV2(manufacturer_id, beacon, out);
+  out[0] = ADV_V3_MFG_LEN + 1;
+  out[4] = (uint8_t)((ADV_FORMAT_V3 << 4) | (beacon.timestamp >> 28));
+  out[14] = beacon.age;
+  return ADV_V3_LEN;
+}
+
+/* ============= Decoder ============= */
+/**
+ * @brief Decode a beacon advert of any version from raw advertising data (AD structures)
+ * @param adv Advertising data as reported by the controller
+ * @param len Its length
+ * @param manufacturer_id MANUFACTURER_ID
+ * @param name PRODUCT_NAME (complete local name of a v1 button)
+ * @param out Decoded beacon
+ * @return bool true if this is a button advert
+ */
+static inline bool advDecode(const uint8_t* adv, const size_t len, const uint16_t manufacturer_id, const char* name,
+                             adv_beacon_t* out) {
+  const uint8_t* mfg = nullptr;
+  size_t mfg_len = 0;
+  bool name_match = false;
+  const size_t name_len = strlen(name);
+
+  size_t pos = 0;
+  while (pos < len) {
+    const uint8_t field_len = adv[pos];
+    if (field_len == 0 || pos + 1 + field_len > len) {
+      break;
+    }
+    const uint8_t type = adv[pos + 1];
+    const uint8_t* data = adv + pos + 2;
+    const size_t data_len = field_len - 1;
+    if (type == ADV_TYPE_MFG) {
+      mfg = data;
+      mfg_len = data_len;
+    } else if (type == ADV_TYPE_NAME) {
+      name_match = data_len == name_len && memcmp(data, name, name_len) == 0;
+    }
+    pos += 1 + field_len;
+  }
+  if (!mfg) {
+    return false;
+  }
+
+  const bool our_id = mfg_len >= 2 && (mfg[0] | (mfg[1] << 8)) == manufacturer_id;
+  const bool v2 = our_id && mfg_len == ADV_V2_MFG_LEN && (mfg[2] >> 4) == ADV_FORMAT_V2;
+  const bool v3 = our_id && mfg_len == ADV_V3_MFG_LEN && (mfg[2] >> 4) == ADV_FORMAT_V3;
+  if (v2 || v3) {
+    const uint32_t counter = advGetBe32(mfg + 7);
+    out->format = v3 ? ADV_FORMAT_V3 : ADV_FORMAT_V2;
+    out->code = advGetBe32(mfg + 3);
+    out->timestamp = ((uint32_t)(mfg[2] & 0xF) << 28) | (counter >> 4);
+    out->health = (uint8_t)(counter & 0xF);
+    out->hint = mfg[11];
+    out->age = v3 ? mfg[12] : ADV_AGE_NONE;
+    return true;
+  }
+  if (our_id && mfg_len == 2 + ADV_V1_PAYLOAD_LEN) {
+    advFromPayload(mfg + 2, out);
+    return true;
+  }
+  if (mfg_len == ADV_V1_PAYLOAD_LEN && name_match) {
+    advFromPayload(mfg, out);
+    return true;
+  }
+  return false;
+}
+
+#endif  // ADV_FORMAT_H
@@ -0,0 +1,242 @@
+/**
+ * @file    crash_summary.h
+ * @brief   Compact crash summary extracted from the coredump partition
+ * @details After a panic, the ESP-IDF panic handler writes a full core dump into the
+ *          64 KB `coredump` partition. On the next boot that is NOT a deep sleep wake
+ *          we reduce it to a few words (PC, cause, backtrace hash, build id), persist
+ *          that in NVS (+ a copy in RTC memory) and erase the partition later, right
+ *          before going to sleep, so the button wake path never touches it.
+ *
+ *          Summary is printed in the next factory session as:
+ *            [CRASH] pc=0x... cause=0x... ra=0x... bt=0x... build=xxxxxxxx reset=N
+ *          and can be symbolized with crash_symbolizer/symbolize_crash.sh
+ *
+ * @note    Requires core dump to flash in ELF format (CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH
+ *          and CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF), which is the arduino-esp32 default.
+ *          If not available, all functions compile to no-ops.
+ */
+
+#ifndef CRASH_SUMMARY_H
+#define CRASH_SUMMARY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_system.h>
+#include <esp_attr.h>
+#include <nvs.h>
+
+#if defined(CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH) && defined(CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF)
+#include <esp_core_dump.h>
+#define CRASH_SUMMARY_SUPPORTED 1
+#else
+#define CRASH_SUMMARY_SUPPORTED 0
+#endif
+
+/* ============= Crash Summary Configuration ============= */
+#define CRASH_SUMMARY_MAGIC 0xC4A5D00D   /**< Validates the RTC/NVS copy */
+#define CRASH_NVS_NAMESPACE "diag"       /**< NVS namespace for diagnostics */
+#define CRASH_NVS_KEY "crash"            /**< NVS key of the summary blob */
+#define CRASH_BUILD_ID_LEN 4             /**< First 4 bytes of the ELF SHA256 */
+
+#define CRASH_FLAG_PENDING_REPORT 0x01 /**< Not yet reported in a factory session */
+#define CRASH_FLAG_PENDING_ERASE 0x02  /**< Coredump partition still to be erased */
+
+/**
+ * @brief Compact crash summary [28 bytes]
+ * @details On RISC-V (ESP32-H2) `cause` is mcause and `ra` the return address of the
+ *          faulting frame. `bt_hash` is FNV-1a over the captured stack dump, so the
+ *          same crash site in the same build always groups under one hash.
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t pc;
+  uint32_t cause;
+  uint32_t ra;
+  uint32_t bt_hash;
+  uint8_t build_id[CRASH_BUILD_ID_LEN];
+  uint8_t reset_reason;
+  uint8_t flags;
+  uint16_t reserved;
+} crash_summary_t;
+
+RTC_DATA_ATTR static crash_summary_t crash_summary; /**< Survives deep sleep */
+
+
+/**
+ * @brief FNV-1a 32-bit hash, used to condense the backtrace
+ */
+static uint32_t crashHash(const uint8_t* data, size_t len) {
+  uint32_t hash = 0x811C9DC5;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 0x01000193;
+  }
+  return hash;
+}
+
+/**
+ * @brief Convert leading hex chars of the ELF SHA256 string into build id bytes
+ */
+static void crashParseBuildId(const char* hex, uint8_t* out) {
+  for (int i = 0; i < CRASH_BUILD_ID_LEN; i++) {
+    uint8_t byte = 0;
+    for (int n = 0; n < 2; n++) {
+      char c = hex[i * 2 + n];
+      byte <<= 4;
+      if (c >= '0' && c <= '9') byte |= c - '0';
+      else if (c >= 'a' && c <= 'f') byte |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') byte |= c - 'A' + 10;
+    }
+    out[i] = byte;
+  }
+}
+
+/**
+ * @brief Store summary in NVS so it also survives a power cycle
+ * @return bool true if the blob was written
+ */
+static bool crashSummaryStore(const crash_summary_t* summary) {
+  nvs_handle_t handle;
+  if (nvs_open(CRASH_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_blob(handle, CRASH_NVS_KEY, summary, sizeof(crash_summary_t));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+
+/**
+ * @brief Load summary from NVS
+ * @return bool true if a valid summary was found
+ */
+static bool crashSummaryLoad(crash_summary_t* summary) {
+  nvs_handle_t handle;
+  if (nvs_open(CRASH_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+  size_t len = sizeof(crash_summary_t);
+  esp_err_t err = nvs_get_blob(handle, CRASH_NVS_KEY, summary, &len);
+  nvs_close(handle);
+  return err == ESP_OK && len == sizeof(crash_summary_t) && summary->magic == CRASH_SUMMARY_MAGIC;
+}
+
+/**
+ * @brief Detect a stored core dump and reduce it to a crash_summary_t
+ * @details Skipped entirely on deep sleep wakes (button press path): a core dump can
+ *          only appear after a panic/watchdog reset, which is never a deep sleep wake.
+ * @return bool true if a new summary was captured (not for a dump seen before)
+ */
+static bool crashSummaryCapture(void) {
+  const esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_DEEPSLEEP) {
+    return false;
+  }
+
+  if (crash_summary.magic != CRASH_SUMMARY_MAGIC) {
+    memset(&crash_summary, 0, sizeof(crash_summary));
+  }
+
+#if CRASH_SUMMARY_SUPPORTED
+  if (esp_core_dump_image_check() != ESP_OK) {
+    return false;
+  }
+
+  esp_core_dump_summary_t* dump = (esp_core_dump_summary_t*)malloc(sizeof(esp_core_dump_summary_t));
+  if (dump == nullptr) {
+    return false;
+  }
+  if (esp_core_dump_get_summary(dump) != ESP_OK) {
+    free(dump);
+    return false;
+  }
+
+  crash_summary_t summary = {};
+  summary.magic = CRASH_SUMMARY_MAGIC;
+  summary.pc = dump->exc_pc;
+#if CONFIG_IDF_TARGET_ARCH_RISCV
+  summary.cause = dump->ex_info.mcause;
+  summary.ra = dump->ex_info.ra;
+  summary.bt_hash = crashHash(dump->exc_bt_info.stackdump, dump->exc_bt_info.dump_size);
+#else
+  summary.cause = dump->ex_info.exc_cause;
+  summary.ra = dump->exc_bt_info.depth > 1 ? dump->exc_bt_info.bt[1] : 0;
+  summary.bt_hash = crashHash((const uint8_t*)dump->exc_bt_info.bt, dump->exc_bt_info.depth * sizeof(uint32_t));
+#endif
+  crashParseBuildId((const char*)dump->app_elf_sha256, summary.build_id);
+  summary.reset_reason = static_cast<uint8_t>(reason);
+  summary.flags = CRASH_FLAG_PENDING_REPORT | CRASH_FLAG_PENDING_ERASE;
+  free(dump);
+
+  // Same dump seen again (e.g. power cycle before the lazy erase) -> don't rewrite NVS, and
+  // keep its report state: a summary already reported isn't pending again. The dump is
+  // still in flash, so the erase is
+  crash_summary_t stored;
+  const bool fresh = !crashSummaryLoad(&stored) || stored.pc != summary.pc || stored.bt_hash != summary.bt_hash;
+  if (fresh) {
+    crashSummaryStore(&summary);
+  } else {
+    summary.flags = (stored.flags & CRASH_FLAG_PENDING_REPORT) | CRASH_FLAG_PENDING_ERASE;
+  }
+  crash_summary = summary;
+
+  DEBUG_VERBOSE_F("\n[CRASH] Core dump found: pc=0x%08lX cause=0x%08lX bt=0x%08lX%s",
+                  summary.pc, summary.cause, summary.bt_hash, fresh ? "" : " (seen before)");
+  return fresh;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief True if a crash summary is waiting to be reported
+ * @note  Reads RTC memory only, safe to call on the wake path
+ */
+static bool crashSummaryPending(void) {
+  return crash_summary.magic == CRASH_SUMMARY_MAGIC && (crash_summary.flags & CRASH_FLAG_PENDING_REPORT);
+}
+
+/**
+ * @brief Report the stored summary (factory session) and mark it as reported
+ * @details The RTC copy is cleared by a power cycle, so NVS is the source of truth here
+ */
+static void crashSummaryReport(void) {
+  crash_summary_t summary;
+  if (!crashSummaryLoad(&summary) || !(summary.flags & CRASH_FLAG_PENDING_REPORT)) {
+    DEBUG_VERBOSE("\n[CRASH] No crash recorded");
+    return;
+  }
+
+  DEBUG_VERBOSE_F("\n[CRASH] pc=0x%08lX cause=0x%08lX ra=0x%08lX bt=0x%08lX build=%02x%02x%02x%02x reset=%d",
+                  summary.pc, summary.cause, summary.ra, summary.bt_hash,
+                  summary.build_id[0], summary.build_id[1], summary.build_id[2], summary.build_id[3],
+                  summary.reset_reason);
+
+  summary.flags &= ~CRASH_FLAG_PENDING_REPORT;
+  crashSummaryStore(&summary);
+  crash_summary.flags &= ~CRASH_FLAG_PENDING_REPORT;
+}
+
+/**
+ * @brief Erase the coredump partition if a captured dump is still in there
+ * @note  Call off the wake path (after broadcasting, before deep sleep): a flash erase of
+ *        the 64 KB partition takes a few hundred ms
+ */
+static void crashSummaryEraseDeferred(void) {
+  if (crash_summary.magic != CRASH_SUMMARY_MAGIC || !(crash_summary.flags & CRASH_FLAG_PENDING_ERASE)) {
+    return;
+  }
+#if CRASH_SUMMARY_SUPPORTED
+  if (esp_core_dump_image_erase() != ESP_OK) {
+    DEBUG_VERBOSE("\n[CRASH] Core dump erase failed, will retry next sleep");
+    return;
+  }
+#endif
+  crash_summary.flags &= ~CRASH_FLAG_PENDING_ERASE;
+  DEBUG_VERBOSE("\n[CRASH] Core dump partition erased");
+}
+
+#endif  // CRASH_SUMMARY_H
@@ -0,0 +1,381 @@
+/**
+ * @file    diag_log.h
+ * @brief   Append-only diagnostic log in flash pages: format, batch, commit and recovery
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): the firmware batches records in
+ *          RTC memory and commits them to the `spiffs` data partition (diag_log_store.h),
+ *          host_tools/diag/ decodes partition images and captures and simulates power
+ *          loss with the same code.
+ *
+ *          Page [DIAG_LOG_PAGE = 256 bytes, one flash program page, little endian]:
+ *            magic "HBDL" | version u8 | count u8 | used u16 | seq u32 | records[used] | 0xFF... | crc32
+ *            seq counts the pages since the log was created, crc32 (zlib) covers all bytes before it.
+ *          Record: type u8 | len u8 | value[len]
+ *            WAKE    wake u32 | clock u32 | cause u8 | reserved u8 | charge_uc u32 | phase_mask u16 |
+ *                    phase u16 for each bit of phase_mask (WakePhase, diagnostics.h)
+ *                    clock: timestamp word of the device clock (button_events.h)
+ *                    phase: esp_timer time in DIAG_LOG_PHASE_UNIT_US units, saturating
+ *            EVENT   wake u32 | type u8 | arg u8 (diag_event_t, diagnostics.h)
+ *            ENERGY  diag_log_energy_t: the energy counters at the commit, last record of every page
+ *
+ *          Wear leveling: pages are written in order through the whole partition and wrap
+ *          around. A sector is erased when the head enters it, so all sectors wear evenly
+ *          and the oldest pages are the ones overwritten.
+ *          Recovery after a power loss (RTC state gone): the newest sector is the one whose
+ *          first page has the highest seq, the head is the first blank page after its last
+ *          valid one. A page torn by a power loss during its write fails the CRC: readers
+ *          skip it, the writer moves past it.
+ */
+
+#ifndef DIAG_LOG_H
+#define DIAG_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(ESP_PLATFORM)
+#include "esp_rom_crc.h"
+#endif
+
+/* ============= Log Format ============= */
+#define DIAG_LOG_MAGIC 0x4C444248u       /**< "HBDL" */
+#define DIAG_LOG_VERSION 1
+#define DIAG_LOG_PAGE 256                /**< Flash program page */
+#define DIAG_LOG_SECTOR 4096             /**< Flash erase sector */
+#define DIAG_LOG_PAGES_PER_SECTOR (DIAG_LOG_SECTOR / DIAG_LOG_PAGE)
+#define DIAG_LOG_HEADER_LEN 12
+#define DIAG_LOG_CRC_OFFSET (DIAG_LOG_PAGE - 4)
+#define DIAG_LOG_CAPACITY (DIAG_LOG_CRC_OFFSET - DIAG_LOG_HEADER_LEN)  /**< Record bytes per page */
+#define DIAG_LOG_PHASE_UNIT_US 256       /**< Phase resolution: 16.7 s range in a u16 */
+#define DIAG_LOG_MAX_PHASES 16
+#define DIAG_LOG_WAKE_FIXED_LEN 16       /**< WAKE value without its phases */
+#define DIAG_LOG_STATE_MAGIC 0xD1A61001  /**< Validates diag_log_t (bump on layout change) */
+
+enum class DiagLogRecord : uint8_t {
+  WAKE = 1,
+  EVENT = 2,
+  ENERGY = 3
+};
+
+/**
+ * @brief What started a wake
+ */
+enum class DiagLogCause : uint8_t {
+  BOOT = 0,    /**< Not a deep sleep wake: power-on, reset, brownout, panic */
+  BUTTON,      /**< EXT1: SOS or cancel press */
+  TIMER        /**< Device clock calibration or stuck button check */
+};
+
+/**
+ * @brief Energy counters (energy_account_t, diagnostics.h), 32-bit [32 bytes]
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t total_uc;
+  uint32_t active_ms;
+  uint32_t adv_ms;
+  uint32_t ble_frames;
+  uint32_t ble_charge_uc;
+  uint32_t ieee_frames;
+  uint32_t ieee_failed;
+  uint32_t ieee_charge_uc;
+} diag_log_energy_t;
+
+/**
+ * @brief One wake, decoded (phases not in phase_mask are 0)
+ */
+typedef struct {
+  uint32_t wake;
+  uint32_t clock;
+  DiagLogCause cause;
+  uint32_t charge_uc;
+  uint16_t phase_mask;
+  uint16_t phase[DIAG_LOG_MAX_PHASES];
+} diag_log_wake_t;
+
+/**
+ * @brief Log state and the batch of uncommitted records (RTC memory on target)
+ */
+typedef struct {
+  uint32_t magic;       /**< DIAG_LOG_STATE_MAGIC: head and seq are valid */
+  uint32_t pages;       /**< Pages in the partition */
+  uint32_t head;        /**< Page index of the next commit */
+  uint32_t seq;         /**< seq of the next page */
+  uint32_t commits;     /**< Pages written since the state was created */
+  uint32_t failed;      /**< Commits that failed (flash error) */
+  uint16_t used;        /**< Record bytes in the batch */
+  uint8_t count;        /**< Records in the batch */
+  uint8_t wakes;        /**< Wakes in the batch */
+  uint8_t batch[DIAG_LOG_CAPACITY];
+} diag_log_t;
+
+/**
+ * @brief Flash access (the data partition on target, memory on host)
+ */
+class DiagLogIo {
+public:
+  virtual ~DiagLogIo() {}
+  /** Read `len` bytes at `offset` in the partition */
+  virtual bool read(uint32_t offset, void* buf, size_t len) = 0;
+  /** Program `len` bytes at `offset` (erased before) */
+  virtual bool write(uint32_t offset, const void* buf, size_t len) = 0;
+  /** Erase the DIAG_LOG_SECTOR at `offset` */
+  virtual bool erase(uint32_t offset) = 0;
+};
+
+
+/**
+ * @brief CRC-32 (zlib), ROM implementation on target
+ */
+static inline uint32_t diagLogCrc32(const uint8_t* data, size_t len) {
+#if defined(ESP_PLATFORM)
+  return esp_rom_crc32_le(0, data, len);
+#else
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++) {
+      crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+    }
+  }
+  return ~crc;
+#endif
+}
+
+static inline uint32_t diagLogGet32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void diagLogPut32(uint8_t* p, const uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/* ============= Pages ============= */
+/**
+ * @brief true if `page` is a complete log page (magic, version, length, CRC)
+ */
+static inline bool diagLogPageValid(const uint8_t* page) {
+  return diagLogGet32(page) == DIAG_LOG_MAGIC && page[4] == DIAG_LOG_VERSION
+         && (uint32_t)(page[6] | (page[7] << 8)) <= DIAG_LOG_CAPACITY
+         && diagLogGet32(page + DIAG_LOG_CRC_OFFSET) == diagLogCrc32(page, DIAG_LOG_CRC_OFFSET);
+}
+
+static inline uint32_t diagLogPageSeq(const uint8_t* page) {
+  return diagLogGet32(page + 8);
+}
+
+/**
+ * @brief true if `page` is erased flash
+ */
+static inline bool diagLogPageBlank(const uint8_t* page) {
+  for (int i = 0; i < DIAG_LOG_PAGE; i++) {
+    if (page[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Next record of a valid page
+ * @param offset Byte offset into the records, 0 for the first
+ * @return bool false after the last record
+ */
+static inline bool diagLogNextRecord(const uint8_t* page, uint16_t& offset, DiagLogRecord& type, const uint8_t*& value,
+                                     uint8_t& len) {
+  const uint16_t used = (uint16_t)(page[6] | (page[7] << 8));
+  if (offset + 2 > used || offset + 2 + page[DIAG_LOG_HEADER_LEN + offset + 1] > used) {
+    return false;
+  }
+  const uint8_t* rec = page + DIAG_LOG_HEADER_LEN + offset;
+  type = static_cast<DiagLogRecord>(rec[0]);
+  len = rec[1];
+  value = rec + 2;
+  offset = (uint16_t)(offset + 2 + len);
+  return true;
+}
+
+/* ============= Records ============= */
+/**
+ * @brief Serialize a WAKE value
+ * @param out DIAG_LOG_WAKE_FIXED_LEN + 2 * DIAG_LOG_MAX_PHASES bytes
+ * @return uint8_t Value length
+ */
+static inline uint8_t diagLogWakeValue(const diag_log_wake_t& w, uint8_t* out) {
+  diagLogPut32(out, w.wake);
+  diagLogPut32(out + 4, w.clock);
+  out[8] = static_cast<uint8_t>(w.cause);
+  out[9] = 0;
+  diagLogPut32(out + 10, w.charge_uc);
+  out[14] = (uint8_t)w.phase_mask;
+  out[15] = (uint8_t)(w.phase_mask >> 8);
+  uint8_t len = DIAG_LOG_WAKE_FIXED_LEN;
+  for (int i = 0; i < DIAG_LOG_MAX_PHASES; i++) {
+    if (w.phase_mask & (1u << i)) {
+      out[len++] = (uint8_t)w.phase[i];
+      out[len++] = (uint8_t)(w.phase[i] >> 8);
+    }
+  }
+  return len;
+}
+
+/**
+ * @brief Parse a WAKE value
+ * @return bool false if the length doesn't match the phase mask
+ */
+static inline bool diagLogParseWake(const uint8_t* value, const uint8_t len, diag_log_wake_t* w) {
+  if (len < DIAG_LOG_WAKE_FIXED_LEN) {
+    return false;
+  }
+  memset(w, 0, sizeof(*w));
+  w->wake = diagLogGet32(value);
+  w->clock = diagLogGet32(value + 4);
+  w->cause = static_cast<DiagLogCause>(value[8]);
+  w->charge_uc = diagLogGet32(value + 10);
+  w->phase_mask = (uint16_t)(value[14] | (value[15] << 8));
+  uint8_t pos = DIAG_LOG_WAKE_FIXED_LEN;
+  for (int i = 0; i < DIAG_LOG_MAX_PHASES; i++) {
+    if (w->phase_mask & (1u << i)) {
+      if (pos + 2 > len) {
+        return false;
+      }
+      w->phase[i] = (uint16_t)(value[pos] | (value[pos + 1] << 8));
+      pos += 2;
+    }
+  }
+  return pos == len;
+}
+
+/**
+ * @brief esp_timer time of a phase in DIAG_LOG_PHASE_UNIT_US units (a reached phase is never 0)
+ */
+static inline uint16_t diagLogPhaseUnits(const uint32_t us) {
+  const uint32_t units = (us + DIAG_LOG_PHASE_UNIT_US - 1) / DIAG_LOG_PHASE_UNIT_US;
+  return units > 0xFFFF ? 0xFFFF : (units == 0 ? 1 : (uint16_t)units);
+}
+
+/* ============= Batch and Commit ============= */
+/**
+ * @brief Start a log in a partition of `size` bytes (state only, flash untouched)
+ */
+static inline void diagLogInit(diag_log_t& log, const uint32_t size) {
+  memset(&log, 0, sizeof(log));
+  log.magic = DIAG_LOG_STATE_MAGIC;
+  log.pages = (size / DIAG_LOG_SECTOR) * DIAG_LOG_PAGES_PER_SECTOR;
+  log.seq = 1;
+}
+
+/**
+ * @brief true if a record with a `len` byte value fits the batch (ENERGY record kept free)
+ */
+static inline bool diagLogFits(const diag_log_t& log, const size_t len) {
+  return log.used + 2 + len + 2 + sizeof(diag_log_energy_t) <= DIAG_LOG_CAPACITY;
+}
+
+/**
+ * @brief Add a record to the batch
+ * @return bool false if it doesn't fit: commit first
+ */
+static inline bool diagLogAppend(diag_log_t& log, const DiagLogRecord type, const void* value, const uint8_t len) {
+  if (!diagLogFits(log, len)) {
+    return false;
+  }
+  uint8_t* rec = log.batch + log.used;
+  rec[0] = static_cast<uint8_t>(type);
+  rec[1] = len;
+  memcpy(rec + 2, value, len);
+  log.used = (uint16_t)(log.used + 2 + len);
+  log.count++;
+  return true;
+}
+
+/**
+ * @brief Write the batch as the next page, with the energy counters as its last record
+ * @details Erases the sector first when the head enters it. The batch is emptied once
+ *          the page is written. After a flash error the head moves on and the batch
+ *          is kept for the next commit.
+ * @return bool true if the page was written (or the batch was empty)
+ */
+static inline bool diagLogCommit(diag_log_t& log, DiagLogIo& io, const diag_log_energy_t& energy) {
+  if (log.count == 0 || log.pages == 0) {
+    return log.count == 0;
+  }
+  uint8_t page[DIAG_LOG_PAGE];
+  memset(page, 0xFF, sizeof(page));
+  memcpy(page + DIAG_LOG_HEADER_LEN, log.batch, log.used);
+  uint16_t used = log.used;
+  page[DIAG_LOG_HEADER_LEN + used] = static_cast<uint8_t>(DiagLogRecord::ENERGY);
+  page[DIAG_LOG_HEADER_LEN + used + 1] = sizeof(diag_log_energy_t);
+  memcpy(page + DIAG_LOG_HEADER_LEN + used + 2, &energy, sizeof(energy));
+  used = (uint16_t)(used + 2 + sizeof(energy));
+
+  diagLogPut32(page, DIAG_LOG_MAGIC);
+  page[4] = DIAG_LOG_VERSION;
+  page[5] = (uint8_t)(log.count + 1);
+  page[6] = (uint8_t)used;
+  page[7] = (uint8_t)(used >> 8);
+  diagLogPut32(page + 8, log.seq);
+  diagLogPut32(page + DIAG_LOG_CRC_OFFSET, diagLogCrc32(page, DIAG_LOG_CRC_OFFSET));
+
+  const uint32_t offset = log.head * DIAG_LOG_PAGE;
+  bool ok = log.head % DIAG_LOG_PAGES_PER_SECTOR != 0 || io.erase(offset);
+  ok = ok && io.write(offset, page, sizeof(page));
+  log.head = (log.head + 1) % log.pages;
+  log.seq++;
+  if (!ok) {
+    log.failed++;
+    return false;
+  }
+  log.commits++;
+  log.used = 0;
+  log.count = 0;
+  log.wakes = 0;
+  return true;
+}
+
+/**
+ * @brief Find head and seq in the partition (the RTC state was lost)
+ * @details Reads the first page of every sector, then the newest sector page by page.
+ *          The batch is emptied. A partition without a valid page starts a new log at 0.
+ * @return bool false on a read error
+ */
+static inline bool diagLogRecover(diag_log_t& log, DiagLogIo& io, const uint32_t size) {
+  diagLogInit(log, size);
+  const uint32_t sectors = log.pages / DIAG_LOG_PAGES_PER_SECTOR;
+  uint8_t page[DIAG_LOG_PAGE];
+  uint32_t newest = sectors, newest_seq = 0;
+  for (uint32_t s = 0; s < sectors; s++) {
+    if (!io.read(s * DIAG_LOG_SECTOR, page, sizeof(page))) {
+      return false;
+    }
+    if (diagLogPageValid(page) && diagLogPageSeq(page) >= newest_seq) {
+      newest = s;
+      newest_seq = diagLogPageSeq(page);
+    }
+  }
+  if (newest == sectors) {
+    return true;  // New log: the first commit erases sector 0
+  }
+
+  // Newest sector: the head is the first blank page after the last valid one
+  const uint32_t first = newest * DIAG_LOG_PAGES_PER_SECTOR;
+  uint32_t last = first, head = first + DIAG_LOG_PAGES_PER_SECTOR;
+  for (uint32_t p = first; p < first + DIAG_LOG_PAGES_PER_SECTOR; p++) {
+    if (!io.read(p * DIAG_LOG_PAGE, page, sizeof(page))) {
+      return false;
+    }
+    if (diagLogPageValid(page) && diagLogPageSeq(page) >= newest_seq) {
+      last = p;
+      newest_seq = diagLogPageSeq(page);
+      head = first + DIAG_LOG_PAGES_PER_SECTOR;
+    } else if (p > last && diagLogPageBlank(page) && head == first + DIAG_LOG_PAGES_PER_SECTOR) {
+      head = p;
+    }
+  }
+  log.head = head % log.pages;
+  log.seq = newest_seq + 1;
+  return true;
+}
+
+#endif  // DIAG_LOG_H
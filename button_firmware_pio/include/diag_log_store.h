@@ -0,0 +1,275 @@
+/**
+ * @file    diag_log_store.h
+ * @brief   Persistent diagnostic log: RTC batch, commit policy and readout of the flash log
+ * @details The wake timeline, energy counters and event ring (diagnostics.h) live in RTC
+ *          memory: a power loss clears them, and without a serial cable nothing of them
+ *          is left. This keeps their history in the `spiffs` data partition, which the
+ *          firmware doesn't mount otherwise (diag_log.h: format, wear leveling, recovery).
+ *
+ *          Each wake adds a WAKE record and the events of the wake to a batch in RTC
+ *          memory (a few us of memory writes). The batch is committed as one
+ *          256 byte page:
+ *            - every DIAG_LOG_COMMIT_WAKES wakes, or earlier when the page is full
+ *            - on every wake once the battery is low: estimated remaining charge below
+ *              DIAG_LOG_LOW_BATTERY_PCT, or a brownout reset since power-on. The board has
+ *              no battery sense input, so the estimate is the energy account plus
+ *              DIAG_CURRENT_SLEEP_UA since power-on against DIAG_LOG_BATTERY_MAH.
+ *            - before a factory or maintenance session, so the readout is complete
+ *          A commit is a ~1 ms page program, plus a 4 KB sector erase every 16th page. Its
+ *          time is added to the energy account.
+ *
+ *          Readout:
+ *            - factory session: every page goes out over UART0 as is, whatever DEBUG_LEVEL
+ *              is (like the self-test record). host_tools diag_log_decode finds the pages
+ *              in the byte stream by magic and CRC.
+ *            - maintenance: LOG characteristic (...16), each read returns the next
+ *              DIAG_LOG_READ_PAGES valid pages, oldest first, an empty value at the end
+ *              (maint_client.py log).
+ *
+ *          No `spiffs` partition in the partition table: the log is off, nothing else changes.
+ *
+ * @note  Include after diagnostics.h and device_clock.h, before maintenance.h
+*/
+
+#ifndef DIAG_LOG_STORE_H
+#define DIAG_LOG_STORE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_partition.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <BLEDevice.h>
+#include "diag_log.h"
+
+/* ============= Diagnostic Log Configuration ============= */
+#define DIAG_LOG_COMMIT_WAKES 8          /**< Commit at least every 8 wakes */
+#define DIAG_LOG_BATTERY_MAH 220         /**< CR2032 */
+#define DIAG_LOG_LOW_BATTERY_PCT 10      /**< Commit on every wake below this */
+#define DIAG_LOG_READ_PAGES 2            /**< Pages per LOG read (512 bytes, MAINT_ATT_MTU) */
+#define MAINT_CHAR_LOG_UUID "4d41494e-0016-4a45-4e4e-594645520000"
+
+static_assert(static_cast<int>(WakePhase::COUNT) <= DIAG_LOG_MAX_PHASES, "WakePhase doesn't fit a WAKE record");
+
+RTC_DATA_ATTR static diag_log_t diag_log;        /**< Batch, head and seq: persist across deep sleep */
+RTC_DATA_ATTR static uint8_t diag_log_brownout;  /**< A brownout reset since power-on */
+static const esp_partition_t* diag_log_part = nullptr;
+
+/**
+ * @brief Log I/O on the data partition
+ */
+class FlashDiagLogIo : public DiagLogIo {
+public:
+  bool read(uint32_t offset, void* buf, size_t len) override {
+    return esp_partition_read(diag_log_part, offset, buf, len) == ESP_OK;
+  }
+  bool write(uint32_t offset, const void* buf, size_t len) override {
+    return esp_partition_write(diag_log_part, offset, buf, len) == ESP_OK;
+  }
+  bool erase(uint32_t offset) override {
+    return esp_partition_erase_range(diag_log_part, offset, DIAG_LOG_SECTOR) == ESP_OK;
+  }
+};
+
+static FlashDiagLogIo diag_log_io;
+
+
+/**
+ * @brief Find the partition, recover head and seq if the RTC state was lost
+ * @details Only on a commit or readout, never on a wake that just batches.
+ * @return bool false without a usable partition
+ */
+static bool diagLogOpen(void) {
+  if (diag_log_part == nullptr) {
+    diag_log_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+    if (diag_log_part == nullptr || diag_log_part->size < DIAG_LOG_SECTOR) {
+      diag_log_part = nullptr;
+      return false;
+    }
+  }
+  if (diag_log.magic != DIAG_LOG_STATE_MAGIC) {
+    diagLogInit(diag_log, 0);
+  }
+  const uint32_t pages = (diag_log_part->size / DIAG_LOG_SECTOR) * DIAG_LOG_PAGES_PER_SECTOR;
+  if (diag_log.pages != pages) {
+    const diag_log_t batch = diag_log;  // Records batched since the RTC state was lost
+    if (!diagLogRecover(diag_log, diag_log_io, diag_log_part->size)) {
+      DEBUG_VERBOSE("\n[LOG] Partition read failed");
+      return false;
+    }
+    memcpy(diag_log.batch, batch.batch, batch.used);
+    diag_log.used = batch.used;
+    diag_log.count = batch.count;
+    diag_log.wakes = batch.wakes;
+    DEBUG_VERBOSE_F("\n[LOG] %lu pages, head %lu, next seq %lu", diag_log.pages, diag_log.head, diag_log.seq);
+  }
+  return true;
+}
+
+/**
+ * @brief Energy counters for the ENERGY record
+ */
+static diag_log_energy_t diagLogEnergy(void) {
+  const energy_account_t& e = diag_data.energy;
+  const radio_account_t& ble = e.radio[static_cast<int>(DiagRadio::BLE)];
+  const radio_account_t& ieee = e.radio[static_cast<int>(DiagRadio::IEEE802154)];
+  return { (uint32_t)e.total_charge_uc, e.active_ms, e.adv_ms, ble.tx_frames, ble.charge_uc,
+           ieee.tx_frames, ieee.tx_failed, ieee.charge_uc };
+}
+
+/**
+ * @brief Commit the batch now
+ * @return bool true if the batch is on flash (or was empty)
+ */
+static bool diagLogCommitNow(void) {
+  if (diag_log.magic == DIAG_LOG_STATE_MAGIC && diag_log.count == 0) {
+    return true;
+  }
+  const uint32_t start = (uint32_t)esp_timer_get_time();
+  if (!diagLogOpen()) {
+    return false;
+  }
+  const bool ok = diagLogCommit(diag_log, diag_log_io, diagLogEnergy());
+  const uint32_t us = (uint32_t)esp_timer_get_time() - start;
+  diag_data.energy.total_charge_uc += (uint64_t)us * DIAG_CURRENT_ACTIVE_UA / 1000000ULL;
+  diag_data.energy.active_ms += us / 1000;
+  DEBUG_VERBOSE_F("\n[LOG] Page %lu %s in %lu us", diag_log.seq - 1, ok ? "committed" : "FAILED", us);
+  return ok;
+}
+
+/**
+ * @brief Low battery: estimated remaining charge, or a brownout since power-on
+ */
+static bool diagLogBatteryLow(void) {
+  const uint64_t capacity_uc = (uint64_t)DIAG_LOG_BATTERY_MAH * 3600000ULL;
+  const uint64_t used_uc = diag_data.energy.total_charge_uc + (device_clock.elapsed_us / 1000000ULL) * DIAG_CURRENT_SLEEP_UA;
+  return diag_log_brownout || used_uc >= capacity_uc * (100 - DIAG_LOG_LOW_BATTERY_PCT) / 100;
+}
+
+/**
+ * @brief Batch this wake: WAKE record and the events of this wake, commit when due
+ * @note  Call after diagCloseWake(), before the sleep entry
+ */
+static void diagLogWake(void) {
+  const esp_reset_reason_t reset = esp_reset_reason();
+  if (reset == ESP_RST_POWERON) {
+    diag_log_brownout = 0;
+  } else if (reset == ESP_RST_BROWNOUT) {
+    diag_log_brownout = 1;
+  }
+  if (diag_log.magic != DIAG_LOG_STATE_MAGIC) {
+    diagLogInit(diag_log, 0);  // Batch only: head and seq come from the partition at the first commit
+  }
+
+  diag_log_wake_t w = {};
+  w.wake = diag_data.wakes;
+  w.clock = deviceClockWord();
+  w.cause = reset != ESP_RST_DEEPSLEEP ? DiagLogCause::BOOT
+          : (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER ? DiagLogCause::TIMER : DiagLogCause::BUTTON);
+  w.charge_uc = diag_data.energy.last_wake_uc;
+  for (int i = 0; i < static_cast<int>(WakePhase::COUNT); i++) {
+    const uint32_t t = diagPhase(static_cast<WakePhase>(i));
+    if (t) {
+      w.phase_mask |= 1u << i;
+      w.phase[i] = diagLogPhaseUnits(t);
+    }
+  }
+  const int sleep = static_cast<int>(WakePhase::SLEEP_ENTRY);  // Not marked yet: now
+  w.phase_mask |= 1u << sleep;
+  w.phase[sleep] = diagLogPhaseUnits((uint32_t)esp_timer_get_time());
+  uint8_t value[DIAG_LOG_WAKE_FIXED_LEN + 2 * DIAG_LOG_MAX_PHASES];
+  const uint8_t len = diagLogWakeValue(w, value);
+  if (!diagLogFits(diag_log, len)) {
+    diagLogCommitNow();
+  }
+  diagLogAppend(diag_log, DiagLogRecord::WAKE, value, len);
+
+  // Events of this wake, oldest first
+  for (uint16_t n = diag_data.event_count; n > 0; n--) {
+    const diag_event_t& ev = diag_data.events[(diag_data.event_head + DIAG_EVENT_RING_SIZE - n) & (DIAG_EVENT_RING_SIZE - 1)];
+    if (ev.wake != diag_data.wakes) {
+      continue;
+    }
+    uint8_t ev_value[6];
+    diagLogPut32(ev_value, ev.wake);
+    ev_value[4] = static_cast<uint8_t>(ev.type);
+    ev_value[5] = ev.arg;
+    if (!diagLogFits(diag_log, sizeof(ev_value))) {
+      diagLogCommitNow();
+    }
+    diagLogAppend(diag_log, DiagLogRecord::EVENT, ev_value, sizeof(ev_value));
+  }
+  diag_log.wakes++;
+
+  if (diag_log.wakes >= DIAG_LOG_COMMIT_WAKES || diagLogBatteryLow()) {
+    diagLogCommitNow();
+  }
+}
+
+/**
+ * @brief Factory session: commit, then send every valid page over UART0, oldest first
+ * @details Opens the UART itself when debug output is off, like selftestEmit().
+ */
+static void diagLogEmit(void) {
+  diagLogCommitNow();
+  if (!diagLogOpen()) {
+    DEBUG_VERBOSE("\n[LOG] No log partition");
+    return;
+  }
+#if DEBUG_LEVEL == DEBUG_LEVEL_NONE
+  Serial.begin(115200);
+  delay(10);
+#endif
+  uint8_t page[DIAG_LOG_PAGE];
+  uint32_t sent = 0;
+  for (uint32_t i = 0; i < diag_log.pages; i++) {
+    const uint32_t p = (diag_log.head + i) % diag_log.pages;
+    if (diag_log_io.read(p * DIAG_LOG_PAGE, page, sizeof(page)) && diagLogPageValid(page)) {
+      Serial.write(page, sizeof(page));
+      sent++;
+    }
+  }
+  Serial.flush();
+#if DEBUG_LEVEL == DEBUG_LEVEL_NONE
+  Serial.end();
+  DEBUG_INIT();  // Park the serial pins again
+#endif
+  DEBUG_VERBOSE_F("\n[LOG] %lu pages sent", sent);
+}
+
+/* ============= Maintenance Readout ============= */
+static uint32_t diag_log_read_pos = 0;  /**< Pages from the head already scanned this session */
+
+/**
+ * @brief LOG reads: the next valid pages, an empty value after the last one
+ */
+class DiagLogReadCallbacks : public BLECharacteristicCallbacks {
+  void onRead(BLECharacteristic* chr) override {
+    static uint8_t value[DIAG_LOG_READ_PAGES * DIAG_LOG_PAGE];
+    size_t len = 0;
+    while (len < sizeof(value) && diag_log_read_pos < diag_log.pages) {
+      const uint32_t p = (diag_log.head + diag_log_read_pos++) % diag_log.pages;
+      if (diag_log_io.read(p * DIAG_LOG_PAGE, value + len, DIAG_LOG_PAGE) && diagLogPageValid(value + len)) {
+        len += DIAG_LOG_PAGE;
+      }
+    }
+    chr->setValue(value, len);
+  }
+};
+
+/**
+ * @brief Commit the batch and add the LOG characteristic to the maintenance service
+ */
+static void diagLogAddService(BLEService* service) {
+  diagLogCommitNow();
+  diag_log_read_pos = 0;
+  if (!diagLogOpen()) {
+    return;
+  }
+  BLECharacteristic* chr = service->createCharacteristic(MAINT_CHAR_LOG_UUID, BLECharacteristic::PROPERTY_READ);
+  chr->setCallbacks(new DiagLogReadCallbacks());
+}
+
+#endif  // DIAG_LOG_STORE_H
@@ -0,0 +1,295 @@
+/**
+ * @file    field_config.h
+ * @brief   Field configuration stored in NVS and cached in RTC memory
+ * @details Tunables that used to be compile-time only (beacon time, factory wait,
+ *          advertising intervals, TX power, 802.15.4 transport) live in a versioned, CRC-checked record in
+ *          NVS. The record is decoded ONCE (power-on, reset or after a maintenance write)
+ *          into `device_config` in RTC memory, so normal wakes read plain memory and
+ *          never open NVS.
+ *          A missing, corrupt, unknown-version or out-of-range record falls back to the
+ *          compiled defaults below.
+ *
+ *          Writes come only from the authenticated maintenance channel (maintenance.h),
+ *          tagged as described in maint_auth.h with the domain "HBCFG".
+ *
+ *          The closed-loop TX power estimate (tx_power.h) follows the same pattern: learned
+ *          from gateway reports (domain "HBLNK"), stored in NVS on every report, decoded
+ *          with the configuration and RTC resident after that.
+ *
+ *          Whether the unit was provisioned (left factory mode) is kept in NVS too: RTC
+ *          memory doesn't survive the restart into an update.
+*/
+
+#ifndef FIELD_CONFIG_H
+#define FIELD_CONFIG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <nvs.h>
+#include <esp_bt.h>
+#include "esp_rom_crc.h"
+#include "maint_auth.h"
+#include "tx_power.h"
+
+/* ============= Compiled Defaults ============= */
+#define CONFIG_DEFAULT_BEACON_TIME_MS 10000  /**< Broadcast duration in ms */
+#define CONFIG_DEFAULT_FACTORY_WAIT_MS 20000 /**< Factory reset timeout in ms */
+#define CONFIG_DEFAULT_ADV_MIN_INTERVAL 0x40 /**< 0x40 * 0.625ms = 40ms */
+#define CONFIG_DEFAULT_ADV_MAX_INTERVAL 0x80 /**< 0x80 * 0.625ms = 80ms */
+#define CONFIG_DEFAULT_TX_POWER ESP_PWR_LVL_N12 /**< -12dBm */
+#define CONFIG_DEFAULT_IEEE_CHANNEL 0        /**< 802.15.4 transport: 0 = off, 11-26 = channel */
+#define CONFIG_DEFAULT_IEEE_INTERVAL_MS 100  /**< One 802.15.4 frame every 100ms (+0-10ms) */
+#define CONFIG_IEEE_INTERVAL_UNIT_MS 10      /**< Record unit of the 802.15.4 frame interval */
+
+/* ============= Record Format ============= */
+#define CONFIG_RECORD_VERSION 1
+#define CONFIG_RTC_MAGIC 0xC0F16003          /**< Validates the RTC cache (bump on device_config_t / tx_link_t change) */
+#define CONFIG_NVS_NAMESPACE "config"
+#define CONFIG_NVS_KEY "rec"
+#define CONFIG_NVS_LINK_KEY "link"           /**< tx_link_t + CRC32 */
+#define CONFIG_NVS_PROVISIONED_KEY "prov"    /**< u8, 1 = left factory mode once (survives resets, unlike RTC memory) */
+#define CONFIG_AUTH_TAG_LEN MAINT_AUTH_TAG_LEN
+#define CONFIG_CHALLENGE_LEN MAINT_CHALLENGE_LEN
+#define CONFIG_AUTH_DOMAIN "HBCFG"
+
+/**
+ * @brief Configuration record, as stored in NVS and sent over the maintenance channel [20 bytes]
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t version;           /**< CONFIG_RECORD_VERSION */
+  uint8_t tx_power;          /**< esp_power_level_t */
+  uint16_t adv_min_interval; /**< Units of 0.625ms */
+  uint16_t adv_max_interval; /**< Units of 0.625ms */
+  uint8_t ieee_channel;      /**< 802.15.4 transport: 0 = off (records before it had 0 here), 11-26 */
+  uint8_t ieee_interval;     /**< 802.15.4 frame interval, units of CONFIG_IEEE_INTERVAL_UNIT_MS */
+  uint32_t beacon_time_ms;
+  uint32_t factory_wait_ms;
+  uint32_t crc;              /**< CRC32 (zlib) of all bytes above */
+} config_record_t;
+
+/**
+ * @brief Decoded configuration, RTC resident
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t beacon_time_ms;
+  uint32_t factory_wait_ms;
+  uint16_t adv_min_interval;
+  uint16_t adv_max_interval;
+  esp_power_level_t tx_power;
+  uint8_t ieee_channel;      /**< 0 = 802.15.4 transport off */
+  uint16_t ieee_interval_ms;
+  bool from_nvs;             /**< false: compiled defaults */
+} device_config_t;
+
+RTC_DATA_ATTR static device_config_t device_config; /**< Persists across deep sleep */
+RTC_DATA_ATTR static tx_link_t tx_link;             /**< TX power link estimate (tx_power.h), valid with device_config */
+
+
+/**
+ * @brief CRC of a record (everything except the crc field)
+ */
+static uint32_t configRecordCrc(const config_record_t* rec) {
+  return esp_rom_crc32_le(0, (const uint8_t*)rec, offsetof(config_record_t, crc));
+}
+
+/**
+ * @brief Check version, CRC and value ranges of a record
+ */
+static bool configRecordValid(const config_record_t* rec) {
+  if (rec->version != CONFIG_RECORD_VERSION || rec->crc != configRecordCrc(rec)) {
+    return false;
+  }
+  return rec->beacon_time_ms >= 1000 && rec->beacon_time_ms <= 60000
+         && rec->factory_wait_ms >= 5000 && rec->factory_wait_ms <= 120000
+         && rec->adv_min_interval >= 0x20 && rec->adv_min_interval <= rec->adv_max_interval
+         && rec->adv_max_interval <= 0x4000
+         && rec->tx_power <= ESP_PWR_LVL_P20
+         && (rec->ieee_channel == 0
+             || (rec->ieee_channel >= 11 && rec->ieee_channel <= 26 && rec->ieee_interval >= 2 && rec->ieee_interval <= 100));
+}
+
+/**
+ * @brief Fill the RTC cache with the compiled defaults
+ */
+static void configApplyDefaults(void) {
+  device_config.magic = CONFIG_RTC_MAGIC;
+  device_config.beacon_time_ms = CONFIG_DEFAULT_BEACON_TIME_MS;
+  device_config.factory_wait_ms = CONFIG_DEFAULT_FACTORY_WAIT_MS;
+  device_config.adv_min_interval = CONFIG_DEFAULT_ADV_MIN_INTERVAL;
+  device_config.adv_max_interval = CONFIG_DEFAULT_ADV_MAX_INTERVAL;
+  device_config.tx_power = CONFIG_DEFAULT_TX_POWER;
+  device_config.ieee_channel = CONFIG_DEFAULT_IEEE_CHANNEL;
+  device_config.ieee_interval_ms = CONFIG_DEFAULT_IEEE_INTERVAL_MS;
+  device_config.from_nvs = false;
+}
+
+/**
+ * @brief Decode a valid record into the RTC cache
+ */
+static void configApplyRecord(const config_record_t* rec) {
+  device_config.magic = CONFIG_RTC_MAGIC;
+  device_config.beacon_time_ms = rec->beacon_time_ms;
+  device_config.factory_wait_ms = rec->factory_wait_ms;
+  device_config.adv_min_interval = rec->adv_min_interval;
+  device_config.adv_max_interval = rec->adv_max_interval;
+  device_config.tx_power = static_cast<esp_power_level_t>(rec->tx_power);
+  device_config.ieee_channel = rec->ieee_channel;
+  device_config.ieee_interval_ms = rec->ieee_channel ? rec->ieee_interval * CONFIG_IEEE_INTERVAL_UNIT_MS : CONFIG_DEFAULT_IEEE_INTERVAL_MS;
+  device_config.from_nvs = true;
+}
+
+/**
+ * @brief Encode the current configuration as a record
+ */
+static void configToRecord(config_record_t* rec) {
+  memset(rec, 0, sizeof(config_record_t));
+  rec->version = CONFIG_RECORD_VERSION;
+  rec->tx_power = static_cast<uint8_t>(device_config.tx_power);
+  rec->adv_min_interval = device_config.adv_min_interval;
+  rec->adv_max_interval = device_config.adv_max_interval;
+  rec->ieee_channel = device_config.ieee_channel;
+  rec->ieee_interval = rec->ieee_channel ? (uint8_t)(device_config.ieee_interval_ms / CONFIG_IEEE_INTERVAL_UNIT_MS) : 0;
+  rec->beacon_time_ms = device_config.beacon_time_ms;
+  rec->factory_wait_ms = device_config.factory_wait_ms;
+  rec->crc = configRecordCrc(rec);
+}
+
+/**
+ * @brief Restore the TX power link estimate from NVS (none: configured level)
+ */
+static void configLoadLink(nvs_handle_t handle) {
+  uint8_t blob[sizeof(tx_link_t) + sizeof(uint32_t)];
+  size_t len = sizeof(blob);
+  uint32_t crc;
+  if (nvs_get_blob(handle, CONFIG_NVS_LINK_KEY, blob, &len) == ESP_OK && len == sizeof(blob)) {
+    memcpy(&crc, blob + sizeof(tx_link_t), sizeof(crc));
+    if (crc == esp_rom_crc32_le(0, blob, sizeof(tx_link_t))) {
+      memcpy(&tx_link, blob, sizeof(tx_link_t));
+      DEBUG_VERBOSE_F("\n[CONFIG] TX power link estimate loaded: %d dB path loss", tx_link.loss_db);
+    }
+  }
+}
+
+/**
+ * @brief Store the TX power link estimate in NVS (after a gateway report)
+ * @return bool true on success
+ */
+static bool configStoreLink(void) {
+  uint8_t blob[sizeof(tx_link_t) + sizeof(uint32_t)];
+  memcpy(blob, &tx_link, sizeof(tx_link_t));
+  const uint32_t crc = esp_rom_crc32_le(0, blob, sizeof(tx_link_t));
+  memcpy(blob + sizeof(tx_link_t), &crc, sizeof(crc));
+  nvs_handle_t handle;
+  if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_blob(handle, CONFIG_NVS_LINK_KEY, blob, sizeof(blob));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+
+/**
+ * @brief Make sure `device_config` (and `tx_link`) is valid
+ * @details Fast path (every deep sleep wake): RTC cache is valid -> nothing to do.
+ *          Otherwise the NVS record is decoded once, or the defaults are used.
+ */
+static void configLoad(void) {
+  if (device_config.magic == CONFIG_RTC_MAGIC) {
+    return;
+  }
+
+  config_record_t rec;
+  size_t len = sizeof(rec);
+  nvs_handle_t handle;
+  bool loaded = false;
+  memset(&tx_link, 0, sizeof(tx_link));
+  if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    loaded = nvs_get_blob(handle, CONFIG_NVS_KEY, &rec, &len) == ESP_OK && len == sizeof(rec);
+    configLoadLink(handle);
+    nvs_close(handle);
+  }
+
+  if (loaded && configRecordValid(&rec)) {
+    configApplyRecord(&rec);
+    DEBUG_VERBOSE("\n[CONFIG] Field configuration loaded from NVS");
+  } else {
+    configApplyDefaults();
+    DEBUG_VERBOSE_F("\n[CONFIG] %s, using compiled defaults", loaded ? "Invalid record" : "No record");
+  }
+}
+
+/**
+ * @brief Store a record in NVS and decode it into the RTC cache
+ * @return bool true on success
+ */
+static bool configStore(const config_record_t* rec) {
+  if (!configRecordValid(rec)) {
+    return false;
+  }
+  nvs_handle_t handle;
+  if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_blob(handle, CONFIG_NVS_KEY, rec, sizeof(config_record_t));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    return false;
+  }
+  configApplyRecord(rec);
+  return true;
+}
+
+/**
+ * @brief Has this unit left factory mode once (any image)?
+ * @note  One NVS read: boots that aren't deep sleep wakes only
+ */
+static bool configProvisioned(void) {
+  nvs_handle_t handle;
+  uint8_t value = 0;
+  if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    nvs_get_u8(handle, CONFIG_NVS_PROVISIONED_KEY, &value);
+    nvs_close(handle);
+  }
+  return value == 1;
+}
+
+/**
+ * @brief Record that the unit is provisioned (written once)
+ * @return bool true on success
+ */
+static bool configMarkProvisioned(void) {
+  if (configProvisioned()) {
+    return true;
+  }
+  nvs_handle_t handle;
+  if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_u8(handle, CONFIG_NVS_PROVISIONED_KEY, 1);
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+
+/**
+ * @brief Verify the authentication tag of a configuration write
+ * @param rec       Received record
+ * @param tag       Received tag (CONFIG_AUTH_TAG_LEN bytes)
+ * @param challenge Session challenge (CONFIG_CHALLENGE_LEN bytes)
+ * @return bool true if the tag matches
+ */
+static bool configVerifyAuth(const config_record_t* rec, const uint8_t* tag, const uint8_t* challenge) {
+  return maintAuthVerify(CONFIG_AUTH_DOMAIN, challenge, rec, sizeof(config_record_t), tag);
+}
+
+#endif  // FIELD_CONFIG_H
@@ -0,0 +1,284 @@
+/**
+ * @file    gateway_core.h
+ * @brief   Gateway advert filter, duplicate suppression and UART batch framing
+ * @details Portable C++ (no Arduino / ESP-IDF dependency) so the exact same code runs in
+ *          the gateway firmware and in the host simulator (host_tools/gateway/gateway_sim.cpp).
+ *
+ *          Filter: a button advert in any layout of adv_format.h is accepted:
+ *            - v3: v2 | press age
+ *            - v2: MANUFACTURER_ID | header | code | counter + health | device hint, no name
+ *            - v1: the 8-byte payload of broadcastBeacon() (rolling code u32 BE | timestamp
+ *              u32 BE) as manufacturer data, with the complete local name PRODUCT_NAME or
+ *              after MANUFACTURER_ID
+ *          Everything else is dropped right in the scan callback.
+ *          All decode to the same code and timestamp word. The rolling-code scheme and the
+ *          event type (SOS / cancel, button_events.h) are the timestamp's top nibble: records
+ *          carry it through unchanged, with the advert's version, device hint, health bits
+ *          and press age.
+ *
+ *          Dedup: one press is on air for seconds with the same code + timestamp. The first
+ *          sighting is forwarded, repeats are dropped for GW_DEDUP_WINDOW_MS, then one more
+ *          record goes out (the host sees the beacon is still on air). The press age changes
+ *          while the press is on air and is not part of the key.
+ *
+ *          Latency: a record says how long it waited in the gateway (reception to frame),
+ *          so the host places the reception on its own clock: frame arrival - wait. With
+ *          the v3 press age, that is the press itself: reception - age.
+ *
+ *          UART frame [little endian]:
+ *            sync 0xA5 0x5A | version u8 | count u8 | seq u16 | count x record[22] | crc32 (zlib)
+ *            record: mac[6] | addr_type u8 | rssi i8 | code u32 | timestamp u32
+ *                    | format u8 | hint u8 | health u8 | age u8 | wait_ms u16
+ *            crc32 covers version .. last record. count = 0 is a heartbeat.
+*/
+
+#ifndef GATEWAY_CORE_H
+#define GATEWAY_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "esp_rom_crc.h"
+#endif
+
+#include "adv_format.h"
+
+/* ============= Gateway Configuration ============= */
+#define GW_DEDUP_SLOTS 256          /**< Presses tracked at once, power of two */
+#define GW_DEDUP_PROBE 8            /**< Slots probed per lookup */
+#define GW_DEDUP_WINDOW_MS 2000     /**< Repeats of one press dropped for this long */
+#define GW_BATCH_MAX_RECORDS 16     /**< Records per frame */
+#define GW_BATCH_MAX_DELAY_MS 10    /**< Oldest record waits at most this long for a full frame */
+#define GW_HEARTBEAT_MS 1000        /**< Empty frame when nothing was sent for this long */
+
+/* ============= Frame Format ============= */
+#define GW_FRAME_SYNC0 0xA5
+#define GW_FRAME_SYNC1 0x5A
+#define GW_FRAME_VERSION 3          /**< 3: records carry the press age and their wait in the gateway */
+#define GW_FRAME_HEADER_LEN 6
+#define GW_FRAME_CRC_LEN 4
+#define GW_RECORD_LEN 22
+#define GW_FRAME_MAX_LEN (GW_FRAME_HEADER_LEN + GW_BATCH_MAX_RECORDS * GW_RECORD_LEN + GW_FRAME_CRC_LEN)
+
+/**
+ * @brief One forwarded button advert
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t mac[6];       /**< Advertiser address, as received */
+  uint8_t addr_type;
+  int8_t rssi;
+  uint32_t code;        /**< Rolling code */
+  uint32_t timestamp;   /**< Beacon timestamp */
+  uint8_t format;       /**< ADV_FORMAT_V1 / V2 / V3 */
+  uint8_t hint;         /**< Device hint (v2, v3), 0 = none */
+  uint8_t health;       /**< ADV_HEALTH_* bits (v2, v3) */
+  uint8_t age;          /**< Press age code (v3, advAgeMs()), ADV_AGE_NONE = not carried */
+  uint16_t wait_ms;     /**< Reception to frame in this gateway, set by GwBatcher::finish() */
+} gw_record_t;
+
+static_assert(sizeof(gw_record_t) == GW_RECORD_LEN, "gw_record_t is a wire format");
+
+
+/**
+ * @brief CRC-32 (zlib), ROM implementation on target
+ */
+static inline uint32_t gwCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+#if defined(ESP_PLATFORM)
+  return esp_rom_crc32_le(crc, data, len);
+#else
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+#endif
+}
+
+
+/* ============= Filter ============= */
+/**
+ * @brief Decode a button advert (adv_format.h, any version) from raw advert data (AD structures)
+ * @param adv Advertising data as reported by the controller
+ * @param len Its length
+ * @param manufacturer_id MANUFACTURER_ID
+ * @param name PRODUCT_NAME (complete local name of a v1 button)
+ * @param beacon_out Decoded beacon
+ * @return bool true if this is a button advert
+ */
+static inline bool gwParseAdvert(const uint8_t* adv, size_t len, uint16_t manufacturer_id, const char* name,
+                                 adv_beacon_t* beacon_out) {
+  return advDecode(adv, len, manufacturer_id, name, beacon_out);
+}
+
+/**
+ * @brief Build the record for an accepted advert
+ */
+static inline void gwMakeRecord(gw_record_t* rec, const uint8_t* mac, uint8_t addr_type, int8_t rssi,
+                                const adv_beacon_t& beacon) {
+  memcpy(rec->mac, mac, 6);
+  rec->addr_type = addr_type;
+  rec->rssi = rssi;
+  rec->code = beacon.code;
+  rec->timestamp = beacon.timestamp;
+  rec->format = beacon.format;
+  rec->hint = beacon.hint;
+  rec->health = beacon.health;
+  rec->age = beacon.age;
+  rec->wait_ms = 0;
+}
+
+
+/* ============= Dedup ============= */
+/**
+ * @brief Fixed size table of recently forwarded presses (no allocation)
+ */
+class GwDedup {
+public:
+  /**
+   * @brief true if the record should be forwarded (and remember it)
+   */
+  bool admit(const gw_record_t& rec, uint32_t now_ms) {
+    const uint32_t h = hash(rec);
+    Slot* victim = nullptr;
+    for (uint32_t i = 0; i < GW_DEDUP_PROBE; i++) {
+      Slot& s = slots[(h + i) & (GW_DEDUP_SLOTS - 1)];
+      if (s.used && s.code == rec.code && s.timestamp == rec.timestamp && memcmp(s.mac, rec.mac, 6) == 0) {
+        if (now_ms - s.forwarded_ms < GW_DEDUP_WINDOW_MS) {
+          dropped++;
+          return false;
+        }
+        s.forwarded_ms = now_ms;
+        return true;
+      }
+      // Free slot, else the slot forwarded longest ago
+      if (!victim || (victim->used && (!s.used || now_ms - s.forwarded_ms > now_ms - victim->forwarded_ms))) {
+        victim = &s;
+      }
+    }
+    memcpy(victim->mac, rec.mac, 6);
+    victim->code = rec.code;
+    victim->timestamp = rec.timestamp;
+    victim->forwarded_ms = now_ms;
+    victim->used = true;
+    return true;
+  }
+
+  uint32_t dropped = 0;  /**< Repeats suppressed */
+
+private:
+  struct Slot {
+    uint8_t mac[6];
+    bool used;
+    uint32_t code;
+    uint32_t timestamp;
+    uint32_t forwarded_ms;
+  };
+
+  static uint32_t hash(const gw_record_t& rec) {
+    uint32_t h = rec.code ^ (rec.timestamp * 0x9E3779B1u);
+    for (int i = 0; i < 6; i++) {
+      h = (h ^ rec.mac[i]) * 0x01000193u;
+    }
+    return h ^ (h >> 15);
+  }
+
+  Slot slots[GW_DEDUP_SLOTS] = {};
+};
+
+
+/* ============= Batching ============= */
+/**
+ * @brief Collects records into one CRC-framed UART packet
+ * @details add() until it returns true (frame full) or due() says the oldest record
+ *          waited long enough, then finish() and send the frame. finish() writes each
+ *          record's wait since its reception.
+ */
+class GwBatcher {
+public:
+  /**
+   * @brief Append a record received just now
+   * @return bool true if the frame is full now
+   */
+  bool add(const gw_record_t& rec, uint32_t now_ms) {
+    return add(rec, now_ms, now_ms);
+  }
+
+  /**
+   * @brief Append a record
+   * @param heard_ms When the advert was received (it may have waited in a queue since)
+   * @return bool true if the frame is full now
+   */
+  bool add(const gw_record_t& rec, uint32_t now_ms, uint32_t heard_ms) {
+    if (count == 0) {
+      first_ms = now_ms;
+    }
+    memcpy(frame + GW_FRAME_HEADER_LEN + count * GW_RECORD_LEN, &rec, GW_RECORD_LEN);
+    heard[count] = heard_ms;
+    count++;
+    return count == GW_BATCH_MAX_RECORDS;
+  }
+
+  /**
+   * @brief true if a frame should go out now (partial batch timed out, or heartbeat)
+   */
+  bool due(uint32_t now_ms) const {
+    if (count) {
+      return count == GW_BATCH_MAX_RECORDS || now_ms - first_ms >= GW_BATCH_MAX_DELAY_MS;
+    }
+    return now_ms - sent_ms >= GW_HEARTBEAT_MS;
+  }
+
+  /**
+   * @brief Close the frame and start a new batch
+   * @return size_t frame length; the frame stays valid until the next add()
+   */
+  size_t finish(uint32_t now_ms) {
+    frame[0] = GW_FRAME_SYNC0;
+    frame[1] = GW_FRAME_SYNC1;
+    frame[2] = GW_FRAME_VERSION;
+    frame[3] = count;
+    frame[4] = seq & 0xFF;
+    frame[5] = seq >> 8;
+    for (uint8_t i = 0; i < count; i++) {
+      const uint32_t wait = now_ms - heard[i];
+      uint8_t* w = frame + GW_FRAME_HEADER_LEN + i * GW_RECORD_LEN + offsetof(gw_record_t, wait_ms);
+      w[0] = (uint8_t)(wait > 0xFFFF ? 0xFF : wait);
+      w[1] = (uint8_t)(wait > 0xFFFF ? 0xFF : wait >> 8);
+    }
+    const size_t body = GW_FRAME_HEADER_LEN + count * GW_RECORD_LEN;
+    const uint32_t crc = gwCrc32(0, frame + 2, body - 2);
+    for (int i = 0; i < 4; i++) {
+      frame[body + i] = (uint8_t)(crc >> (8 * i));
+    }
+    seq++;
+    count = 0;
+    sent_ms = now_ms;
+    return body + GW_FRAME_CRC_LEN;
+  }
+
+  const uint8_t* data(void) const {
+    return frame;
+  }
+
+private:
+  uint8_t frame[GW_FRAME_MAX_LEN];
+  uint32_t heard[GW_BATCH_MAX_RECORDS];
+  uint8_t count = 0;
+  uint16_t seq = 0;
+  uint32_t first_ms = 0;
+  uint32_t sent_ms = 0;
+};
+
+#endif  // GATEWAY_CORE_H
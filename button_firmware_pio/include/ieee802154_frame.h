@@ -0,0 +1,173 @@
+/**
+ * @file    ieee802154_frame.h
+ * @brief   SOS payload as a raw IEEE 802.15.4 broadcast frame, and the transmit pacer
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): the button builds its frames
+ *          with it, the host stand-in receiver parses them with it
+ *          (host_tools/radio/ieee802154_rx.cpp, dual_radio_sim.cpp).
+ *
+ *          Frame [PSDU, little endian, 28 bytes]:
+ *            fcf u16 = 0xC841 | seq u8 | dest PAN 0xFFFF | dest 0xFFFF | src EUI-64 |
+ *            magic "SO" | version u8 | payload[8] | fcs u16
+ *            fcf: data frame, no ack, PAN ID compression, short dest, extended src, 2003.
+ *            src: custom MAC with FF FE in the middle (EUI-48 -> EUI-64), sent reversed.
+ *            payload: the 8 bytes of the BLE manufacturer data (code u32 BE | timestamp u32 BE),
+ *            same rolling code, same timestamp. fcs: CRC-16/KERMIT, appended by the radio.
+ *
+ *          Pacer: one frame every interval + 0-10ms random (like BLE advDelay, so buttons
+ *          don't stay in lockstep). A frame the radio couldn't send (channel busy, or BLE
+ *          won the radio arbitration) is retried on the next poll, at most
+ *          IEEE802154_MAX_RETRIES times.
+*/
+
+#ifndef IEEE802154_FRAME_H
+#define IEEE802154_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* ============= Frame Format ============= */
+#define IEEE802154_FCF 0xC841                /**< Data, PAN ID compression, short dest, extended src */
+#define IEEE802154_BROADCAST 0xFFFF          /**< Dest PAN and dest address */
+#define IEEE802154_MAGIC0 'S'
+#define IEEE802154_MAGIC1 'O'
+#define IEEE802154_SOS_VERSION 1
+#define IEEE802154_PAYLOAD_LEN 8             /**< = BLE manufacturer data */
+#define IEEE802154_MHR_LEN 15                /**< fcf + seq + dest PAN + dest + src EUI-64 */
+#define IEEE802154_FCS_LEN 2
+#define IEEE802154_PSDU_LEN (IEEE802154_MHR_LEN + 3 + IEEE802154_PAYLOAD_LEN + IEEE802154_FCS_LEN)
+#define IEEE802154_SHR_PHR_LEN 6             /**< Preamble 4 + SFD 1 + PHR 1 */
+#define IEEE802154_BYTE_US 32                /**< 250 kbit/s O-QPSK */
+#define IEEE802154_FRAME_US ((IEEE802154_SHR_PHR_LEN + IEEE802154_PSDU_LEN) * IEEE802154_BYTE_US)
+#define IEEE802154_CHANNEL_MIN 11
+#define IEEE802154_CHANNEL_MAX 26
+
+/* ============= Pacer Configuration ============= */
+#define IEEE802154_JITTER_MS 10              /**< Random 0-10ms added to every interval */
+#define IEEE802154_MAX_RETRIES 3             /**< Retries of one frame before waiting a full interval */
+
+
+/**
+ * @brief CRC-16/KERMIT, the 802.15.4 FCS (the radio computes it on transmit)
+ */
+static inline uint16_t ieee802154Fcs(const uint8_t* data, size_t len) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+/**
+ * @brief Build the frame for one SOS payload
+ * @param psdu   IEEE802154_PSDU_LEN bytes; the FCS bytes are filled in too (radios ignore them)
+ * @param seq    MAC sequence number
+ * @param mac    Custom MAC (6 bytes, as printed: most significant first)
+ * @param payload The 8-byte BLE payload
+ * @return size_t IEEE802154_PSDU_LEN
+ */
+static inline size_t ieee802154BuildFrame(uint8_t* psdu, uint8_t seq, const uint8_t* mac, const uint8_t* payload) {
+  psdu[0] = IEEE802154_FCF & 0xFF;
+  psdu[1] = IEEE802154_FCF >> 8;
+  psdu[2] = seq;
+  psdu[3] = psdu[4] = 0xFF;  // Dest PAN
+  psdu[5] = psdu[6] = 0xFF;  // Dest address
+  const uint8_t eui64[8] = { mac[0], mac[1], mac[2], 0xFF, 0xFE, mac[3], mac[4], mac[5] };
+  for (int i = 0; i < 8; i++) {
+    psdu[7 + i] = eui64[7 - i];  // Little endian on air
+  }
+  psdu[IEEE802154_MHR_LEN] = IEEE802154_MAGIC0;
+  psdu[IEEE802154_MHR_LEN + 1] = IEEE802154_MAGIC1;
+  psdu[IEEE802154_MHR_LEN + 2] = IEEE802154_SOS_VERSION;
+  memcpy(psdu + IEEE802154_MHR_LEN + 3, payload, IEEE802154_PAYLOAD_LEN);
+  const size_t body = IEEE802154_PSDU_LEN - IEEE802154_FCS_LEN;
+  const uint16_t fcs = ieee802154Fcs(psdu, body);
+  psdu[body] = fcs & 0xFF;
+  psdu[body + 1] = fcs >> 8;
+  return IEEE802154_PSDU_LEN;
+}
+
+/**
+ * @brief Recognize an SOS frame and extract sender and payload
+ * @param psdu     Frame as received
+ * @param len      Its length
+ * @param has_fcs  true if the last two bytes are the FCS (checked then)
+ * @param mac_out  6 bytes: custom MAC of the button
+ * @param seq_out  MAC sequence number (may be nullptr)
+ * @param payload_out 8 bytes
+ * @return bool true for a valid SOS frame
+ */
+static inline bool ieee802154ParseFrame(const uint8_t* psdu, size_t len, bool has_fcs, uint8_t* mac_out, uint8_t* seq_out,
+                                        uint8_t* payload_out) {
+  const size_t body = IEEE802154_PSDU_LEN - IEEE802154_FCS_LEN;
+  if (len != (has_fcs ? IEEE802154_PSDU_LEN : body)) {
+    return false;
+  }
+  if ((psdu[0] | (psdu[1] << 8)) != IEEE802154_FCF || (psdu[3] & psdu[4] & psdu[5] & psdu[6]) != 0xFF
+      || psdu[IEEE802154_MHR_LEN] != IEEE802154_MAGIC0 || psdu[IEEE802154_MHR_LEN + 1] != IEEE802154_MAGIC1
+      || psdu[IEEE802154_MHR_LEN + 2] != IEEE802154_SOS_VERSION) {
+    return false;
+  }
+  if (has_fcs && ieee802154Fcs(psdu, body) != (psdu[body] | (psdu[body + 1] << 8))) {
+    return false;
+  }
+  uint8_t eui64[8];
+  for (int i = 0; i < 8; i++) {
+    eui64[i] = psdu[14 - i];
+  }
+  if (eui64[3] != 0xFF || eui64[4] != 0xFE) {
+    return false;  // Not derived from a MAC-48: not a button
+  }
+  const uint8_t mac[6] = { eui64[0], eui64[1], eui64[2], eui64[5], eui64[6], eui64[7] };
+  memcpy(mac_out, mac, 6);
+  if (seq_out) {
+    *seq_out = psdu[2];
+  }
+  memcpy(payload_out, psdu + IEEE802154_MHR_LEN + 3, IEEE802154_PAYLOAD_LEN);
+  return true;
+}
+
+
+/* ============= Pacer ============= */
+/**
+ * @brief When the next 802.15.4 frame goes out, on the same clock as the BLE window
+ * @details begin() at advertising start, then due() / sent() from the beacon loop.
+ *          `random` arguments are any 32-bit random value (esp_random() on the button).
+ */
+class Ieee802154Pacer {
+public:
+  void begin(uint32_t now_ms, uint32_t interval_ms, uint32_t random) {
+    interval = interval_ms;
+    next_ms = now_ms + random % (IEEE802154_JITTER_MS + 1);  // First frame right away
+    retries = 0;
+  }
+
+  bool due(uint32_t now_ms) const {
+    return (int32_t)(now_ms - next_ms) >= 0;
+  }
+
+  /**
+   * @brief Result of the frame started after due()
+   * @param start_ms When that frame was started (the result comes in later)
+   * @param ok false: not on air (busy channel / lost arbitration)
+   */
+  void sent(uint32_t start_ms, bool ok, uint32_t random) {
+    if (!ok && retries < IEEE802154_MAX_RETRIES) {
+      retries++;
+      next_ms = start_ms;  // Next poll
+      return;
+    }
+    retries = 0;
+    next_ms = start_ms + interval + random % (IEEE802154_JITTER_MS + 1);
+  }
+
+private:
+  uint32_t interval = 0;
+  uint32_t next_ms = 0;
+  uint8_t retries = 0;
+};
+
+#endif  // IEEE802154_FRAME_H
@@ -0,0 +1,146 @@
+/**
+ * @file    maint_auth.h
+ * @brief   Challenge-response authentication of maintenance writes
+ * @details Every state changing write over the maintenance channel carries a tag:
+ *            tag = HMAC-SHA256(device key, domain | challenge[8] | payload)[0..15]
+ *          The device key is MAINT_AUTH_KEY_LEN random bytes of this unit, drawn in its
+ *          first factory session and kept in NVS (maintAuthProvision()). That session
+ *          sends it once to the line station (selftestEmitKey(), "HBKY" record), which
+ *          hands it to the backend; later sessions never send it again. It isn't derived
+ *          from anything: the fleet constants (PRODUCT_KEY, BATCH_ID, the firmware image)
+ *          and the seed don't give it, nor does the key of another unit.
+ *          A unit without a key (provisioned by an image before the keys, or NVS erased
+ *          without a factory session) refuses every authenticated write: it is re-flashed
+ *          and goes through the station again.
+ *          The domain string separates the uses (configuration, firmware update) so a
+ *          tag for one can never be accepted by the other.
+ *          The challenge is random, new for every session and renewed after every
+ *          authenticated write, so a captured write can't be replayed.
+ *
+ * @note  The key is a plain NVS blob: without flash encryption, whoever can read the flash
+ *        of a unit has that unit's key (and no other). Firmware updates are also signed
+ *        with the release key (ota_update.h), a device key alone can't install an image.
+*/
+
+#ifndef MAINT_AUTH_H
+#define MAINT_AUTH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <BLEDevice.h>
+#include <esp_random.h>
+#include <nvs.h>
+#include "mbedtls/md.h"
+
+#define MAINT_AUTH_TAG_LEN 16
+#define MAINT_AUTH_KEY_LEN 16
+#define MAINT_CHALLENGE_LEN 8
+#define MAINT_AUTH_MAX_PAYLOAD 96    /**< Largest authenticated payload (OTA header) */
+#define MAINT_AUTH_NVS_NAMESPACE "maint"
+#define MAINT_AUTH_NVS_KEY "key"
+
+/* ============= Session State ============= */
+static uint8_t maint_challenge[MAINT_CHALLENGE_LEN];
+static uint8_t maint_key[MAINT_AUTH_KEY_LEN];
+static bool maint_key_valid = false;
+static BLECharacteristic* maint_challenge_chr = nullptr;
+
+/**
+ * @brief Read the device key from NVS
+ * @return bool false if the unit has none
+ */
+static bool maintAuthLoadKey(uint8_t* key) {
+  nvs_handle_t handle;
+  if (nvs_open(MAINT_AUTH_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+  size_t len = MAINT_AUTH_KEY_LEN;
+  const esp_err_t err = nvs_get_blob(handle, MAINT_AUTH_NVS_KEY, key, &len);
+  nvs_close(handle);
+  return err == ESP_OK && len == MAINT_AUTH_KEY_LEN;
+}
+
+/**
+ * @brief Device key of a factory session: the stored one, or a new one if the unit has none
+ * @details Call with the radio on (factory session after the BLE start): esp_fill_random()
+ *          is a true random source then.
+ * @param key Out: the device key
+ * @return bool true only if the key was drawn and stored now: the one session that sends it
+ *         to the station
+ */
+static bool maintAuthProvision(uint8_t* key) {
+  if (maintAuthLoadKey(key)) {
+    return false;
+  }
+  esp_fill_random(key, MAINT_AUTH_KEY_LEN);
+  nvs_handle_t handle;
+  if (nvs_open(MAINT_AUTH_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_blob(handle, MAINT_AUTH_NVS_KEY, key, MAINT_AUTH_KEY_LEN);
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+
+/**
+ * @brief Draw a new challenge and publish it on the CHALLENGE characteristic
+ */
+static void maintRenewChallenge(void) {
+  esp_fill_random(maint_challenge, sizeof(maint_challenge));
+  if (maint_challenge_chr) {
+    maint_challenge_chr->setValue(maint_challenge, sizeof(maint_challenge));
+  }
+}
+
+/**
+ * @brief Start the authentication state of a maintenance session (loads the device key)
+ */
+static void maintAuthBegin(BLECharacteristic* challenge_chr) {
+  maint_challenge_chr = challenge_chr;
+  maint_key_valid = maintAuthLoadKey(maint_key);
+  if (!maint_key_valid) {
+    DEBUG_VERBOSE("\n[MAINT] No device key: authenticated writes are refused");
+  }
+  maintRenewChallenge();
+}
+
+
+/**
+ * @brief Verify the tag of an authenticated write
+ * @param domain    Domain separation string, e.g. "HBCFG"
+ * @param challenge Session challenge (MAINT_CHALLENGE_LEN bytes)
+ * @param payload   Authenticated bytes
+ * @param len       Payload length (<= MAINT_AUTH_MAX_PAYLOAD)
+ * @param tag       Received tag (MAINT_AUTH_TAG_LEN bytes)
+ * @return bool true if the tag matches the device key of this session (false without a key)
+ */
+static bool maintAuthVerify(const char* domain, const uint8_t* challenge, const void* payload, size_t len,
+                            const uint8_t* tag) {
+  const size_t domain_len = strlen(domain);
+  uint8_t msg[8 + MAINT_CHALLENGE_LEN + MAINT_AUTH_MAX_PAYLOAD];
+  if (!maint_key_valid || domain_len > 8 || len > MAINT_AUTH_MAX_PAYLOAD) {
+    return false;
+  }
+
+  memcpy(msg, domain, domain_len);
+  memcpy(msg + domain_len, challenge, MAINT_CHALLENGE_LEN);
+  memcpy(msg + domain_len + MAINT_CHALLENGE_LEN, payload, len);
+
+  uint8_t mac[32];
+  if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), maint_key, sizeof(maint_key),
+                      msg, domain_len + MAINT_CHALLENGE_LEN + len, mac) != 0) {
+    return false;
+  }
+
+  // Constant time compare
+  uint8_t diff = 0;
+  for (int i = 0; i < MAINT_AUTH_TAG_LEN; i++) {
+    diff |= mac[i] ^ tag[i];
+  }
+  return diff == 0;
+}
+
+#endif  // MAINT_AUTH_H
@@ -0,0 +1,384 @@
+/**
+ * @file    ota_delta.h
+ * @brief   Streaming decoder for compressed binary delta (HBD1) firmware updates
+ * @details Portable C++ (no Arduino / ESP-IDF dependency) so the exact same decoder
+ *          runs on target and in the host simulator (host_tools/ota_sim.cpp).
+ *
+ *          Image format: [header 76B][LZ compressed delta op stream]
+ *            header: "HBD1" | base_size u32 | base_sha256[32] | target_size u32 | target_sha256[32]
+ *
+ *          LZ layer (LZ4 block like, OTA_LZ_WINDOW byte window):
+ *            token = literal_len:4 | (match_len - 4):4, 15 = continued by extra bytes (255 = more)
+ *            literals[literal_len] | offset u16 LE | (extra match length bytes)
+ *            The stream may end right after the literals of a sequence.
+ *
+ *          Delta op stream (bsdiff like, `old` cursor starts at 0):
+ *            0x00 ADD   varint len, bytes[len]               -> new = bytes
+ *            0x01 DIFF  svarint seek, varint len, bytes[len] -> new = old[cursor + i] + bytes[i]
+ *            0x02 COPY  svarint seek, varint len             -> new = old[cursor + i]
+ *            (seek moves the old cursor before the op, the op advances it by len)
+ *
+ *          Data arrives in arbitrary chunks: feed() never needs more than it's given.
+*/
+
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* ============= Format Constants ============= */
+#define OTA_DELTA_MAGIC "HBD1"
+#define OTA_DELTA_HEADER_LEN 76
+#define OTA_LZ_WINDOW 16384     /**< Max LZ match offset, power of two */
+#define OTA_LZ_MIN_MATCH 4
+#define OTA_OUT_BUFFER 4096     /**< One flash sector per write */
+#define OTA_BASE_CACHE 256
+
+enum class DeltaOp : uint8_t {
+  ADD = 0x00,
+  DIFF = 0x01,
+  COPY = 0x02
+};
+
+enum class DeltaStatus : uint8_t {
+  OK = 0,
+  BAD_HEADER,
+  BAD_STREAM,     /**< Corrupt LZ or op stream */
+  BASE_READ,      /**< Old image read failed / out of range */
+  TARGET_WRITE,   /**< New image write failed */
+  TOO_LONG,       /**< More output than target_size */
+  INCOMPLETE      /**< finish() before target_size bytes were produced */
+};
+
+/**
+ * @brief Parsed image header
+ */
+struct DeltaHeader {
+  uint32_t base_size;
+  uint8_t base_sha256[32];
+  uint32_t target_size;
+  uint8_t target_sha256[32];
+
+  /**
+   * @brief Parse the fixed size header
+   * @return bool false if the magic doesn't match
+   */
+  bool parse(const uint8_t* data, size_t len) {
+    if (len < OTA_DELTA_HEADER_LEN || memcmp(data, OTA_DELTA_MAGIC, 4) != 0) {
+      return false;
+    }
+    base_size = readU32(data + 4);
+    memcpy(base_sha256, data + 8, 32);
+    target_size = readU32(data + 40);
+    memcpy(target_sha256, data + 44, 32);
+    return true;
+  }
+
+  static uint32_t readU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+};
+
+/**
+ * @brief Storage access used by the decoder (flash partitions on target, memory on host)
+ */
+class DeltaIo {
+public:
+  virtual ~DeltaIo() {}
+  /** Read `len` bytes of the running (base) image at `offset` */
+  virtual bool readBase(uint32_t offset, uint8_t* buf, size_t len) = 0;
+  /** Append `len` bytes to the new (target) image. Hashing happens here too */
+  virtual bool writeTarget(const uint8_t* buf, size_t len) = 0;
+};
+
+/**
+ * @brief Streaming LZ + delta decoder
+ */
+class DeltaDecoder {
+public:
+  /**
+   * @brief Start decoding an image described by `header`
+   */
+  void begin(DeltaIo* io, const DeltaHeader& header) {
+    this->io = io;
+    base_size = header.base_size;
+    target_size = header.target_size;
+    produced = 0;
+    status = DeltaStatus::OK;
+    lz_state = LzState::TOKEN;
+    lz_lit = lz_match = 0;
+    lz_offset = 0;
+    win_pos = 0;
+    op_state = OpState::OP;
+    op = DeltaOp::ADD;
+    varint = 0;
+    varint_shift = 0;
+    op_len = 0;
+    old_pos = 0;
+    out_len = 0;
+    cache_off = 0;
+    cache_len = 0;
+    memset(window, 0, sizeof(window));  // No bytes of the previous session behind the stream start
+  }
+
+  /**
+   * @brief Feed compressed bytes
+   * @return DeltaStatus OK while all is well, first error otherwise (sticky)
+   */
+  DeltaStatus feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len && status == DeltaStatus::OK; i++) {
+      lzByte(data[i]);
+    }
+    return status;
+  }
+
+  /**
+   * @brief Flush the output and check that the complete target was produced
+   */
+  DeltaStatus finish(void) {
+    if (status != DeltaStatus::OK) {
+      return status;
+    }
+    if (lz_state != LzState::TOKEN && lz_state != LzState::OFFSET_LO) {
+      return status = DeltaStatus::BAD_STREAM;
+    }
+    if (op_state != OpState::OP) {
+      return status = DeltaStatus::BAD_STREAM;
+    }
+    flushOut();
+    if (status == DeltaStatus::OK && produced != target_size) {
+      status = DeltaStatus::INCOMPLETE;
+    }
+    return status;
+  }
+
+  uint32_t bytesProduced(void) const {
+    return produced;
+  }
+
+private:
+  enum class LzState : uint8_t { TOKEN, LIT_EXT, LITERALS, OFFSET_LO, OFFSET_HI, MATCH_EXT };
+  enum class OpState : uint8_t { OP, SEEK, LEN, DATA };
+
+  /* ---------- LZ layer ---------- */
+  void lzByte(uint8_t b) {
+    switch (lz_state) {
+      case LzState::TOKEN:
+        lz_lit = b >> 4;
+        lz_match = (b & 0x0F) + OTA_LZ_MIN_MATCH;
+        if (lz_lit == 15) {
+          lz_state = LzState::LIT_EXT;
+        } else {
+          lz_state = lz_lit ? LzState::LITERALS : LzState::OFFSET_LO;
+        }
+        break;
+      case LzState::LIT_EXT:
+        lz_lit += b;
+        if (b != 255) {
+          lz_state = LzState::LITERALS;
+        }
+        break;
+      case LzState::LITERALS:
+        lzOut(b);
+        if (--lz_lit == 0) {
+          lz_state = LzState::OFFSET_LO;
+        }
+        break;
+      case LzState::OFFSET_LO:
+        lz_offset = b;
+        lz_state = LzState::OFFSET_HI;
+        break;
+      case LzState::OFFSET_HI:
+        lz_offset |= (uint16_t)b << 8;
+        if (lz_offset == 0 || lz_offset > OTA_LZ_WINDOW) {
+          status = DeltaStatus::BAD_STREAM;
+          return;
+        }
+        if (lz_match == 15 + OTA_LZ_MIN_MATCH) {
+          lz_state = LzState::MATCH_EXT;
+        } else {
+          lzCopyMatch();
+        }
+        break;
+      case LzState::MATCH_EXT:
+        lz_match += b;
+        if (b != 255) {
+          lzCopyMatch();
+        }
+        break;
+    }
+  }
+
+  void lzCopyMatch(void) {
+    for (uint32_t n = 0; n < lz_match && status == DeltaStatus::OK; n++) {
+      lzOut(window[(win_pos - lz_offset) & (OTA_LZ_WINDOW - 1)]);
+    }
+    lz_state = LzState::TOKEN;
+  }
+
+  void lzOut(uint8_t b) {
+    window[win_pos] = b;
+    win_pos = (win_pos + 1) & (OTA_LZ_WINDOW - 1);
+    opByte(b);
+  }
+
+  /* ---------- Delta op layer ---------- */
+  void opByte(uint8_t b) {
+    switch (op_state) {
+      case OpState::OP:
+        if (b > static_cast<uint8_t>(DeltaOp::COPY)) {
+          status = DeltaStatus::BAD_STREAM;
+          return;
+        }
+        op = static_cast<DeltaOp>(b);
+        varint = 0;
+        varint_shift = 0;
+        op_state = (op == DeltaOp::ADD) ? OpState::LEN : OpState::SEEK;
+        break;
+      case OpState::SEEK:
+        if (!varintByte(b)) {
+          break;
+        }
+        old_pos += (int32_t)((varint >> 1) ^ (~(varint & 1) + 1));  // zigzag
+        varint = 0;
+        varint_shift = 0;
+        op_state = OpState::LEN;
+        break;
+      case OpState::LEN:
+        if (!varintByte(b)) {
+          break;
+        }
+        op_len = varint;
+        if ((uint64_t)produced + out_len + op_len > target_size) {
+          status = DeltaStatus::TOO_LONG;
+          return;
+        }
+        if (op == DeltaOp::COPY) {
+          copyBase(op_len);
+          op_state = OpState::OP;
+        } else {
+          op_state = op_len ? OpState::DATA : OpState::OP;
+        }
+        break;
+      case OpState::DATA:
+        if (op == DeltaOp::DIFF) {
+          uint8_t old_byte;
+          if (!baseByte(old_pos++, &old_byte)) {
+            return;
+          }
+          b = (uint8_t)(b + old_byte);
+        }
+        putOut(b);
+        if (--op_len == 0) {
+          op_state = OpState::OP;
+        }
+        break;
+    }
+  }
+
+  /** @return true when the varint is complete */
+  bool varintByte(uint8_t b) {
+    if (varint_shift > 28) {
+      status = DeltaStatus::BAD_STREAM;
+      return false;
+    }
+    varint |= (uint32_t)(b & 0x7F) << varint_shift;
+    varint_shift += 7;
+    return (b & 0x80) == 0;
+  }
+
+  /* ---------- Base (old image) access ---------- */
+  bool baseByte(uint32_t offset, uint8_t* out) {
+    if (offset >= base_size) {
+      status = DeltaStatus::BASE_READ;
+      return false;
+    }
+    if (offset < cache_off || offset >= cache_off + cache_len) {
+      cache_off = offset;
+      cache_len = base_size - offset < OTA_BASE_CACHE ? base_size - offset : OTA_BASE_CACHE;
+      if (!io->readBase(cache_off, cache, cache_len)) {
+        cache_len = 0;
+        status = DeltaStatus::BASE_READ;
+        return false;
+      }
+    }
+    *out = cache[offset - cache_off];
+    return true;
+  }
+
+  void copyBase(uint32_t len) {
+    if ((uint64_t)old_pos + len > base_size) {
+      status = DeltaStatus::BASE_READ;
+      return;
+    }
+    while (len > 0 && status == DeltaStatus::OK) {
+      const uint32_t chunk = len < OTA_BASE_CACHE ? len : OTA_BASE_CACHE;
+      if (!io->readBase(old_pos, cache, chunk)) {
+        status = DeltaStatus::BASE_READ;
+        return;
+      }
+      cache_off = old_pos;
+      cache_len = chunk;
+      for (uint32_t i = 0; i < chunk && status == DeltaStatus::OK; i++) {
+        putOut(cache[i]);
+      }
+      old_pos += chunk;
+      len -= chunk;
+    }
+  }
+
+  /* ---------- Target (new image) output ---------- */
+  void putOut(uint8_t b) {
+    // The LEN check covers every op, this one the output itself: never past the header's size
+    if ((uint64_t)produced + out_len >= target_size) {
+      status = DeltaStatus::TOO_LONG;
+      return;
+    }
+    out[out_len++] = b;
+    if (out_len == OTA_OUT_BUFFER) {
+      flushOut();
+    }
+  }
+
+  void flushOut(void) {
+    if (out_len == 0) {
+      return;
+    }
+    if (!io->writeTarget(out, out_len)) {
+      status = DeltaStatus::TARGET_WRITE;
+    }
+    produced += out_len;
+    out_len = 0;
+  }
+
+  DeltaIo* io = nullptr;
+  uint32_t base_size = 0;
+  uint32_t target_size = 0;
+  uint32_t produced = 0;
+  DeltaStatus status = DeltaStatus::OK;
+
+  LzState lz_state = LzState::TOKEN;
+  uint32_t lz_lit = 0;
+  uint32_t lz_match = 0;
+  uint16_t lz_offset = 0;
+  uint32_t win_pos = 0;
+  uint8_t window[OTA_LZ_WINDOW];
+
+  OpState op_state = OpState::OP;
+  DeltaOp op = DeltaOp::ADD;
+  uint32_t varint = 0;
+  uint8_t varint_shift = 0;
+  uint32_t op_len = 0;
+  uint32_t old_pos = 0;
+
+  uint8_t out[OTA_OUT_BUFFER];
+  uint32_t out_len = 0;
+
+  uint8_t cache[OTA_BASE_CACHE];
+  uint32_t cache_off = 0;
+  uint32_t cache_len = 0;
+};
+
+#endif  // OTA_DELTA_H
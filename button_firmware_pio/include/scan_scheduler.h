@@ -0,0 +1,331 @@
+/**
+ * @file    scan_scheduler.h
+ * @brief   Scan window / interval picked for the button's advertising pattern
+ * @details Portable C++ (no Arduino / ESP-IDF dependency), also run by the host
+ *          simulator (host_tools/gateway/scan_sim.cpp).
+ *
+ *          A button press is on air for beacon_ms, one advertising event every
+ *          adv_interval_ms + advDelay (0-10ms), each event on all three channels. The
+ *          scanner listens for `window` every `interval`, on one channel per interval.
+ *          scanOptimize() picks the lowest duty (window / interval) that still detects a
+ *          press with target.detect_prob, and within target.latency_ms with
+ *          target.latency_quantile.
+ *
+ *          Model: m = (window - PDU) / event spacing advertising events land in a window.
+ *          Each is received with link_prob, so a window catches the press with
+ *          q = 1 - (1 - link_prob)^m (fractional m interpolated). The first window starts
+ *          at a uniform phase after the press, and windows are independent (advDelay
+ *          decorrelates them).
+ *
+ *          Adaptation: the first sighting of a press switches the scanner to full duty and
+ *          tracks that press. The gaps between its adverts give the advertising interval,
+ *          and first to last sighting gives a lower bound of the beacon time. The profile is
+ *          the slowest interval and the longest beacon of the last SCAN_PROFILE_HISTORY presses.
+ *          When it moves by more than SCAN_PROFILE_TOLERANCE, the parameters are optimized again.
+*/
+
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <stdint.h>
+#include <string.h>
+#include "gateway_core.h"
+
+/* ============= Scheduler Configuration ============= */
+#define SCAN_UNIT_US 625              /**< BLE scan interval / window unit */
+#define SCAN_MIN_UNITS 0x0010         /**< 10ms, shortest interval / window considered */
+#define SCAN_MAX_UNITS 0x4000         /**< 10.24s, longest scan interval allowed */
+#define SCAN_TRACK_UNITS 0x0050       /**< 50ms interval = window while tracking a press */
+#define SCAN_ADV_DELAY_MS 10.0f       /**< advDelay: 0-10ms random per advertising event */
+#define SCAN_PDU_MS 0.376f            /**< 31 byte legacy ADV_IND at 1M PHY */
+#define SCAN_PHASES 16                /**< Press start phases averaged by the latency model */
+#define SCAN_TRACK_MAX_GAPS 64
+#define SCAN_TRACK_MIN_GAPS 8         /**< Fewer: the tracked press doesn't update the profile */
+#define SCAN_TRACK_IDLE_MS 1000       /**< Tracking ends this long after the last sighting */
+#define SCAN_TRACK_MAX_MS 70000       /**< ... or this long after it started */
+#define SCAN_PROFILE_HISTORY 8
+#define SCAN_PROFILE_TOLERANCE 0.1f   /**< Relative change that triggers a new optimization */
+
+/**
+ * @brief Advertising pattern of one press
+ */
+struct ScanProfile {
+  float adv_interval_ms;   /**< Advertising interval (without advDelay) */
+  float beacon_ms;         /**< Time a press stays on air */
+};
+
+/**
+ * @brief What the scanner has to achieve
+ */
+struct ScanTarget {
+  float detect_prob = 0.999f;     /**< Press detected at all */
+  float latency_ms = 1000.0f;     /**< ... and within this time */
+  float latency_quantile = 0.95f; /**< ... for this share of presses */
+  float link_prob = 0.7f;         /**< One advertising event received (range, collisions) */
+};
+
+/**
+ * @brief Chosen parameters and what the model predicts for them
+ */
+struct ScanParams {
+  uint16_t interval;       /**< SCAN_UNIT_US units */
+  uint16_t window;
+  float duty;
+  float detect_prob;
+  float latency_prob;      /**< P(detected within target.latency_ms) */
+};
+
+
+/* ============= Model ============= */
+/**
+ * @brief base^n for integer n
+ */
+static inline float scanPowi(float base, uint32_t n) {
+  float result = 1.0f;
+  while (n) {
+    if (n & 1) {
+      result *= base;
+    }
+    base *= base;
+    n >>= 1;
+  }
+  return result;
+}
+
+/**
+ * @brief Probability that one scan window misses the press
+ */
+static inline float scanWindowMiss(const ScanProfile& profile, float link_prob, float window_ms) {
+  const float spacing = profile.adv_interval_ms + SCAN_ADV_DELAY_MS / 2;
+  const float m = (window_ms > SCAN_PDU_MS ? window_ms - SCAN_PDU_MS : 0.0f) / spacing;
+  const uint32_t k = (uint32_t)m;
+  const float frac = m - (float)k;
+  const float miss = scanPowi(1.0f - link_prob, k);
+  return (1.0f - frac) * miss + frac * miss * (1.0f - link_prob);
+}
+
+/**
+ * @brief P(press detected within x_ms of its start), averaged over the press start phase
+ */
+static float scanDetectBy(const ScanProfile& profile, float link_prob, float interval_ms, float window_ms, float x_ms) {
+  const float miss = scanWindowMiss(profile, link_prob, window_ms);
+  const float limit = x_ms < profile.beacon_ms ? x_ms : profile.beacon_ms;
+  float sum = 0.0f;
+  for (int i = 0; i < SCAN_PHASES; i++) {
+    const float phase = ((float)i + 0.5f) * interval_ms / SCAN_PHASES;  // Press start to first window
+    if (phase + window_ms <= limit) {
+      const uint32_t windows = (uint32_t)((limit - phase - window_ms) / interval_ms) + 1;
+      sum += 1.0f - scanPowi(miss, windows);
+    }
+  }
+  return sum / SCAN_PHASES;
+}
+
+/**
+ * @brief Evaluate one interval / window pair (SCAN_UNIT_US units)
+ */
+static inline ScanParams scanEvaluate(const ScanProfile& profile, const ScanTarget& target, uint16_t interval, uint16_t window) {
+  const float interval_ms = interval * (SCAN_UNIT_US / 1000.0f);
+  const float window_ms = window * (SCAN_UNIT_US / 1000.0f);
+  ScanParams p;
+  p.interval = interval;
+  p.window = window;
+  p.duty = (float)window / (float)interval;
+  p.detect_prob = scanDetectBy(profile, target.link_prob, interval_ms, window_ms, profile.beacon_ms);
+  p.latency_prob = scanDetectBy(profile, target.link_prob, interval_ms, window_ms, target.latency_ms);
+  return p;
+}
+
+static inline bool scanMeets(const ScanParams& p, const ScanTarget& target) {
+  return p.detect_prob >= target.detect_prob && p.latency_prob >= target.latency_quantile;
+}
+
+/**
+ * @brief Lowest duty interval / window meeting the target
+ * @return bool false if not even continuous scanning meets it (out = continuous scanning)
+ */
+static bool scanOptimize(const ScanProfile& profile, const ScanTarget& target, ScanParams* out) {
+  bool found = false;
+  // Intervals in ~6% steps; per interval the smallest window is found by bisection
+  // (detection only improves with a longer window)
+  for (uint32_t interval = SCAN_MIN_UNITS; interval <= SCAN_MAX_UNITS; interval += interval / 16 + 1) {
+    if (!scanMeets(scanEvaluate(profile, target, (uint16_t)interval, (uint16_t)interval), target)) {
+      continue;
+    }
+    uint32_t lo = SCAN_MIN_UNITS, hi = interval;
+    while (lo < hi) {
+      const uint32_t mid = (lo + hi) / 2;
+      if (scanMeets(scanEvaluate(profile, target, (uint16_t)interval, (uint16_t)mid), target)) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    const ScanParams p = scanEvaluate(profile, target, (uint16_t)interval, (uint16_t)hi);
+    if (!found || p.duty < out->duty) {
+      *out = p;
+      found = true;
+    }
+  }
+  if (!found) {
+    *out = scanEvaluate(profile, target, SCAN_TRACK_UNITS, SCAN_TRACK_UNITS);
+  }
+  return found;
+}
+
+
+/* ============= Scheduler ============= */
+enum class ScanEvent : uint8_t {
+  NONE = 0,
+  TRACK_START,   /**< Switch to full duty (trackParams()) */
+  TRACK_END      /**< Tracking done: call update() with the observation */
+};
+
+/**
+ * @brief What tracking one press showed
+ */
+struct ScanObservation {
+  uint16_t gaps;
+  float gap_ms[SCAN_TRACK_MAX_GAPS];  /**< Time between consecutive sightings */
+  float on_air_ms;                    /**< First to last sighting */
+};
+
+/**
+ * @brief Picks the scan parameters and keeps them matched to the buttons
+ * @details onSighting() for every button advert (before dedup), poll() from the main loop.
+ *          On the gateway, onSighting() and poll() run on different tasks: guard both with
+ *          the same lock. update() is the slow part (optimization) and needs no lock.
+ */
+class ScanScheduler {
+public:
+  /**
+   * @brief Start from the configured button profile
+   */
+  void begin(const ScanProfile& initial, const ScanTarget& scan_target) {
+    target = scan_target;
+    current = initial;
+    history_len = 0;
+    tracking = false;
+    scanOptimize(current, target, &optimized);
+  }
+
+  /**
+   * @brief One accepted button advert
+   */
+  void onSighting(const gw_record_t& rec, uint32_t now_ms) {
+    if (!tracking) {
+      tracking = true;
+      started = true;
+      memcpy(mac, rec.mac, 6);
+      code = rec.code;
+      timestamp = rec.timestamp;
+      first_ms = last_ms = now_ms;
+      obs.gaps = 0;
+      return;
+    }
+    if (rec.code != code || rec.timestamp != timestamp || memcmp(rec.mac, mac, 6) != 0) {
+      return;  // Another press: only one is tracked at a time
+    }
+    if (obs.gaps < SCAN_TRACK_MAX_GAPS) {
+      obs.gap_ms[obs.gaps++] = (float)(now_ms - last_ms);
+    }
+    last_ms = now_ms;
+  }
+
+  /**
+   * @brief Tracking state changes; fills `out` on TRACK_END
+   */
+  ScanEvent poll(uint32_t now_ms, ScanObservation* out) {
+    if (started) {
+      started = false;
+      return ScanEvent::TRACK_START;
+    }
+    if (tracking && (now_ms - last_ms > SCAN_TRACK_IDLE_MS || now_ms - first_ms > SCAN_TRACK_MAX_MS)) {
+      tracking = false;
+      obs.on_air_ms = (float)(last_ms - first_ms);
+      *out = obs;
+      return ScanEvent::TRACK_END;
+    }
+    return ScanEvent::NONE;
+  }
+
+  /**
+   * @brief Fold a tracked press into the profile, optimize again if it moved
+   * @return const ScanParams& parameters to scan with from now on
+   */
+  const ScanParams& update(ScanObservation& o) {
+    if (o.gaps < SCAN_TRACK_MIN_GAPS) {
+      return optimized;
+    }
+    // Sort (insertion, at most 64): the short gaps are single advertising events,
+    // longer ones span missed events
+    for (uint16_t i = 1; i < o.gaps; i++) {
+      const float v = o.gap_ms[i];
+      int j = i - 1;
+      while (j >= 0 && o.gap_ms[j] > v) {
+        o.gap_ms[j + 1] = o.gap_ms[j];
+        j--;
+      }
+      o.gap_ms[j + 1] = v;
+    }
+    const float shortest = o.gap_ms[o.gaps / 10];
+    uint16_t single = 0;
+    while (single < o.gaps && o.gap_ms[single] < 1.5f * shortest) {
+      single++;
+    }
+    const float spacing = o.gap_ms[single / 2];
+
+    ScanProfile& h = history[history_len % SCAN_PROFILE_HISTORY];
+    h.adv_interval_ms = spacing > SCAN_ADV_DELAY_MS / 2 ? spacing - SCAN_ADV_DELAY_MS / 2 : spacing;
+    h.beacon_ms = o.on_air_ms + spacing;
+    history_len++;
+
+    // Slowest interval (fewest events per window) and longest beacon (every observation
+    // is a lower bound) over the recent presses
+    ScanProfile measured = {};
+    for (uint32_t i = 0; i < history_len && i < SCAN_PROFILE_HISTORY; i++) {
+      measured.adv_interval_ms = history[i].adv_interval_ms > measured.adv_interval_ms ? history[i].adv_interval_ms : measured.adv_interval_ms;
+      measured.beacon_ms = history[i].beacon_ms > measured.beacon_ms ? history[i].beacon_ms : measured.beacon_ms;
+    }
+    if (relChange(measured.adv_interval_ms, current.adv_interval_ms) > SCAN_PROFILE_TOLERANCE
+        || relChange(measured.beacon_ms, current.beacon_ms) > SCAN_PROFILE_TOLERANCE) {
+      current = measured;
+      scanOptimize(current, target, &optimized);
+      reoptimized++;
+    }
+    return optimized;
+  }
+
+  const ScanParams& params(void) const {
+    return optimized;
+  }
+
+  const ScanProfile& profile(void) const {
+    return current;
+  }
+
+  uint32_t reoptimized = 0;   /**< Profile changes acted on */
+
+private:
+  static float relChange(float a, float b) {
+    const float d = a > b ? a - b : b - a;
+    return b > 0 ? d / b : 1.0f;
+  }
+
+  ScanTarget target;
+  ScanProfile current = {};
+  ScanParams optimized = {};
+  ScanProfile history[SCAN_PROFILE_HISTORY] = {};
+  uint32_t history_len = 0;
+
+  bool tracking = false;
+  bool started = false;
+  uint8_t mac[6] = {};
+  uint32_t code = 0;
+  uint32_t timestamp = 0;
+  uint32_t first_ms = 0;
+  uint32_t last_ms = 0;
+  ScanObservation obs = {};
+};
+
+#endif  // SCAN_SCHEDULER_H
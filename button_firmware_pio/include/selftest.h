@@ -0,0 +1,177 @@
+/**
+ * @file    selftest.h
+ * @brief   Factory self-test result record
+ * @details The factory session runs a fixed sequence of steps (see runSelfTest() in the
+ *          sketch). Each step is timed and the whole run is sent as ONE binary record
+ *          over UART0, whatever DEBUG_LEVEL is, so line stations don't depend on log text.
+ *
+ *          Record [16 + 12 * SELFTEST_STEP_COUNT + 4 = 104 bytes, little endian]:
+ *            magic "HBST" | version u8 | step_count u8 | pass_mask u16 | mac[6] | reserved u16
+ *            step_count x { id u8 | result u8 | reserved u16 | duration_us u32 | value u32 }
+ *            crc32 (zlib) of everything above
+ *          The station tool (factory_station/station.py) finds records in the byte stream by
+ *          the magic and checks the CRC, so debug text around them doesn't matter.
+ *
+ *          Device key record [32 bytes], only in the session that drew the key (maint_auth.h),
+ *          right before the result record:
+ *            magic "HBKY" | version u8 | reserved u8 | mac[6] | key[16] | crc32 (zlib)
+*/
+
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include <stdint.h>
+#include <string.h>
+#include <esp_timer.h>
+#include "esp_rom_crc.h"
+#include "mbedtls/sha256.h"
+
+/* ============= Self-test Configuration ============= */
+#define SELFTEST_MAGIC 0x54534248      /**< "HBST" */
+#define SELFTEST_VERSION 1
+#define SELFTEST_KEY_MAGIC 0x594B4248  /**< "HBKY" */
+#define SELFTEST_KEY_VERSION 1
+#define SELFTEST_ADV_BURST_MS 200      /**< Length of the test advertising burst */
+#define SELFTEST_BUTTON_RELEASE_MS 3000 /**< Wait for the release when factory mode was entered by holding the button */
+#define SELFTEST_HOLD_TEST_PIN GPIO_NUM_2 /**< Unused pin for the GPIO hold check */
+
+/**
+ * @brief Steps, in order of execution
+ */
+enum class SelfTestStep : uint8_t {
+  EFUSE_MAC = 0,  /**< value: 1 if the custom MAC is programmed */
+  SEED,           /**< value: first 4 bytes of SHA-256("HBSEED" | seed), never the seed itself */
+  BLE_INIT,       /**< duration: controller + host init of this boot, value: TX power level */
+  ADV_BURST,      /**< value: advertised ms */
+  BUTTON_LINE,    /**< value: line level (1 = released) */
+  GPIO_HOLD,      /**< value: bit 0 level while held (0 expected), bit 1 level once released (1 expected) */
+  SLEEP_ENTRY,    /**< duration: deep sleep wakeup configuration */
+  COUNT
+};
+
+#define SELFTEST_STEP_COUNT static_cast<int>(SelfTestStep::COUNT)
+
+enum class SelfTestResult : uint8_t {
+  NOT_RUN = 0,
+  PASS,
+  FAIL
+};
+
+typedef struct __attribute__((packed)) {
+  SelfTestStep id;
+  SelfTestResult result;
+  uint16_t reserved;
+  uint32_t duration_us;
+  uint32_t value;
+} selftest_step_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t step_count;
+  uint16_t pass_mask;     /**< Bit n set: step n passed */
+  uint8_t mac[6];
+  uint16_t reserved;
+  selftest_step_t steps[SELFTEST_STEP_COUNT];
+  uint32_t crc;
+} selftest_record_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint8_t mac[6];
+  uint8_t key[16];        /**< MAINT_AUTH_KEY_LEN */
+  uint32_t crc;
+} selftest_key_record_t;
+
+static selftest_record_t selftest_record;
+static uint32_t selftest_step_start = 0;
+
+
+/**
+ * @brief Start a new run
+ */
+static void selftestBegin(const uint8_t* mac) {
+  memset(&selftest_record, 0, sizeof(selftest_record));
+  selftest_record.magic = SELFTEST_MAGIC;
+  selftest_record.version = SELFTEST_VERSION;
+  selftest_record.step_count = SELFTEST_STEP_COUNT;
+  memcpy(selftest_record.mac, mac, 6);
+  for (int i = 0; i < SELFTEST_STEP_COUNT; i++) {
+    selftest_record.steps[i].id = static_cast<SelfTestStep>(i);
+  }
+}
+
+/**
+ * @brief Start timing a step
+ */
+static inline void selftestStart(void) {
+  selftest_step_start = (uint32_t)esp_timer_get_time();
+}
+
+/**
+ * @brief Record a step result; duration_us = 0 takes the time since selftestStart()
+ */
+static void selftestRecord(const SelfTestStep step, const bool pass, const uint32_t value, uint32_t duration_us = 0) {
+  if (duration_us == 0) {
+    duration_us = (uint32_t)esp_timer_get_time() - selftest_step_start;
+  }
+  selftest_step_t& s = selftest_record.steps[static_cast<int>(step)];
+  s.result = pass ? SelfTestResult::PASS : SelfTestResult::FAIL;
+  s.duration_us = duration_us;
+  s.value = value;
+  if (pass) {
+    selftest_record.pass_mask |= 1u << static_cast<int>(step);
+  }
+  DEBUG_VERBOSE_F("\n[SELFTEST] step %d %s %luus value=0x%08lX", static_cast<int>(step), pass ? "PASS" : "FAIL", duration_us, value);
+}
+
+/**
+ * @brief true if every step passed
+ */
+static bool selftestPassed(void) {
+  return selftest_record.pass_mask == (1u << SELFTEST_STEP_COUNT) - 1;
+}
+
+/**
+ * @brief Send a record over UART0
+ * @details Opens the UART itself when debug output is off (serial pins are parked low
+ *          then) and parks the pins again afterwards.
+ */
+static void selftestWrite(const void* record, const size_t len) {
+#if DEBUG_LEVEL == DEBUG_LEVEL_NONE
+  Serial.begin(115200);
+  delay(10);
+#endif
+  Serial.write((const uint8_t*)record, len);
+  Serial.flush();
+#if DEBUG_LEVEL == DEBUG_LEVEL_NONE
+  Serial.end();
+  DEBUG_INIT();  // Park the serial pins again
+#endif
+}
+
+/**
+ * @brief Send the result record over UART0
+ */
+static void selftestEmit(void) {
+  selftest_record.crc = esp_rom_crc32_le(0, (const uint8_t*)&selftest_record, offsetof(selftest_record_t, crc));
+  selftestWrite(&selftest_record, sizeof(selftest_record));
+}
+
+/**
+ * @brief Send the device key record over UART0 (the session that drew the key only)
+ */
+static void selftestEmitKey(const uint8_t* mac, const uint8_t* key) {
+  selftest_key_record_t record = {};
+  record.magic = SELFTEST_KEY_MAGIC;
+  record.version = SELFTEST_KEY_VERSION;
+  memcpy(record.mac, mac, sizeof(record.mac));
+  memcpy(record.key, key, sizeof(record.key));
+  record.crc = esp_rom_crc32_le(0, (const uint8_t*)&record, offsetof(selftest_key_record_t, crc));
+  selftestWrite(&record, sizeof(record));
+  memset(&record, 0, sizeof(record));
+}
+
+#endif  // SELFTEST_H
@@ -0,0 +1,156 @@
+/**
+ * @file    sos_802154.h
+ * @brief   Optional IEEE 802.15.4 SOS transport, interleaved with the BLE advertising window
+ * @details Sites with Thread or Zigbee infrastructure have 802.15.4 receivers everywhere.
+ *          When `device_config.ieee_channel` is set (field configuration), the button also
+ *          sends its SOS payload as raw 802.15.4 broadcast frames on that channel, for as
+ *          long as it advertises. Same payload bytes as the BLE advert: one rolling code
+ *          generation, two radios. Frame format and pacing: ieee802154_frame.h.
+ *
+ *          Uses the raw radio driver (esp_ieee802154), no Zigbee or Thread stack:
+ *          CONFIG_ZB_ENABLED=0 in platformio.ini stays as it is. BLE and 802.15.4 share the
+ *          one radio of the ESP32-H2; the coexistence arbiter gives BLE advertising events
+ *          priority, a frame that loses (or finds the channel busy, CCA) is retried.
+ *
+ *          Both radios run off the same beacon loop and the same clock: the 802.15.4 window
+ *          is marked in the wake timeline (IEEE_START / IEEE_STOP, inside ADV_START /
+ *          ADV_STOP) and its frames, failures, airtime and charge go into their own
+ *          radio account (diagnostics.h).
+*/
+
+#ifndef SOS_802154_H
+#define SOS_802154_H
+
+#include <stdint.h>
+#include <esp_random.h>
+#include "esp_ieee802154.h"
+#include "diagnostics.h"
+#include "ieee802154_frame.h"
+
+/* ============= Transport State ============= */
+static uint8_t ieee_frame[1 + IEEE802154_PSDU_LEN];  /**< PHR (length) + PSDU, as the driver wants it */
+static Ieee802154Pacer ieee_pacer;
+static bool ieee_active = false;
+static uint8_t ieee_seq = 0;
+static bool ieee_pending = false;             /**< A frame was started, its result not yet given to the pacer */
+static uint32_t ieee_tx_start_ms = 0;         /**< When it was started: the pacer counts from there */
+static volatile bool ieee_tx_busy = false;    /**< Frame handed to the radio, no result yet */
+static volatile bool ieee_tx_ok = false;
+static volatile uint32_t ieee_tx_frames = 0;  /**< On air this wake */
+static volatile uint32_t ieee_tx_failed = 0;  /**< Busy channel / lost arbitration this wake */
+
+
+/* ============= Driver Callbacks (radio ISR) ============= */
+// Override the driver's weak defaults
+extern "C" void esp_ieee802154_transmit_done(const uint8_t* frame, const uint8_t* ack, esp_ieee802154_frame_info_t* ack_frame_info) {
+  (void)frame;
+  (void)ack;
+  (void)ack_frame_info;
+  ieee_tx_frames++;
+  ieee_tx_ok = true;
+  ieee_tx_busy = false;
+}
+
+extern "C" void esp_ieee802154_transmit_failed(const uint8_t* frame, esp_ieee802154_tx_error_t error) {
+  (void)frame;
+  (void)error;
+  ieee_tx_failed++;
+  ieee_tx_ok = false;
+  ieee_tx_busy = false;
+}
+
+
+/**
+ * @brief esp_power_level_t (BLE) -> dBm, so both radios use the configured power
+ */
+static int8_t sos802154Dbm(const esp_power_level_t level) {
+  static const int8_t dbm[] = { -24, -21, -18, -15, -12, -9, -6, -3, 0, 3, 6, 9, 12, 15, 18, 20 };
+  const int i = static_cast<int>(level);
+  return (i >= 0 && i < (int)sizeof(dbm)) ? dbm[i] : -12;
+}
+
+/**
+ * @brief Turn the 802.15.4 radio on and start pacing frames
+ * @param mac     Custom MAC (sender address)
+ * @param payload The 8-byte payload of this press (same as the BLE advert)
+ * @return bool false if the transport is off (ieee_channel = 0) or the radio didn't start
+ * @note  Call right after the BLE advertising start
+ */
+static bool sos802154Begin(const uint8_t* mac, const uint8_t* payload) {
+  ieee_active = false;
+  ieee_tx_frames = ieee_tx_failed = 0;
+  if (device_config.ieee_channel == 0) {
+    return false;
+  }
+  if (esp_ieee802154_enable() != ESP_OK) {
+    DEBUG_VERBOSE("\n[802.15.4] Radio enable failed, BLE only");
+    return false;
+  }
+  esp_ieee802154_set_channel(device_config.ieee_channel);
+  esp_ieee802154_set_txpower(sos802154Dbm(device_config.tx_power));
+  esp_ieee802154_set_rx_when_idle(false);  // Transmit only: no receiver on between frames
+
+  ieee_frame[0] = IEEE802154_PSDU_LEN;
+  ieee802154BuildFrame(ieee_frame + 1, ieee_seq, mac, payload);
+  ieee_pacer.begin(millis(), device_config.ieee_interval_ms, esp_random());
+  ieee_tx_busy = false;
+  ieee_pending = false;
+  ieee_active = true;
+  diagMark(WakePhase::IEEE_START);
+  DEBUG_VERBOSE_F("\n[802.15.4] Broadcasting on channel %d every %d ms", device_config.ieee_channel,
+                  device_config.ieee_interval_ms);
+  return true;
+}
+
+/**
+ * @brief Send the next frame when due
+ * @note  Call from the beacon loop, next to the maintenance pattern poll
+ */
+static void sos802154Poll(void) {
+  if (!ieee_active) {
+    return;
+  }
+  const uint32_t now = millis();
+  if (ieee_pending) {
+    if (ieee_tx_busy) {
+      return;
+    }
+    ieee_pending = false;
+    ieee_pacer.sent(ieee_tx_start_ms, ieee_tx_ok, esp_random());
+  }
+  if (!ieee_pacer.due(now)) {
+    return;
+  }
+  // New sequence number per frame: receivers drop MAC-level duplicates by it
+  ieee_frame[1 + 2] = ieee_seq++;
+  ieee_tx_busy = true;
+  ieee_pending = true;
+  ieee_tx_start_ms = now;
+  if (esp_ieee802154_transmit(ieee_frame, true) != ESP_OK) {  // true: CCA before sending
+    ieee_tx_busy = false;
+    ieee_tx_ok = false;
+    ieee_tx_failed++;
+  }
+}
+
+/**
+ * @brief Stop the transport and account this wake's 802.15.4 traffic
+ * @note  Call right before the BLE advertising stop
+ */
+static void sos802154End(void) {
+  if (!ieee_active) {
+    return;
+  }
+  ieee_active = false;
+  const uint32_t start = millis();
+  while (ieee_tx_busy && millis() - start < 5) {
+    // A frame is on air (~1.1ms): let it finish
+  }
+  esp_ieee802154_disable();
+  diagMark(WakePhase::IEEE_STOP);
+  diagRadioTx(DiagRadio::IEEE802154, ieee_tx_frames, ieee_tx_failed, ieee_tx_frames * IEEE802154_FRAME_US,
+              DIAG_CURRENT_802154_TX_UA);
+  DEBUG_VERBOSE_F("\n[802.15.4] %lu frames sent, %lu not sent (busy / arbitration)", ieee_tx_frames, ieee_tx_failed);
+}
+
+#endif  // SOS_802154_H
@@ -0,0 +1,184 @@
+/**
+ * @file    tx_power.h
+ * @brief   Closed-loop TX power: the lowest level that keeps a link margin at the gateways
+ * @details Portable C++ (no Arduino / ESP-IDF dependency): the firmware runs it for every
+ *          press, host_tools/radio/tx_power_sim.cpp runs the same code.
+ *
+ *          A fixed level (-12 dBm by default) is too weak at the edge of coverage and more
+ *          than needed next to a gateway. The button can't hear the gateways, so the loop
+ *          closes over the maintenance channel: a tool writes the RSSI the gateways
+ *          received for recent presses (best gateway per press, host_tools rc_verify
+ *          --link-report), together with the gateway floor, the margin and the highest
+ *          level allowed. The button kept the level of its last TX_POWER_HISTORY presses,
+ *          so each matched press gives level dBm - RSSI; their mean is the report's path
+ *          loss sample (the margin covers the shadowing of a single press).
+ *
+ *          Estimate: a worse sample is taken at once, a better one moves the estimate
+ *          1/2^TX_POWER_DECAY_SHIFT of the way (one good report doesn't lower the level).
+ *          Level of a press: the lowest with dBm >= floor + margin + path loss, then
+ *          - one level up per TX_POWER_AGE_PRESSES presses since the last report: an old
+ *            estimate loses trust (the button may have moved)
+ *          - every TX_POWER_PROBE_EVERY-th press TX_POWER_PROBE_STEP levels up (probe). If the
+ *            link got worse, low presses stop arriving and give no sample; a probe still does.
+ *          Without an estimate (never reported) the configured level is used as before.
+ *
+ *          The estimate and its settings are one site's: the button's. A button moved to
+ *          another site ages back up until its next report.
+ */
+
+#ifndef TX_POWER_H
+#define TX_POWER_H
+
+#include <stdint.h>
+
+/* ============= TX Power Configuration ============= */
+#define TX_POWER_LEVELS 16                /**< esp_power_level_t 0 .. 15 */
+#define TX_POWER_HISTORY 8                /**< Presses whose level is kept to match reports */
+#define TX_POWER_REPORTS 8                /**< Reports per feedback write */
+#define TX_POWER_DECAY_SHIFT 2            /**< A better sample moves the estimate 1/4 of the way */
+#define TX_POWER_AGE_PRESSES 16           /**< One level up per this many presses without a report */
+#define TX_POWER_PROBE_EVERY 8            /**< Every 8th press is a probe */
+#define TX_POWER_PROBE_STEP 2             /**< Probe: 2 levels (6 dB) up */
+#define TX_POWER_DEFAULT_FLOOR_DBM -90    /**< Gateway RSSI the margin is counted from */
+#define TX_POWER_DEFAULT_MARGIN_DB 12     /**< Shadowing (body, doors) and fading of one press */
+#define TX_POWER_MIN_MARGIN_DB 3
+
+/**
+ * @brief dBm of each level (esp_power_level_t, ESP32-H2: -24 dBm to +20 dBm in 3 dB steps)
+ */
+static const int8_t TX_POWER_DBM[TX_POWER_LEVELS] = { -24, -21, -18, -15, -12, -9, -6, -3, 0, 3, 6, 9, 12, 15, 18, 20 };
+
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;  /**< Timestamp word of the press (button_events.h) */
+  uint8_t level;
+} tx_press_t;
+
+/**
+ * @brief Link estimate (RTC memory, stored in NVS on every report)
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t valid;             /**< 0 = never reported: configured level */
+  uint8_t loss_db;           /**< Path loss estimate to the best gateway */
+  int8_t floor_dbm;          /**< Gateway RSSI the margin is counted from */
+  uint8_t margin_db;
+  uint8_t max_level;         /**< Highest level allowed */
+  uint8_t last_level;        /**< Level of the last press */
+  uint16_t reports;          /**< Feedback writes that matched a press */
+  uint32_t presses;          /**< Presses sent */
+  uint32_t report_press;     /**< `presses` at the last matched report */
+  uint8_t history_head;
+  tx_press_t history[TX_POWER_HISTORY];
+} tx_link_t;
+
+/**
+ * @brief One press as received by the gateways
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;  /**< Timestamp word of the press */
+  int8_t rssi;         /**< Best gateway RSSI (dBm) */
+} tx_report_t;
+
+/**
+ * @brief Feedback write payload [44 bytes]
+ */
+typedef struct __attribute__((packed)) {
+  int8_t floor_dbm;
+  uint8_t margin_db;
+  uint8_t max_level;
+  uint8_t count;       /**< Valid entries in reports */
+  tx_report_t reports[TX_POWER_REPORTS];
+} tx_feedback_t;
+
+/**
+ * @brief Level for a press
+ */
+typedef struct {
+  uint8_t level;
+  bool probe;
+} tx_choice_t;
+
+
+/**
+ * @brief Lowest level whose dBm is at least dbm (the highest level if none)
+ */
+static inline uint8_t txPowerLevelFor(const int dbm) {
+  for (uint8_t level = 0; level < TX_POWER_LEVELS; level++) {
+    if (TX_POWER_DBM[level] >= dbm) {
+      return level;
+    }
+  }
+  return TX_POWER_LEVELS - 1;
+}
+
+/**
+ * @brief Choose the level of the next press
+ * @param configured Level without an estimate (device_config.tx_power)
+ */
+static inline tx_choice_t txPowerChoose(const tx_link_t& link, const uint8_t configured) {
+  if (!link.valid) {
+    return { configured, false };
+  }
+  int level = txPowerLevelFor(link.floor_dbm + link.margin_db + link.loss_db);
+  level += (int)((link.presses - link.report_press) / TX_POWER_AGE_PRESSES);
+  const bool probe = link.presses % TX_POWER_PROBE_EVERY == TX_POWER_PROBE_EVERY - 1;
+  if (probe) {
+    level += TX_POWER_PROBE_STEP;
+  }
+  return { (uint8_t)(level > link.max_level ? link.max_level : level), probe };
+}
+
+/**
+ * @brief Record a press and its level (to match later reports)
+ */
+static inline void txPowerSent(tx_link_t& link, const uint32_t timestamp, const uint8_t level) {
+  link.history[link.history_head] = { timestamp, level };
+  link.history_head = (uint8_t)((link.history_head + 1) % TX_POWER_HISTORY);
+  link.last_level = level;
+  link.presses++;
+}
+
+/**
+ * @brief Check the settings of a feedback write
+ */
+static inline bool txPowerFeedbackValid(const tx_feedback_t& fb) {
+  return fb.count <= TX_POWER_REPORTS && fb.max_level < TX_POWER_LEVELS && fb.margin_db >= TX_POWER_MIN_MARGIN_DB
+         && fb.margin_db <= 40 && fb.floor_dbm >= -110 && fb.floor_dbm <= -40;
+}
+
+/**
+ * @brief Apply a feedback write: settings, and the path loss of the reported presses
+ * @return uint8_t Reports that matched a press in the history (0: settings only)
+ */
+static inline uint8_t txPowerFeedback(tx_link_t& link, const tx_feedback_t& fb) {
+  link.floor_dbm = fb.floor_dbm;
+  link.margin_db = fb.margin_db;
+  link.max_level = fb.max_level;
+
+  int sum = 0;
+  uint8_t matched = 0;
+  for (uint8_t r = 0; r < fb.count; r++) {
+    for (const tx_press_t& p : link.history) {
+      if (p.timestamp == fb.reports[r].timestamp && p.timestamp != 0) {
+        sum += TX_POWER_DBM[p.level] - fb.reports[r].rssi;
+        matched++;
+        break;
+      }
+    }
+  }
+  if (matched == 0) {
+    return 0;
+  }
+  int loss = (sum + matched - 1) / matched;
+  loss = loss < 0 ? 0 : (loss > 255 ? 255 : loss);
+  if (!link.valid || loss >= link.loss_db) {
+    link.loss_db = (uint8_t)loss;
+  } else {
+    link.loss_db = (uint8_t)(link.loss_db - ((link.loss_db - loss + (1 << TX_POWER_DECAY_SHIFT) - 1) >> TX_POWER_DECAY_SHIFT));
+  }
+  link.valid = 1;
+  link.reports++;
+  link.report_press = link.presses;
+  return matched;
+}
+
+#endif  // TX_POWER_H
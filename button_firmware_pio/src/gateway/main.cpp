@@ -0,0 +1,205 @@
+/**
+ * @file    gateway_firmware.ino
+ * @brief   ESP32-H2 SOS gateway: dedicated scanner forwarding button adverts over UART
+ * @details Scans passively with a duty cycle picked for the buttons' advertising pattern
+ *          (scan_scheduler.h): lowest duty that still catches a press within the target
+ *          latency. A sighted press is tracked at full duty, and what it shows about the
+ *          buttons' interval and beacon time keeps the parameters matched. Every advertising
+ *          report is filtered in
+ *          the GAP callback, before any advert object is built: only button adverts pass
+ *          (see gateway_core.h), repeats of one press are dropped right there. Accepted adverts
+ *          go out as 22-byte records in CRC-framed batches on UART0 at GW_UART_BAUD.
+ *          A host reads frames, not advertisements.
+ *
+ *          UART0 only carries frames (no debug text). The LED (if fitted) is not used.
+ *
+ * @note    Needs secrets.h (MANUFACTURER_ID), same as the button firmware.
+ */
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include "esp_gap_ble_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "secrets.h"
+#include "gateway_core.h"
+#include "scan_scheduler.h"
+
+
+/* ============= Gateway Configuration ============= */
+#define PRODUCT_NAME "ESP32H2 SoS Button"  /**< Complete local name of a v1 button */
+#define GW_UART_BAUD 2000000               /**< Frame link to the host */
+#define GW_UART_TX_BUFFER 4096
+#define GW_QUEUE_LEN 64                    /**< Records between the GAP callback and loop() */
+#define GW_BUTTON_ADV_INTERVAL_MS 80.0f    /**< Button default: CONFIG_DEFAULT_ADV_MAX 0x80 * 0.625ms */
+#define GW_BUTTON_BEACON_MS 10000.0f       /**< Button default: CONFIG_DEFAULT_BEACON_MS */
+#define GW_TARGET_LATENCY_MS 1000.0f       /**< 95% of presses forwarded within this */
+
+
+/* ============= Type Definitions ============= */
+/**
+ * @brief Record on its way from the GAP callback to loop()
+ */
+typedef struct {
+  gw_record_t rec;
+  uint32_t heard_ms;  /**< Reception: the record's wait in the gateway counts from here */
+} gw_queued_t;
+
+
+/* ============= Global Variables ============= */
+static QueueHandle_t record_queue = nullptr;
+static GwDedup dedup;
+static GwBatcher batcher;
+static ScanScheduler scheduler;
+static portMUX_TYPE scheduler_lock = portMUX_INITIALIZER_UNLOCKED;  // GAP callback vs loop()
+
+static esp_ble_scan_params_t scan_params = {
+  .scan_type = BLE_SCAN_TYPE_PASSIVE,
+  .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+  .scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL,
+  .scan_interval = SCAN_TRACK_UNITS,  // Set from the scheduler in setup()
+  .scan_window = SCAN_TRACK_UNITS,
+  .scan_duplicate = BLE_SCAN_DUPLICATE_DISABLE  // Own dedup: a new press of the same button must pass
+};
+
+
+/* ============= Function Prototypes ============= */
+static void gapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+static void onScanResult(const esp_ble_gap_cb_param_t::ble_scan_result_evt_param& result);
+static void sendFrame(uint32_t now_ms);
+static void pollScheduler(uint32_t now_ms);
+static void applyScanParams(uint16_t interval, uint16_t window);
+
+
+
+
+/**
+ * @brief Arduino setup function
+ */
+void setup() {
+  Serial.setTxBufferSize(GW_UART_TX_BUFFER);
+  Serial.begin(GW_UART_BAUD);
+
+  record_queue = xQueueCreate(GW_QUEUE_LEN, sizeof(gw_queued_t));
+
+  ScanProfile profile;
+  profile.adv_interval_ms = GW_BUTTON_ADV_INTERVAL_MS;
+  profile.beacon_ms = GW_BUTTON_BEACON_MS;
+  ScanTarget target;
+  target.latency_ms = GW_TARGET_LATENCY_MS;
+  scheduler.begin(profile, target);
+  scan_params.scan_interval = scheduler.params().interval;
+  scan_params.scan_window = scheduler.params().window;
+
+  // Stack up, then raw GAP events: no BLEScan / BLEAdvertisedDevice per report
+  BLEDevice::init("");
+  BLEDevice::setCustomGapHandler(gapHandler);
+  esp_ble_gap_set_scan_params(&scan_params);  // Scanning starts on SCAN_PARAM_SET_COMPLETE
+}
+
+
+/**
+ * @brief Arduino loop function: batch records and send frames
+ */
+void loop() {
+  gw_queued_t queued;
+  // Wait for a record, but never longer than a partial batch may wait
+  if (xQueueReceive(record_queue, &queued, pdMS_TO_TICKS(1)) == pdTRUE) {
+    const uint32_t now = millis();
+    if (batcher.add(queued.rec, now, queued.heard_ms)) {
+      sendFrame(now);
+    }
+  }
+  const uint32_t now = millis();
+  if (batcher.due(now)) {
+    sendFrame(now);
+  }
+  pollScheduler(now);
+}
+
+
+
+
+/**
+ * @brief GAP events (BLE stack task)
+ */
+static void gapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  switch (event) {
+    case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+      esp_ble_gap_start_scanning(0);  // 0 = no timeout
+      break;
+    case ESP_GAP_BLE_SCAN_RESULT_EVT:
+      if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+        onScanResult(param->scan_rst);
+      } else if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+        esp_ble_gap_start_scanning(0);  // Keep scanning whatever stopped it
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+
+/**
+ * @brief Filter + dedup one advertising report, queue the record
+ */
+static void onScanResult(const esp_ble_gap_cb_param_t::ble_scan_result_evt_param& result) {
+  adv_beacon_t beacon;
+  if (!gwParseAdvert(result.ble_adv, result.adv_data_len, MANUFACTURER_ID, PRODUCT_NAME, &beacon)) {
+    return;
+  }
+  gw_queued_t queued;
+  gw_record_t& rec = queued.rec;
+  gwMakeRecord(&rec, result.bda, (uint8_t)result.ble_addr_type, (int8_t)result.rssi, beacon);
+  const uint32_t now = millis();
+  taskENTER_CRITICAL(&scheduler_lock);
+  scheduler.onSighting(rec, now);  // Every sighting: the scheduler measures the advert spacing
+  taskEXIT_CRITICAL(&scheduler_lock);
+  if (!dedup.admit(rec, now)) {
+    return;
+  }
+  queued.heard_ms = now;
+  xQueueSend(record_queue, &queued, 0);  // Full queue: the next repeat after the dedup window gets through
+}
+
+
+/**
+ * @brief Close the current batch and write it to UART0
+ */
+static void sendFrame(uint32_t now_ms) {
+  const size_t len = batcher.finish(now_ms);
+  Serial.write(batcher.data(), len);
+}
+
+
+/**
+ * @brief Follow the scheduler: full duty while a press is tracked, optimized duty after
+ */
+static void pollScheduler(uint32_t now_ms) {
+  ScanObservation obs;
+  taskENTER_CRITICAL(&scheduler_lock);
+  const ScanEvent event = scheduler.poll(now_ms, &obs);
+  taskEXIT_CRITICAL(&scheduler_lock);
+
+  if (event == ScanEvent::TRACK_START) {
+    applyScanParams(SCAN_TRACK_UNITS, SCAN_TRACK_UNITS);
+  } else if (event == ScanEvent::TRACK_END) {
+    const ScanParams& p = scheduler.update(obs);  // Optimization runs here, outside the lock
+    applyScanParams(p.interval, p.window);
+  }
+}
+
+
+/**
+ * @brief Restart scanning with new interval / window (SCAN_UNIT_US units)
+ */
+static void applyScanParams(uint16_t interval, uint16_t window) {
+  if (scan_params.scan_interval == interval && scan_params.scan_window == window) {
+    return;
+  }
+  scan_params.scan_interval = interval;
+  scan_params.scan_window = window;
+  esp_ble_gap_stop_scanning();
+  esp_ble_gap_set_scan_params(&scan_params);  // Scanning restarts on SCAN_PARAM_SET_COMPLETE
+}
@@ -55,12 +55,33 @@
 #include "soc/periph_defs.h"
 #include "driver/rtc_io.h"
 #include "soc/rtc.h"
+#include "crash_summary.h"
+#include "diagnostics.h"
+#include "field_config.h"
+#include "ota_update.h"
+#include "device_clock.h"
+#include "diag_log_store.h"
+#include "maintenance.h"
+#include "selftest.h"
+#include "sos_802154.h"
+#include "button_events.h"
+#include "rolling_code.h"
+#include "adv_format.h"
 
 /* ============= Configuration Constants ============= */
 #define PRODUCT_NAME "ESP32H2 SoS Button" /**< Product-specific name */
 #define WAKEUP_BOOT_BTN_PIN GPIO_NUM_9  /**< GPIO pin for BOOT button: gpio_num_t type, not a simple int */
-#define BEACON_TIME_MS 10000            /**< Broadcast duration in ms */
-#define FACTORY_WAIT_MS 20000           /**< Factory reset timeout in ms */
+#define WAKEUP_CANCEL_BTN_PIN GPIO_NUM_10  /**< GPIO pin for the cancel button (LP IO, EXT1 capable, external pull-up like BOOT) */
+#define WAKEUP_BTN_MASK ((1ULL << WAKEUP_BOOT_BTN_PIN) | (1ULL << WAKEUP_CANCEL_BTN_PIN))  /**< Both buttons wake (EXT1, any low) */
+#define BLE_START_ASYNC 1          /**< 1: BLE starts in its own task during the local setup, 0: in sequence (A/B on the wake timeline) */
+#define BLE_START_TASK_STACK 8192  /**< Stack of the BLE start task (BLEDevice::init() runs on it) */
+#define BLE_START_TASK_PRIORITY 2  /**< Above loopTask (1): the local setup runs whenever the controller start blocks */
+#define BLE_START_TIMEOUT_MS 3000  /**< BLE not ready by then: BLE_INIT_FAILED */
+#define BEACON_ADV_FORMAT ADV_FORMAT_V3  /**< SOS advert layout (adv_format.h): V2 / V1 while a site's gateways only decode those */
+#define ADV_AGE_RESTAMP_MS 100     /**< v3: the press age in the advert is renewed this often while advertising */
+#define ROLLING_CODE_SCHEME ROLLING_CODE_SCHEME_V1  /**< Rolling code scheme (rolling_code.h): V2 once the site's verifiers have the V2 seeds */
+// ** Note: Beacon time, factory wait, advertising intervals and TX power are field
+// configurable, compiled defaults & NVS record are in field_config.h (device_config)
 
 
 
@@ -73,6 +94,7 @@ enum class DeviceState {
   UNINITIALIZED, /**< Initial state after power-on */
   FACTORY_MODE,  /**< Factory reset/initialization mode */
   NORMAL_MODE,   /**< Normal beacon operation mode */
+  MAINTENANCE_MODE, /**< Connectable diagnostics mode (press pattern) */
   ERROR          /**< Error state */
 };
 
@@ -103,23 +125,34 @@ typedef struct __attribute__((packed)) {
 
 
 
+typedef rolling_code::SchemeOf<ROLLING_CODE_SCHEME>::type ButtonRollingCode;  /**< Seed and mixer of this build */
+
 /* ============= Global Variables ============= */
 RTC_DATA_ATTR static rtc_data_t rtc_data;      /**< Persists across deep sleep */
 static BLEAdvertising* pAdvertising = nullptr; /**< BLE advertising handle */
+static SemaphoreHandle_t ble_ready_sem = nullptr; /**< Given when setupBLE() returns (async start) */
+static bool ble_ok = false;                     /**< setupBLE() result, valid once BLE is ready */
+static uint64_t timer_wake_press = 0;           /**< Buttons pressed as a timer wake fired (button_health.h) */
 
 
 
 /* ============= Function Prototypes ============= */
 /* Core State Functions */
-static bool initializeHardware(void);
+static void initializeHardware(void);
 static void enterFactoryMode(void);
+static void runSelfTest(void);
 static void enterNormalMode(void);
+static void enterDeepSleep(void);
 static void handleError(const ErrorCode& error);
 
 /* Hardware Control */
 static void powerDownDomains(void);
+static void disableUnusedPeripherals(void);
 static void disableUnusedPins(void);
-static bool setupDeepSleepWakeup(const gpio_num_t wakeup_pin);
+static bool setupDeepSleepWakeup(const uint64_t wakeup_mask);
+static void configureButtonPins(void);
+static uint64_t readButtonLines(const uint64_t known_stuck);
+static uint64_t readButtonLevels(void);
 
 /* Security Functions */
 static uint32_t generateSeed(void);
@@ -127,7 +160,11 @@ static uint32_t generateRollingCode(const uint32_t timestamp);
 
 /* BLE Functions */
 static bool setupBLE(void);
-static void broadcastBeacon(void);
+static void startBLE(void);
+static bool waitBLEReady(void);
+static void requireBLE(void);
+static void broadcastBeacon(const ButtonEvent event);
+static size_t setBeaconAdvert(const adv_beacon_t& beacon, const uint8_t* payload, uint8_t* adv);
 
 /* Utility Functions */
 static void printDebugInfo(uint32_t code);
@@ -142,6 +179,7 @@ static void optimizeClocks(void);
  * @brief Arduino setup function
  */
 void setup() {
+  diagInit();  // Start of the wake timeline
   DEBUG_INIT();
   DEBUG_VERBOSE(DBG_INIT);
 
@@ -156,9 +194,59 @@ void setup() {
     rtc_data.lastError = ErrorCode::NONE;
   }
 
-  // Initialize hardware
-  if (!initializeHardware()) {
-    handleError(rtc_data.lastError);
+  if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+    diagEvent(DiagEvent::BOOT, static_cast<uint8_t>(esp_reset_reason()));
+  }
+
+  // Field configuration: decoded from NVS once, plain RTC memory on every wake after that
+  configLoad();
+
+  // RTC memory is fresh after any reset but a deep sleep wake (update restart, panic, watchdog),
+  // and an update may change the rolling code scheme: the seed is derived again (eFuse MAC and
+  // build constants only), so the first press after the update uses the new one
+  if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+    rtc_data.seed = generateSeed();
+  }
+
+  // Timer wake: device clock calibration (device_clock.h) or stuck button check (button_health.h,
+  // in enterDeepSleep()). Straight back to sleep, unless a button that isn't stuck reads low:
+  // a press that started as the timer fired, EXT1 won't report it
+  if (deviceClockCalibrationWake()) {
+    configureButtonPins();
+    timer_wake_press = buttonHealthTimerWakePress(diag_data.health, WAKEUP_BTN_MASK, readButtonLevels());
+    if (timer_wake_press == 0) {
+      deviceClockUpdate();
+      enterDeepSleep();
+      return;
+    }
+    DEBUG_VERBOSE("\n[WAKE] Timer wake with a button pressed: handled as a press");
+  }
+
+  // First boots of a freshly updated image are counted (and rolled back if never confirmed).
+  // Before the clock and BLE bring-up: a new image that hangs there still used up an attempt
+  const bool ota_pending = otaBootCheck();
+
+  // Initialize hardware: starts BLE first, everything up to the beacon runs while it comes up
+  initializeHardware();
+
+  // Reduce a core dump left by a previous panic to a compact summary
+  // (no-op on deep sleep wakes, so the button press path is not affected)
+  if (crashSummaryCapture()) {
+    diagEvent(DiagEvent::CRASH);
+  }
+
+  // Hardware and BLE came up: the new image is good. The restart after an update
+  // is not a button press, so go back to sleep without an SOS beacon. The restart
+  // cleared RTC memory: a provisioned unit is known from NVS
+  if (ota_pending) {
+    requireBLE();
+    otaConfirm();
+    if (configProvisioned()) {
+      rtc_data.is_initialized = true;
+      rtc_data.state = DeviceState::NORMAL_MODE;
+      enterDeepSleep();
+      return;
+    }
   }
 
   // Determine operation mode
@@ -168,6 +256,7 @@ void setup() {
   if (!rtc_data.is_initialized || (esp_reset_reason() == ESP_RST_POWERON && gpio_get_level(WAKEUP_BOOT_BTN_PIN) == 0)) {
     rtc_data.state = DeviceState::FACTORY_MODE;
     DEBUG_VERBOSE(DBG_FACTORY_WARN);
+    requireBLE();
     enterFactoryMode();
   } else {
     rtc_data.state = DeviceState::NORMAL_MODE;
@@ -186,34 +275,92 @@ void loop() {
 
 
 /**
-* @brief Configure deep sleep wakeup on specified GPIO using EXT1 (ESP32-H2)
-* @param wakeup_pin RTC-capable GPIO to use as wakeup source (GPIOs 0-10)
+* @brief Configure deep sleep wakeup on specified GPIOs using EXT1 (ESP32-H2)
+* @param wakeup_mask Bitmask of RTC-capable GPIOs (LP IO, GPIOs 7-14), any of them low wakes the chip
 * @return bool true if wakeup configured successfully, false on any error
+* @note  Which pin woke the chip: esp_sleep_get_ext1_wakeup_status() (see buttonEventFromWake())
 */
-static bool setupDeepSleepWakeup(const gpio_num_t wakeup_pin) {
+static bool setupDeepSleepWakeup(const uint64_t wakeup_mask) {
   DEBUG_VERBOSE("\n[DEEP SLEEP] Configuring wakeup...");
-  // Create bitmask for the provided pin
-  const uint64_t ext_wakeup_pin_1_mask = 1ULL << wakeup_pin;
+  if (wakeup_mask == 0) {
+    // All buttons stuck (button_health.h): the timer is the only wake source
+    DEBUG_VERBOSE("\n[DEEP SLEEP] No button armed, timer wake only");
+    return true;
+  }
   // Configure EXT1 wakeup
-  esp_err_t result = esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_1_mask, ESP_EXT1_WAKEUP_ANY_LOW);
+  esp_err_t result = esp_sleep_enable_ext1_wakeup_io(wakeup_mask, ESP_EXT1_WAKEUP_ANY_LOW);
+  const uint32_t mask = (uint32_t)wakeup_mask;  // GPIOs 0-27
 
   switch (result) {
     case ESP_OK:
-      DEBUG_VERBOSE_F("\n[DEEP SLEEP] Wakeup configuration successful for GPIO%d", wakeup_pin);
+      DEBUG_VERBOSE_F("\n[DEEP SLEEP] Wakeup configuration successful for GPIO mask 0x%08lX", mask);
       return true;
     case ESP_ERR_INVALID_ARG:
-      DEBUG_VERBOSE_F("\n[ERROR] Invalid argument - GPIO%d might not be RTC capable", wakeup_pin);
+      DEBUG_VERBOSE_F("\n[ERROR] Invalid argument - a GPIO of mask 0x%08lX might not be RTC capable", mask);
       return false;
     case ESP_ERR_NOT_ALLOWED:
-      DEBUG_VERBOSE_F("\n[ERROR] Operation not allowed for GPIO%d", wakeup_pin);
+      DEBUG_VERBOSE_F("\n[ERROR] Operation not allowed for GPIO mask 0x%08lX", mask);
       return false;
     default:
-      DEBUG_VERBOSE_F("\n[ERROR] Unknown error: %d for GPIO%d", result, wakeup_pin);
+      DEBUG_VERBOSE_F("\n[ERROR] Unknown error: %d for GPIO mask 0x%08lX", result, mask);
       return false;
   }
 }
 
 
+/**
+* @brief Button GPIOs as inputs with pull-up (native ESP-IDF configuration)
+*/
+static void configureButtonPins(void) {
+  gpio_config_t io_conf = {
+    .pin_bit_mask = WAKEUP_BTN_MASK,  // BOOT (SOS) and cancel buttons
+    .mode = GPIO_MODE_INPUT,
+    .pull_up_en = GPIO_PULLUP_ENABLE,
+    .pull_down_en = GPIO_PULLDOWN_DISABLE,
+    .intr_type = GPIO_INTR_DISABLE,
+    .hys_ctrl_mode = GPIO_HYS_SOFT_DISABLE
+  };
+  gpio_config(&io_conf);
+}
+
+
+/**
+* @brief Button lines reading low, for the stuck button check before deep sleep
+* @param known_stuck Buttons already stuck: read once. Any other low line gets
+*                    BUTTON_STUCK_RELEASE_WAIT_MS to go high (a press held past the beacon).
+* @return uint64_t GPIO mask of the buttons still low
+*/
+static uint64_t readButtonLines(const uint64_t known_stuck) {
+  configureButtonPins();  // Also on timer wakes, which skip initializeHardware()
+  const uint32_t start = millis();
+  uint64_t low;
+  do {
+    low = readButtonLevels();
+    if ((low & ~known_stuck) == 0) {
+      break;
+    }
+    delay(10);
+  } while (millis() - start < BUTTON_STUCK_RELEASE_WAIT_MS);
+  return low;
+}
+
+
+/**
+* @brief Button lines reading low now (pins configured by configureButtonPins())
+* @return uint64_t GPIO mask of the buttons reading low
+*/
+static uint64_t readButtonLevels(void) {
+  const gpio_num_t pins[] = { WAKEUP_BOOT_BTN_PIN, WAKEUP_CANCEL_BTN_PIN };
+  uint64_t low = 0;
+  for (const gpio_num_t pin : pins) {
+    if (gpio_get_level(pin) == 0) {
+      low |= 1ULL << pin;
+    }
+  }
+  return low;
+}
+
+
 /**
  * @brief Optimize power consumption by disabling unused peripherals and configuring clocks
  * @details Disables various ESP32-H2 peripherals and their associated GPIOs:
@@ -234,6 +381,8 @@ static bool setupDeepSleepWakeup(const gpio_num_t wakeup_pin) {
  * @note 2. UART0 should not be disabled if using Serial debug
  * @note 3. BT module should not be disabled if quick BLE restart needed
  * @note 4. Can't disable TIMG0/1: Timer Groups as they are used for RTC and other things ...
+ * @note 5. Only the CPU clock and SYSTIMER are set up here, before the BLE start.
+ *          The other peripherals: disableUnusedPeripherals(), while BLE comes up
  */
 static void optimizeClocks(void) {
   DEBUG_VERBOSE("\n[POWER] ----------------------");
@@ -266,6 +415,22 @@ static void optimizeClocks(void) {
 
 
 // For ESP32-H2, use correct module definitions
+#ifdef CONFIG_IDF_TARGET_ESP32H2
+  // Timers before the BLE start: the controller and the BLE stack run on them.
+  // The other peripherals are disabled while BLE comes up (disableUnusedPeripherals())
+  periph_module_disable(PERIPH_SYSTIMER_MODULE);  // System Timer
+  // -- NEW -- //
+  esp_timer_early_init();  // InitESP timer early with minimal config, needed for stat LED blinks
+  // --------- //
+#endif
+}
+
+
+/**
+ * @brief Disables peripherals the beacon doesn't use
+ * @note  Runs while BLE comes up: none of these is used by the BLE controller or stack
+ */
+static void disableUnusedPeripherals(void) {
 #ifdef CONFIG_IDF_TARGET_ESP32H2
   periph_module_disable(PERIPH_LEDC_MODULE);    // Disable unused peripherals (LED PWM module)
   periph_module_disable(PERIPH_MCPWM0_MODULE);  // Disable unused peripherals (Motor Control PWM )
@@ -282,10 +447,6 @@ static void optimizeClocks(void) {
   // we can enable the disablement of RMT CTRL PERIF
 
   periph_module_disable(PERIPH_SARADC_MODULE);    // ADC
-  periph_module_disable(PERIPH_SYSTIMER_MODULE);  // System Timer
-  // -- NEW -- //
-  esp_timer_early_init();  // InitESP timer early with minimal config, needed for stat LED blinks
-  // --------- //
   periph_module_disable(PERIPH_UART1_MODULE);  // UART1
   periph_module_disable(PERIPH_SPI2_MODULE);   // SPI2
   periph_module_disable(PERIPH_I2C0_MODULE);   // I2C0
@@ -319,7 +480,7 @@ static void disableUnusedPins(void) {
     GPIO_NUM_6,  // JTAG pins TCK
     GPIO_NUM_7,  // JTAG pins TDO
     // --------------------------------------------------------- //
-    GPIO_NUM_10,  // No critical function
+    // GPIO_NUM_10,  // Cancel button (WAKEUP_CANCEL_BTN_PIN)
     GPIO_NUM_11,  // No critical function
     GPIO_NUM_12,  // No critical function
     GPIO_NUM_13   // No critical function
@@ -333,6 +494,9 @@ static void disableUnusedPins(void) {
   };
 
   for (gpio_num_t pin : unusedPins) {
+    if (pin == DIAG_MARKER_PIN) {
+      continue;  // Phase marker for a power analyzer (diagnostics.h)
+    }
     // Initialize GPIO configuration structure
     gpio_config_t io_conf = {};
     io_conf.intr_type = GPIO_INTR_DISABLE;        // Disable interrupts
@@ -352,47 +516,40 @@ static void disableUnusedPins(void) {
 
 /**
  * @brief Hardware initialization
- * @return bool true if all initializations successful, false otherwise
+ * @details BLE controller bring-up is the slowest step of a wake, so it starts right
+ *          after the clocks it depends on (startBLE()). The local setup runs while it
+ *          comes up, and so does the rest of the wake up to the first use of the radio,
+ *          which waits for it (requireBLE()):
+ *            clocks -> BLE start ---------------------------> BLE ready -> advertising
+ *                   -> LED, peripherals, pins, OTA boot check,   ^
+ *                      crash summary, event, rolling code -------'
+ *          The wake timeline has both ends (BLE_START, BLE_WAIT, BLE_READY).
  */
-static bool initializeHardware(void) {
-  bool success = true;
-
+static void initializeHardware(void) {
   DEBUG_VERBOSE(DBG_HW_INIT);
   DEBUG_VERBOSE_F(DBG_HW_STATE, static_cast<int>(rtc_data.state));
 
+  // Add clock optimization here - before BLE init but after basic setup
+  optimizeClocks();
+  diagMark(WakePhase::CLOCKS_DONE);
+
+  // ** IMPORTANT: Always try to setup BLE, regardless of state
+  startBLE();
+
   // Configure status LED
   LED_INIT();
 
-  // Add clock optimization here - before BLE init but after basic setup
-  optimizeClocks();
+  disableUnusedPeripherals();
 
   // -- OLD
   // Configure BOOT button with internal pullup
   // pinMode(WAKEUP_BOOT_BTN_PIN, INPUT_PULLUP);
   // -- NEW
-  // Native ESP-IDF configuration for input with pull-up
-  gpio_config_t io_conf = {
-    .pin_bit_mask = (1ULL << WAKEUP_BOOT_BTN_PIN),
-    .mode = GPIO_MODE_INPUT,
-    .pull_up_en = GPIO_PULLUP_ENABLE,
-    .pull_down_en = GPIO_PULLDOWN_DISABLE,
-    .intr_type = GPIO_INTR_DISABLE,
-    .hys_ctrl_mode = GPIO_HYS_SOFT_DISABLE
-  };
-  gpio_config(&io_conf);
+  configureButtonPins();
 
   // Disable unused pins
   disableUnusedPins();
-
-  // ** IMPORTANT: Always try to setup BLE, regardless of state
-  if (!setupBLE()) {
-    DEBUG_VERBOSE(DBG_ERR_BLE);
-    success = false;
-    rtc_data.lastError = ErrorCode::BLE_INIT_FAILED;
-  }
-
-  DEBUG_VERBOSE_F(DBG_HW_RESULT, success ? "SUCCESS" : "FAILED");
-  return success;
+  diagMark(WakePhase::PINS_DONE);
 }
 
 
@@ -434,8 +591,8 @@ static bool setupBLE(void) {
     // esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, ESP_PWR_LVL_N12);  // -12dBm
     // -- NEW
     // Set minimum transmit power for advertising and scanning
-    esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, ESP_PWR_LVL_N12);   // -12dBm
-    esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_SCAN, ESP_PWR_LVL_N12);  // -12dBm
+    esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, device_config.tx_power);   // -12dBm by default
+    esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_SCAN, device_config.tx_power);  // -12dBm by default
 
     pAdvertising = BLEDevice::getAdvertising();
 
@@ -446,8 +603,8 @@ static bool setupBLE(void) {
 
     // Optimize advertising parameters for power saving
     pAdvertising->setScanResponse(false);
-    pAdvertising->setMinInterval(0x40);  // 40ms * 0.625ms = 25ms
-    pAdvertising->setMaxInterval(0x80);  // 80ms * 0.625ms = 50ms
+    pAdvertising->setMinInterval(device_config.adv_min_interval);  // Default: 0x40 * 0.625ms = 40ms
+    pAdvertising->setMaxInterval(device_config.adv_max_interval);  // Default: 0x80 * 0.625ms = 80ms
 
     DEBUG_VERBOSE(DBG_BLE_SETUP);
     return true;
@@ -458,6 +615,79 @@ static bool setupBLE(void) {
 }
 
 
+/**
+ * @brief BLE start task: setupBLE(), then signals waitBLEReady()
+ */
+static void bleStartTask(void* arg) {
+  (void)arg;
+  ble_ok = setupBLE();
+  diagMark(WakePhase::BLE_READY);
+  xSemaphoreGive(ble_ready_sem);
+  vTaskDelete(nullptr);
+}
+
+
+/**
+* @brief Starts BLE (setupBLE()) without waiting for it
+* @details BLE_START_ASYNC: in a task above loopTask's priority. It runs until the
+*          controller start blocks, and the wake's local setup runs in those gaps.
+*          Otherwise (or if the task can't be created) BLE starts right here, in sequence.
+*/
+static void startBLE(void) {
+  diagMark(WakePhase::BLE_START);
+#if BLE_START_ASYNC
+  ble_ready_sem = xSemaphoreCreateBinary();
+  if (ble_ready_sem != nullptr
+      && xTaskCreate(bleStartTask, "ble_start", BLE_START_TASK_STACK, nullptr, BLE_START_TASK_PRIORITY, nullptr) == pdPASS) {
+    return;
+  }
+  if (ble_ready_sem != nullptr) {
+    vSemaphoreDelete(ble_ready_sem);
+    ble_ready_sem = nullptr;
+  }
+  DEBUG_VERBOSE("\n[BLE] Start task not created, starting in sequence");
+#endif
+  ble_ok = setupBLE();
+  diagMark(WakePhase::BLE_READY);
+}
+
+
+/**
+* @brief Waits until BLE is ready (at most BLE_START_TIMEOUT_MS)
+* @return bool setupBLE() result, false on timeout
+* @note  Only the first call waits
+*/
+static bool waitBLEReady(void) {
+  if (ble_ready_sem == nullptr) {
+    return ble_ok;
+  }
+  diagMark(WakePhase::BLE_WAIT);
+  const bool ready = xSemaphoreTake(ble_ready_sem, pdMS_TO_TICKS(BLE_START_TIMEOUT_MS)) == pdTRUE;
+  if (!ready) {
+    return false;  // Still starting: the semaphore stays with the task, handleError() restarts
+  }
+  vSemaphoreDelete(ble_ready_sem);
+  ble_ready_sem = nullptr;
+  return ble_ok;
+}
+
+
+/**
+* @brief First use of the radio: waits for BLE, a failed start goes to handleError()
+*/
+static void requireBLE(void) {
+  const bool success = waitBLEReady();
+  if (!success) {
+    DEBUG_VERBOSE(DBG_ERR_BLE);
+    rtc_data.lastError = ErrorCode::BLE_INIT_FAILED;
+  }
+  DEBUG_VERBOSE_F(DBG_HW_RESULT, success ? "SUCCESS" : "FAILED");
+  if (!success) {
+    handleError(rtc_data.lastError);
+  }
+}
+
+
 
 
 /**
@@ -499,10 +729,8 @@ static uint32_t generateSeed(void) {
   uint8_t macAddr[6];
   getMacAddressEx(true, macAddr);  // Get raw custom unique MAC bytes using our new function
 
-  uint32_t seed = PRODUCT_KEY;
-  seed ^= ((uint32_t)BATCH_ID << 16);
-  seed ^= ((macAddr[0] << 24) | (macAddr[1] << 16) | (macAddr[2] << 8) | macAddr[3]);
-  return seed;
+  // PRODUCT_KEY, BATCH_ID and the MAC, by the seed policy of ROLLING_CODE_SCHEME (rolling_code.h, shared with the host tools)
+  return ButtonRollingCode::seed(PRODUCT_KEY, BATCH_ID, macAddr);
 }
 
 
@@ -520,7 +748,7 @@ static uint32_t generateSeed(void) {
 *    - Generated seed
 *    - Operation instructions
 * 3. Wait for user action:
-*    - 20 second timeout (FACTORY_WAIT_MS)
+*    - 20 second timeout (device_config.factory_wait_ms)
 *    - Early exit on BOOT button press
 * 4. Transition:
 *    - Mark device as initialized
@@ -534,6 +762,7 @@ static void enterFactoryMode(void) {
   // LED_YELLOW();
 
   DEBUG_VERBOSE(DBG_FACTORY_ENTER);
+  diagEvent(DiagEvent::FACTORY);
 
   // Generate and store new seed
   rtc_data.seed = generateSeed();
@@ -542,11 +771,17 @@ static void enterFactoryMode(void) {
   // Print device information
   DEBUG_VERBOSE_F(DBG_MAC_CUSTOM, getMacAddress().c_str());  // unique custm set MAC address
   DEBUG_VERBOSE_F(DBG_FACTORY_SEED, rtc_data.seed);
+  crashSummaryReport();  // Crash summary from a previous panic, if any
+  diagLogEmit();         // Diagnostic log pages over UART0 (host_tools diag_log_decode)
+
+  // Self-test: one binary result record for the line station, result on the LED
+  runSelfTest();
+
   DEBUG_VERBOSE(DBG_FACTORY_WAIT);  // msg: "Will await 20 sec to jump to normal ops.\n[FACTORY] Or, press BOOT to jump to normal operation."
 
   // Wait for button press or timeout
   uint32_t start_time = millis();
-  while (millis() - start_time < FACTORY_WAIT_MS) {
+  while (millis() - start_time < device_config.factory_wait_ms) {
     BLINK_YELLOW_LED(250);  // Call the blink function frequently
     // -- OLD
     // if (digitalRead(WAKEUP_BOOT_BTN_PIN) == LOW) {
@@ -560,6 +795,7 @@ static void enterFactoryMode(void) {
 
   // Transition to normal operation (steps)
   rtc_data.is_initialized = true;
+  configMarkProvisioned();
   rtc_data.state = DeviceState::NORMAL_MODE;
 
   DEBUG_VERBOSE(DBG_FACTORY_TRANS);
@@ -572,10 +808,127 @@ static void enterFactoryMode(void) {
 
 
 
+/**
+ * @brief Factory self-test
+ * @details Timed steps, sent as one binary record over UART0 (see selftest.h):
+ *          1. eFuse custom MAC programmed
+ *          2. Seed derivation is deterministic and matches the stored seed
+ *          3. BLE init time, taken from this boot's wake timeline (same number the
+ *             diagnostics track)
+ *          4. Short advertising burst
+ *          5. Button line released (waits for the release if factory mode was entered
+ *             by holding the button)
+ *          6. GPIO hold keeps an unused pin low while it's driven high
+ *          7. Deep sleep wakeup configuration
+ *          The first session of a unit also draws its device key (maint_auth.h) and sends
+ *          it, in its own record, ahead of the result.
+ *          LED: 1 sec green if all steps passed, red otherwise.
+ */
+static void runSelfTest(void) {
+  // 1. eFuse custom MAC (all zero = not programmed)
+  uint8_t mac[6] = { 0 };
+  selftestStart();
+  getMacAddressEx(true, mac);
+  selftestBegin(mac);
+  bool mac_set = false;
+  for (int i = 0; i < 6; i++) {
+    mac_set |= mac[i] != 0;
+  }
+  selftestRecord(SelfTestStep::EFUSE_MAC, mac_set, mac_set);
+
+  // 2. Seed derivation - only a hash of the seed leaves the device
+  selftestStart();
+  const uint32_t seed = generateSeed();
+  uint8_t msg[10] = { 'H', 'B', 'S', 'E', 'E', 'D' };
+  memcpy(msg + 6, &seed, sizeof(seed));
+  uint8_t digest[32];
+  mbedtls_sha256(msg, sizeof(msg), digest, 0);
+  uint32_t seed_check;
+  memcpy(&seed_check, digest, sizeof(seed_check));
+  selftestRecord(SelfTestStep::SEED, seed != 0 && seed == rtc_data.seed && generateSeed() == seed, seed_check);
+
+  // 3. BLE init of this boot
+  const uint32_t ble_us = diagPhase(WakePhase::BLE_READY) - diagPhase(WakePhase::BLE_START);
+  selftestRecord(SelfTestStep::BLE_INIT, pAdvertising != nullptr && rtc_data.lastError != ErrorCode::BLE_INIT_FAILED,
+                 static_cast<uint32_t>(device_config.tx_power), ble_us ? ble_us : 1);
+
+  // 4. Advertising burst (manufacturer data: MANUFACTURER_ID + "ST")
+  selftestStart();
+  const uint32_t adv_start = millis();
+  if (pAdvertising) {
+    BLEAdvertisementData advData;
+    advData.setName(PRODUCT_NAME);
+    String data;
+    data += (char)(MANUFACTURER_ID & 0xFF);
+    data += (char)(MANUFACTURER_ID >> 8);
+    data += "ST";
+    advData.setManufacturerData(data);
+    pAdvertising->setAdvertisementData(advData);
+    pAdvertising->start();
+    delay(SELFTEST_ADV_BURST_MS);
+    pAdvertising->stop();
+  }
+  selftestRecord(SelfTestStep::ADV_BURST, pAdvertising != nullptr, millis() - adv_start);
+
+  // 5. Button line
+  selftestStart();
+  const uint32_t release_start = millis();
+  while (gpio_get_level(WAKEUP_BOOT_BTN_PIN) == 0 && millis() - release_start < SELFTEST_BUTTON_RELEASE_MS) {
+    delay(10);
+  }
+  const int level = gpio_get_level(WAKEUP_BOOT_BTN_PIN);
+  selftestRecord(SelfTestStep::BUTTON_LINE, level == 1, level);
+
+  // 6. GPIO hold: held low while driven high, then free to go high (pad works)
+  selftestStart();
+  const gpio_num_t pin = SELFTEST_HOLD_TEST_PIN;
+  gpio_hold_dis(pin);
+  gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT);
+  gpio_set_level(pin, 0);
+  gpio_hold_en(pin);
+  gpio_set_level(pin, 1);
+  const int held = gpio_get_level(pin);
+  gpio_hold_dis(pin);
+  gpio_set_level(pin, 1);
+  const int released = gpio_get_level(pin);
+  gpio_set_level(pin, 0);  // Back to the disableUnusedPins() state
+  gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+  gpio_hold_en(pin);
+  selftestRecord(SelfTestStep::GPIO_HOLD, held == 0 && released == 1, held | (released << 1));
+
+  // 7. Sleep entry: wakeup source (the factory session ends in deep sleep)
+  selftestStart();
+  selftestRecord(SelfTestStep::SLEEP_ENTRY, setupDeepSleepWakeup(WAKEUP_BTN_MASK), 0);
+
+  // Device key of the maintenance channel (maint_auth.h): drawn in the first factory session
+  // (BLE is up, so the RNG is a true random source) and sent to the station only then
+  uint8_t key[MAINT_AUTH_KEY_LEN];
+  if (maintAuthProvision(key)) {
+    selftestEmitKey(mac, key);
+    DEBUG_VERBOSE("\n[FACTORY] New device key sent to the station");
+  }
+  memset(key, 0, sizeof(key));
+
+  selftestEmit();
+  diagEvent(DiagEvent::SELFTEST, (uint8_t)selftest_record.pass_mask);
+  DEBUG_VERBOSE_F("\n[SELFTEST] %s (mask 0x%02X)", selftestPassed() ? "PASS 👏🏼" : "FAIL ❌", selftest_record.pass_mask);
+
+  if (selftestPassed()) {
+    LED_GREEN();
+  } else {
+    LED_RED();
+  }
+  delay(1000);
+  LED_OFF();
+}
+
+
+
+
 /**
 * @brief Generates secure rolling code using seed, timestamp (used for generating rolling code), and mixing operations
 * @details Algorithm flow:
-* 1. Gets 32-bit timestamp from esp_timer
+* 1. Gets the 32-bit timestamp word (device clock + event type + scheme, device_clock.h)
 * 2. Combines with stored seed via multi-stage mixing:
 *    - Initial mix: (seed ^ timestamp) * prime1
 *    - Stage 1: XOR with right-shifted (13 bits)
@@ -586,18 +939,10 @@ static void enterFactoryMode(void) {
 * 
 * @return uint32_t Generated rolling code
 * @note Uses prime multipliers and bit shifts for avalanche effect
+* @note The mixer is that of ROLLING_CODE_SCHEME (rolling_code.h): host verifiers use the same code
 */
 static uint32_t generateRollingCode(const uint32_t timestamp) {
-  uint32_t base = rtc_data.seed;
-
-  uint32_t mixed = (base ^ timestamp) * 0x7FFF;  // Prime1 multiplication
-  mixed = mixed ^ (mixed >> 13);                 // First diffusion
-  mixed = mixed * 0x5C4D;                        // Prime2 multiplication
-  mixed = mixed ^ (mixed >> 17);                 // Second diffusion
-  mixed = mixed * rtc_data.seed;                 // Additional mixing
-  mixed = mixed ^ (mixed >> 16);                 // Final diffusion
-
-  return mixed;
+  return ButtonRollingCode::code(rtc_data.seed, timestamp);
 }
 
 
@@ -609,16 +954,17 @@ static uint32_t generateRollingCode(const uint32_t timestamp) {
 *    - Green LED
 *    - Serial logging
 * 2. Main operations:
+*    - Event of this press from the EXT1 wake pin(s): SOS or cancel (button_events.h)
 *    - Generate rolling code
 *    - (Optional)Print debug info
-*    - Broadcast over BLE
+*    - Broadcast over BLE, with the event's broadcast profile
 * 3. Sleep preparation:
 *    - Increment counter
-*    - Configure WAKEUP_BOOT_BTN_PIN as wakeup source
+*    - Configure WAKEUP_BTN_MASK (SOS and cancel buttons) as wakeup source
 *    - Turn off LED
 *    - Enter deep sleep
 *
-* @note Device wakes on WAKEUP_BOOT_BTN_PIN low signal
+* @note Device wakes on a low signal of either button
 */
 static void enterNormalMode(void) {
   // LED Status: Active/Normal - Green
@@ -630,26 +976,66 @@ static void enterNormalMode(void) {
   // 1. Broadcast Rolling code
   // 2. Go to Sleep
 
+  // Which button woke us: EXT1 status, or the press seen on a timer wake (none, e.g. after factory mode: SOS)
+  const uint64_t wake_mask = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT1 ? esp_sleep_get_ext1_wakeup_status() : timer_wake_press;
+  const ButtonEvent event = buttonEventFromWake(wake_mask, 1ULL << WAKEUP_CANCEL_BTN_PIN);
+
   // 1. Broadcast Rolling code
   // Single call to broadcast - it handles timestamp,
   // rolling code generation and broadcasting internally
-  broadcastBeacon();
+  broadcastBeacon(event);
+  diagEvent(event == ButtonEvent::CANCEL ? DiagEvent::CANCEL : DiagEvent::SOS);
 
   rtc_data.counter++;
 
+  // 2. (Optional) Maintenance mode, if the press pattern was seen during the beacon
+  if (maintenanceRequested()) {
+    rtc_data.state = DeviceState::MAINTENANCE_MODE;
+    maintenanceRun(PRODUCT_NAME, &rtc_data, sizeof(rtc_data), offsetof(rtc_data_t, seed));
+    rtc_data.state = DeviceState::NORMAL_MODE;
+  }
+
   // 3. Prep to sleep ...
+  enterDeepSleep();
+}
+
+
+/**
+* @brief Configures the wakeup source and enters deep sleep
+* @note Returns only if the wakeup pin could not be configured
+*/
+static void enterDeepSleep(void) {
   DEBUG_VERBOSE(DBG_NORMAL_SLEEP);
 
+  // Stuck button: EXT1 is level triggered, a line still low would wake us right away.
+  // Stuck buttons leave the EXT1 mask and are checked on a timer with backoff (button_health.h)
+  button_health_t& health = diag_data.health;
+  const uint64_t low_mask = readButtonLines(health.stuck_mask);
+  const button_wake_plan_t wake_plan = buttonHealthPlan(health, WAKEUP_BTN_MASK, low_mask, diag_data.wakes);
+  if (wake_plan.report) {
+    const uint8_t buttons = ((health.stuck_mask >> WAKEUP_BOOT_BTN_PIN) & 1) | (((health.stuck_mask >> WAKEUP_CANCEL_BTN_PIN) & 1) << 1);
+    diagEvent(DiagEvent::STUCK_BUTTON, buttons);
+    DEBUG_VERBOSE_F("\n[WARNING] Stuck buttons: 0x%02X (0 = released), next check in %lu s", buttons, wake_plan.timer_s);
+  }
+
   // Configure wakeup on GPIO ...
   // Ext1 Wakeup (Multiple Pins) (also, only one for ESP32-H2): Can wake up on MULTIPLE GPIO pins simultaneously & offers more complex
   // setupDeepSleepWakeup();
-  if (!setupDeepSleepWakeup(WAKEUP_BOOT_BTN_PIN)) {
+  if (!setupDeepSleepWakeup(wake_plan.ext1_mask)) {
     DEBUG_VERBOSE("\n[ERROR] Deep sleep wakeup configuration failed ❌");
     DEBUG_VERBOSE("\n[ERROR] So, will not go to sleep (exiting function ...) 😳\n");
     return;
   }
   DEBUG_VERBOSE("\n[WARNING] Will go to sleep as we could setup wakeup pin. 🥱\n");
 
+  // Lazy erase of a captured core dump, after the beacon is done
+  crashSummaryEraseDeferred();
+
+  diagCloseWake((device_config.adv_min_interval + device_config.adv_max_interval) * 625 / 2,
+                advPduUs(advLen(BEACON_ADV_FORMAT, PRODUCT_NAME)));
+  diagLogWake();  // Batched in RTC memory, a flash page every few wakes (diag_log_store.h)
+  diagPrintTimeline();
+
   DEBUG_FLUSH();   // Allow serial to flush
   DEBUG_DEINIT();  // Kill Serial / Deinitilaize Serial
   LED_OFF();       // Turn off LEDs
@@ -661,39 +1047,49 @@ static void enterNormalMode(void) {
   // Solution: - No explicit power domain configuration. Let ESP-IDF handle the power domains automatically for stable wake-up
   powerDownDomains();
 
+  // Close the awake interval with this wake's slow clock calibration. Timer wake: the next
+  // calibration, or the stuck button check if that is sooner
+  deviceClockUpdate();
+  uint32_t timer_s = deviceClockWakeS();
+  if (wake_plan.timer_s && wake_plan.timer_s < timer_s) {
+    timer_s = wake_plan.timer_s;
+  }
+  esp_sleep_enable_timer_wakeup((uint64_t)timer_s * 1000000);
+
   // Go to sleep
+  diagMark(WakePhase::SLEEP_ENTRY);
   esp_deep_sleep_start();
 }
 
 
 /**
 * @brief Broadcasts rolling code via BLE advertising
-* @param code 32-bit rolling code to broadcast
-* @details Packet structure [12 bytes total]:
-*   - Header: MANUFACTURER_ID [2B]
-*   - Type: Rolling code identifier [1B]
-*   - Length: Payload length [1B]
-*   - Payload: Rolling code [4B]
-*   - Payload: Timestamp [4B]      // NEW
-*   - CRC: Checksum [1B]
+* @param event Button event of this press: carried in the timestamp word, selects the broadcast profile
+* @details Advert layout BEACON_ADV_FORMAT (adv_format.h):
+*   - v3 [15 bytes]: v2 | press age [1B]: ms since the wake edge, renewed every ADV_AGE_RESTAMP_MS
+*   - v2 [14 bytes]: MANUFACTURER_ID [2B] | version + event [1B] | rolling code [4B] |
+*     counter: timestamp word without the event + health bits [4B] | device hint [1B]
+*   - v1 [30 bytes]: PRODUCT_NAME [20B] | rolling code [4B] + timestamp [4B] as manufacturer data
 * @flow:
-* 1. Validates BLE initialization
-* 2. Splits 32-bit code into 4 bytes
-* 3. Splits 32-bit timestamp into 4 bytes  // NEW
-* 4. Creates BLE advertisement payload
-* 5. Broadcasts for BEACON_TIME_MS duration
+* 1. Stamps the timestamp word (device clock + event) and generates the rolling code
+* 2. Builds the 8-byte payload (also the 802.15.4 payload) and the advert
+* 3. Validates BLE initialization, stamps the press age
+* 4. Broadcasts for the event's profile: device_config.beacon_time_ms for an SOS, a short burst for a cancel,
+*    at the TX power of the closed loop (tx_power.h)
+* 5. If enabled, sends the same payload as 802.15.4 frames in the same window (sos_802154.h)
 *
-* @note Total payload increased from 9 to 12 bytes to accommodate timestamp
-*       This aids web-app verification by providing timing context
+* @note v2 drops the name, which was more than half of every v1 PDU: 240 instead of 368 us on air.
+*       v3's press age costs 8 us of it back.
 */
-static void broadcastBeacon() {
-  if (!pAdvertising) {
-    DEBUG_VERBOSE(DBG_ERR_BLE_UNINIT);
-    return;
-  }
+static void broadcastBeacon(const ButtonEvent event) {
+  const broadcast_profile_t sos_profile = { device_config.beacon_time_ms, device_config.adv_min_interval,
+                                            device_config.adv_max_interval, true };
+  const broadcast_profile_t profile = buttonEventProfile(event, sos_profile);
+  DEBUG_VERBOSE_F("\n[BLE] Event: %s", buttonEventName(event));
 
-  // Get timestamp ONCE for both operations
-  uint32_t timestamp = esp_timer_get_time() & 0xFFFFFFFF;
+  // Get timestamp ONCE for both operations: device clock in seconds, runs through deep sleep
+  // (device_clock.h), event type and rolling code scheme in its top nibble, all covered by the code
+  uint32_t timestamp = buttonSchemeStamp(buttonEventStamp(deviceClockWord(), event), ROLLING_CODE_SCHEME);
 
   // Generate rolling code using this timestamp
   uint32_t code = generateRollingCode(timestamp);
@@ -701,58 +1097,109 @@ static void broadcastBeacon() {
   printDebugInfo(code);  // Add this here, using same generated code
 
   // Create 8-byte payload
-  uint8_t payload[8];
-  // Rolling code (first 4 bytes)
-  payload[0] = (code >> 24) & 0xFF;
-  payload[1] = (code >> 16) & 0xFF;
-  payload[2] = (code >> 8) & 0xFF;
-  payload[3] = code & 0xFF;
-  // Same timestamp used for generation (next 4 bytes)
-  payload[4] = (timestamp >> 24) & 0xFF;
-  payload[5] = (timestamp >> 16) & 0xFF;
-  payload[6] = (timestamp >> 8) & 0xFF;
-  payload[7] = timestamp & 0xFF;
-
-  // Create advertisement data first
-  BLEAdvertisementData advData;
-  advData.setName(PRODUCT_NAME);
-  String data;
-  for (int i = 0; i < 8; i++) {
-    data += (char)payload[i];
-  }
-  advData.setManufacturerData(data);
-
-  // Now debug output with the created data
-  DEBUG_VERBOSE("\n[BLE] Complete Advertisement Packet Structure:");
-  DEBUG_VERBOSE_F("\n      Header: Manufacturer ID [2B]: 0x%04X", MANUFACTURER_ID);
-  DEBUG_VERBOSE("\n      Type: Rolling code identifier [1B]");
-  DEBUG_VERBOSE_F("\n      Length: Payload length [1B]: %d", 8);  // 8 bytes payload
-  DEBUG_VERBOSE("\n      Payload [8B]:");
-  DEBUG_VERBOSE("\n          Rolling Code [4B]:");
-  for (int i = 0; i < 4; i++) {
-    DEBUG_VERBOSE_F("\n          [%d]: 0x%02X", i, payload[i]);
-  }
-  DEBUG_VERBOSE("\n          Timestamp [4B]:");
-  DEBUG_VERBOSE_F("\n          Full Value: 0x%08X", timestamp);
-  for (int i = 4; i < 8; i++) {
-    DEBUG_VERBOSE_F("\n          [%d]: 0x%02X", i, payload[i]);
-  }
-  DEBUG_VERBOSE("\n[BLE] Complete Adv Packet:");
-  DEBUG_VERBOSE_F("\n      Name: %s", PRODUCT_NAME);
-  DEBUG_VERBOSE("\n      Data: ");
-  for (int i = 0; i < data.length(); i++) {
-    DEBUG_VERBOSE_F("0x%02X ", (uint8_t)data[i]);
+  uint8_t payload[ROLLING_CODE_PAYLOAD_LEN];
+  // Rolling code (first 4 bytes), same timestamp used for generation (next 4 bytes), both big endian
+  rolling_code::encodePayload(code, timestamp, payload);
+
+  // TX power of this press: lowest level that keeps the link margin at the gateways,
+  // from their reports (tx_power.h). The configured level until the first report.
+  const tx_choice_t tx = txPowerChoose(tx_link, static_cast<uint8_t>(device_config.tx_power));
+
+  // Advert: v2 carries the health bits and the device hint instead of the name, v3 the press age too
+  adv_beacon_t beacon = { BEACON_ADV_FORMAT, code, timestamp, advHint(rtc_data.seed), 0, ADV_AGE_NONE };
+  beacon.health |= diag_data.health.stuck_mask ? ADV_HEALTH_STUCK : 0;
+  beacon.health |= crashSummaryPending() ? ADV_HEALTH_CRASH : 0;
+  beacon.health |= rtc_data.lastError != ErrorCode::NONE ? ADV_HEALTH_ERROR : 0;
+  beacon.health |= tx_link.valid && tx.level == tx_link.max_level && !tx.probe ? ADV_HEALTH_LINK : 0;
+
+  // Everything above ran while BLE came up: the radio is needed from here
+  requireBLE();
+  if (!pAdvertising) {
+    DEBUG_VERBOSE(DBG_ERR_BLE_UNINIT);
+    return;
   }
-  DEBUG_VERBOSE_F("\n      Total Packet Size: %d bytes", 12);  // 2+1+1+8 bytes
-  DEBUG_VERBOSE("\n");
 
-  pAdvertising->setAdvertisementData(advData);
+  esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, static_cast<esp_power_level_t>(tx.level));
+  txPowerSent(tx_link, timestamp, tx.level);
+  DEBUG_VERBOSE_F("\n[BLE] TX power: %d dBm%s", TX_POWER_DBM[tx.level], tx.probe ? " (probe)" : "");
+
+  // Press age as late as possible: right before the first PDU (the debug output comes after it)
+  uint8_t adv[ADV_MAX_LEN];
+  beacon.age = advAge(diagWakeAgeMs());
+  const size_t adv_len = setBeaconAdvert(beacon, payload, adv);
+  pAdvertising->setMinInterval(profile.adv_min_interval);
+  pAdvertising->setMaxInterval(profile.adv_max_interval);
 
   // Start advertising for specified duration
-  DEBUG_VERBOSE_F(DBG_BLE_BROADCAST_WARN, static_cast<int>(BEACON_TIME_MS / 1000));
   pAdvertising->start();
-  delay(BEACON_TIME_MS);
+  diagMark(WakePhase::ADV_START);
+  DEBUG_VERBOSE_F("\n[BLE] Advert v%d [%d bytes, %lu us per PDU]:", BEACON_ADV_FORMAT, static_cast<int>(adv_len),
+                  static_cast<unsigned long>(advPduUs(adv_len)));
+  DEBUG_VERBOSE_F("\n      Rolling Code: 0x%08X, Timestamp: 0x%08X", code, timestamp);
+  if (BEACON_ADV_FORMAT == ADV_FORMAT_V3) {
+    DEBUG_VERBOSE_F(", press age %lu ms", static_cast<unsigned long>(advAgeMs(beacon.age)));
+  }
+  DEBUG_VERBOSE("\n      Data: ");
+  for (size_t i = 0; i < adv_len; i++) {
+    DEBUG_VERBOSE_F("0x%02X ", adv[i]);
+  }
+  DEBUG_VERBOSE("\n");
+  DEBUG_VERBOSE_F(DBG_BLE_BROADCAST_WARN, static_cast<int>(profile.beacon_ms / 1000));
+  if (profile.ieee802154) {
+    uint8_t mac[6];
+    getMacAddressEx(true, mac);
+    sos802154Begin(mac, payload);  // No-op unless the 802.15.4 transport is configured
+  }
+  // Instead of a plain delay(beacon time): watch the button for the maintenance press pattern
+  // (SOS button only: a cancel burst is shorter than the pattern window). The SOS press that
+  // woke us is the first press of the pattern
+  maintenancePatternBegin(event == ButtonEvent::SOS);
+  uint32_t start_time = millis();
+  uint32_t stamp_time = start_time;
+  while (millis() - start_time < profile.beacon_ms) {
+    if (event == ButtonEvent::SOS) {
+      maintenancePatternPoll(WAKEUP_BOOT_BTN_PIN);
+    }
+    sos802154Poll();
+    // The age a gateway sees is at most one restamp behind the PDU it hears
+    if (BEACON_ADV_FORMAT == ADV_FORMAT_V3 && millis() - stamp_time >= ADV_AGE_RESTAMP_MS) {
+      beacon.age = advAge(diagWakeAgeMs());
+      setBeaconAdvert(beacon, payload, adv);
+      stamp_time = millis();
+    }
+    delay(10);
+  }
+  sos802154End();
   pAdvertising->stop();
+  diagMark(WakePhase::ADV_STOP);
+}
+
+
+/**
+ * @brief Builds the advert of a press in its layout and hands it to the controller
+ * @param beacon Code, timestamp word, health, hint and press age
+ * @param payload 8-byte payload (v1)
+ * @param adv ADV_MAX_LEN bytes, the advertising data
+ * @return size_t Bytes of advertising data
+ * @note Also while advertising: the controller sends the new data from the next event on
+ */
+static size_t setBeaconAdvert(const adv_beacon_t& beacon, const uint8_t* payload, uint8_t* adv) {
+  size_t adv_len;
+  if (beacon.format == ADV_FORMAT_V3) {
+    adv_len = advBuildV3(MANUFACTURER_ID, beacon, adv);
+  } else if (beacon.format == ADV_FORMAT_V2) {
+    adv_len = advBuildV2(MANUFACTURER_ID, beacon, adv);
+  } else {
+    adv_len = advBuildV1(PRODUCT_NAME, payload, adv);
+  }
+  BLEAdvertisementData advData;
+  String data;
+  for (size_t i = 0; i < adv_len; i++) {
+    data += (char)adv[i];
+  }
+  advData.addData(data);
+  pAdvertising->setAdvertisementData(advData);
+  return adv_len;
 }
 
 
@@ -828,6 +1275,7 @@ static void handleError(const ErrorCode& error) {
   }
 
   rtc_data.state = DeviceState::ERROR;
+  diagEvent(DiagEvent::ERROR, static_cast<uint8_t>(error));
 
   // Detailed error logging
   switch (error) {
@@ -0,0 +1,161 @@
+#!/bin/bash
+
+# Symbolizes compact crash summaries printed by the firmware in factory mode:
+#   [CRASH] pc=0x... cause=0x... ra=0x... bt=0x... build=xxxxxxxx reset=N
+# against the archived button_firmware.elf
+
+# Define colors
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+ELF_FILE="$SCRIPT_DIR/../button_firmware/binary/button_firmware.elf"
+LOG_FILE=""
+
+# Function to find the RISC-V addr2line shipped with the arduino-esp32 core or PlatformIO
+find_addr2line() {
+    if command -v riscv32-esp-elf-addr2line > /dev/null 2>&1; then
+        command -v riscv32-esp-elf-addr2line
+        return
+    fi
+    local candidate
+    for candidate in \
+        "$HOME"/.arduino15/packages/esp32/tools/*/*/riscv32-esp-elf/bin/riscv32-esp-elf-addr2line \
+        "$HOME"/.arduino15/packages/esp32/tools/*/*/bin/riscv32-esp-elf-addr2line \
+        "$HOME"/Library/Arduino15/packages/esp32/tools/*/*/riscv32-esp-elf/bin/riscv32-esp-elf-addr2line \
+        "$HOME"/Library/Arduino15/packages/esp32/tools/*/*/bin/riscv32-esp-elf-addr2line \
+        "$HOME"/.platformio/packages/toolchain-riscv32-esp/bin/riscv32-esp-elf-addr2line; do
+        if [ -x "$candidate" ]; then
+            echo "$candidate"
+            return
+        fi
+    done
+}
+
+# Function to print the RISC-V mcause as text
+describe_cause() {
+    local cause=$(( $1 & 0x7FFFFFFF ))
+    if (( $1 & 0x80000000 )); then
+        echo "Interrupt $cause"
+        return
+    fi
+    case $cause in
+        0) echo "Instruction address misaligned" ;;
+        1) echo "Instruction access fault" ;;
+        2) echo "Illegal instruction" ;;
+        3) echo "Breakpoint" ;;
+        4) echo "Load address misaligned" ;;
+        5) echo "Load access fault" ;;
+        6) echo "Store address misaligned" ;;
+        7) echo "Store access fault" ;;
+        8) echo "Environment call from U-mode" ;;
+        11) echo "Environment call from M-mode" ;;
+        *) echo "Unknown ($cause)" ;;
+    esac
+}
+
+# Function to print the esp_reset_reason_t as text
+describe_reset() {
+    case $1 in
+        4) echo "PANIC" ;;
+        5) echo "INT_WDT" ;;
+        6) echo "TASK_WDT" ;;
+        7) echo "WDT" ;;
+        9) echo "BROWNOUT" ;;
+        *) echo "reason $1" ;;
+    esac
+}
+
+# Function to extract one key=value field from a summary line
+field() {
+    echo "$2" | sed -n "s/.*$1=\([0-9A-Fa-fx]*\).*/\1/p"
+}
+
+# Show usage
+show_usage() {
+    echo "Crash Summary Symbolizer"
+    echo "========================"
+    echo "Usage: $0 [--elf <ELF>] [<LOG_FILE>]"
+    echo ""
+    echo "Options:"
+    echo "  --elf <ELF>    Firmware ELF (default: button_firmware/binary/button_firmware.elf)"
+    echo "  --help         Show this help message"
+    echo ""
+    echo "Reads the serial log of a factory session from <LOG_FILE> or stdin."
+    echo ""
+    echo "Examples:"
+    echo "  $0 factory_session.log"
+    echo "  $0 --elf old_release/button_firmware.elf factory_session.log"
+    echo "  cat /dev/cu.usbserial-2120 | $0"
+    exit 1
+}
+
+# Parse command line arguments
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        --help)
+            show_usage
+            ;;
+        --elf)
+            if [ -n "$2" ]; then
+                ELF_FILE="$2"
+                shift 2
+            else
+                echo -e "${RED}[!]${NC} Error: --elf requires a file argument"
+                show_usage
+            fi
+            ;;
+        *)
+            LOG_FILE="$1"
+            shift
+            ;;
+    esac
+done
+
+if [ ! -f "$ELF_FILE" ]; then
+    echo -e "${RED}[!]${NC} ELF file not found: $ELF_FILE"
+    exit 1
+fi
+
+ADDR2LINE=$(find_addr2line)
+if [ -z "$ADDR2LINE" ]; then
+    echo -e "${YELLOW}[*]${NC} riscv32-esp-elf-addr2line not found, printing raw addresses only"
+fi
+
+# Build id of the firmware = first 4 bytes of the ELF SHA256 (same as app_elf_sha256 on target)
+ELF_BUILD_ID=$( (sha256sum "$ELF_FILE" 2>/dev/null || shasum -a 256 "$ELF_FILE") | cut -c1-8)
+echo -e "${GREEN}[✓]${NC} ELF: $ELF_FILE (build $ELF_BUILD_ID)"
+
+count=0
+while IFS= read -r line; do
+    [[ $line == *"[CRASH] pc="* ]] || continue
+    count=$((count + 1))
+
+    pc=$(field pc "$line")
+    cause=$(field cause "$line")
+    ra=$(field ra "$line")
+    bt=$(field bt "$line")
+    build=$(field build "$line")
+    reset=$(field reset "$line")
+
+    echo ""
+    echo -e "=== Crash #$count (bt hash $bt) ==="
+    echo -e "    Reset:  $(describe_reset "$reset")"
+    echo -e "    Cause:  $(describe_cause "$cause")"
+    if [ "${build,,}" != "${ELF_BUILD_ID,,}" ]; then
+        echo -e "${RED}[!]${NC} Build $build does not match ELF build $ELF_BUILD_ID, symbols may be wrong"
+    fi
+    if [ -n "$ADDR2LINE" ]; then
+        echo -e "    PC:     $("$ADDR2LINE" -pfiaC -e "$ELF_FILE" "$pc")"
+        echo -e "    Caller: $("$ADDR2LINE" -pfiaC -e "$ELF_FILE" "$ra")"
+    else
+        echo -e "    PC:     $pc"
+        echo -e "    Caller: $ra"
+    fi
+done < "${LOG_FILE:-/dev/stdin}"
+
+if [ $count -eq 0 ]; then
+    echo -e "${YELLOW}[*]${NC} No crash summaries found"
+fi
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Factory self-test station: collect the binary self-test records (selftest.h) of freshly
+flashed buttons and log them.
+
+Each port is reset into the factory session (first boot after flashing) and read until a
+record with a valid CRC shows up or --timeout passes. Records are found by their "HBST"
+magic, so debug builds work too: the log text around the record is skipped.
+
+The first session of a unit also sends its maintenance device key ("HBKY" record, right
+before the result). It is sent only once, so a unit whose key isn't recorded here has to be
+re-flashed (nvs erased) and tested again.
+
+Outputs:
+  --results  one row per unit (time, port, mac, pass, pass_mask, per step result + duration)
+  --latency  one row per unit and step (time, mac, step, duration_us, value), the long
+             format for tracking init/wake latency across builds and batches
+  --keys     one row per new device key (time, mac, key): for the backend and maint_client.py,
+             created readable by its owner only
+All files are appended to. A p50/p95 summary per step is printed at the end.
+
+Usage:
+  station.py --port /dev/ttyUSB0 --port /dev/ttyUSB1
+  station.py --port /dev/ttyUSB0 --no-reset --timeout 30
+
+Requires: pyserial (pip install pyserial)
+"""
+
+import argparse
+import csv
+import os
+import struct
+import sys
+import time
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+from datetime import datetime
+
+try:
+    import serial
+except ImportError:
+    sys.exit("[!] pyserial is required: pip install pyserial")
+
+# Must match selftest.h
+MAGIC = b"HBST"
+VERSION = 1
+STEPS = ["EFUSE_MAC", "SEED", "BLE_INIT", "ADV_BURST", "BUTTON_LINE", "GPIO_HOLD", "SLEEP_ENTRY"]
+HEADER_FORMAT = "<4sBBH6sH"   # magic, version, step_count, pass_mask, mac, reserved
+STEP_FORMAT = "<BBHII"        # id, result, reserved, duration_us, value
+HEADER_LEN = struct.calcsize(HEADER_FORMAT)
+STEP_LEN = struct.calcsize(STEP_FORMAT)
+RESULTS = {0: "not_run", 1: "pass", 2: "fail"}
+KEY_MAGIC = b"HBKY"
+KEY_VERSION = 1
+KEY_FORMAT = "<4sBB6s16sI"    # magic, version, reserved, mac, key, crc
+KEY_LEN = struct.calcsize(KEY_FORMAT)
+
+
+def parse_record(buf, start):
+    """Parse the record at buf[start:]. Returns (record dict, end offset), None if it's
+    incomplete yet, or False if the bytes at start aren't a valid record."""
+    if len(buf) - start < HEADER_LEN:
+        return None
+    _, version, count, mask, mac, _ = struct.unpack_from(HEADER_FORMAT, buf, start)
+    if version != VERSION or count != len(STEPS):
+        return False
+    end = start + HEADER_LEN + count * STEP_LEN + 4
+    if len(buf) < end:
+        return None
+    (crc,) = struct.unpack_from("<I", buf, end - 4)
+    if zlib.crc32(bytes(buf[start:end - 4])) != crc:
+        return False
+    steps = []
+    for i in range(count):
+        sid, result, _, duration_us, value = struct.unpack_from(STEP_FORMAT, buf, start + HEADER_LEN + i * STEP_LEN)
+        steps.append({"step": STEPS[sid] if sid < len(STEPS) else str(sid),
+                      "result": RESULTS.get(result, str(result)), "duration_us": duration_us, "value": value})
+    record = {"mac": ":".join(f"{b:02X}" for b in mac), "pass_mask": mask,
+              "passed": mask == (1 << count) - 1, "steps": steps}
+    return record, end
+
+
+def parse_key_record(buf, start):
+    """Parse the device key record at buf[start:], same returns as parse_record()."""
+    if len(buf) - start < KEY_LEN:
+        return None
+    _, version, _, mac, key, crc = struct.unpack_from(KEY_FORMAT, buf, start)
+    if version != KEY_VERSION or zlib.crc32(bytes(buf[start:start + KEY_LEN - 4])) != crc:
+        return False
+    return {"mac": ":".join(f"{b:02X}" for b in mac), "key": key.hex()}, start + KEY_LEN
+
+
+def find_record(buf, magic=MAGIC, parse=parse_record):
+    """First valid record in buf. Returns (record or None, bytes that can be dropped)."""
+    pos = 0
+    while True:
+        start = buf.find(magic, pos)
+        if start < 0:
+            return None, max(0, len(buf) - len(magic) + 1)
+        parsed = parse(buf, start)
+        if parsed is None:
+            return None, start
+        if parsed:
+            return parsed[0], parsed[1]
+        pos = start + 1
+
+
+def run_unit(port, baud, timeout, reset):
+    """Reset one unit and wait for its record. Returns (record or None, message). The record
+    gets the unit's device key if this session sent one ("key", else None)."""
+    try:
+        with serial.Serial(port, baud, timeout=0.1) as ser:
+            if reset:
+                # Same DTR/RTS sequence as esptool's hard reset: EN low, then release
+                ser.dtr = False
+                ser.rts = True
+                time.sleep(0.1)
+                ser.rts = False
+            buf = bytearray()
+            key = None
+            deadline = time.monotonic() + timeout
+            while time.monotonic() < deadline:
+                buf += ser.read(4096)
+                found, key_consumed = find_record(buf, KEY_MAGIC, parse_key_record)
+                key = found or key
+                record, consumed = find_record(buf)
+                if record:
+                    record["key"] = key["key"] if key and key["mac"] == record["mac"] else None
+                    return record, ""
+                del buf[:min(consumed, key_consumed)]
+            return None, f"no self-test record within {timeout:.0f}s"
+    except serial.SerialException as e:
+        return None, str(e)
+
+
+def append_csv(path, header, rows, mode=0o644):
+    new_file = not os.path.exists(path)
+    with open(os.open(path, os.O_WRONLY | os.O_CREAT | os.O_APPEND, mode), "a", newline="") as f:
+        writer = csv.writer(f)
+        if new_file:
+            writer.writerow(header)
+        writer.writerows(rows)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Factory self-test station")
+    parser.add_argument("--port", action="append", required=True, help="Serial port (repeat for parallel units)")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=15, help="Seconds to wait for the record per unit")
+    parser.add_argument("--no-reset", action="store_true", help="Don't reset the units, just listen")
+    parser.add_argument("--results", default="selftest_results.csv", help="Per unit results CSV (appended)")
+    parser.add_argument("--latency", default="selftest_latency.csv", help="Per step durations CSV (appended)")
+    parser.add_argument("--keys", default="device_keys.csv", help="New maintenance device keys CSV (appended, owner only)")
+    args = parser.parse_args()
+
+    print(f"[*] Waiting for self-test records on {len(args.port)} unit(s)")
+    with ThreadPoolExecutor(max_workers=len(args.port)) as pool:
+        results = list(pool.map(lambda p: run_unit(p, args.baud, args.timeout, not args.no_reset), args.port))
+
+    stamp = datetime.now().isoformat(timespec="seconds")
+    result_rows, latency_rows, key_rows = [], [], []
+    for port, (record, _) in zip(args.port, results):
+        if not record:
+            result_rows.append([stamp, port, "", "no_record", ""] + [""] * (2 * len(STEPS)))
+            continue
+        row = [stamp, port, record["mac"], "pass" if record["passed"] else "fail", f"0x{record['pass_mask']:02X}"]
+        for s in record["steps"]:
+            row += [s["result"], s["duration_us"]]
+            latency_rows.append([stamp, record["mac"], s["step"], s["duration_us"], s["value"]])
+        result_rows.append(row)
+        if record["key"]:
+            key_rows.append([stamp, record["mac"], record["key"]])
+    step_columns = [c for name in STEPS for c in (name.lower(), f"{name.lower()}_us")]
+    append_csv(args.results, ["time", "port", "mac", "result", "pass_mask"] + step_columns, result_rows)
+    append_csv(args.latency, ["time", "mac", "step", "duration_us", "value"], latency_rows)
+    if key_rows:
+        append_csv(args.keys, ["time", "mac", "key"], key_rows, mode=0o600)
+
+    failed = 0
+    for port, (record, message) in zip(args.port, results):
+        if not record:
+            print(f"[!] {port}: {message}")
+            failed += 1
+            continue
+        bad = [s["step"] for s in record["steps"] if s["result"] != "pass"]
+        print(f"[{'✓' if not bad else '!'}] {port}: {record['mac']} " + ("PASS" if not bad else "FAIL " + ", ".join(bad))
+              + (f", new device key saved to {args.keys}" if record["key"] else ""))
+        failed += bool(bad)
+
+    # Per step timing over every record in the latency log, not just this run
+    durations = {}
+    with open(args.latency, newline="") as f:
+        for row in csv.DictReader(f):
+            durations.setdefault(row["step"], []).append(int(row["duration_us"]))
+    if durations:
+        print(f"[*] Step durations over {len(durations.get(STEPS[0], []))} record(s) in {args.latency}:")
+        for step in STEPS:
+            if step in durations:
+                v = durations[step]
+                print(f"    {step:<12} p50 {percentile(v, 50) / 1000:8.2f} ms   p95 {percentile(v, 95) / 1000:8.2f} ms")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Flash units on the factory line from a sparse flash set (make_flash_set.py), and time it.
+
+Only the used regions are written (compressed parts are inflated and SHA-256 checked
+first), and the state partitions listed in the set (nvs, coredump) are blanked. With --merged the
+full 4 MB merged image is written instead: this is the baseline to compare against.
+
+Every unit is flashed in its own esptool process, all ports in parallel. One CSV row
+per unit is appended to --log (port, mode, bytes, seconds, result), so flash time per
+unit can be compared before/after on real line data.
+
+Usage:
+  factory_flash.py flash_set/flash_set.json --port /dev/ttyUSB0 --port /dev/ttyUSB1
+  factory_flash.py --merged button_firmware.merged.bin --port /dev/ttyUSB0 --log times.csv
+
+Requires: esptool (pip install esptool)
+"""
+
+import argparse
+import csv
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+
+FLASH_ARGS = ["--flash_mode", "qio", "--flash_freq", "64m", "--flash_size", "4MB"]
+
+
+def esptool_cmd():
+    for name in ("esptool.py", "esptool"):
+        path = shutil.which(name)
+        if path:
+            return [path]
+    return [sys.executable, "-m", "esptool"]
+
+
+def load_flash_set(path, workdir):
+    """Inflate and check every part, return (esptool offset/file pairs, bytes written)."""
+    base = os.path.dirname(os.path.abspath(path))
+    with open(path) as f:
+        manifest = json.load(f)
+    pairs = []
+    for part in manifest["parts"]:
+        with open(os.path.join(base, part["compressed_file"]), "rb") as f:
+            data = zlib.decompress(f.read())
+        if len(data) != part["size"] or hashlib.sha256(data).hexdigest() != part["sha256"]:
+            sys.exit(f"[!] {part['name']}: size or SHA-256 mismatch, flash set is damaged")
+        raw = os.path.join(workdir, part["file"])
+        with open(raw, "wb") as f:
+            f.write(data)
+        pairs += [hex(part["offset"]), raw]
+    # Erase regions go into the same esptool call as blank (0xFF) parts: one connect per
+    # unit, and blank data costs next to nothing on a compressed link
+    for region in manifest.get("erase", []):
+        blank = os.path.join(workdir, f"{region['name']}.erase.bin")
+        with open(blank, "wb") as f:
+            f.write(b"\xff" * region["size"])
+        pairs += [hex(region["offset"]), blank]
+    written = sum(p["size"] for p in manifest["parts"])
+    return pairs, written
+
+
+def flash_unit(port, baud, pairs):
+    """Write all parts in one esptool call. Returns (seconds, ok, last output line)."""
+    start = time.monotonic()
+    cmd = esptool_cmd() + ["--chip", "esp32h2", "--port", port, "--baud", str(baud), "write_flash"] + FLASH_ARGS + pairs
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    seconds = time.monotonic() - start
+    if result.returncode != 0:
+        last = (result.stdout + result.stderr).strip().splitlines()[-1:] or [""]
+        return seconds, False, last[0]
+    return seconds, True, ""
+
+
+def summarize_log(path):
+    """Before/after over the whole log: mean time per unit of each mode (successful units only)."""
+    with open(path, newline="") as f:
+        rows = [row for row in csv.DictReader(f) if row["result"] == "ok"]
+    means = {}
+    for mode in ("merged", "sparse"):
+        times = [float(row["seconds"]) for row in rows if row["mode"] == mode]
+        if times:
+            means[mode] = sum(times) / len(times)
+            print(f"    {mode:<6} {len(times):>4} unit(s), mean {means[mode]:.1f}s")
+    if len(means) == 2:
+        print(f"[*] sparse takes {100.0 * means['sparse'] / means['merged']:.0f}% of the merged flash time")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Factory flashing from a sparse flash set")
+    parser.add_argument("flash_set", nargs="?", help="flash_set.json from make_flash_set.py")
+    parser.add_argument("--merged", help="Baseline: write this full merged image at 0x0 instead")
+    parser.add_argument("--port", action="append", required=True, help="Serial port (repeat for parallel units)")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--log", default="flash_times.csv", help="CSV file the per unit times are appended to")
+    args = parser.parse_args()
+    if bool(args.flash_set) == bool(args.merged):
+        sys.exit("[!] Give either a flash_set.json or --merged <image>")
+
+    with tempfile.TemporaryDirectory() as workdir:
+        if args.merged:
+            mode, pairs, written = "merged", ["0x0", args.merged], os.path.getsize(args.merged)
+        else:
+            mode = "sparse"
+            pairs, written = load_flash_set(args.flash_set, workdir)
+        print(f"[*] {mode}: {written} bytes to write on {len(args.port)} unit(s)")
+
+        with ThreadPoolExecutor(max_workers=len(args.port)) as pool:
+            results = list(pool.map(lambda p: flash_unit(p, args.baud, pairs), args.port))
+
+    new_log = not os.path.exists(args.log)
+    with open(args.log, "a", newline="") as f:
+        writer = csv.writer(f)
+        if new_log:
+            writer.writerow(["port", "mode", "bytes", "seconds", "result"])
+        for port, (seconds, ok, _) in zip(args.port, results):
+            writer.writerow([port, mode, written, f"{seconds:.2f}", "ok" if ok else "fail"])
+
+    failed = 0
+    for port, (seconds, ok, message) in zip(args.port, results):
+        print(f"[{'✓' if ok else '!'}] {port}: {seconds:.1f}s {message}")
+        failed += not ok
+    times = [r[0] for r in results if r[1]]
+    if times:
+        print(f"[*] {mode}: mean {sum(times) / len(times):.1f}s per unit (log: {args.log})")
+    summarize_log(args.log)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+Split a merged (4 MB, 0xFF padded) flash image into a sparse flash set.
+
+Only the regions that hold data are kept: bootloader, partition table, boot_app0
+(otadata) and the app, each at its offset. Every part is stored raw (for the web
+flasher) and deflate-compressed (for the factory line), and listed with its size
+and SHA-256 in flash_set.json. Partitions that carry device state (nvs, coredump)
+are listed as erase regions, so a re-flashed unit starts as clean as with the
+merged image. Each erase region also gets a blank (0xFF) raw file: ESP Web Tools
+can only write parts, so the web manifest lists the blanks to clear the state there
+too.
+
+The set is checked before it is written: the parts laid over 0xFF must give back
+the merged image byte for byte.
+
+Usage: make_flash_set.py <merged.bin> <out_dir> [--version v1.2.3] [--web-manifest manifest.json]
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import struct
+import sys
+import zlib
+
+PARTITION_TABLE_OFFSET = 0x8000
+PARTITION_TABLE_SIZE = 0x1000
+BOOTLOADER_OFFSET = 0x0  # ESP32-H2
+SECTOR = 0x1000
+
+TYPE_APP, TYPE_DATA = 0x00, 0x01
+SUBTYPE_OTA, SUBTYPE_NVS, SUBTYPE_COREDUMP = 0x00, 0x02, 0x03
+STATE_SUBTYPES = (SUBTYPE_NVS, SUBTYPE_COREDUMP)
+
+
+def parse_partitions(image):
+    table = image[PARTITION_TABLE_OFFSET:PARTITION_TABLE_OFFSET + PARTITION_TABLE_SIZE]
+    parts = []
+    for i in range(0, len(table), 32):
+        entry = table[i:i + 32]
+        if entry[:2] != b"\xaa\x50":
+            continue
+        ptype, subtype, offset, size = struct.unpack_from("<BBII", entry, 2)
+        name = entry[12:28].rstrip(b"\0").decode()
+        parts.append(dict(name=name, type=ptype, subtype=subtype, offset=offset, size=size))
+    if not parts:
+        sys.exit("[!] No partition table at 0x8000")
+    return parts
+
+
+def used_length(data):
+    """Length without trailing 0xFF padding, rounded up to 4 bytes (flash write granularity)."""
+    n = len(data.rstrip(b"\xff"))
+    return min(len(data), (n + 3) & ~3)
+
+
+def regions(image, partitions):
+    """(name, offset, data) for every region holding data."""
+    if min(p["offset"] for p in partitions) < PARTITION_TABLE_OFFSET + PARTITION_TABLE_SIZE:
+        sys.exit("[!] Partition overlaps the partition table")
+    found = [("bootloader", BOOTLOADER_OFFSET, image[BOOTLOADER_OFFSET:PARTITION_TABLE_OFFSET]),
+             ("partitions", PARTITION_TABLE_OFFSET, image[PARTITION_TABLE_OFFSET:PARTITION_TABLE_OFFSET + PARTITION_TABLE_SIZE])]
+    for p in partitions:
+        name = p["name"]
+        if p["type"] == TYPE_DATA and p["subtype"] == SUBTYPE_OTA:
+            name = "boot_app0"
+        found.append((name, p["offset"], image[p["offset"]:p["offset"] + p["size"]]))
+
+    out = []
+    for name, offset, data in found:
+        n = used_length(data)
+        if n == 0:
+            continue
+        # boot_app0 is written whole: a stale second otadata sector could select the other slot
+        out.append((name, offset, data if name == "boot_app0" else data[:n]))
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sparse, compressed flash set from a merged image")
+    parser.add_argument("merged", help="Merged flash image (e.g. button_firmware.merged.bin)")
+    parser.add_argument("out_dir")
+    parser.add_argument("--version", default="", help="Firmware version recorded in the manifest")
+    parser.add_argument("--web-manifest", help="esp-web-tools manifest.json to point at the raw parts")
+    args = parser.parse_args()
+
+    with open(args.merged, "rb") as f:
+        image = f.read()
+    partitions = parse_partitions(image)
+    found = regions(image, partitions)
+
+    # Round trip check before anything is written
+    rebuilt = bytearray(b"\xff" * len(image))
+    for _, offset, data in found:
+        rebuilt[offset:offset + len(data)] = data
+    if bytes(rebuilt) != image:
+        sys.exit("[!] Parts don't reproduce the merged image, not writing anything")
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    manifest = dict(version=args.version, chip="ESP32-H2", flash_size=len(image), parts=[], erase=[])
+    for name, offset, data in found:
+        raw_file, zz_file = f"{name}.bin", f"{name}.bin.zz"
+        packed = zlib.compress(data, 9)
+        with open(os.path.join(args.out_dir, raw_file), "wb") as f:
+            f.write(data)
+        with open(os.path.join(args.out_dir, zz_file), "wb") as f:
+            f.write(packed)
+        manifest["parts"].append(dict(name=name, offset=offset, size=len(data), sha256=hashlib.sha256(data).hexdigest(),
+                                      file=raw_file, compressed_file=zz_file, compressed_size=len(packed)))
+    for p in partitions:
+        if p["type"] == TYPE_DATA and p["subtype"] in STATE_SUBTYPES:
+            blank_file = f"{p['name']}.erase.bin"
+            with open(os.path.join(args.out_dir, blank_file), "wb") as f:
+                f.write(b"\xff" * p["size"])
+            manifest["erase"].append(dict(name=p["name"], offset=p["offset"], size=p["size"], file=blank_file))
+    with open(os.path.join(args.out_dir, "flash_set.json"), "w") as f:
+        json.dump(manifest, f, indent=2)
+        f.write("\n")
+
+    if args.web_manifest:
+        with open(args.web_manifest) as f:
+            web = json.load(f)
+        rel = os.path.relpath(args.out_dir, os.path.dirname(os.path.abspath(args.web_manifest)))
+        web["builds"][0]["parts"] = [dict(path=f"{rel}/{p['file']}", offset=hex(p["offset"]))
+                                     for p in sorted(manifest["parts"] + manifest["erase"], key=lambda p: p["offset"])]
+        with open(args.web_manifest, "w") as f:
+            json.dump(web, f, indent=2)
+            f.write("\n")
+
+    written = sum(p["size"] for p in manifest["parts"])
+    packed = sum(p["compressed_size"] for p in manifest["parts"])
+    erased = sum(p["size"] for p in manifest["erase"])
+    print(f"[✓] {len(manifest['parts'])} parts in {args.out_dir}")
+    for p in manifest["parts"]:
+        print(f"    {p['offset']:#08x}  {p['name']:<11} {p['size']:>8} bytes  ({p['compressed_size']} compressed)")
+    print(f"[*] Written: {written} of {len(image)} bytes ({100.0 * written / len(image):.1f}%), "
+          f"{packed} bytes compressed, {erased} bytes erased (nvs, coredump)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+/**
+ * @file    press_pattern_sim.cpp
+ * @brief   Maintenance press pattern against scripted press sequences
+ * @details Runs the firmware's pattern (press_pattern.h) as maintenancePatternPoll() does:
+ *          the SOS line sampled every SIM_POLL_MS from the beacon start on. Each scenario is
+ *          a wake (SOS press or not) and the presses that follow it, with the expected result.
+ *
+ *          Scenarios:
+ *            wake+4           the wake press and 4 quick presses: maintenance mode
+ *            wake+3           the wake press and 3 quick presses: no
+ *            held-wake+4      the wake press still held at the beacon start, then 4 presses
+ *            held-wake+3      the same with 3: the held wake press counts once, not twice
+ *            cancel-wake+4    a cancel wake and 4 SOS presses: no wake press to count
+ *            cancel-wake+5    a cancel wake and 5 SOS presses: maintenance mode
+ *            slow             the wake press and 4 presses spread over 4 s: no
+ *            late-5           the window ran out, 5 new presses later in the beacon: yes
+ *            bounce           the wake press and 4 presses, each bouncing for 40 ms
+ *          Check (exit code 1 if one fails): every scenario ends as expected.
+ *
+ *          Usage: press_pattern_sim [--beacon-start MS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "press_pattern.h"
+
+#define SIM_POLL_MS 10            /**< The beacon loop's delay(10) */
+#define SIM_BEACON_MS 10000       /**< CONFIG_DEFAULT_BEACON_TIME_MS */
+#define SIM_BEACON_START_MS 400   /**< Wake to the first sample (boot, BLE up, advertising started) */
+#define SIM_PRESS_MS 120          /**< A quick press */
+#define SIM_GAP_MS 250            /**< Between quick presses */
+
+struct Press {
+  uint32_t start_ms, end_ms;
+};
+
+struct Scenario {
+  const char* name;
+  bool wake_press;            /**< The wake was an SOS press (it starts at 0 ms) */
+  uint32_t wake_release_ms;   /**< End of the wake press */
+  std::vector<Press> presses; /**< SOS presses after the wake press */
+  bool expected;
+  std::vector<Press> bounces; /**< Contact bounce: short lows, not presses */
+};
+
+static std::vector<Press> quick(uint32_t start_ms, int count, uint32_t gap_ms = SIM_GAP_MS) {
+  std::vector<Press> presses;
+  for (int i = 0; i < count; i++) {
+    presses.push_back({ start_ms, start_ms + SIM_PRESS_MS });
+    start_ms += SIM_PRESS_MS + gap_ms;
+  }
+  return presses;
+}
+
+static bool lowAt(const Scenario& s, uint32_t t) {
+  if (s.wake_press && t < s.wake_release_ms) return true;
+  for (const std::vector<Press>* v : { &s.presses, &s.bounces }) {
+    for (const Press& p : *v) {
+      if (t >= p.start_ms && t < p.end_ms) return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @return uint32_t Time the pattern was detected, 0 if not within the beacon
+ */
+static uint32_t run(const Scenario& s, const uint32_t beacon_start_ms) {
+  press_pattern_t pattern;
+  pressPatternBegin(pattern, s.wake_press);
+  for (uint32_t t = beacon_start_ms; t < beacon_start_ms + SIM_BEACON_MS; t += SIM_POLL_MS) {
+    if (pressPatternStep(pattern, lowAt(s, t), t)) return t;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  uint32_t beacon_start_ms = SIM_BEACON_START_MS;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--beacon-start" && i + 1 < argc) beacon_start_ms = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else {
+      fprintf(stderr, "Usage: %s [--beacon-start MS]\n", argv[0]);
+      return 2;
+    }
+  }
+  const uint32_t first = beacon_start_ms + 50;  // First press after the beacon start
+
+  std::vector<Scenario> scenarios = {
+    { "wake+4", true, 150, quick(first, MAINT_PRESS_COUNT - 1), true, {} },
+    { "wake+3", true, 150, quick(first, MAINT_PRESS_COUNT - 2), false, {} },
+    { "held-wake+4", true, beacon_start_ms + 200, quick(beacon_start_ms + 450, MAINT_PRESS_COUNT - 1), true, {} },
+    { "held-wake+3", true, beacon_start_ms + 200, quick(beacon_start_ms + 450, MAINT_PRESS_COUNT - 2), false, {} },
+    { "cancel-wake+4", false, 0, quick(first, MAINT_PRESS_COUNT - 1), false, {} },
+    { "cancel-wake+5", false, 0, quick(first, MAINT_PRESS_COUNT), true, {} },
+    { "slow", true, 150, quick(first, MAINT_PRESS_COUNT - 1, 900), false, {} },
+    { "late-5", true, 150, quick(5000, MAINT_PRESS_COUNT), true, {} },
+  };
+  Scenario bounce = { "bounce", true, 150, quick(first, MAINT_PRESS_COUNT - 1), true, {} };
+  for (Press& p : bounce.presses) {
+    for (uint32_t b = 0; b < 40; b += 20) bounce.bounces.push_back({ p.start_ms + b, p.start_ms + b + 5 });
+    p.start_ms += 40;
+  }
+  scenarios.push_back(bounce);
+
+  printf("[*] Maintenance pattern: %d presses within %d ms, the wake press included, first sample at %u ms\n\n",
+         MAINT_PRESS_COUNT, MAINT_PATTERN_WINDOW_MS, beacon_start_ms);
+  printf("| Scenario | Presses after the wake | Expected | Result | Detected at |\n");
+  printf("|----------|-----------------------:|----------|--------|------------:|\n");
+  bool ok = true;
+  for (const Scenario& s : scenarios) {
+    const uint32_t at = run(s, beacon_start_ms);
+    ok &= (at != 0) == s.expected;
+    printf("| %s | %zu | %s | %s %s | %s |\n", s.name, s.presses.size(), s.expected ? "maintenance" : "-",
+           (at != 0) == s.expected ? "[✓]" : "[!]", at ? "maintenance" : "-", at ? (std::to_string(at) + " ms").c_str() : "-");
+  }
+  printf("\n[%s] %s\n", ok ? "✓" : "!", ok ? "all scenarios as expected" : "a scenario did not end as expected");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,412 @@
+/**
+ * @file    stuck_sim.cpp
+ * @brief   Stuck button lines against the level-triggered EXT1 wake, with and without detection
+ * @details The button's wake loop on one timeline. Button lines are low during presses and
+ *          stuck intervals. Asleep, an armed line that is low wakes the chip at once (EXT1,
+ *          any low); the timer wakes it for the device clock (hourly, jittered) and, with
+ *          detection, for the stuck button check. A press that starts as the timer fires
+ *          wakes the chip on the timer; the timer path reads the lines a few ms in and
+ *          buttonHealthTimerWakePress() turns a low line that isn't stuck into a button wake.
+ *          A button wake is a boot plus the beacon; a timer wake is a few ms. At every sleep
+ *          entry the firmware's buttonHealthPlan()
+ *          (button_health.h) chooses the wake sources. Without detection (the old firmware)
+ *          all buttons stay armed.
+ *
+ *          Scenarios:
+ *            stuck-sos    the SOS line stuck for 3 days, cancel presses meanwhile, then presses
+ *            stuck-both   both lines stuck for a day (e.g. moisture across both)
+ *            held-press   an SOS press held 1 s past the end of its beacon
+ *            held-long    an SOS press held 30 s
+ *            flaky        the SOS line stuck and released every few minutes for a day
+ *            timer-press  presses that start as a timer wake fires: an SOS press at a device
+ *                         clock wake, a cancel press at a stuck check of the SOS line, an SOS
+ *                         press held 5 s at a clock wake
+ *
+ *          Checks (exit code 1 if one fails), with detection:
+ *            drain        besides its first beacon, a line stuck for hours costs less than 10x
+ *                         the deep sleep current; shorter stuck intervals (each check waits
+ *                         for a release) less than a tenth of the cost without detection
+ *            report-once  one report per stuck line and one per release
+ *            beacons      at most one beacon per stuck interval (the wake that looked like a press)
+ *            rearm        a released line is armed again within BUTTON_STUCK_BACKOFF_MAX_S
+ *            presses      every press wakes the chip, except presses of a released line
+ *                         before its check found it released (counted, bounded by rearm)
+ *            hold         a press held past the beacon isn't reported as stuck
+ *            timer-press  every press at a timer wake is served, none is reported as stuck
+ *          Without detection, the table shows how long the battery lasts once a line sticks.
+ *
+ *          Usage: stuck_sim [--battery-mah N] [--seed N]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+#include "button_health.h"
+
+#define SIM_SOS_GPIO 9                  /**< WAKEUP_BOOT_BTN_PIN */
+#define SIM_CANCEL_GPIO 10              /**< WAKEUP_CANCEL_BTN_PIN */
+#define SIM_WAKE_MASK ((1ULL << SIM_SOS_GPIO) | (1ULL << SIM_CANCEL_GPIO))
+#define SIM_SLEEP_UA 5                  /**< Deep sleep current (POWER_OPTIMIZATION.md) */
+#define SIM_ACTIVE_UA 15000             /**< DIAG_CURRENT_ACTIVE_UA (diagnostics.h) */
+#define SIM_ADV_UA 16500                /**< DIAG_CURRENT_ADV_UA (diagnostics.h) */
+#define SIM_BOOT_S 0.3                  /**< Wake to advertising */
+#define SIM_BEACON_S 10.0               /**< CONFIG_DEFAULT_BEACON_TIME_MS */
+#define SIM_CANCEL_S 2.0                /**< BUTTON_CANCEL_BEACON_MS */
+#define SIM_TIMER_WAKE_S 0.03           /**< Timer wake: boot, clock update, line check, sleep */
+#define SIM_TIMER_READ_S 0.005          /**< Timer wake to the line read in setup() */
+#define SIM_POLL_S 0.01                 /**< readButtonLines() poll interval */
+#define SIM_CAL_WAKE_S 3600             /**< DEVICE_CLOCK_CAL_WAKE_S (device_clock.h) */
+#define SIM_PRESS_S 0.3                 /**< A normal press */
+
+struct Interval {
+  double start, end;
+  bool press;   /**< A press to serve (else a stuck line) */
+  bool served;  /**< The press woke the chip */
+};
+
+/** A press that starts as a timer wake fires: the tie goes to the timer, EXT1 doesn't see it */
+struct TimerPress {
+  double after;      /**< At the first matching timer wake from then on */
+  bool stuck_check;  /**< At a stuck line check, else at a device clock wake */
+  size_t line;
+  double len;
+};
+
+struct Line {
+  uint32_t gpio;
+  std::vector<Interval> low;
+
+  bool isLow(double t) const {
+    for (const Interval& i : low) {
+      if (t >= i.start && t < i.end) return true;
+    }
+    return false;
+  }
+  /** First time >= t the line is low (INFINITY if never) */
+  double nextLow(double t) const {
+    double next = INFINITY;
+    for (const Interval& i : low) {
+      if (t >= i.start && t < i.end) return t;
+      if (i.start > t) next = std::min(next, i.start);
+    }
+    return next;
+  }
+};
+
+struct Scenario {
+  const char* name;
+  double days;
+  std::vector<Line> lines;  /**< SOS, cancel */
+  std::vector<TimerPress> timer_presses;
+};
+
+struct RunResult {
+  double charge_uc = 0;
+  double stuck_charge_uc = 0;     /**< While a line is stuck */
+  double stuck_s = 0;
+  double empty_after_h = -1;      /**< Battery empty this long after the first stuck line, -1 = not */
+  double stuck_beacon_uc = 0;     /**< Beacons woken by a stuck line */
+  uint32_t beacons = 0;
+  uint32_t stuck_beacons = 0;     /**< Woken by a stuck line */
+  uint32_t timer_wakes = 0;
+  uint32_t reports = 0, releases = 0, episodes = 0;
+  uint32_t presses = 0, served = 0, before_rearm = 0;
+  uint32_t timer_presses = 0, timer_served = 0;
+  uint32_t stuck_intervals = 0;
+  double rearm_max_s = 0;
+};
+
+/* ============= Scenarios ============= */
+
+static Interval press(double t, double len = SIM_PRESS_S) {
+  return { t, t + len, true, false };
+}
+
+static std::vector<Scenario> makeScenarios(std::mt19937& rng) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  std::vector<Scenario> scenarios;
+  const double h = 3600, d = 86400;
+
+  Scenario s = { "stuck-sos", 7, { { SIM_SOS_GPIO, {} }, { SIM_CANCEL_GPIO, {} } }, {} };
+  s.lines[0].low.push_back(press(2 * h));
+  s.lines[0].low.push_back({ d, 4 * d, false, false });
+  for (double t = d + 3 * h; t < 4 * d; t += 6 * h + uni(rng) * h) s.lines[1].low.push_back(press(t));
+  for (double t = 4 * d + 600; t < 7 * d; t += 12 * h + uni(rng) * h) s.lines[0].low.push_back(press(t));
+  scenarios.push_back(s);
+
+  s = { "stuck-both", 3, { { SIM_SOS_GPIO, {} }, { SIM_CANCEL_GPIO, {} } }, {} };
+  s.lines[0].low.push_back({ d, 2 * d, false, false });
+  s.lines[1].low.push_back({ d + 60, 2 * d + 1800, false, false });
+  s.lines[0].low.push_back(press(2 * d + 2 * h));
+  s.lines[1].low.push_back(press(2 * d + 3 * h));
+  scenarios.push_back(s);
+
+  s = { "held-press", 1, { { SIM_SOS_GPIO, {} }, { SIM_CANCEL_GPIO, {} } }, {} };
+  s.lines[0].low.push_back(press(h, SIM_BOOT_S + SIM_BEACON_S + 1.0));
+  s.lines[0].low.push_back(press(2 * h));
+  scenarios.push_back(s);
+
+  s = { "held-long", 1, { { SIM_SOS_GPIO, {} }, { SIM_CANCEL_GPIO, {} } }, {} };
+  s.lines[0].low.push_back({ h, h + 30, false, false });
+  s.lines[0].low.push_back(press(h + 120));
+  scenarios.push_back(s);
+
+  s = { "flaky", 2, { { SIM_SOS_GPIO, {} }, { SIM_CANCEL_GPIO, {} } }, {} };
+  for (double t = h; t < d + h; ) {
+    const double stuck = 60 + uni(rng) * 600, gap = 60 + uni(rng) * 600;
+    s.lines[0].low.push_back({ t, t + stuck, false, false });
+    t += stuck + gap;
+  }
+  s.lines[0].low.push_back(press(d + 2 * h));
+  scenarios.push_back(s);
+
+  s = { "timer-press", 1, { { SIM_SOS_GPIO, {} }, { SIM_CANCEL_GPIO, {} } }, {} };
+  s.lines[0].low.push_back({ 6 * h, 6 * h + 600, false, false });
+  s.timer_presses = { { 0, false, 0, SIM_PRESS_S }, { 6 * h, true, 1, SIM_PRESS_S }, { 12 * h, false, 0, 5.0 } };
+  scenarios.push_back(s);
+  return scenarios;
+}
+
+/* ============= Device ============= */
+
+static bool stuckAt(const Scenario& s, double t) {
+  for (const Line& l : s.lines) {
+    for (const Interval& i : l.low) {
+      if (!i.press && t >= i.start && t < i.end) return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t stuckMask(const Scenario& s, double t) {
+  uint64_t m = 0;
+  for (const Line& l : s.lines) {
+    for (const Interval& i : l.low) {
+      if (!i.press && t >= i.start && t < i.end) m |= 1ULL << l.gpio;
+    }
+  }
+  return m;
+}
+
+static uint64_t lowMask(const Scenario& s, double t) {
+  uint64_t m = 0;
+  for (const Line& l : s.lines) {
+    if (l.isLow(t)) m |= 1ULL << l.gpio;
+  }
+  return m;
+}
+
+static RunResult run(const Scenario& scenario, const bool detect, const double battery_mah, const uint32_t seed) {
+  Scenario s = scenario;  // Timer presses are added as their wakes come
+  size_t next_timer_press = 0;
+  std::mt19937 rng(seed);
+  RunResult r;
+  button_health_t health = {};
+  const double end = s.days * 86400;
+  const double battery_uc = battery_mah * 3.6e6;
+  double first_stuck = INFINITY;
+  struct StuckEnd {
+    uint64_t gpio_bit;
+    double end;
+    double rearmed;  /**< First sleep entry with the line armed again */
+    double next_low; /**< The line goes low again (rearm no longer pending) */
+  };
+  std::vector<StuckEnd> stuck_ends;
+  for (const Line& l : s.lines) {
+    for (const Interval& i : l.low) {
+      if (i.press) {
+        r.presses++;
+      } else {
+        first_stuck = std::min(first_stuck, i.start);
+        stuck_ends.push_back({ 1ULL << l.gpio, i.end, INFINITY, l.nextLow(i.end) });
+      }
+    }
+  }
+  r.stuck_intervals = (uint32_t)stuck_ends.size();
+
+  double t = 0;
+  uint64_t armed = SIM_WAKE_MASK;
+  uint32_t timer_s = SIM_CAL_WAKE_S, wakes = 0;
+  bool stuck_check = false;  /**< The timer is the stuck line check, not the device clock */
+  const auto spend = [&](double from, double to, double ua) {
+    const double uc = ua * (to - from);
+    r.charge_uc += uc;
+    if (stuckAt(s, from)) {
+      r.stuck_charge_uc += uc;
+      r.stuck_s += to - from;
+    }
+    if (r.empty_after_h < 0 && r.charge_uc > battery_uc && first_stuck < to) {
+      r.empty_after_h = (to - first_stuck) / 3600;
+    }
+  };
+
+  while (t < end) {
+    // Asleep: the first armed line that is low, or the timer
+    double wake_t = t + timer_s;
+    for (const Line& l : s.lines) {
+      if (armed & (1ULL << l.gpio)) wake_t = std::min(wake_t, l.nextLow(t));
+    }
+    for (StuckEnd& e : stuck_ends) {
+      if ((armed & e.gpio_bit) && t >= e.end) e.rearmed = std::min(e.rearmed, t);
+    }
+    wake_t = std::min(wake_t, end);
+    spend(t, wake_t, SIM_SLEEP_UA);
+    if (wake_t >= end) break;
+    wakes++;
+
+    // Awake: EXT1 status, or on a timer wake (the timer wins a tie) the lines read in setup()
+    const bool timer_wake = wake_t >= t + timer_s;
+    if (timer_wake && next_timer_press < s.timer_presses.size()) {
+      const TimerPress& tp = s.timer_presses[next_timer_press];
+      if (wake_t >= tp.after && stuck_check == tp.stuck_check) {
+        s.lines[tp.line].low.push_back(press(wake_t, tp.len));
+        r.presses++;
+        r.timer_presses++;
+        next_timer_press++;
+      }
+    }
+    const uint64_t status = timer_wake ? buttonHealthTimerWakePress(health, SIM_WAKE_MASK, lowMask(s, wake_t + SIM_TIMER_READ_S))
+                                       : lowMask(s, wake_t) & armed;
+    double awake_s;
+    if (status) {
+      const ButtonEvent event = buttonEventFromWake(status, 1ULL << SIM_CANCEL_GPIO);
+      awake_s = SIM_BOOT_S + (event == ButtonEvent::CANCEL ? SIM_CANCEL_S : SIM_BEACON_S);
+      spend(wake_t, wake_t + SIM_BOOT_S, SIM_ACTIVE_UA);
+      spend(wake_t + SIM_BOOT_S, wake_t + awake_s, SIM_ADV_UA);
+      r.beacons++;
+      if (status & stuckMask(s, wake_t)) {
+        r.stuck_beacons++;
+        r.stuck_beacon_uc += SIM_ACTIVE_UA * SIM_BOOT_S + SIM_ADV_UA * (awake_s - SIM_BOOT_S);
+      }
+      for (Line& l : s.lines) {
+        for (Interval& i : l.low) {
+          if (i.press && (status & (1ULL << l.gpio)) && wake_t >= i.start && wake_t < i.start + 0.05) {
+            r.timer_served += timer_wake && !i.served;
+            i.served = true;
+          }
+        }
+      }
+    } else {
+      awake_s = SIM_TIMER_WAKE_S;
+      spend(wake_t, wake_t + awake_s, SIM_ACTIVE_UA);
+      r.timer_wakes++;
+    }
+    double sleep_t = wake_t + awake_s;
+
+    // Sleep entry: readButtonLines(), then the plan
+    if (detect) {
+      const double wait_end = sleep_t + BUTTON_STUCK_RELEASE_WAIT_MS / 1000.0;
+      while ((lowMask(s, sleep_t) & ~(uint64_t)health.stuck_mask) && sleep_t < wait_end) sleep_t += SIM_POLL_S;
+      spend(wake_t + awake_s, sleep_t, SIM_ACTIVE_UA);
+      const button_wake_plan_t plan = buttonHealthPlan(health, SIM_WAKE_MASK, lowMask(s, sleep_t), wakes);
+      r.reports += plan.report > 0;
+      r.releases += plan.report < 0;
+      armed = plan.ext1_mask;
+      timer_s = SIM_CAL_WAKE_S / 2 + rng() % SIM_CAL_WAKE_S;
+      stuck_check = plan.timer_s && plan.timer_s < timer_s;
+      if (stuck_check) timer_s = plan.timer_s;
+    } else {
+      armed = SIM_WAKE_MASK;
+      timer_s = SIM_CAL_WAKE_S / 2 + rng() % SIM_CAL_WAKE_S;
+    }
+    t = sleep_t;
+  }
+
+  r.episodes = health.episodes;
+  for (const StuckEnd& e : stuck_ends) {
+    if (e.end < end) r.rearm_max_s = std::max(r.rearm_max_s, std::min(e.rearmed, e.next_low) - e.end);
+  }
+  for (const Line& l : s.lines) {
+    for (const Interval& i : l.low) {
+      if (!i.press) continue;
+      r.served += i.served;
+      for (const StuckEnd& e : stuck_ends) {
+        const bool pending = e.gpio_bit == 1ULL << l.gpio && i.start >= e.end && i.start < std::min(e.rearmed, e.next_low);
+        r.before_rearm += !i.served && pending;
+      }
+    }
+  }
+  return r;
+}
+
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-11s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  double battery_mah = 220;  // CR2032
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--battery-mah" && i + 1 < argc) battery_mah = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else {
+      fprintf(stderr, "Usage: %s [--battery-mah N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  std::mt19937 rng(seed);
+  const std::vector<Scenario> scenarios = makeScenarios(rng);
+
+  printf("[*] Stuck lines against EXT1 (any low), %.0f mAh battery, backoff %d-%d s\n\n", battery_mah,
+         BUTTON_STUCK_BACKOFF_MIN_S, BUTTON_STUCK_BACKOFF_MAX_S);
+  printf("| Scenario | Firmware | Beacons | Timer wakes | Stuck: mean current | Battery empty | Presses served | Rearm |\n");
+  printf("|----------|----------|--------:|------------:|--------------------:|--------------:|---------------:|------:|\n");
+
+  bool ok = true;
+  char detail[200];
+  for (const Scenario& s : scenarios) {
+    const RunResult old_fw = run(s, false, battery_mah, seed);
+    const RunResult r = run(s, true, battery_mah, seed);
+    for (int k = 0; k < 2; k++) {
+      const RunResult& x = k ? r : old_fw;
+      const std::string empty = x.empty_after_h < 0 ? "-" : std::to_string((int)lround(x.empty_after_h)) + " h after sticking";
+      printf("| %s | %s | %u | %u | %s | %s | %u / %u | %.0f s |\n", s.name, k ? "detection" : "no detection", x.beacons,
+             x.timer_wakes, x.stuck_s > 0 ? (std::to_string((int)lround(x.stuck_charge_uc / x.stuck_s)) + " uA").c_str() : "-",
+             empty.c_str(), x.served, x.presses, x.rearm_max_s);
+    }
+
+    printf("\n[*] %s: %u episode(s), %u report(s), %u release(s)\n", s.name, r.episodes, r.reports, r.releases);
+    if (r.stuck_s > 0) {
+      const double mean_ua = (r.stuck_charge_uc - r.stuck_beacon_uc) / r.stuck_s;
+      const double old_ua = old_fw.stuck_charge_uc / old_fw.stuck_s;
+      const double limit_ua = r.stuck_s / r.stuck_intervals >= 3600 ? 10 * SIM_SLEEP_UA : old_ua / 10;
+      snprintf(detail, sizeof(detail), "%.1f uA while stuck besides the first beacons (limit %.0f uA; without detection %.0f uA)",
+               mean_ua, limit_ua, old_ua);
+      ok &= check("drain", mean_ua < limit_ua, detail);
+      // A line stuck again before its release was seen continues the episode
+      snprintf(detail, sizeof(detail), "%u stuck intervals: %u episodes, %u reports, %u releases", r.stuck_intervals, r.episodes,
+               r.reports, r.releases);
+      ok &= check("report-once", r.episodes > 0 && r.reports >= r.episodes && r.reports <= r.stuck_intervals &&
+                                     r.releases == r.episodes, detail);
+      snprintf(detail, sizeof(detail), "%u beacon(s) woken by %u stuck intervals (without detection: %u)", r.stuck_beacons,
+               r.stuck_intervals, old_fw.stuck_beacons);
+      ok &= check("beacons", r.stuck_beacons <= r.stuck_intervals, detail);
+      snprintf(detail, sizeof(detail), "released lines armed again within %.0f s", r.rearm_max_s);
+      ok &= check("rearm", r.rearm_max_s <= BUTTON_STUCK_BACKOFF_MAX_S, detail);
+    }
+    snprintf(detail, sizeof(detail), "%u of %u presses woke the chip, %u more before the release check", r.served, r.presses,
+             r.before_rearm);
+    ok &= check("presses", r.served + r.before_rearm == r.presses, detail);
+    if (strcmp(s.name, "held-press") == 0) {
+      snprintf(detail, sizeof(detail), "%u stuck report(s) for a press held 1 s past its beacon", r.reports);
+      ok &= check("hold", r.reports == 0, detail);
+    }
+    if (!s.timer_presses.empty()) {
+      snprintf(detail, sizeof(detail), "%u of %u presses at timer wakes served (%zu scripted), %u stuck report(s) for %u stuck interval(s)",
+               r.timer_served, r.timer_presses, s.timer_presses.size(), r.reports, r.stuck_intervals);
+      ok &= check("timer-press", r.timer_presses == s.timer_presses.size() && r.timer_served == r.timer_presses &&
+                                     r.reports == r.stuck_intervals, detail);
+    }
+    printf("\n");
+  }
+  return ok ? 0 : 1;
+}
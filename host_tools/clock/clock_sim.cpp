@@ -0,0 +1,286 @@
+/**
+ * @file    clock_sim.cpp
+ * @brief   Device clock through deep sleep: drift of the RC slow clock against calibration strategies
+ * @details The button's clock counts RTC slow clock ticks (device_clock.h). The RC slow
+ *          clock is off by a few percent per chip and drifts with temperature; the slow
+ *          clock calibration (period against the 32 MHz XTAL) is only measured when the
+ *          chip wakes. This simulator runs a year of deep sleep for many chips and compares
+ *          how ticks are turned into time:
+ *            nominal       nominal period, no calibration
+ *            wake-cal      period calibrated at the wake that ends the sleep (what
+ *                          esp_rtc_get_time_us() does)
+ *            mean-cal      mean of the calibrations at both ends of the sleep
+ *            + cal wakes   mean-cal, plus a timer wake about every DEVICE_CLOCK_CAL_WAKE_S
+ *                          (jittered) that only calibrates: what device_clock.h does
+ *          The arithmetic is deviceClockUpdate()'s: Q13.19 periods, integer microseconds.
+ *
+ *          Chip: static RC error +-5%, temperature coefficient up to --tempco ppm/C, XTAL
+ *          +-10 ppm, calibration noise 5 ppm. Temperature profiles: indoor (daily cycle),
+ *          worn (body heat by day, cold nights), outdoor (daily and seasonal cycle, weather).
+ *          Presses (--presses per day) wake the chip too.
+ *
+ *          Reported: worst clock error over all chips within 7 days, 30 days and a year of
+ *          the first sync, and the charge the calibration wakes cost.
+ *          Check (exit code 1 if it fails): the firmware's strategy stays within the
+ *          verifier window RC_VERIFY_WINDOW_S (rc_verify) for a year.
+ *
+ *          Usage: clock_sim [--chips N] [--days N] [--presses P] [--tempco PPM] [--cal-wake S] [--seed N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+
+#define SIM_RC_SLOW_HZ 136000.0         /**< ESP32-H2 RC_SLOW nominal */
+#define SIM_RTC_CLK_CAL_FRACT 19        /**< RTC_CLK_CAL_FRACT */
+#define SIM_STEP_S 10.0                 /**< Integration step of the temperature */
+#define SIM_WAKE_MS 30                  /**< Awake time of a calibration-only wake (boot, update, sleep) */
+#define SIM_SLEEP_UA 5                  /**< Deep sleep current (POWER_OPTIMIZATION.md) */
+#define DEVICE_CLOCK_CAL_WAKE_S 3600    /**< Keep in sync with device_clock.h */
+#define RC_VERIFY_WINDOW_S 900          /**< Keep in sync with rc_verify */
+#define DIAG_CURRENT_ACTIVE_UA 15000    /**< diagnostics.h */
+
+struct SimConfig {
+  uint32_t chips = 40;
+  uint32_t days = 365;
+  double presses = 0.5;        /**< Per day */
+  double tempco_ppm = 300;     /**< Largest |temperature coefficient| of a chip (5% over -40..125 C) */
+  uint32_t cal_wake_s = DEVICE_CLOCK_CAL_WAKE_S;
+  uint32_t seed = 1;
+};
+
+/* ============= Temperature ============= */
+enum class Profile { INDOOR, WORN, OUTDOOR, COUNT };
+static const char* const profile_names[] = { "indoor", "worn", "outdoor" };
+
+class Temperature {
+public:
+  Temperature(Profile p, std::mt19937& rng) : profile(p), rng(rng) {}
+
+  /** @brief Temperature at t (s), advancing the weather by one step */
+  double step(double t) {
+    const double day = fmod(t, 86400.0) / 86400.0;
+    const double daily = sin(2 * M_PI * (day - 0.25));  // Peak mid-afternoon
+    switch (profile) {
+      case Profile::INDOOR:
+        weather = ou(weather, 1.0, 3 * 3600.0);
+        return 21 + 2 * daily + weather;
+      case Profile::WORN: {
+        weather = ou(weather, 2.0, 3600.0);
+        const bool worn = day > 8.0 / 24 && day < 22.0 / 24;
+        return (worn ? 30 : 14) + weather;
+      }
+      default: {
+        weather = ou(weather, 3.0, 6 * 3600.0);
+        const double season = sin(2 * M_PI * t / (365.25 * 86400.0));
+        return 10 + 6 * daily + 10 * season + weather;
+      }
+    }
+  }
+
+private:
+  /** @brief Ornstein-Uhlenbeck step: stationary sigma, correlation time tau */
+  double ou(double x, double sigma, double tau) {
+    const double a = exp(-SIM_STEP_S / tau);
+    return a * x + sigma * sqrt(1 - a * a) * normal(rng);
+  }
+
+  Profile profile;
+  std::mt19937& rng;
+  std::normal_distribution<double> normal{ 0.0, 1.0 };
+  double weather = 0;
+};
+
+/* ============= Chip ============= */
+struct Chip {
+  double static_err;   /**< RC frequency error at 25 C */
+  double tempco;       /**< Per C */
+  double tempco2;      /**< Per C^2 */
+  double xtal_err;     /**< Calibration reference error */
+
+  double hz(double temp) const {
+    const double d = temp - 25;
+    return SIM_RC_SLOW_HZ * (1 + static_err + tempco * d + tempco2 * d * d);
+  }
+};
+
+/* ============= Strategies ============= */
+enum class Strategy { NOMINAL, WAKE_CAL, MEAN_CAL, CAL_WAKES, COUNT };
+static const char* const strategy_names[] = { "nominal", "wake-cal", "mean-cal", "+ cal wakes" };
+#define STRATEGIES ((int)Strategy::COUNT)
+
+/**
+ * @brief One device clock (deviceClockUpdate() / deviceClockSync() arithmetic)
+ */
+struct DeviceClock {
+  Strategy strategy;
+  uint64_t last_ticks = 0;
+  uint32_t cal = 0;
+  uint64_t elapsed_us = 0;
+  int64_t offset_us = 0;
+
+  static uint64_t toUs(uint64_t ticks, uint32_t period) {
+    return (ticks * period) >> SIM_RTC_CLK_CAL_FRACT;  // rtc_time_slowclk_to_us()
+  }
+
+  void update(uint64_t ticks, uint32_t cal_now) {
+    const uint32_t nominal = (uint32_t)((1e6 / SIM_RC_SLOW_HZ) * (1 << SIM_RTC_CLK_CAL_FRACT));
+    const uint64_t d = ticks - last_ticks;
+    uint64_t us;
+    switch (strategy) {
+      case Strategy::NOMINAL: us = toUs(d, nominal); break;
+      case Strategy::WAKE_CAL: us = toUs(d, cal_now); break;
+      default: us = toUs(d, (uint32_t)(((uint64_t)cal + cal_now) / 2)); break;
+    }
+    elapsed_us += us;
+    last_ticks = ticks;
+    cal = cal_now;
+  }
+
+  int64_t nowUs(void) const {
+    return (int64_t)elapsed_us + offset_us;
+  }
+
+  void sync(int64_t true_us) {
+    offset_us = true_us - (int64_t)elapsed_us;
+  }
+};
+
+struct ChipResult {
+  double worst_s[STRATEGIES][3] = {};  /**< Worst |error| within 7 d, 30 d, the whole run */
+  uint64_t cal_wakes = 0;
+};
+
+static ChipResult runChip(const SimConfig& cfg, Profile profile, std::mt19937& rng) {
+  std::uniform_real_distribution<double> uni(-1.0, 1.0);
+  std::normal_distribution<double> cal_noise(0.0, 5e-6);
+  std::exponential_distribution<double> press_gap(cfg.presses / 86400.0);
+  Chip chip;
+  chip.static_err = 0.05 * uni(rng);
+  chip.tempco = cfg.tempco_ppm * 1e-6 * uni(rng);
+  chip.tempco2 = 2e-6 * uni(rng);
+  chip.xtal_err = 10e-6 * uni(rng);
+
+  Temperature temperature(profile, rng);
+  double ticks = 0;  // Real valued, the counter reads floor()
+  double t = 0, temp = temperature.step(0);
+  auto calibrate = [&]() {
+    const double period_us = 1e6 / chip.hz(temp) * (1 + chip.xtal_err) * (1 + cal_noise(rng));
+    return (uint32_t)llround(period_us * (1 << SIM_RTC_CLK_CAL_FRACT));
+  };
+
+  DeviceClock clocks[STRATEGIES];
+  for (int s = 0; s < STRATEGIES; s++) {
+    clocks[s].strategy = (Strategy)s;
+    clocks[s].update(0, calibrate());
+    clocks[s].sync(0);
+  }
+
+  ChipResult res;
+  const double end = cfg.days * 86400.0;
+  double next_press = press_gap(rng);
+  double next_cal = cfg.cal_wake_s;
+  double next_check = 3600;
+  while (t < end) {
+    t += SIM_STEP_S;
+    ticks += chip.hz(temp) * SIM_STEP_S;
+    temp = temperature.step(t);
+    const uint64_t counter = (uint64_t)ticks;
+
+    const bool press = t >= next_press;
+    const bool cal_wake = t >= next_cal;
+    const bool check = t >= next_check;
+    if (press) next_press += press_gap(rng);
+    if (cal_wake) next_cal += cfg.cal_wake_s * (0.5 + (uni(rng) + 1) / 2);  // Jittered like the firmware
+    if (check) next_check += 3600;
+    if (!press && !cal_wake && !check) {
+      continue;
+    }
+
+    const uint32_t cal = calibrate();
+    res.cal_wakes += cal_wake && !press;
+    const int64_t true_us = (int64_t)(t * 1e6);
+    for (int s = 0; s < STRATEGIES; s++) {
+      DeviceClock& c = clocks[s];
+      const bool wakes = press || (cal_wake && s >= (int)Strategy::CAL_WAKES);
+      if (wakes) {
+        c.update(counter, cal);
+      }
+      if (check) {
+        // What a press now would send: a wake updates the clock first (copy, don't disturb)
+        DeviceClock probe = c;
+        probe.update(counter, cal);
+        const double err = fabs((double)(probe.nowUs() - true_us)) / 1e6;
+        for (int r = 0; r < 3; r++) {
+          const double limit = r == 0 ? 7 * 86400.0 : r == 1 ? 30 * 86400.0 : end;
+          if (t <= limit) res.worst_s[s][r] = std::max(res.worst_s[s][r], err);
+        }
+      }
+    }
+  }
+  return res;
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--chips" && i + 1 < argc) cfg.chips = (uint32_t)atoi(argv[++i]);
+    else if (a == "--days" && i + 1 < argc) cfg.days = (uint32_t)atoi(argv[++i]);
+    else if (a == "--presses" && i + 1 < argc) cfg.presses = atof(argv[++i]);
+    else if (a == "--tempco" && i + 1 < argc) cfg.tempco_ppm = atof(argv[++i]);
+    else if (a == "--cal-wake" && i + 1 < argc) cfg.cal_wake_s = (uint32_t)atoi(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Usage: %s [--chips N] [--days N] [--presses P] [--tempco PPM] [--cal-wake S] "
+                      "[--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (cfg.days < 7 || cfg.cal_wake_s == 0 || cfg.presses <= 0) {
+    fprintf(stderr, "[!] Need --days >= 7, --cal-wake > 0, --presses > 0\n");
+    return 2;
+  }
+
+  printf("[*] %u chips per profile, %u days, %.2f presses/day, tempco up to %.0f ppm/C, cal wake every %u s\n\n",
+         cfg.chips, cfg.days, cfg.presses, cfg.tempco_ppm, cfg.cal_wake_s);
+  printf("| Profile | Strategy | 7 days | 30 days | %u days |\n", cfg.days);
+  printf("|---------|----------|--------|---------|---------|\n");
+
+  std::mt19937 rng(cfg.seed);
+  double firmware_worst = 0;
+  uint64_t cal_wakes = 0;
+  for (int p = 0; p < (int)Profile::COUNT; p++) {
+    double worst[STRATEGIES][3] = {};
+    for (uint32_t c = 0; c < cfg.chips; c++) {
+      const ChipResult r = runChip(cfg, (Profile)p, rng);
+      for (int s = 0; s < STRATEGIES; s++)
+        for (int k = 0; k < 3; k++) worst[s][k] = std::max(worst[s][k], r.worst_s[s][k]);
+      cal_wakes += r.cal_wakes;
+    }
+    for (int s = 0; s < STRATEGIES; s++) {
+      printf("| %s | %s | %.1f s | %.1f s | %.1f s |\n", profile_names[p], strategy_names[s], worst[s][0], worst[s][1], worst[s][2]);
+    }
+    firmware_worst = std::max(firmware_worst, worst[(int)Strategy::CAL_WAKES][2]);
+  }
+
+  const double wakes_per_day = (double)cal_wakes / ((double)cfg.chips * (int)Profile::COUNT * cfg.days);
+  const double wake_uc = (double)DIAG_CURRENT_ACTIVE_UA * SIM_WAKE_MS / 1000;
+  const double sleep_uc_day = (double)SIM_SLEEP_UA * 86400;
+  printf("\n[*] Calibration wakes: %.1f per day, ~%.0f uC each (%d ms at %d uA): %.2f%% on top of the deep sleep current\n",
+         wakes_per_day, wake_uc, SIM_WAKE_MS, DIAG_CURRENT_ACTIVE_UA, 100 * wakes_per_day * wake_uc / sleep_uc_day);
+
+  char detail[120];
+  snprintf(detail, sizeof(detail), "worst error %.1f s in %u days (verifier window +-%d s)", firmware_worst, cfg.days,
+           RC_VERIFY_WINDOW_S);
+  const bool ok = firmware_worst < RC_VERIFY_WINDOW_S;
+  printf("[%s] %-9s %s\n", ok ? "✓" : "!", "window", detail);
+  return ok ? 0 : 1;
+}
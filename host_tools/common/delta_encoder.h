@@ -0,0 +1,300 @@
+/**
+ * @file    delta_encoder.h
+ * @brief   Encoder for compressed binary delta (HBD1) images
+ * @details Counterpart of button_firmware/ota_delta.h (see there for the format).
+ *          1. Delta: bsdiff like. Matches are found through an 8 byte hash index over
+ *             the base image, then extended forward while at least half of the bytes
+ *             match (shifted code after a small change still matches "mostly"). Such
+ *             regions become DIFF ops (mostly zero bytes), exact regions COPY ops,
+ *             unmatched bytes ADD ops.
+ *          2. LZ: greedy hash chain compressor over the op stream, LZ4 block like tokens.
+ */
+
+#ifndef HOST_DELTA_ENCODER_H
+#define HOST_DELTA_ENCODER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "ota_delta.h"
+#include "sha256.h"
+
+namespace delta {
+
+using Bytes = std::vector<uint8_t>;
+
+/* ============= Op stream ============= */
+inline void putVarint(Bytes& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((uint8_t)v);
+}
+
+inline void putSvarint(Bytes& out, int32_t v) {
+  putVarint(out, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+class OpWriter {
+public:
+  explicit OpWriter(Bytes& out) : out(out) {}
+
+  void add(const uint8_t* data, uint32_t len) {
+    if (len == 0) return;
+    out.push_back(static_cast<uint8_t>(DeltaOp::ADD));
+    putVarint(out, len);
+    out.insert(out.end(), data, data + len);
+  }
+
+  void diffOrCopy(const Bytes& base, const Bytes& target, uint32_t old_at, uint32_t new_at, uint32_t len) {
+    bool exact = memcmp(&base[old_at], &target[new_at], len) == 0;
+    out.push_back(static_cast<uint8_t>(exact ? DeltaOp::COPY : DeltaOp::DIFF));
+    putSvarint(out, (int32_t)(old_at - old_cursor));
+    putVarint(out, len);
+    if (!exact) {
+      for (uint32_t i = 0; i < len; i++) {
+        out.push_back((uint8_t)(target[new_at + i] - base[old_at + i]));
+      }
+    }
+    old_cursor = old_at + len;
+  }
+
+private:
+  Bytes& out;
+  uint32_t old_cursor = 0;
+};
+
+/**
+ * @brief Build the (uncompressed) delta op stream turning `base` into `target`
+ */
+inline Bytes makeOps(const Bytes& base, const Bytes& target) {
+  const uint32_t kKey = 8;        // bytes hashed for the index
+  const uint32_t kHashBits = 20;
+  const uint32_t kMaxCandidates = 32;
+  const uint32_t kMinMatch = 12;  // exact bytes needed to start a region
+  const uint32_t kWindow = 16;    // approximate extension window
+
+  auto hashAt = [&](const Bytes& b, uint32_t i) {
+    uint64_t v;
+    memcpy(&v, &b[i], sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - kHashBits));
+  };
+
+  // Hash index over the base: head per bucket + chain to the previous position
+  std::vector<int32_t> head(1u << kHashBits, -1);
+  std::vector<int32_t> chain(base.size(), -1);
+  for (uint32_t i = 0; i + kKey <= base.size(); i++) {
+    const uint32_t h = hashAt(base, i);
+    chain[i] = head[h];
+    head[h] = (int32_t)i;
+  }
+
+  Bytes ops;
+  OpWriter writer(ops);
+  uint32_t p = 0;
+  uint32_t literal_start = 0;
+  int64_t align = 0;  // old index = new index + align
+  const uint32_t n = (uint32_t)target.size();
+
+  auto matchesAt = [&](uint32_t np, int64_t al, uint32_t len) {
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < len && np + i < n; i++) {
+      const int64_t o = (int64_t)np + i + al;
+      if (o >= 0 && o < (int64_t)base.size() && base[o] == target[np + i]) m++;
+    }
+    return m;
+  };
+
+  while (p < n) {
+    // 1. Keep the current alignment while it still mostly matches
+    bool aligned = matchesAt(p, align, kWindow) >= kWindow / 2 && p + align >= 0;
+    if (!aligned && p + kKey <= n) {
+      // 2. Look for a new alignment through the hash index
+      uint32_t best_len = 0;
+      int64_t best_align = 0;
+      uint32_t tries = 0;
+      for (int32_t c = head[hashAt(target, p)]; c >= 0 && tries < kMaxCandidates; c = chain[c], tries++) {
+        uint32_t len = 0;
+        while (p + len < n && c + len < base.size() && base[c + len] == target[p + len]) len++;
+        if (len > best_len) {
+          best_len = len;
+          best_align = (int64_t)c - p;
+        }
+      }
+      if (best_len >= kMinMatch) {
+        align = best_align;
+        aligned = true;
+      }
+    }
+    if (!aligned) {
+      p++;
+      continue;
+    }
+
+    // 3. Extend the region while at least half of each window matches
+    uint32_t end = p;
+    while (end < n && end + align < (int64_t)base.size() && matchesAt(end, align, kWindow) >= kWindow / 2) {
+      end += kWindow;
+    }
+    if (end > n) end = n;
+    if (end + align > (int64_t)base.size()) end = (uint32_t)(base.size() - align);
+    // Trim trailing mismatches
+    while (end > p && base[end - 1 + align] != target[end - 1]) end--;
+    if (end == p) {
+      p++;
+      continue;
+    }
+
+    writer.add(&target[literal_start], p - literal_start);
+    // Long exact stretches inside a region become COPY, the rest DIFF
+    uint32_t seg = p;
+    while (seg < end) {
+      uint32_t run_end = seg;
+      while (run_end < end && base[run_end + align] == target[run_end]) run_end++;
+      if (run_end - seg >= 64 || run_end == end) {
+        writer.diffOrCopy(base, target, (uint32_t)(seg + align), seg, run_end - seg);
+        seg = run_end;
+      } else {
+        // Mismatch soon: DIFF up to the start of the next long exact run
+        uint32_t next = run_end;
+        while (next < end) {
+          uint32_t r = next;
+          while (r < end && base[r + align] == target[r]) r++;
+          if (r - next >= 64 || r == end) break;
+          next = r + 1;
+        }
+        writer.diffOrCopy(base, target, (uint32_t)(seg + align), seg, next - seg);
+        seg = next;
+      }
+    }
+    p = end;
+    literal_start = p;
+  }
+  writer.add(&target[literal_start], n - literal_start);
+  return ops;
+}
+
+/* ============= LZ layer ============= */
+inline void putLength(Bytes& out, uint32_t len) {
+  while (len >= 255) {
+    out.push_back(255);
+    len -= 255;
+  }
+  out.push_back((uint8_t)len);
+}
+
+/**
+ * @brief Compress with the LZ layer understood by DeltaDecoder
+ */
+inline Bytes lzCompress(const Bytes& in) {
+  const uint32_t kHashBits = 16;
+  const uint32_t kMaxChain = 64;
+  const uint32_t kMaxMatch = 4096;
+  Bytes out;
+  std::vector<int32_t> head(1u << kHashBits, -1);
+  std::vector<int32_t> prev(in.size(), -1);
+  const uint32_t n = (uint32_t)in.size();
+
+  auto hash4 = [&](uint32_t i) {
+    uint32_t v;
+    memcpy(&v, &in[i], 4);
+    return (v * 2654435761u) >> (32 - kHashBits);
+  };
+  auto insert = [&](uint32_t i) {
+    if (i + 4 > n) return;
+    const uint32_t h = hash4(i);
+    prev[i] = head[h];
+    head[h] = (int32_t)i;
+  };
+
+  uint32_t p = 0;
+  uint32_t lit_start = 0;
+  while (p < n) {
+    uint32_t best_len = 0, best_off = 0;
+    if (p + OTA_LZ_MIN_MATCH <= n) {
+      uint32_t chain_len = 0;
+      for (int32_t c = head[hash4(p)]; c >= 0 && p - c <= OTA_LZ_WINDOW && chain_len < kMaxChain; c = prev[c], chain_len++) {
+        uint32_t len = 0;
+        while (p + len < n && len < kMaxMatch && in[c + len] == in[p + len]) len++;
+        if (len > best_len) {
+          best_len = len;
+          best_off = p - c;
+        }
+      }
+    }
+    if (best_len < OTA_LZ_MIN_MATCH) {
+      insert(p);
+      p++;
+      continue;
+    }
+
+    const uint32_t lit = p - lit_start;
+    const uint32_t ml = best_len - OTA_LZ_MIN_MATCH;
+    out.push_back((uint8_t)(((lit < 15 ? lit : 15) << 4) | (ml < 15 ? ml : 15)));
+    if (lit >= 15) putLength(out, lit - 15);
+    out.insert(out.end(), in.begin() + lit_start, in.begin() + p);
+    out.push_back((uint8_t)best_off);
+    out.push_back((uint8_t)(best_off >> 8));
+    if (ml >= 15) putLength(out, ml - 15);
+
+    for (uint32_t i = 0; i < best_len; i++) insert(p + i);
+    p += best_len;
+    lit_start = p;
+  }
+  // Trailing literals: last sequence without a match
+  const uint32_t lit = n - lit_start;
+  if (lit > 0) {
+    out.push_back((uint8_t)((lit < 15 ? lit : 15) << 4));
+    if (lit >= 15) putLength(out, lit - 15);
+    out.insert(out.end(), in.begin() + lit_start, in.end());
+  }
+  return out;
+}
+
+/* ============= Image ============= */
+/**
+ * @brief Decoder I/O over memory (host side decode / simulation)
+ */
+class MemoryIo : public DeltaIo {
+public:
+  explicit MemoryIo(const Bytes& base) : base(base) {}
+  bool readBase(uint32_t offset, uint8_t* buf, size_t len) override {
+    if ((uint64_t)offset + len > base.size()) return false;
+    memcpy(buf, &base[offset], len);
+    return true;
+  }
+  bool writeTarget(const uint8_t* buf, size_t len) override {
+    target.insert(target.end(), buf, buf + len);
+    sha.update(buf, len);
+    return true;
+  }
+  const Bytes& base;
+  Bytes target;
+  Sha256 sha;
+};
+
+inline void putU32(Bytes& out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+/**
+ * @brief Header + compressed delta turning `base` into `target`
+ */
+inline Bytes makeImage(const Bytes& base, const Bytes& target) {
+  Bytes image(OTA_DELTA_MAGIC, OTA_DELTA_MAGIC + 4);
+  putU32(image, (uint32_t)base.size());
+  const Sha256::Digest base_hash = Sha256::hash(base.data(), base.size());
+  image.insert(image.end(), base_hash.begin(), base_hash.end());
+  putU32(image, (uint32_t)target.size());
+  const Sha256::Digest target_hash = Sha256::hash(target.data(), target.size());
+  image.insert(image.end(), target_hash.begin(), target_hash.end());
+  const Bytes payload = lzCompress(makeOps(base, target));
+  image.insert(image.end(), payload.begin(), payload.end());
+  return image;
+}
+
+}  // namespace delta
+
+#endif  // HOST_DELTA_ENCODER_H
@@ -0,0 +1,46 @@
+/**
+ * @file    diag_log_pages.h
+ * @brief   Diagnostic log pages (diag_log.h) found in any byte stream, in seq order
+ * @details The pages are found by magic and CRC at any byte offset, so the same reader
+ *          takes a partition image (esptool read_flash), a UART capture of a factory
+ *          session with debug text around the pages, and the pages maint_client.py log
+ *          saved. A page seen twice (two readouts in one capture) is kept once.
+ */
+
+#ifndef HOST_DIAG_LOG_PAGES_H
+#define HOST_DIAG_LOG_PAGES_H
+
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <map>
+#include <vector>
+
+#include "diag_log.h"
+
+using DiagLogPage = std::array<uint8_t, DIAG_LOG_PAGE>;
+
+/**
+ * @brief Valid pages of `data`, by seq
+ */
+inline std::map<uint32_t, DiagLogPage> findDiagLogPages(const uint8_t* data, const size_t len) {
+  std::map<uint32_t, DiagLogPage> pages;
+  size_t i = 0;
+  while (i + DIAG_LOG_PAGE <= len) {
+    if (diagLogGet32(data + i) == DIAG_LOG_MAGIC && diagLogPageValid(data + i)) {
+      DiagLogPage page;
+      memcpy(page.data(), data + i, DIAG_LOG_PAGE);
+      pages[diagLogPageSeq(page.data())] = page;
+      i += DIAG_LOG_PAGE;
+    } else {
+      i++;
+    }
+  }
+  return pages;
+}
+
+inline std::map<uint32_t, DiagLogPage> findDiagLogPages(const std::vector<uint8_t>& data) {
+  return findDiagLogPages(data.data(), data.size());
+}
+
+#endif  // HOST_DIAG_LOG_PAGES_H
@@ -0,0 +1,39 @@
+/**
+ * @file    file_util.h
+ * @brief   Whole-file read/write helpers for the host tools
+ */
+
+#ifndef HOST_FILE_UTIL_H
+#define HOST_FILE_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+inline bool readFile(const std::string& path, std::vector<uint8_t>& out) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    return false;
+  }
+  out.clear();
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    out.insert(out.end(), buf, buf + n);
+  }
+  const bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+inline bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+#endif  // HOST_FILE_UTIL_H
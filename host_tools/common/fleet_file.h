@@ -0,0 +1,144 @@
+/**
+ * @file    fleet_file.h
+ * @brief   Fleet file: custom MAC and rolling code seed of every provisioned button
+ * @details CSV, one button per line:
+ *            mac,seed
+ *            24:6F:28:A1:B2:C3,0x36197ED9
+ *          The MAC is the custom MAC burned at provisioning (the seed source), not the
+ *          BLE advertising address. Lines starting with '#' are comments.
+ *
+ *          During a rolling code scheme migration (rolling_code.h) a button has a seed per
+ *          scheme and the scheme it was enrolled with:
+ *            mac,seed,seed_v2,scheme
+ *            24:6F:28:A1:B2:C3,0x36197ED9,0x20C7BD0A,1
+ *          A two-column line is a V1 button without a V2 seed.
+ *          Written by rc_fleet and gateway_sim --fleet, read by rc_verify.
+ */
+
+#ifndef HOST_FLEET_FILE_H
+#define HOST_FLEET_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "rolling_code.h"
+
+struct FleetEntry {
+  uint8_t mac[6];
+  uint8_t scheme = ROLLING_CODE_SCHEME_V1;  /**< Enrolled with */
+  bool has_v2 = false;                       /**< seed_v2 is known */
+  uint32_t seed;                             /**< V1 */
+  uint32_t seed_v2 = 0;
+};
+
+inline bool parseMac(const char* s, uint8_t* mac) {
+  unsigned b[6];
+  char tail;
+  if (sscanf(s, "%2x:%2x:%2x:%2x:%2x:%2x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &tail) != 6) {
+    return false;
+  }
+  for (int i = 0; i < 6; i++) mac[i] = (uint8_t)b[i];
+  return true;
+}
+
+inline std::string formatMac(const uint8_t* mac) {
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return buf;
+}
+
+/**
+ * @brief Buttons provisioned with sequential custom MACs from `first_mac`
+ * @param scheme Enrolled scheme
+ * @param dual Both seeds (a fleet that migrates, or is enrolled on V2)
+ */
+inline std::vector<FleetEntry> makeFleet(uint32_t product_key, uint16_t batch_id, const uint8_t* first_mac, uint32_t count,
+                                         uint8_t scheme = ROLLING_CODE_SCHEME_V1, bool dual = false) {
+  uint64_t base = 0;
+  for (int i = 0; i < 6; i++) base = (base << 8) | first_mac[i];
+  std::vector<FleetEntry> fleet(count);
+  for (uint32_t n = 0; n < count; n++) {
+    const uint64_t m = (base + n) & 0xFFFFFFFFFFFFull;
+    for (int i = 0; i < 6; i++) fleet[n].mac[i] = (uint8_t)(m >> (40 - 8 * i));
+    fleet[n].seed = rolling_code::RollingCodeV1::seed(product_key, batch_id, fleet[n].mac);
+    fleet[n].scheme = scheme;
+    fleet[n].has_v2 = dual || scheme == ROLLING_CODE_SCHEME_V2;
+    fleet[n].seed_v2 = fleet[n].has_v2 ? rolling_code::RollingCodeV2::seed(product_key, batch_id, fleet[n].mac) : 0;
+  }
+  return fleet;
+}
+
+inline bool writeFleet(const std::string& path, const std::vector<FleetEntry>& fleet) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  bool dual = false;
+  for (const FleetEntry& e : fleet) dual |= e.has_v2 || e.scheme != ROLLING_CODE_SCHEME_V1;
+  fprintf(f, dual ? "mac,seed,seed_v2,scheme\n" : "mac,seed\n");
+  for (const FleetEntry& e : fleet) {
+    if (dual && e.has_v2) {
+      fprintf(f, "%s,0x%08X,0x%08X,%u\n", formatMac(e.mac).c_str(), e.seed, e.seed_v2, e.scheme);
+    } else {
+      fprintf(f, "%s,0x%08X\n", formatMac(e.mac).c_str(), e.seed);
+    }
+  }
+  const bool ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
+
+/**
+ * @return bool false if the file can't be read or a line doesn't parse (`error` says which)
+ */
+inline bool readFleet(const std::string& path, std::vector<FleetEntry>& fleet, std::string& error) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    error = "can't open " + path;
+    return false;
+  }
+  fleet.clear();
+  char line[128];
+  uint32_t lineno = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineno++;
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == 0 || line[0] == '#' || strcmp(line, "mac,seed") == 0 || strcmp(line, "mac,seed,seed_v2,scheme") == 0) {
+      continue;
+    }
+    FleetEntry e;
+    char* comma = strchr(line, ',');
+    char* end = nullptr;
+    if (comma) {
+      *comma = 0;
+      e.seed = (uint32_t)strtoul(comma + 1, &end, 0);
+    }
+    ok = comma && parseMac(line, e.mac) && end != comma + 1;
+    if (ok && *end == ',') {
+      // Migration columns: seed_v2,scheme
+      char* v2 = end + 1;
+      e.seed_v2 = (uint32_t)strtoul(v2, &end, 0);
+      e.has_v2 = true;
+      ok = end != v2 && *end == ',';
+      if (ok) {
+        const unsigned long scheme = strtoul(end + 1, &end, 10);
+        e.scheme = (uint8_t)scheme;
+        ok = scheme == ROLLING_CODE_SCHEME_V1 || scheme == ROLLING_CODE_SCHEME_V2;
+      }
+    }
+    ok = ok && *end == 0;
+    if (ok) {
+      fleet.push_back(e);
+    } else {
+      error = path + ":" + std::to_string(lineno) + ": expected mac,seed or mac,seed,seed_v2,scheme";
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+#endif  // HOST_FLEET_FILE_H
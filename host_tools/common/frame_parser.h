@@ -0,0 +1,318 @@
+/**
+ * @file    frame_parser.h
+ * @brief   Zero-copy parser for gateway UART frames (gateway_core.h frame format)
+ * @details MirrorRing: power-of-two ring buffer mapped twice back to back, so any span of
+ *          up to `capacity` bytes starting anywhere in the ring is contiguous in memory.
+ *          read() goes straight into it, and a frame that wraps around the end needs
+ *          no copy.
+ *
+ *          FrameParser: finds the sync bytes (SSE2 when available: 16 positions per
+ *          compare), checks version, count and CRC-32, and hands out FrameViews. A view's
+ *          records point into the ring. Nothing is copied or allocated per frame.
+ *          A view is valid until the next MirrorRing::fill() / commit().
+ *
+ *          Resync: a header or CRC that doesn't check out skips ONE byte and scans on.
+ *          A corrupted frame therefore never takes the valid frame after it along.
+ */
+
+#ifndef HOST_FRAME_PARSER_H
+#define HOST_FRAME_PARSER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gateway_core.h"
+
+namespace gwlink {
+
+/* ============= Ring buffer ============= */
+class MirrorRing {
+public:
+  MirrorRing() = default;
+  MirrorRing(const MirrorRing&) = delete;
+  MirrorRing& operator=(const MirrorRing&) = delete;
+
+  ~MirrorRing() {
+    if (base) {
+      munmap(base, 2 * cap);
+    }
+  }
+
+  /**
+   * @brief Map the ring
+   * @param capacity Power of two, multiple of the page size
+   */
+  bool init(size_t capacity) {
+    if (capacity == 0 || (capacity & (capacity - 1)) || capacity % (size_t)sysconf(_SC_PAGESIZE)) {
+      return false;
+    }
+#if defined(__linux__)
+    const int fd = memfd_create("gw_ring", 0);
+#else
+    char path[] = "/tmp/gw_ring_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd >= 0) {
+      unlink(path);
+    }
+#endif
+    if (fd < 0) {
+      return false;
+    }
+    bool ok = ftruncate(fd, (off_t)capacity) == 0;
+    uint8_t* area = nullptr;
+    if (ok) {
+      // Reserve 2x, then map the same pages into both halves
+      void* p = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      ok = p != MAP_FAILED;
+      area = (uint8_t*)p;
+    }
+    ok = ok && mmap(area, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+         && mmap(area + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+    close(fd);
+    if (!ok) {
+      if (area) {
+        munmap(area, 2 * capacity);
+      }
+      return false;
+    }
+    base = area;
+    cap = capacity;
+    mask = capacity - 1;
+    return true;
+  }
+
+  size_t size(void) const {
+    return (size_t)(tail - head);
+  }
+
+  size_t space(void) const {
+    return cap - size();
+  }
+
+  /** @brief Unread data, contiguous for size() bytes */
+  const uint8_t* readPtr(void) const {
+    return base + (head & mask);
+  }
+
+  /** @brief Free space, contiguous for space() bytes */
+  uint8_t* writePtr(void) {
+    return base + (tail & mask);
+  }
+
+  void commit(size_t n) {
+    tail += n;
+  }
+
+  void consume(size_t n) {
+    head += n;
+  }
+
+  /**
+   * @brief read() from fd into the ring
+   * @return bytes read, 0 on EOF / ring full, -1 on error (errno set; EAGAIN for no data)
+   */
+  ssize_t fill(int fd) {
+    if (space() == 0) {
+      return 0;
+    }
+    const ssize_t n = read(fd, writePtr(), space());
+    if (n > 0) {
+      commit((size_t)n);
+    }
+    return n;
+  }
+
+private:
+  uint8_t* base = nullptr;
+  size_t cap = 0;
+  size_t mask = 0;
+  uint64_t head = 0;
+  uint64_t tail = 0;
+};
+
+/* ============= Sync search ============= */
+static const size_t NPOS = (size_t)-1;
+
+/**
+ * @brief Offset of the first GW_FRAME_SYNC0 GW_FRAME_SYNC1 pair, byte by byte
+ */
+inline size_t findSyncScalar(const uint8_t* p, size_t n) {
+  for (size_t i = 0; i + 1 < n; i++) {
+    if (p[i] == GW_FRAME_SYNC0 && p[i + 1] == GW_FRAME_SYNC1) {
+      return i;
+    }
+  }
+  return NPOS;
+}
+
+/**
+ * @brief Offset of the first sync pair, 16 positions per step with SSE2
+ */
+inline size_t findSync(const uint8_t* p, size_t n) {
+#if defined(__SSE2__)
+  const __m128i s0 = _mm_set1_epi8((char)GW_FRAME_SYNC0);
+  const __m128i s1 = _mm_set1_epi8((char)GW_FRAME_SYNC1);
+  size_t i = 0;
+  for (; i + 17 <= n; i += 16) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+    const __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 1));
+    const int m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, s0), _mm_cmpeq_epi8(b, s1)));
+    if (m) {
+      return i + (size_t)__builtin_ctz((unsigned)m);
+    }
+  }
+  const size_t rest = findSyncScalar(p + i, n - i);
+  return rest == NPOS ? NPOS : i + rest;
+#else
+  return findSyncScalar(p, n);
+#endif
+}
+
+/* ============= CRC ============= */
+/**
+ * @brief CRC-32 (zlib), slicing-by-8
+ */
+class Crc32 {
+public:
+  Crc32() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int s = 1; s < 8; s++) {
+        t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+      }
+    }
+  }
+
+  uint32_t operator()(const uint8_t* p, size_t n) const {
+    uint32_t crc = 0xFFFFFFFFu;
+    while (n >= 8) {
+      uint32_t lo, hi;
+      memcpy(&lo, p, 4);
+      memcpy(&hi, p + 4, 4);
+      lo ^= crc;
+      crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+      p += 8;
+      n -= 8;
+    }
+    while (n--) {
+      crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+
+private:
+  uint32_t t[8][256];
+};
+
+/* ============= Parser ============= */
+/**
+ * @brief One validated frame; records point into the ring
+ */
+struct FrameView {
+  uint16_t seq;
+  uint8_t count;
+  const gw_record_t* records;  /**< Packed, 1-byte aligned */
+};
+
+struct ParserStats {
+  uint64_t frames = 0;
+  uint64_t records = 0;
+  uint64_t skipped_bytes = 0;  /**< Bytes outside valid frames */
+  uint64_t crc_errors = 0;
+  uint64_t bad_headers = 0;
+  uint64_t seq_gaps = 0;       /**< Frames lost according to the sequence numbers */
+};
+
+template <size_t (*FindSync)(const uint8_t*, size_t) = findSync>
+class FrameParser {
+public:
+  explicit FrameParser(MirrorRing& ring) : ring(ring) {}
+
+  /**
+   * @brief Next valid frame from the ring
+   * @return bool false if more data is needed
+   */
+  bool next(FrameView& view) {
+    for (;;) {
+      const size_t avail = ring.size();
+      const uint8_t* p = ring.readPtr();
+      if (avail < 2) {
+        return false;
+      }
+      if (p[0] != GW_FRAME_SYNC0 || p[1] != GW_FRAME_SYNC1) {
+        const size_t at = FindSync(p, avail);
+        const size_t skip = at == NPOS ? avail - 1 : at;  // Keep a trailing SYNC0
+        skipBytes(skip);
+        if (at == NPOS) {
+          return false;
+        }
+        continue;
+      }
+      if (avail < GW_FRAME_HEADER_LEN) {
+        return false;
+      }
+      const uint8_t count = p[3];
+      if (p[2] != GW_FRAME_VERSION || count > GW_BATCH_MAX_RECORDS) {
+        stats.bad_headers++;
+        skipBytes(1);
+        continue;
+      }
+      const size_t len = GW_FRAME_HEADER_LEN + (size_t)count * GW_RECORD_LEN + GW_FRAME_CRC_LEN;
+      if (avail < len) {
+        return false;
+      }
+      uint32_t crc;
+      memcpy(&crc, p + len - GW_FRAME_CRC_LEN, 4);
+      if (crc32(p + 2, len - 2 - GW_FRAME_CRC_LEN) != crc) {
+        stats.crc_errors++;
+        skipBytes(1);
+        continue;
+      }
+
+      view.seq = (uint16_t)(p[4] | (p[5] << 8));
+      view.count = count;
+      view.records = reinterpret_cast<const gw_record_t*>(p + GW_FRAME_HEADER_LEN);
+      if (have_seq) {
+        stats.seq_gaps += (uint16_t)(view.seq - last_seq - 1);
+      }
+      have_seq = true;
+      last_seq = view.seq;
+      stats.frames++;
+      stats.records += count;
+      ring.consume(len);
+      return true;
+    }
+  }
+
+  ParserStats stats;
+
+private:
+  void skipBytes(size_t n) {
+    stats.skipped_bytes += n;
+    ring.consume(n);
+  }
+
+  MirrorRing& ring;
+  Crc32 crc32;
+  bool have_seq = false;
+  uint16_t last_seq = 0;
+};
+
+}  // namespace gwlink
+
+#endif  // HOST_FRAME_PARSER_H
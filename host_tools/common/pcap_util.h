@@ -0,0 +1,95 @@
+/**
+ * @file    pcap_util.h
+ * @brief   Minimal pcap reader / writer for raw IEEE 802.15.4 captures
+ * @details Classic pcap (not pcapng), microsecond timestamps, either byte order on read.
+ *          Link types: 195 (802.15.4 with FCS, what most sniffers write) and 230 (no FCS).
+ */
+
+#ifndef HOST_PCAP_UTIL_H
+#define HOST_PCAP_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define PCAP_LINKTYPE_IEEE802_15_4_WITHFCS 195
+#define PCAP_LINKTYPE_IEEE802_15_4_NOFCS 230
+
+struct PcapPacket {
+  uint64_t t_us;
+  std::vector<uint8_t> data;
+};
+
+class PcapWriter {
+public:
+  bool open(const std::string& path, uint32_t linktype) {
+    f = fopen(path.c_str(), "wb");
+    if (!f) {
+      return false;
+    }
+    const uint32_t header[6] = { 0xA1B2C3D4u, 0x00040002u, 0, 0, 65535, linktype };  // Version 2.4
+    return fwrite(header, sizeof(header), 1, f) == 1;
+  }
+
+  bool write(uint64_t t_us, const uint8_t* data, size_t len) {
+    const uint32_t rec[4] = { (uint32_t)(t_us / 1000000), (uint32_t)(t_us % 1000000), (uint32_t)len, (uint32_t)len };
+    return fwrite(rec, sizeof(rec), 1, f) == 1 && fwrite(data, 1, len, f) == len;
+  }
+
+  bool close(void) {
+    const bool ok = f && fclose(f) == 0;
+    f = nullptr;
+    return ok;
+  }
+
+  ~PcapWriter() {
+    if (f) {
+      fclose(f);
+    }
+  }
+
+private:
+  FILE* f = nullptr;
+};
+
+/**
+ * @brief Read a whole capture
+ * @return bool false if the file is missing or not a classic pcap
+ */
+inline bool readPcap(FILE* f, uint32_t& linktype, std::vector<PcapPacket>& out) {
+  uint8_t header[24];
+  if (fread(header, sizeof(header), 1, f) != 1) {
+    return false;
+  }
+  uint32_t magic;
+  memcpy(&magic, header, 4);
+  const bool swap = magic == 0xD4C3B2A1u;
+  if (!swap && magic != 0xA1B2C3D4u) {
+    return false;
+  }
+  auto u32 = [swap](const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+  };
+  linktype = u32(header + 20);
+  uint8_t rec[16];
+  while (fread(rec, sizeof(rec), 1, f) == 1) {
+    PcapPacket p;
+    p.t_us = (uint64_t)u32(rec) * 1000000 + u32(rec + 4);
+    const uint32_t len = u32(rec + 8);
+    if (len > 65535) {
+      return false;
+    }
+    p.data.resize(len);
+    if (len && fread(p.data.data(), 1, len, f) != len) {
+      return false;
+    }
+    out.push_back(std::move(p));
+  }
+  return true;
+}
+
+#endif  // HOST_PCAP_UTIL_H
@@ -0,0 +1,581 @@
+/**
+ * @file    power_trace.h
+ * @brief   Power analyzer traces against the firmware's wake timelines: import, alignment, charge per phase
+ * @details A trace is a CSV export of a power analyzer: time, current, optionally voltage
+ *          and a digital channel wired to the button's phase marker (DIAG_MARKER_PIN,
+ *          diagnostics.h). The timelines come from the firmware: the `[DIAG] Wake #N
+ *          timeline (us)` lines of a verbose serial capture, or diag_log_decode --csv.
+ *          Their times are esp_timer microseconds since the app started, so each wake
+ *          needs its own offset into the trace:
+ *            marker   the edges the marker makes for a timeline (diagMarker() rule)
+ *                     cross-correlated with the trace's edges: the lag that matches most
+ *                     edges within the timeline's resolution, refined to their mean residual
+ *            current  no marker: the lag at which the timeline's phase boundaries best
+ *                     explain the current as piecewise constant (least squares, the same
+ *                     as the best normalized cross-correlation with a step template)
+ *          Wakes are found in the trace itself (current above the sleep floor), so the
+ *          boot before setup() and the way down into deep sleep are measured too.
+ */
+
+#ifndef HOST_POWER_TRACE_H
+#define HOST_POWER_TRACE_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* ============= Timelines ============= */
+#define POWER_MARKS 11  /**< WakePhase::COUNT */
+static const char* const POWER_MARK_NAMES[POWER_MARKS] = { "setup", "clocks", "ble_start", "pins", "ble_wait", "ble",
+                                                           "adv_start", "ieee_start", "ieee_stop", "adv_stop", "sleep" };
+enum PowerMark { MARK_SETUP = 0, MARK_CLOCKS = 1, MARK_ADV_START = 6, MARK_ADV_STOP = 9, MARK_SLEEP = 10 };
+
+struct WakeTimeline {
+  uint32_t wake = 0;                /**< Wake counter of the firmware (0 = unknown) */
+  double us[POWER_MARKS];           /**< esp_timer time of each mark, < 0 = not reached */
+  double resolution_us = 1;         /**< 1 for the serial timeline, 256 for the flash log */
+  WakeTimeline() {
+    for (double& u : us) u = -1;
+  }
+  bool has(const int mark) const { return us[mark] >= 0; }
+  /** Last mark before the sleep entry (the flash log's sleep is taken before it, the serial one has none) */
+  double lastUs() const {
+    double last = 0;
+    for (int m = 0; m < MARK_SLEEP; m++) last = std::max(last, us[m]);
+    return last;
+  }
+};
+
+static inline int powerMarkIndex(const std::string& name) {
+  for (int m = 0; m < POWER_MARKS; m++) {
+    if (name == POWER_MARK_NAMES[m]) return m;
+  }
+  return -1;
+}
+
+/**
+ * @brief Timelines in a serial capture (`[DIAG] Wake #N timeline (us): setup=.. clocks=..`)
+ *        or a diag_log_decode --csv file (`wake,cause,clock,synced,charge_uc,setup_ms,..`)
+ */
+static inline std::vector<WakeTimeline> parseTimelines(const std::string& text) {
+  std::vector<WakeTimeline> out;
+  std::vector<int> csv_cols;  // Mark of each CSV column, -1 = not a mark
+  bool csv = false;
+  for (size_t b = 0, e; b < text.size(); b = e + 1) {
+    e = text.find('\n', b);
+    if (e == std::string::npos) e = text.size();
+    std::string line = text.substr(b, e - b);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    const size_t tag = line.find("[DIAG] Wake #");
+    if (tag != std::string::npos && line.find("timeline (us):") != std::string::npos) {
+      WakeTimeline t;
+      t.wake = (uint32_t)strtoul(line.c_str() + tag + 13, nullptr, 10);
+      size_t p = line.find("):") + 2;
+      while (p < line.size()) {
+        const size_t eq = line.find('=', p);
+        if (eq == std::string::npos) break;
+        size_t name_start = line.find_last_of(' ', eq);
+        name_start = name_start == std::string::npos || name_start < p ? p : name_start + 1;
+        const int m = powerMarkIndex(line.substr(name_start, eq - name_start));
+        char* end;
+        const double v = strtod(line.c_str() + eq + 1, &end);
+        if (m >= 0) t.us[m] = v;
+        p = (size_t)(end - line.c_str());
+        if (p <= eq) break;
+      }
+      if (t.has(MARK_SETUP)) out.push_back(t);
+      continue;
+    }
+
+    if (line.rfind("wake,cause,", 0) == 0) {
+      csv = true;
+      csv_cols.clear();
+      size_t c = 0;
+      while (c <= line.size()) {
+        size_t d = line.find(',', c);
+        if (d == std::string::npos) d = line.size();
+        std::string name = line.substr(c, d - c);
+        const bool ms = name.size() > 3 && name.compare(name.size() - 3, 3, "_ms") == 0;
+        csv_cols.push_back(ms ? powerMarkIndex(name.substr(0, name.size() - 3)) : -1);
+        c = d + 1;
+      }
+      continue;
+    }
+    if (csv && !line.empty() && isdigit((unsigned char)line[0])) {
+      WakeTimeline t;
+      t.resolution_us = 256;  // DIAG_LOG_PHASE_UNIT_US
+      t.wake = (uint32_t)strtoul(line.c_str(), nullptr, 10);
+      size_t c = 0;
+      for (size_t col = 0; col < csv_cols.size() && c <= line.size(); col++) {
+        size_t d = line.find(',', c);
+        if (d == std::string::npos) d = line.size();
+        if (csv_cols[col] >= 0 && d > c) t.us[csv_cols[col]] = strtod(line.c_str() + c, nullptr) * 1000.0;
+        c = d + 1;
+      }
+      if (t.has(MARK_SETUP)) out.push_back(t);
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Marker edges a timeline makes, in esp_timer us (diagMarker(): high at setup,
+ *        toggled at every mark)
+ * @note  The sleep entry edge is left out: the serial timeline is printed before it, and
+ *        the flash log's sleep time is taken before it too. It stays an unmatched edge.
+ */
+static inline std::vector<double> timelineEdges(const WakeTimeline& t) {
+  std::vector<std::pair<double, int>> marks;
+  for (int m = 0; m < MARK_SLEEP; m++) {
+    if (t.has(m)) marks.push_back({ t.us[m], m });
+  }
+  std::sort(marks.begin(), marks.end());
+  std::vector<double> edges;
+  for (const auto& mark : marks) edges.push_back(mark.first);  // Rising at setup, a toggle at every other mark
+  return edges;
+}
+
+/* ============= Traces ============= */
+struct PowerTrace {
+  std::vector<double> t;        /**< s */
+  std::vector<double> i;        /**< A */
+  std::vector<double> v;        /**< V, empty without a voltage column */
+  std::vector<uint8_t> marker;  /**< Marker level, empty without a marker column */
+  std::vector<double> q, e;     /**< Charge (C) and energy (J) from t[0] to t[k], step-hold */
+  std::vector<double> s1, s2;   /**< Prefix sums of i and i^2 per sample (least squares fit) */
+
+  size_t size() const { return t.size(); }
+  double period() const { return t.size() > 1 ? (t.back() - t.front()) / (double)(t.size() - 1) : 0; }
+
+  void integrate(const double supply_v) {
+    const size_t n = t.size();
+    q.assign(n, 0);
+    e.assign(n, 0);
+    s1.assign(n + 1, 0);
+    s2.assign(n + 1, 0);
+    for (size_t k = 0; k < n; k++) {
+      s1[k + 1] = s1[k] + i[k];
+      s2[k + 1] = s2[k] + i[k] * i[k];
+      if (k + 1 < n) {
+        const double dq = i[k] * (t[k + 1] - t[k]);
+        q[k + 1] = q[k] + dq;
+        e[k + 1] = e[k] + dq * (v.empty() ? supply_v : v[k]);
+      }
+    }
+  }
+  /** Index of the last sample at or before `time` */
+  size_t at(const double time) const {
+    const size_t k = (size_t)(std::upper_bound(t.begin(), t.end(), time) - t.begin());
+    return k ? k - 1 : 0;
+  }
+  double chargeTo(const double time) const {
+    const size_t k = at(time);
+    return q[k] + (time > t[k] ? i[k] * (time - t[k]) : 0);
+  }
+  double energyTo(const double time, const double supply_v) const {
+    const size_t k = at(time);
+    return e[k] + (time > t[k] ? i[k] * (time - t[k]) * (v.empty() ? supply_v : v[k]) : 0);
+  }
+};
+
+struct TraceColumns {
+  std::string time, current, voltage, marker;  /**< Header name (substring) or 0-based index, "" = detect */
+  int marker_bit = 0;                          /**< Bit string columns (PPK2 "D0-D7"): character index */
+  double time_scale = 0, current_scale = 0;    /**< To s and A; 0 = from the header unit */
+};
+
+static inline std::string powerLower(std::string s) {
+  for (char& c : s) c = (char)tolower((unsigned char)c);
+  return s;
+}
+
+/** Scale of a unit in a header cell: "Time (ms)", "Current(uA)", "current [A]", "I (µA)" */
+static inline double powerUnitScale(const std::string& cell, const bool time) {
+  const std::string h = powerLower(cell);
+  const size_t open = h.find_first_of("([");
+  if (open == std::string::npos) return 0;
+  const size_t close = h.find_first_of(")]", open);
+  std::string u = h.substr(open + 1, close == std::string::npos ? std::string::npos : close - open - 1);
+  u.erase(std::remove(u.begin(), u.end(), ' '), u.end());
+  if (u.rfind("\xc2\xb5", 0) == 0) u = "u" + u.substr(2);  // µ
+  const char* base = time ? "s" : "a";
+  if (u == base) return 1;
+  if (u == std::string("m") + base) return 1e-3;
+  if (u == std::string("u") + base) return 1e-6;
+  if (u == std::string("n") + base) return 1e-9;
+  return 0;
+}
+
+static inline int powerFindColumn(const std::vector<std::string>& header, const std::string& want,
+                                  const std::vector<const char*>& auto_names) {
+  if (!want.empty()) {
+    if (isdigit((unsigned char)want[0])) return atoi(want.c_str());
+    for (size_t c = 0; c < header.size(); c++) {
+      if (powerLower(header[c]).find(powerLower(want)) != std::string::npos) return (int)c;
+    }
+    return -2;  // Asked for, not there
+  }
+  for (const char* name : auto_names) {
+    for (size_t c = 0; c < header.size(); c++) {
+      if (powerLower(header[c]).find(name) != std::string::npos) return (int)c;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Parse a CSV export (',' ';' or tab). Without a header: time (s), current (A)
+ * @return bool false with `error` set
+ */
+static inline bool parseTraceCsv(const std::string& text, const TraceColumns& cols, PowerTrace& trace, std::string& error) {
+  char sep = ',';
+  std::vector<std::string> header;
+  int tc = 0, ic = 1, vc = -1, mc = -1;
+  double t_scale = cols.time_scale, i_scale = cols.current_scale;
+  bool have_layout = false;
+  std::vector<std::string> cells;
+  for (size_t b = 0, e; b < text.size(); b = e + 1) {
+    e = text.find('\n', b);
+    if (e == std::string::npos) e = text.size();
+    std::string line = text.substr(b, e - b);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == '#') continue;
+
+    if (!have_layout) {
+      sep = line.find('\t') != std::string::npos ? '\t' : (line.find(';') != std::string::npos ? ';' : ',');
+    }
+    cells.clear();
+    for (size_t c = 0;;) {
+      size_t d = line.find(sep, c);
+      std::string cell = line.substr(c, d == std::string::npos ? std::string::npos : d - c);
+      cell.erase(std::remove(cell.begin(), cell.end(), '"'), cell.end());
+      cells.push_back(cell);
+      if (d == std::string::npos) break;
+      c = d + 1;
+    }
+
+    if (!have_layout) {
+      const bool numeric = !cells[0].empty() && (isdigit((unsigned char)cells[0][0]) || cells[0][0] == '-' || cells[0][0] == '.');
+      if (!numeric) {
+        header = cells;
+        tc = powerFindColumn(header, cols.time, { "time", "timestamp" });
+        ic = powerFindColumn(header, cols.current, { "current", "i (" });
+        vc = powerFindColumn(header, cols.voltage, { "voltage" });
+        mc = powerFindColumn(header, cols.marker, { "marker", "gpio", "digital", "d0" });
+        if (tc < 0 || ic < 0 || vc == -2 || mc == -2) {
+          error = "columns not found in the header (--time-col / --current-col / --voltage-col / --marker-col)";
+          return false;
+        }
+        if (!t_scale) t_scale = powerUnitScale(header[tc], true);
+        if (!i_scale) i_scale = powerUnitScale(header[ic], false);
+        have_layout = true;
+        continue;
+      }
+      if (!cols.marker.empty() && isdigit((unsigned char)cols.marker[0])) mc = atoi(cols.marker.c_str());
+      if (!cols.voltage.empty() && isdigit((unsigned char)cols.voltage[0])) vc = atoi(cols.voltage.c_str());
+      have_layout = true;
+    }
+    if ((int)cells.size() <= std::max(std::max(tc, ic), std::max(vc, mc))) continue;
+    trace.t.push_back(strtod(cells[tc].c_str(), nullptr));
+    trace.i.push_back(strtod(cells[ic].c_str(), nullptr));
+    if (vc >= 0) trace.v.push_back(strtod(cells[vc].c_str(), nullptr));
+    if (mc >= 0) {
+      const std::string& m = cells[mc];
+      const bool bits = m.size() > 1 && m.find_first_not_of("01") == std::string::npos;
+      trace.marker.push_back(bits ? (cols.marker_bit < (int)m.size() && m[cols.marker_bit] == '1')
+                                  : strtod(m.c_str(), nullptr) > 0.5);
+    }
+  }
+  if (trace.t.size() < 2) {
+    error = "no samples";
+    return false;
+  }
+  if (!t_scale) t_scale = 1;
+  if (!i_scale) i_scale = 1;
+  const double t0 = trace.t[0];
+  for (double& x : trace.t) x = (x - t0) * t_scale;
+  for (double& x : trace.i) x *= i_scale;
+  for (size_t k = 1; k < trace.t.size(); k++) {
+    if (trace.t[k] <= trace.t[k - 1]) {
+      error = "time not increasing at sample " + std::to_string(k);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* ============= Wakes in the Trace ============= */
+struct TraceWake {
+  double start, end;  /**< s: current above the threshold, back at the floor */
+};
+
+/**
+ * @brief Sleep floor: 1st percentile of the current
+ */
+static inline double traceFloor(const PowerTrace& trace) {
+  std::vector<double> c(trace.i);
+  const size_t k = c.size() / 100;
+  std::nth_element(c.begin(), c.begin() + k, c.end());
+  return c[k];
+}
+
+/**
+ * @brief Intervals above floor + threshold; dips shorter than `merge_s` don't split a wake.
+ *        Wakes cut by the start or the end of the capture are left out.
+ */
+static inline std::vector<TraceWake> findWakes(const PowerTrace& trace, const double threshold_a, const double merge_s,
+                                               const double min_s) {
+  const double level = traceFloor(trace) + threshold_a;
+  std::vector<TraceWake> wakes;
+  bool in = false;
+  double start = 0;
+  for (size_t k = 0; k < trace.size(); k++) {
+    const bool above = trace.i[k] > level;
+    if (above && !in) {
+      start = trace.t[k];
+      in = true;
+      if (!wakes.empty() && start - wakes.back().end < merge_s) {
+        start = wakes.back().start;
+        wakes.pop_back();
+      }
+    } else if (!above && in) {
+      wakes.push_back({ start, trace.t[k] });
+      in = false;
+    }
+  }
+  std::vector<TraceWake> out;
+  for (const TraceWake& w : wakes) {
+    if (w.end - w.start >= min_s && w.start > trace.t.front()) out.push_back(w);
+  }
+  return out;  // A wake still running at the end was never closed
+}
+
+/**
+ * @brief Marker edges (s) inside [from, to]
+ */
+static inline std::vector<double> traceEdges(const PowerTrace& trace, const double from, const double to) {
+  std::vector<double> edges;
+  if (trace.marker.empty()) return edges;
+  for (size_t k = trace.at(from) + 1; k < trace.size() && trace.t[k] <= to; k++) {
+    if (trace.marker[k] != trace.marker[k - 1]) edges.push_back(trace.t[k]);
+  }
+  return edges;
+}
+
+/* ============= Alignment ============= */
+struct Alignment {
+  bool ok = false;
+  double lag = 0;        /**< trace time (s) = esp_timer (us) / 1e6 + lag */
+  int matched = 0, expected = 0;
+  double rms_us = 0;     /**< Marker: residual of the matched edges */
+  double fit_gain = 0;   /**< Current: share of the variance the step template explains */
+};
+
+/**
+ * @brief Marker alignment: cross-correlation of the expected and the captured edge trains
+ */
+static inline Alignment alignMarker(const PowerTrace& trace, const TraceWake& w, const WakeTimeline& t) {
+  Alignment a;
+  const std::vector<double> exp_edges = timelineEdges(t);
+  const std::vector<double> got = traceEdges(trace, w.start, w.end + 0.002);
+  a.expected = (int)exp_edges.size();
+  if (exp_edges.empty() || got.empty()) return a;
+  const double tol = (t.resolution_us + 20) * 1e-6 + 2 * trace.period();
+
+  // Candidate lags: every captured edge against every expected one
+  double best_lag = 0, best_err = 0;
+  int best = 0;
+  for (const double g : got) {
+    for (const double x : exp_edges) {
+      const double lag = g - x * 1e-6;
+      if (t.us[MARK_SETUP] * 1e-6 + lag < w.start - tol) continue;  // setup() before the wake
+      int n = 0;
+      double err = 0;
+      for (const double y : exp_edges) {
+        const double at = y * 1e-6 + lag;
+        const auto it = std::lower_bound(got.begin(), got.end(), at - tol);
+        if (it != got.end() && *it <= at + tol) {
+          n++;
+          err += (*it - at) * (*it - at);
+        }
+      }
+      if (n > best || (n == best && err < best_err)) {
+        best = n;
+        best_err = err;
+        best_lag = lag;
+      }
+    }
+  }
+  // Refine: mean residual of the matched edges
+  double sum = 0, sq = 0;
+  int n = 0;
+  for (const double y : exp_edges) {
+    const double at = y * 1e-6 + best_lag;
+    const auto it = std::lower_bound(got.begin(), got.end(), at - tol);
+    if (it != got.end() && *it <= at + tol) {
+      sum += *it - at;
+      n++;
+    }
+  }
+  a.lag = best_lag + (n ? sum / n : 0);
+  for (const double y : exp_edges) {
+    const double at = y * 1e-6 + a.lag;
+    const auto it = std::lower_bound(got.begin(), got.end(), at - tol);
+    if (it != got.end() && *it <= at + tol) sq += (*it - at) * (*it - at);
+  }
+  a.matched = best;
+  a.rms_us = n ? sqrt(sq / n) * 1e6 : 0;
+  a.ok = best * 2 > a.expected;
+  return a;
+}
+
+/**
+ * @brief Current alignment: lag at which the timeline's boundaries explain the current best
+ * @details Fit on the bring-up marks only (setup -> BLE ready): the advertising PDUs' spikes
+ *          would pull the boundaries next to them. A single mark (timer wakes) can't be told
+ *          from the boot's own steps, so the wake is left unaligned.
+ * @param max_boot_s Longest boot before setup() searched
+ */
+static inline Alignment alignCurrent(const PowerTrace& trace, const TraceWake& w, const WakeTimeline& t, const double max_boot_s) {
+  Alignment a;
+  std::vector<double> marks;
+  for (int m = 0; m < MARK_ADV_START; m++) {
+    if (t.has(m)) marks.push_back(t.us[m] * 1e-6);
+  }
+  std::sort(marks.begin(), marks.end());
+  a.expected = (int)marks.size();
+  const size_t k0 = trace.at(w.start), k1 = trace.at(w.end);
+  if (marks.size() < 2 || k1 <= k0 + 2) return a;
+
+  auto sse = [&](const size_t from, const size_t to) {  // Of a constant fit over [from, to)
+    if (to <= from) return 0.0;
+    const double s = trace.s1[to] - trace.s1[from];
+    return trace.s2[to] - trace.s2[from] - s * s / (double)(to - from);
+  };
+  const double total = sse(k0, k1);
+  // setup() within max_boot_s of the wake edge, the last mark before the current drops
+  const double lag_min = w.start - marks.front();
+  const double lag_max = std::min(w.start + max_boot_s - marks.front(), w.end - marks.back());
+  const double step = std::max(trace.period(), 1e-6);
+  double best = -1, best_lag = 0;
+  std::vector<size_t> cut(marks.size());
+  for (double lag = lag_min; lag <= lag_max + 1e-12; lag += step) {
+    for (size_t j = 0; j < marks.size(); j++) {
+      cut[j] = std::min(std::max(trace.at(marks[j] + lag) + 1, k0), k1);
+    }
+    double s = sse(k0, cut[0]);
+    for (size_t j = 0; j + 1 < cut.size(); j++) s += sse(cut[j], cut[j + 1]);
+    s += sse(cut.back(), k1);
+    if (best < 0 || s < best) {
+      best = s;
+      best_lag = lag;
+    }
+  }
+  a.lag = best_lag;
+  a.matched = a.expected;
+  a.fit_gain = total > 0 ? 1 - best / total : 0;
+  a.ok = best >= 0;
+  return a;
+}
+
+/* ============= Charge per Phase ============= */
+struct PhaseCharge {
+  std::string name;
+  double start, end;  /**< s, trace time */
+  double uc, uj;
+  double model_uc;    /**< diagCloseWake()'s estimate of the same interval */
+};
+
+struct ModelCurrents {
+  double active_ua, adv_ua, sleep_ua;  /**< diagnostics.h DIAG_CURRENT_* */
+};
+
+/**
+ * @brief Phases of an aligned wake: boot (wake edge -> setup), clocks (optimizeClocks),
+ *        ble_setup (-> advertising: BLE start, local setup in parallel), advertising,
+ *        sleep_entry (advertising stopped -> current back at the floor). Boundaries the
+ *        timeline lacks merge their phases, named "<from>..<to>" (timer wake: setup..sleep).
+ */
+static inline std::vector<PhaseCharge> wakePhases(const PowerTrace& trace, const TraceWake& w, const WakeTimeline& t,
+                                                  const double lag, const double supply_v, const ModelCurrents& model) {
+  struct Bound {
+    const char* name;
+    double time;
+  };
+  std::vector<Bound> b = { { "edge", w.start } };
+  const int marks[] = { MARK_SETUP, MARK_CLOCKS, MARK_ADV_START, MARK_ADV_STOP };
+  for (const int m : marks) {
+    if (t.has(m)) b.push_back({ POWER_MARK_NAMES[m], std::min(std::max(t.us[m] * 1e-6 + lag, b.back().time), w.end) });
+  }
+  b.push_back({ "sleep", w.end });
+
+  std::vector<PhaseCharge> out;
+  for (size_t j = 0; j + 1 < b.size(); j++) {
+    const std::string from = b[j].name, to = b[j + 1].name;
+    std::string name = from + ".." + to;
+    if (from == "edge" && to == "setup") name = "boot";
+    else if (from == "setup" && to == "clocks") name = "clocks";
+    else if (from == "clocks" && to == "adv_start") name = "ble_setup";
+    else if (from == "adv_start" && to == "adv_stop") name = "advertising";
+    else if (from == "adv_stop" && to == "sleep") name = "sleep_entry";
+    PhaseCharge p;
+    p.name = name;
+    p.start = b[j].time;
+    p.end = b[j + 1].time;
+    p.uc = (trace.chargeTo(p.end) - trace.chargeTo(p.start)) * 1e6;
+    p.uj = (trace.energyTo(p.end, supply_v) - trace.energyTo(p.start, supply_v)) * 1e6;
+    // The firmware counts from esp_timer 0: the boot before the app isn't in its estimate
+    const double model_s = name == "boot" ? std::max(0.0, t.us[MARK_SETUP] * 1e-6) : p.end - p.start;
+    p.model_uc = model_s * (name == "advertising" ? model.adv_ua : model.active_ua);  // s x uA = uC
+    out.push_back(p);
+  }
+  return out;
+}
+
+/**
+ * @brief Kind of a wake, from the marks it reached
+ */
+static inline const char* wakeKind(const WakeTimeline& t) {
+  if (t.has(MARK_ADV_START) && t.has(MARK_ADV_STOP)) return "beacon";
+  if (!t.has(MARK_CLOCKS)) return "timer";
+  return "other";
+}
+
+/**
+ * @brief Pair trace wakes with timelines: the shift of the timeline list at which most
+ *        wake lengths fit their timeline (a capture starts and ends anywhere in a session)
+ * @return Timeline index of each trace wake, -1 = none
+ */
+static inline std::vector<int> pairWakes(const std::vector<TraceWake>& wakes, const std::vector<WakeTimeline>& timelines,
+                                         const double max_boot_s) {
+  auto fits = [&](const TraceWake& w, const WakeTimeline& t) {
+    const double span = t.lastUs() * 1e-6, len = w.end - w.start;
+    return len >= span * 0.9 && len <= span + max_boot_s + 0.1 + span * 0.1;
+  };
+  int best = -1, best_shift = 0;
+  for (int shift = -(int)wakes.size() + 1; shift < (int)timelines.size(); shift++) {
+    int n = 0;
+    for (int k = 0; k < (int)wakes.size(); k++) {
+      const int j = k + shift;
+      if (j >= 0 && j < (int)timelines.size() && fits(wakes[k], timelines[j])) n++;
+    }
+    if (n > best) {
+      best = n;
+      best_shift = shift;
+    }
+  }
+  std::vector<int> pair(wakes.size(), -1);
+  for (int k = 0; k < (int)wakes.size(); k++) {
+    const int j = k + best_shift;
+    if (j >= 0 && j < (int)timelines.size() && fits(wakes[k], timelines[j])) pair[k] = j;
+  }
+  return pair;
+}
+
+#endif  // HOST_POWER_TRACE_H
@@ -0,0 +1,128 @@
+/**
+ * @file    rc_hot_set.h
+ * @brief   Hot sets of the verifier: seeds accepted recently, searched before the fleet
+ * @details Buttons don't move. A press is on air for 10 s, so a gateway forwards it several
+ *          times (gateway_core.h dedup), and a button that pressed often presses again. Most
+ *          records are from a seed accepted a moment ago, at the same gateway. rc_verifier.h
+ *          keeps one set per gateway ("recently seen here") and one for the whole fleet
+ *          ("recently active"), and only scans the seed table when both miss.
+ *
+ *          A set is a small array of (scheme, seed) with an aging counter each:
+ *            touch()  an accepted press: its counter +1 (saturating), or the entry with the
+ *                     lowest counter (the least recently touched of those) is replaced
+ *            aging    every RC_HOT_AGING_PER_SLOT touches per slot, all counters halve:
+ *                     a button that stopped pressing drops out within a few periods
+ *            find()   the mixer over the entries of the record's scheme (and device hint,
+ *                     v2 / v3): evaluations are counted, a miss costs all of them
+ *          A hit is not checked for a second matching seed in the fleet: a code collision
+ *          that a scan would report as AMB goes to the button that was active there.
+ */
+
+#ifndef HOST_RC_HOT_SET_H
+#define HOST_RC_HOT_SET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "adv_format.h"
+#include "gateway_core.h"
+#include "rolling_code.h"
+
+#define RC_HOT_GATEWAY_SLOTS 32   /**< Seeds per gateway set: a few rooms of buttons */
+#define RC_HOT_FLEET_SLOTS 256    /**< Seeds of the fleet-wide set */
+#define RC_HOT_AGING_PER_SLOT 4   /**< Touches per slot between two halvings of the counters */
+
+class RcHotSet {
+public:
+  static constexpr size_t NONE = (size_t)-1;
+
+  explicit RcHotSet(const size_t slots = 0) : slots(slots) {
+    entries.reserve(slots);
+  }
+
+  /**
+   * @brief Seed table index (rc_verifier.h SeedTable) of the entry whose code is the record's
+   * @param scheme Table to search: the record's scheme
+   * @param evaluated Incremented per mixer evaluation
+   * @return size_t NONE if no entry matches
+   */
+  size_t find(const uint8_t scheme, const gw_record_t& rec, uint64_t& evaluated) const {
+    const bool hinted = rec.format >= ADV_FORMAT_V2;
+    for (const Entry& e : entries) {
+      if (e.scheme != scheme || (hinted && e.hint != rec.hint)) {
+        continue;
+      }
+      evaluated++;
+      if (rolling_code::schemeCode(scheme, e.seed, rec.timestamp) == rec.code) {
+        return e.hit;
+      }
+    }
+    return NONE;
+  }
+
+  /**
+   * @brief Record an accepted press of seed `hit` (table index) of `scheme`
+   */
+  void touch(const uint8_t scheme, const uint32_t hit, const uint32_t seed) {
+    if (slots == 0) {
+      return;
+    }
+    tick++;
+    if (++touches >= slots * RC_HOT_AGING_PER_SLOT) {
+      touches = 0;
+      for (Entry& e : entries) e.count >>= 1;
+    }
+    Entry* victim = nullptr;
+    for (Entry& e : entries) {
+      if (e.hit == hit && e.scheme == scheme) {
+        e.count += e.count < 0xFF;
+        e.last = tick;
+        return;
+      }
+      if (!victim || e.count < victim->count || (e.count == victim->count && e.last < victim->last)) {
+        victim = &e;
+      }
+    }
+    const Entry fresh = { seed, hit, tick, scheme, advHint(seed), 1 };
+    if (entries.size() < slots) {
+      entries.push_back(fresh);
+    } else {
+      replaced++;
+      *victim = fresh;
+    }
+  }
+
+  void clear(void) {
+    entries.clear();
+    tick = touches = 0;
+    replaced = 0;
+  }
+
+  size_t size(void) const {
+    return entries.size();
+  }
+
+  size_t bytes(void) const {
+    return entries.capacity() * sizeof(Entry);
+  }
+
+  uint64_t replaced = 0;  /**< Entries evicted for a new seed */
+
+private:
+  struct Entry {
+    uint32_t seed;
+    uint32_t hit;      /**< Seed table index */
+    uint32_t last;     /**< tick of the last touch */
+    uint8_t scheme;
+    uint8_t hint;      /**< advHint(seed) */
+    uint8_t count;     /**< Aging counter */
+  };
+
+  size_t slots;
+  std::vector<Entry> entries;
+  uint32_t tick = 0;
+  uint32_t touches = 0;
+};
+
+#endif  // HOST_RC_HOT_SET_H
@@ -0,0 +1,433 @@
+/**
+ * @file    rc_verifier.h
+ * @brief   Rolling code verifier core: fleet index, time window, seed search, replay check
+ * @details One gateway record goes through three stages:
+ *            window()  a synced device clock (device_clock.h) more than window_s away
+ *                      from the verifier's clock is STALE, without a search
+ *            search()  the seed whose code for the record's timestamp word is the
+ *                      received code (rolling_code::schemeFind()). A v2 / v3 advert's
+ *                      device hint (adv_format.h) narrows it to the seeds with that hint
+ *            accept()  a synced press older than the last one accepted for that seed is
+ *                      a REPLAY; repeats of one press (same timestamp) are accepted
+ *          verify() runs all three. rc_verify prints the verdicts, rc_bench times the stages.
+ *
+ *          Search order (RcOrder): SCAN searches the seed table for every record. HOT first
+ *          tries the seeds recently accepted from the record's gateway, then those recently
+ *          accepted anywhere (rc_hot_set.h), and scans only if both miss. searchStats() has
+ *          the mixer evaluations and where each record was found.
+ *
+ *          Scheme migration (rolling_code.h): while the fleet moves to a new scheme, the
+ *          index has a seed table per scheme, and each record says its scheme (timestamp
+ *          word bit 31, button_events.h). RcMigration:
+ *            OFF       V1 table only, the scheme bit is not looked at (a fleet before the
+ *                      migration: no extra cost at all)
+ *            STRICT    the record's scheme only
+ *            FALLBACK  the record's scheme first; on a miss, the other scheme's table. A
+ *                      genuine press lands there only from a build whose scheme bit is
+ *                      wrong, a forged code always does: the fallback is metered
+ *          The verifier tracks each button's scheme: enrolled in the fleet file, then the
+ *          scheme of its last accepted press (an update moves it to V2, an update rolled
+ *          back moves it to V1 again). migration() and progress() are the metrics.
+ */
+
+#ifndef HOST_RC_VERIFIER_H
+#define HOST_RC_VERIFIER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "adv_format.h"
+#include "button_events.h"
+#include "fleet_file.h"
+#include "gateway_core.h"
+#include "rc_hot_set.h"
+#include "rolling_code.h"
+
+#define RC_VERIFY_WINDOW_S 900  /**< Default time window: a year of drift is within 9 min (clock_sim) */
+#define RC_SCHEMES 2            /**< ROLLING_CODE_SCHEME_V1 .. V2 */
+
+enum class RcVerdict : uint8_t { OK, AMB, BAD, STALE, REPLAY, COUNT };
+
+inline const char* rcVerdictName(const RcVerdict v) {
+  static const char* const names[] = { "OK", "AMB", "BAD", "STALE", "REPLAY" };
+  return v < RcVerdict::COUNT ? names[(uint8_t)v] : "?";
+}
+
+enum class RcMigration : uint8_t { OFF, STRICT, FALLBACK };
+
+inline const char* rcMigrationName(const RcMigration m) {
+  return m == RcMigration::OFF ? "off" : m == RcMigration::STRICT ? "strict" : "fallback";
+}
+
+enum class RcOrder : uint8_t { SCAN, HOT };
+
+inline const char* rcOrderName(const RcOrder o) {
+  return o == RcOrder::HOT ? "hot" : "scan";
+}
+
+/**
+ * @brief Search table of one scheme: seeds sorted by device hint, then seed, and the buttons behind each
+ */
+struct SeedTable {
+  uint8_t scheme = ROLLING_CODE_SCHEME_V1;
+  std::vector<uint32_t> seeds;      /**< Distinct seeds */
+  std::vector<uint32_t> first;      /**< Index into `members` of each seed's first button, one more at the end */
+  std::vector<uint32_t> members;    /**< Index into SeedIndex::buttons, grouped by seed */
+  std::vector<uint32_t> hint_first; /**< Index into `seeds` of each hint's first seed, 257 entries */
+
+  size_t bytes(void) const {
+    return (seeds.capacity() + first.capacity() + members.capacity() + hint_first.capacity()) * sizeof(uint32_t);
+  }
+};
+
+/**
+ * @brief Fleet and its search table per scheme
+ */
+struct SeedIndex {
+  std::vector<FleetEntry> buttons;  /**< Fleet file order */
+  SeedTable v1;                     /**< Every button */
+  SeedTable v2;                     /**< Buttons with a V2 seed */
+
+  explicit SeedIndex(std::vector<FleetEntry> fleet) : buttons(std::move(fleet)) {
+    build(v1, ROLLING_CODE_SCHEME_V1);
+    build(v2, ROLLING_CODE_SCHEME_V2);
+  }
+
+  const SeedTable& table(const uint8_t scheme) const {
+    return scheme == ROLLING_CODE_SCHEME_V2 ? v2 : v1;
+  }
+
+  /**
+   * @return bool true if some button has a V2 seed (a migration is on)
+   */
+  bool dual(void) const {
+    return !v2.seeds.empty();
+  }
+
+  /**
+   * @brief Index into `buttons` of the first button of seed `hit` in the table of `scheme`
+   */
+  uint32_t buttonIndex(const uint8_t scheme, const size_t hit) const {
+    const SeedTable& t = table(scheme);
+    return t.members[t.first[hit]];
+  }
+
+  const FleetEntry& button(const uint8_t scheme, const size_t hit) const {
+    return buttons[buttonIndex(scheme, hit)];
+  }
+
+  /**
+   * @return uint32_t Buttons sharing seed `hit`
+   */
+  uint32_t sharing(const uint8_t scheme, const size_t hit) const {
+    const SeedTable& t = table(scheme);
+    return t.first[hit + 1] - t.first[hit];
+  }
+
+  /**
+   * @return size_t Heap bytes held by the index
+   */
+  size_t bytes(void) const {
+    return buttons.capacity() * sizeof(FleetEntry) + v1.bytes() + v2.bytes();
+  }
+
+private:
+  void build(SeedTable& t, const uint8_t scheme) {
+    t.scheme = scheme;
+    std::vector<std::pair<uint32_t, uint32_t>> order;  // (seed, button)
+    for (uint32_t i = 0; i < buttons.size(); i++) {
+      if (scheme == ROLLING_CODE_SCHEME_V1) order.emplace_back(buttons[i].seed, i);
+      else if (buttons[i].has_v2) order.emplace_back(buttons[i].seed_v2, i);
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+      const uint8_t ha = advHint(a.first), hb = advHint(b.first);
+      return ha != hb ? ha < hb : a < b;
+    });
+    t.members.reserve(order.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+      if (i == 0 || order[i].first != order[i - 1].first) {
+        t.seeds.push_back(order[i].first);
+        t.first.push_back(i);
+      }
+      t.members.push_back(order[i].second);
+    }
+    t.first.push_back((uint32_t)order.size());
+    t.hint_first.resize(257);
+    for (uint32_t h = 0, s = 0; h <= 256; h++) {
+      while (s < t.seeds.size() && advHint(t.seeds[s]) < h) s++;
+      t.hint_first[h] = s;
+    }
+  }
+};
+
+/**
+ * @brief Result of one record
+ */
+struct RcCheck {
+  static constexpr size_t NONE = (size_t)-1;
+
+  RcVerdict verdict;
+  bool synced;
+  int32_t age;          /**< Seconds behind the verifier's clock (synced only) */
+  size_t hit = NONE;    /**< Seed index in the table of `scheme`, NONE if none */
+  uint8_t scheme = ROLLING_CODE_SCHEME_V1;  /**< Table of the hit (the record's scheme, if no hit) */
+  bool fallback = false;  /**< The hit is in the other scheme's table than the record says */
+};
+
+/**
+ * @brief Migration counters since the last reset()
+ */
+struct RcMigrationStats {
+  uint64_t accepted[RC_SCHEMES] = {};  /**< OK records per scheme */
+  uint64_t seeds_primary = 0;          /**< Seeds evaluated in the record's scheme */
+  uint64_t seeds_fallback = 0;         /**< ... and in the other scheme */
+  uint64_t fallbacks = 0;              /**< Searches of the other scheme */
+  uint64_t fallback_hits = 0;          /**< ... that found the seed */
+  uint64_t upgrades = 0;               /**< Buttons seen moving V1 -> V2 */
+  uint64_t rollbacks = 0;              /**< ... V2 -> V1 */
+};
+
+/**
+ * @brief Buttons per tracked scheme
+ */
+struct RcMigrationProgress {
+  uint64_t buttons[RC_SCHEMES] = {};    /**< Enrolled, or moved there by a press */
+  uint64_t confirmed[RC_SCHEMES] = {};  /**< ... with an accepted press of that scheme */
+  uint64_t with_v2 = 0;                 /**< Buttons with a V2 seed */
+};
+
+/**
+ * @brief Search counters since the last reset()
+ */
+struct RcSearchStats {
+  uint64_t searches = 0;      /**< Records searched (in the window) */
+  uint64_t evaluations = 0;   /**< Mixer evaluations: hot sets, scans and fallbacks */
+  uint64_t gateway_hits = 0;  /**< Found in the gateway's hot set */
+  uint64_t fleet_hits = 0;    /**< ... in the fleet-wide hot set */
+  uint64_t scans = 0;         /**< Seed table scans (the rest) */
+};
+
+class RcVerifier {
+public:
+  RcVerifier(const SeedIndex& index, const int32_t window_s, const RcMigration mode = RcMigration::OFF,
+             const RcOrder order = RcOrder::SCAN)
+    : index(index), mode(mode), order(order), window_s(window_s), fleet_hot(order == RcOrder::HOT ? RC_HOT_FLEET_SLOTS : 0) {
+    for (int s = 0; s < RC_SCHEMES; s++) {
+      const size_t n = index.table((uint8_t)(s + 1)).seeds.size();
+      last_accepted[s].resize(mode == RcMigration::OFF && s > 0 ? 0 : n);
+      have_last[s].resize(last_accepted[s].size());
+    }
+    if (mode != RcMigration::OFF) {
+      device_scheme.resize(index.buttons.size());
+    }
+    reset();
+  }
+
+  /**
+   * @brief Forget the accepted presses (replay state), the tracked schemes and the counters
+   */
+  void reset(void) {
+    for (int s = 0; s < RC_SCHEMES; s++) {
+      std::fill(have_last[s].begin(), have_last[s].end(), 0);
+    }
+    for (size_t i = 0; i < device_scheme.size(); i++) {
+      device_scheme[i] = index.buttons[i].scheme;
+    }
+    gateway_hot.clear();
+    fleet_hot.clear();
+    stats = RcMigrationStats();
+    search_stats = RcSearchStats();
+  }
+
+  /**
+   * @return bool false if the record is STALE: synced, and outside the window around now_unix
+   */
+  bool window(const gw_record_t& rec, const uint64_t now_unix, RcCheck& check) const {
+    check.synced = buttonClockSynced(rec.timestamp);
+    check.age = check.synced ? buttonClockAge(rec.timestamp, now_unix) : 0;
+    return !check.synced || (check.age <= window_s && check.age >= -window_s);
+  }
+
+  /**
+   * @brief Seed search: check.hit, check.scheme, and the verdict OK, AMB (a second seed matches) or BAD
+   * @details A v2 / v3 record is searched among the seeds with its device hint only.
+   *          HOT: the hot sets of the record's scheme first (a hit there is OK).
+   *          The record's scheme first, the other one on a miss (FALLBACK).
+   * @param gateway Receiving gateway, for its hot set (0 .. a few hundred)
+   */
+  void search(const gw_record_t& rec, RcCheck& check, const uint16_t gateway = 0) {
+    check.scheme = mode == RcMigration::OFF ? ROLLING_CODE_SCHEME_V1 : buttonSchemeOf(rec.timestamp);
+    check.fallback = false;
+    search_stats.searches++;
+    if (order == RcOrder::HOT && searchHot(rec, check, gateway)) {
+      return;
+    }
+    const size_t scanned = searchTable(index.table(check.scheme), rec, check);
+    stats.seeds_primary += scanned;
+    search_stats.evaluations += scanned;
+    search_stats.scans++;
+    if (check.hit != RcCheck::NONE || mode != RcMigration::FALLBACK) {
+      return;
+    }
+    const uint8_t other = check.scheme == ROLLING_CODE_SCHEME_V1 ? ROLLING_CODE_SCHEME_V2 : ROLLING_CODE_SCHEME_V1;
+    if (index.table(other).seeds.empty()) {
+      return;
+    }
+    stats.fallbacks++;
+    RcCheck second = check;
+    const size_t fallback = searchTable(index.table(other), rec, second);
+    stats.seeds_fallback += fallback;
+    search_stats.evaluations += fallback;
+    if (second.hit != RcCheck::NONE) {
+      stats.fallback_hits++;
+      check = second;
+      check.scheme = other;
+      check.fallback = true;
+    }
+  }
+
+  /**
+   * @brief Replay check of a matched record; records the press (replay state, hot sets) and
+   *        the button's scheme if it is accepted
+   */
+  void accept(const gw_record_t& rec, RcCheck& check, const uint16_t gateway = 0) {
+    if (check.hit == RcCheck::NONE) {
+      return;
+    }
+    const int s = check.scheme - 1;
+    if (check.synced) {
+      if (have_last[s][check.hit] && buttonClockDiff(rec.timestamp, last_accepted[s][check.hit]) < 0) {
+        check.verdict = RcVerdict::REPLAY;
+        return;
+      }
+      last_accepted[s][check.hit] = rec.timestamp;
+      have_last[s][check.hit] = 1;
+    }
+    if (check.verdict != RcVerdict::OK) {
+      return;
+    }
+    stats.accepted[s]++;
+    if (order == RcOrder::HOT) {
+      const uint32_t seed = index.table(check.scheme).seeds[check.hit];
+      if (gateway >= gateway_hot.size()) {
+        gateway_hot.resize(gateway + 1, RcHotSet(RC_HOT_GATEWAY_SLOTS));
+      }
+      gateway_hot[gateway].touch(check.scheme, (uint32_t)check.hit, seed);
+      fleet_hot.touch(check.scheme, (uint32_t)check.hit, seed);
+    }
+    if (device_scheme.empty()) {
+      return;
+    }
+    const SeedTable& t = index.table(check.scheme);
+    for (uint32_t m = t.first[check.hit]; m < t.first[check.hit + 1]; m++) {
+      uint8_t& tracked = device_scheme[t.members[m]];
+      const uint8_t was = tracked & ~SEEN;
+      stats.upgrades += was == ROLLING_CODE_SCHEME_V1 && check.scheme == ROLLING_CODE_SCHEME_V2;
+      stats.rollbacks += was == ROLLING_CODE_SCHEME_V2 && check.scheme == ROLLING_CODE_SCHEME_V1;
+      tracked = check.scheme | SEEN;
+    }
+  }
+
+  RcVerdict verify(const gw_record_t& rec, const uint64_t now_unix, RcCheck& check, const uint16_t gateway = 0) {
+    check.hit = RcCheck::NONE;
+    check.scheme = ROLLING_CODE_SCHEME_V1;
+    check.fallback = false;
+    if (!window(rec, now_unix, check)) {
+      return check.verdict = RcVerdict::STALE;
+    }
+    search(rec, check, gateway);
+    accept(rec, check, gateway);
+    return check.verdict;
+  }
+
+  const RcMigrationStats& migration(void) const {
+    return stats;
+  }
+
+  const RcSearchStats& searchStats(void) const {
+    return search_stats;
+  }
+
+  /**
+   * @brief Buttons per scheme (OFF: all as enrolled)
+   */
+  RcMigrationProgress progress(void) const {
+    RcMigrationProgress p;
+    for (size_t i = 0; i < index.buttons.size(); i++) {
+      const uint8_t tracked = device_scheme.empty() ? index.buttons[i].scheme : device_scheme[i];
+      p.buttons[(tracked & ~SEEN) - 1]++;
+      p.confirmed[(tracked & ~SEEN) - 1] += (tracked & SEEN) != 0;
+      p.with_v2 += index.buttons[i].has_v2;
+    }
+    return p;
+  }
+
+  /**
+   * @return size_t Heap bytes of the replay state, the tracked schemes and the hot sets
+   */
+  size_t bytes(void) const {
+    size_t n = device_scheme.capacity() + fleet_hot.bytes();
+    for (const RcHotSet& h : gateway_hot) n += h.bytes();
+    for (int s = 0; s < RC_SCHEMES; s++) {
+      n += last_accepted[s].capacity() * sizeof(uint32_t) + have_last[s].capacity();
+    }
+    return n;
+  }
+
+  const SeedIndex& index;
+  const RcMigration mode;
+  const RcOrder order;
+
+private:
+  static constexpr uint8_t SEEN = 0x80;  /**< device_scheme: confirmed by a press */
+
+  /**
+   * @return bool true if a hot set of the record's scheme has its seed (check.hit, OK)
+   */
+  bool searchHot(const gw_record_t& rec, RcCheck& check, const uint16_t gateway) {
+    uint64_t evaluated = 0;
+    size_t hit = gateway < gateway_hot.size() ? gateway_hot[gateway].find(check.scheme, rec, evaluated) : RcHotSet::NONE;
+    if (hit != RcHotSet::NONE) {
+      search_stats.gateway_hits++;
+    } else if ((hit = fleet_hot.find(check.scheme, rec, evaluated)) != RcHotSet::NONE) {
+      search_stats.fleet_hits++;
+    }
+    stats.seeds_primary += evaluated;
+    search_stats.evaluations += evaluated;
+    if (hit == RcHotSet::NONE) {
+      return false;
+    }
+    check.hit = hit;
+    check.verdict = RcVerdict::OK;
+    return true;
+  }
+
+  /**
+   * @return size_t Seeds evaluated
+   */
+  static size_t searchTable(const SeedTable& t, const gw_record_t& rec, RcCheck& check) {
+    const uint32_t* seeds = t.seeds.data();
+    const size_t lo = rec.format >= ADV_FORMAT_V2 ? t.hint_first[rec.hint] : 0;
+    const size_t hi = rec.format >= ADV_FORMAT_V2 ? t.hint_first[rec.hint + 1] : t.seeds.size();
+    const size_t hit = lo + rolling_code::schemeFind(t.scheme, seeds + lo, hi - lo, rec.timestamp, rec.code);
+    check.hit = hit < hi ? hit : RcCheck::NONE;
+    check.verdict = hit < hi ? RcVerdict::OK : RcVerdict::BAD;
+    if (hit < hi && hit + 1 + rolling_code::schemeFind(t.scheme, seeds + hit + 1, hi - hit - 1, rec.timestamp, rec.code) < hi) {
+      check.verdict = RcVerdict::AMB;
+    }
+    return hi - lo;
+  }
+
+  int32_t window_s;
+  std::vector<uint32_t> last_accepted[RC_SCHEMES];  // Synced timestamp word of the last accepted press, per seed
+  std::vector<uint8_t> have_last[RC_SCHEMES];
+  std::vector<uint8_t> device_scheme;               // Tracked scheme per button (| SEEN), FALLBACK / STRICT only
+  std::vector<RcHotSet> gateway_hot;                // HOT: per gateway, created by its first accepted press
+  RcHotSet fleet_hot;
+  RcMigrationStats stats;
+  RcSearchStats search_stats;
+};
+
+#endif  // HOST_RC_VERIFIER_H
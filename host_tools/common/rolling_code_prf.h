@@ -0,0 +1,341 @@
+/**
+ * @file    rolling_code_prf.h
+ * @brief   Rolling code PRF candidates: current mixer, SipHash-2-4, ChaCha8, AES-128-CMAC
+ * @details All candidates map (device key, 32-bit timestamp word) to a 32-bit code, like
+ *          generateRollingCode() in button_firmware.ino. Each is written once, as a template
+ *          over its word type, and instantiated three ways by prf_bench:
+ *            - plain uint32_t / uint64_t: reference and scalar throughput
+ *            - GCC vector types (one lane per device key): SIMD batch verification,
+ *              a verifier tests one received code against many keys at once
+ *            - OpCount32 / OpCount64: counts the operations one code costs and prices
+ *              them for the button's RV32IMAC core (estimated on-target cycles)
+ *
+ *          Keys: the mixer keeps the 32-bit seed of the firmware. The others take a
+ *          128-bit key (4 words). Message: the timestamp word, 4 bytes little endian.
+ *            SipHash-2-4: low 32 bits of the 64-bit tag.
+ *            ChaCha8:     8 rounds, 128-bit key ("expand 16-byte k"), counter 0,
+ *                         nonce = timestamp | 0 | 0, first output word.
+ *            AES-CMAC:    RFC 4493 with AES-128, first 4 tag bytes (big endian). A 4-byte
+ *                         message is one padded block: AES(K, M | 0x80 | 0.. ^ K2). Round
+ *                         keys and K2 are per device, computed once (aesCmacSetup()).
+ */
+
+#ifndef HOST_ROLLING_CODE_PRF_H
+#define HOST_ROLLING_CODE_PRF_H
+
+#include <stdint.h>
+#include <string.h>
+#include "rolling_code.h"
+
+namespace prf {
+
+/* ============= Operation Counting (on-target estimate) ============= */
+/**
+ * @brief Operations counted while a PRF runs on OpCount32 / OpCount64, in RV32IMAC
+ *        instructions (no Zbb: rotates are shift, shift, or)
+ */
+struct OpTally {
+  uint64_t alu = 0;   /**< add, xor, or, and, shift */
+  uint64_t mul = 0;
+  uint64_t load = 0;  /**< Table lookups (AES) */
+};
+static OpTally op_tally;
+
+/* RV32IMAC cycle costs, ESP32-H2 class core: single-issue, 1-cycle ALU, multi-cycle
+   multiply, loads with one use stall */
+#define PRF_RV32_ALU_CYCLES 1
+#define PRF_RV32_MUL_CYCLES 2
+#define PRF_RV32_LOAD_CYCLES 2
+
+static inline uint64_t opCycles(const OpTally& t) {
+  return t.alu * PRF_RV32_ALU_CYCLES + t.mul * PRF_RV32_MUL_CYCLES + t.load * PRF_RV32_LOAD_CYCLES;
+}
+
+struct OpCount32 {
+  uint32_t v;
+  OpCount32(uint32_t x = 0) : v(x) {}
+#define PRF_OP32(op, kind, n) \
+  friend OpCount32 operator op(OpCount32 a, OpCount32 b) { op_tally.kind += n; return OpCount32(a.v op b.v); }
+  PRF_OP32(+, alu, 1)
+  PRF_OP32(^, alu, 1)
+  PRF_OP32(|, alu, 1)
+  PRF_OP32(&, alu, 1)
+  PRF_OP32(*, mul, 1)
+#undef PRF_OP32
+  friend OpCount32 operator<<(OpCount32 a, int n) { op_tally.alu++; return OpCount32(a.v << n); }
+  friend OpCount32 operator>>(OpCount32 a, int n) { op_tally.alu++; return OpCount32(a.v >> n); }
+};
+
+/** 64-bit words on a 32-bit core: each op is a short instruction sequence */
+struct OpCount64 {
+  uint64_t v;
+  OpCount64(uint64_t x = 0) : v(x) {}
+  friend OpCount64 operator+(OpCount64 a, OpCount64 b) { op_tally.alu += 4; return OpCount64(a.v + b.v); }  // add, sltu, add, add
+  friend OpCount64 operator^(OpCount64 a, OpCount64 b) { op_tally.alu += 2; return OpCount64(a.v ^ b.v); }
+  friend OpCount64 operator|(OpCount64 a, OpCount64 b) { op_tally.alu += 2; return OpCount64(a.v | b.v); }
+  friend OpCount64 operator<<(OpCount64 a, int n) { op_tally.alu += 4; return OpCount64(a.v << n); }
+  friend OpCount64 operator>>(OpCount64 a, int n) { op_tally.alu += 4; return OpCount64(a.v >> n); }
+};
+
+
+/* ============= Word Helpers ============= */
+/**
+ * @brief Word of a constant: plain cast, or the value in every lane of a vector
+ */
+template <typename W>
+struct Word {
+  static W of(uint64_t x) { return W(x); }
+};
+
+typedef uint32_t u32x8 __attribute__((vector_size(32)));  /**< 8 keys per batch (32-bit PRFs) */
+typedef uint64_t u64x4 __attribute__((vector_size(32)));  /**< 4 keys per batch (SipHash) */
+
+template <>
+struct Word<u32x8> {
+  static u32x8 of(uint64_t x) { return u32x8{} + (uint32_t)x; }
+};
+template <>
+struct Word<u64x4> {
+  static u64x4 of(uint64_t x) { return u64x4{} + x; }
+};
+
+template <typename W>
+static inline W rotl32(W x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+static inline OpCount32 rotl32(OpCount32 x, int n) {
+  op_tally.alu += 3;
+  return OpCount32((x.v << n) | (x.v >> (32 - n)));
+}
+
+template <typename W>
+static inline W rotl64(W x, int n) {
+  return (x << n) | (x >> (64 - n));
+}
+static inline OpCount64 rotl64(OpCount64 x, int n) {
+  op_tally.alu += n == 32 ? 0 : 6;  // Rotate by 32 is a register swap
+  return OpCount64((x.v << n) | (x.v >> (64 - n)));
+}
+
+
+/* ============= Current Mixer ============= */
+/**
+ * @brief generateRollingCode() of button_firmware.ino: rolling_code::MixerV1 itself, not a copy
+ */
+template <typename W>
+static inline W mixer(W seed, W timestamp) {
+  return rolling_code::MixerV1::mix<W>(seed, timestamp);
+}
+
+
+/* ============= SipHash-2-4 ============= */
+template <typename W64>
+static inline void sipRound(W64& v0, W64& v1, W64& v2, W64& v3) {
+  v0 = v0 + v1; v1 = rotl64(v1, 13); v1 = v1 ^ v0; v0 = rotl64(v0, 32);
+  v2 = v2 + v3; v3 = rotl64(v3, 16); v3 = v3 ^ v2;
+  v0 = v0 + v3; v3 = rotl64(v3, 21); v3 = v3 ^ v0;
+  v2 = v2 + v1; v1 = rotl64(v1, 17); v1 = v1 ^ v2; v2 = rotl64(v2, 32);
+}
+
+/**
+ * @brief SipHash-2-4 of a message of 0-7 bytes (one final block)
+ * @param last Message bytes little endian in the low bytes, length << 56 in the top byte
+ */
+template <typename W64>
+static inline W64 sipHash24Short(W64 k0, W64 k1, W64 last) {
+  W64 v0 = k0 ^ Word<W64>::of(0x736f6d6570736575ULL);
+  W64 v1 = k1 ^ Word<W64>::of(0x646f72616e646f6dULL);
+  W64 v2 = k0 ^ Word<W64>::of(0x6c7967656e657261ULL);
+  W64 v3 = k1 ^ Word<W64>::of(0x7465646279746573ULL);
+  v3 = v3 ^ last;
+  sipRound(v0, v1, v2, v3);
+  sipRound(v0, v1, v2, v3);
+  v0 = v0 ^ last;
+  v2 = v2 ^ Word<W64>::of(0xFF);
+  for (int i = 0; i < 4; i++) {
+    sipRound(v0, v1, v2, v3);
+  }
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief Code from SipHash-2-4 of the 4-byte message
+ * @param k0, k1 Key halves: key words 0 | 1 << 32 and 2 | 3 << 32
+ * @param timestamp Zero extended to 64 bits
+ * @return W64 Tag; the code is its low 32 bits
+ */
+template <typename W64>
+static inline W64 sipHashCode(W64 k0, W64 k1, W64 timestamp) {
+  return sipHash24Short(k0, k1, timestamp | Word<W64>::of(4ULL << 56));
+}
+
+
+/* ============= ChaCha ============= */
+template <typename W>
+static inline void chachaQuarter(W& a, W& b, W& c, W& d) {
+  a = a + b; d = d ^ a; d = rotl32(d, 16);
+  c = c + d; b = b ^ c; b = rotl32(b, 12);
+  a = a + b; d = d ^ a; d = rotl32(d, 8);
+  c = c + d; b = b ^ c; b = rotl32(b, 7);
+}
+
+/**
+ * @brief One ChaCha block, only the first `words` output words
+ * @param in 16 input words (constants, key, counter, nonce)
+ */
+template <typename W>
+static inline void chachaBlock(const W* in, int rounds, W* out, int words) {
+  W x[16];
+  for (int i = 0; i < 16; i++) x[i] = in[i];
+  for (int r = 0; r < rounds; r += 2) {
+    chachaQuarter(x[0], x[4], x[8], x[12]);
+    chachaQuarter(x[1], x[5], x[9], x[13]);
+    chachaQuarter(x[2], x[6], x[10], x[14]);
+    chachaQuarter(x[3], x[7], x[11], x[15]);
+    chachaQuarter(x[0], x[5], x[10], x[15]);
+    chachaQuarter(x[1], x[6], x[11], x[12]);
+    chachaQuarter(x[2], x[7], x[8], x[13]);
+    chachaQuarter(x[3], x[4], x[9], x[14]);
+  }
+  for (int i = 0; i < words; i++) out[i] = x[i] + in[i];
+}
+
+/**
+ * @brief Code from ChaCha8 with a 128-bit key
+ */
+template <typename W>
+static inline W chacha8Code(const W* k, W timestamp) {
+  const W zero = Word<W>::of(0);
+  const W in[16] = { Word<W>::of(0x61707865), Word<W>::of(0x3120646e), Word<W>::of(0x79622d36),  // "expand 16-byte k"
+                     Word<W>::of(0x6b206574), k[0], k[1], k[2], k[3], k[0], k[1], k[2], k[3],
+                     zero, timestamp, zero, zero };
+  W out;
+  chachaBlock(in, 8, &out, 1);
+  return out;
+}
+
+
+/* ============= AES-128 / CMAC ============= */
+/**
+ * @brief S-box and T-tables, computed once from GF(2^8)
+ */
+struct AesTables {
+  uint8_t sbox[256];
+  uint32_t te[4][256];
+
+  AesTables() {
+    uint8_t p = 1, q = 1;
+    do {  // p runs through all non-zero elements (generator 3), q = p^-1
+      p = p ^ (uint8_t)(p << 1) ^ (p & 0x80 ? 0x1B : 0);
+      q ^= q << 1;
+      q ^= q << 2;
+      q ^= q << 4;
+      if (q & 0x80) q ^= 0x09;
+      const uint8_t s = q ^ (uint8_t)((q << 1) | (q >> 7)) ^ (uint8_t)((q << 2) | (q >> 6)) ^
+                        (uint8_t)((q << 3) | (q >> 5)) ^ (uint8_t)((q << 4) | (q >> 4));
+      sbox[p] = s ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+    for (int i = 0; i < 256; i++) {
+      const uint8_t s = sbox[i];
+      const uint8_t s2 = (uint8_t)(s << 1) ^ (s & 0x80 ? 0x1B : 0);
+      const uint32_t t = ((uint32_t)s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint8_t)(s2 ^ s);
+      for (int r = 0; r < 4; r++) te[r][i] = (t >> (8 * r)) | (r ? t << (32 - 8 * r) : 0);
+    }
+  }
+};
+static const AesTables aes_tables;
+
+static inline uint32_t aesLookup(const uint32_t* table, uint32_t idx) {
+  return table[idx];
+}
+static inline OpCount32 aesLookup(const uint32_t* table, OpCount32 idx) {
+  op_tally.load++;
+  return OpCount32(table[idx.v]);
+}
+
+/**
+ * @brief Per-device AES-CMAC state: round keys (big endian words) and the K2 subkey
+ */
+struct AesCmacKey {
+  uint32_t rk[44];
+  uint32_t k2[4];
+};
+
+template <typename W>
+static inline void aesEncrypt(const uint32_t* rk, const W* in, W* out) {
+  const uint32_t(&te)[4][256] = aes_tables.te;
+  const W m = Word<W>::of(0xFF);
+  W s[4];
+  for (int c = 0; c < 4; c++) s[c] = in[c] ^ Word<W>::of(rk[c]);
+  for (int r = 1; r < 10; r++) {
+    const uint32_t* k = rk + 4 * r;
+    W t[4];
+    for (int c = 0; c < 4; c++) {  // SubBytes, ShiftRows, MixColumns: four lookups per column
+      t[c] = aesLookup(te[0], s[c] >> 24) ^ aesLookup(te[1], (s[(c + 1) & 3] >> 16) & m) ^
+             aesLookup(te[2], (s[(c + 2) & 3] >> 8) & m) ^ aesLookup(te[3], s[(c + 3) & 3] & m) ^ Word<W>::of(k[c]);
+    }
+    for (int c = 0; c < 4; c++) s[c] = t[c];
+  }
+  // Last round: S-box only (bits 16-23 of te[0] are the plain S-box value), no MixColumns
+  const uint32_t* k = rk + 40;
+  for (int c = 0; c < 4; c++) {
+    const W b0 = (aesLookup(te[0], s[c] >> 24) >> 16) & m;
+    const W b1 = (aesLookup(te[0], (s[(c + 1) & 3] >> 16) & m) >> 16) & m;
+    const W b2 = (aesLookup(te[0], (s[(c + 2) & 3] >> 8) & m) >> 16) & m;
+    const W b3 = (aesLookup(te[0], s[(c + 3) & 3] & m) >> 16) & m;
+    out[c] = ((b0 << 24) | (b1 << 16) | (b2 << 8) | b3) ^ Word<W>::of(k[c]);
+  }
+}
+
+static inline void aesExpandKey(const uint32_t* key, uint32_t* rk) {
+  const uint8_t* sb = aes_tables.sbox;
+  uint8_t rcon = 1;
+  memcpy(rk, key, 16);
+  for (int i = 4; i < 44; i++) {
+    uint32_t t = rk[i - 1];
+    if (i % 4 == 0) {
+      t = ((uint32_t)sb[(t >> 16) & 0xFF] << 24) | ((uint32_t)sb[(t >> 8) & 0xFF] << 16) | ((uint32_t)sb[t & 0xFF] << 8) | sb[t >> 24];
+      t ^= (uint32_t)rcon << 24;
+      rcon = (uint8_t)(rcon << 1) ^ (rcon & 0x80 ? 0x1B : 0);
+    }
+    rk[i] = rk[i - 4] ^ t;
+  }
+}
+
+/**
+ * @brief Round keys and K2 of a device key (4 words, big endian: key bytes 0-3 = word 0)
+ */
+static inline void aesCmacSetup(const uint32_t* key, AesCmacKey* out) {
+  aesExpandKey(key, out->rk);
+  const uint32_t zero[4] = { 0, 0, 0, 0 };
+  uint32_t l[4];
+  aesEncrypt(out->rk, zero, l);
+  uint32_t k1[4];
+  for (int pass = 0; pass < 2; pass++) {  // L -> K1 -> K2: doubling in GF(2^128)
+    const uint32_t* src = pass ? k1 : l;
+    uint32_t* dst = pass ? out->k2 : k1;
+    const bool msb = src[0] >> 31;
+    for (int i = 0; i < 4; i++) dst[i] = (src[i] << 1) | (i < 3 ? src[i + 1] >> 31 : 0);
+    if (msb) dst[3] ^= 0x87;
+  }
+}
+
+/**
+ * @brief Code from AES-128-CMAC of the 4-byte timestamp message
+ * @param rk, k2 From aesCmacSetup() (the same for all lanes of a vector W)
+ */
+template <typename W>
+static inline W aesCmacCode(const uint32_t* rk, const uint32_t* k2, W timestamp) {
+  // Message bytes: timestamp little endian, then the 0x80 padding byte
+  const W m = Word<W>::of(0xFF);
+  const W m0 = ((timestamp & m) << 24) | (((timestamp >> 8) & m) << 16) | (((timestamp >> 16) & m) << 8) | (timestamp >> 24);
+  const W in[4] = { m0 ^ Word<W>::of(k2[0]), Word<W>::of(0x80000000u ^ k2[1]), Word<W>::of(k2[2]), Word<W>::of(k2[3]) };
+  W out[4];
+  aesEncrypt(rk, in, out);
+  return out[0];
+}
+
+}  // namespace prf
+
+#endif  // HOST_ROLLING_CODE_PRF_H
@@ -0,0 +1,519 @@
+/**
+ * @file    seed_replica.h
+ * @brief   Partial seed replicas: a site's buttons at its gateway host, kept current by deltas
+ * @details A site verifies its own buttons locally instead of sending every record over the
+ *          WAN to the central verifier. Its replica holds the seeds of the buttons deployed
+ *          there. A record that misses the replica (BAD) is escalated to the central store,
+ *          which holds the whole fleet: a visiting button, a button added since the last
+ *          sync, or a forged code.
+ *
+ *          The central seed database is written by several origins (Origin): provisioning
+ *          adds buttons, support revokes them, the OTA service moves them to another
+ *          rolling-code scheme. Each origin numbers its ops from 1, and a version vector
+ *          holds the last op of each origin a replica has. SeedStore keeps the op log and
+ *          routes each op to the site of its button.
+ *
+ *          Sync: the replica sends its version vector, the store answers with the ops of
+ *          that site after it, up to its own vector (a DELTA), or with all buttons of the
+ *          site (a SNAPSHOT: first sync, or a replica the store can't continue).
+ *          Ops of other sites advance the vector without being sent.
+ *
+ *          Wire format [little endian, varints LEB128]:
+ *            DELTA     type u8 = 1 | from vv | to vv | count | count x op | crc32
+ *            SNAPSHOT  type u8 = 2 | to vv | count | count x button | crc32
+ *            vv        REPLICA_ORIGINS x seq
+ *            op        type u8 | origin u8 | seq | mac[6] | ADD: site, seed u32
+ *                      | REVOKE: - | SCHEME: scheme u8, seed of that scheme u32
+ *            button    mac[6] | scheme u8 | has_v2 u8 | seed u32 | [seed_v2 u32]
+ *          crc32 (zlib, gwCrc32()) covers type .. last byte before it.
+ *
+ *          The replica's verifier is rc_verifier.h over its buttons, rebuilt after a sync
+ *          that changed them. Replay state is kept per seed here, so it survives the rebuild.
+ */
+
+#ifndef HOST_SEED_REPLICA_H
+#define HOST_SEED_REPLICA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "fleet_file.h"
+#include "gateway_core.h"
+#include "rc_verifier.h"
+
+namespace replica {
+
+#define REPLICA_ORIGINS 3           /**< Origin values */
+#define REPLICA_ALL_SITES 0xFFFF    /**< Site of the central store's own replica: every button */
+#define REPLICA_DIGEST_SEED 0xCBF29CE484222325ull  /**< FNV-1a offset basis */
+
+enum class Origin : uint8_t { PROVISIONING, SUPPORT, OTA };
+enum class OpType : uint8_t { ADD = 1, REVOKE = 2, SCHEME = 3 };
+enum class MsgType : uint8_t { DELTA = 1, SNAPSHOT = 2 };
+
+inline const char* originName(const Origin o) {
+  return o == Origin::PROVISIONING ? "provisioning" : o == Origin::SUPPORT ? "support" : "ota";
+}
+
+/**
+ * @brief One change of the seed database
+ */
+struct SeedOp {
+  OpType type = OpType::ADD;
+  Origin origin = Origin::PROVISIONING;
+  uint64_t seq = 0;       /**< Per origin, from 1 (SeedStore::append() numbers it) */
+  uint8_t mac[6] = {};    /**< Custom MAC of the button */
+  uint16_t site = 0;      /**< ADD: where it is deployed */
+  uint8_t scheme = ROLLING_CODE_SCHEME_V1;  /**< SCHEME: the scheme it moves to */
+  uint32_t seed = 0;      /**< ADD: V1 seed; SCHEME: its seed of `scheme` */
+};
+
+struct VersionVector {
+  uint64_t seq[REPLICA_ORIGINS] = {};
+
+  bool operator==(const VersionVector& o) const {
+    return memcmp(seq, o.seq, sizeof(seq)) == 0;
+  }
+  bool operator!=(const VersionVector& o) const {
+    return !(*this == o);
+  }
+  /**
+   * @return bool true if every origin is at least at `o`'s op
+   */
+  bool covers(const VersionVector& o) const {
+    for (int i = 0; i < REPLICA_ORIGINS; i++) {
+      if (seq[i] < o.seq[i]) return false;
+    }
+    return true;
+  }
+};
+
+using Bytes = std::vector<uint8_t>;
+
+/* ============= Encoding ============= */
+inline void putVarint(Bytes& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((uint8_t)v);
+}
+
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    const uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+inline void putLe32(Bytes& out, const uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+inline bool getLe32(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+  if (end - p < 4) return false;
+  v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  p += 4;
+  return true;
+}
+
+inline bool getBytes(const uint8_t*& p, const uint8_t* end, uint8_t* out, const size_t n) {
+  if ((size_t)(end - p) < n) return false;
+  memcpy(out, p, n);
+  p += n;
+  return true;
+}
+
+inline void putVersion(Bytes& out, const VersionVector& vv) {
+  for (int i = 0; i < REPLICA_ORIGINS; i++) putVarint(out, vv.seq[i]);
+}
+
+inline bool getVersion(const uint8_t*& p, const uint8_t* end, VersionVector& vv) {
+  for (int i = 0; i < REPLICA_ORIGINS; i++) {
+    if (!getVarint(p, end, vv.seq[i])) return false;
+  }
+  return true;
+}
+
+inline void putOp(Bytes& out, const SeedOp& op) {
+  out.push_back((uint8_t)op.type);
+  out.push_back((uint8_t)op.origin);
+  putVarint(out, op.seq);
+  out.insert(out.end(), op.mac, op.mac + 6);
+  if (op.type == OpType::ADD) {
+    putVarint(out, op.site);
+    putLe32(out, op.seed);
+  } else if (op.type == OpType::SCHEME) {
+    out.push_back(op.scheme);
+    putLe32(out, op.seed);
+  }
+}
+
+inline bool getOp(const uint8_t*& p, const uint8_t* end, SeedOp& op) {
+  if (end - p < 2) return false;
+  op.type = (OpType)*p++;
+  op.origin = (Origin)*p++;
+  uint64_t site = 0;
+  if ((uint8_t)op.origin >= REPLICA_ORIGINS || !getVarint(p, end, op.seq) || !getBytes(p, end, op.mac, 6)) return false;
+  switch (op.type) {
+    case OpType::ADD:
+      if (!getVarint(p, end, site)) return false;
+      op.site = (uint16_t)site;
+      return getLe32(p, end, op.seed);
+    case OpType::REVOKE:
+      return true;
+    case OpType::SCHEME:
+      if (p == end) return false;
+      op.scheme = *p++;
+      return op.scheme >= ROLLING_CODE_SCHEME_V1 && op.scheme <= ROLLING_CODE_SCHEME_V2 && getLe32(p, end, op.seed);
+  }
+  return false;
+}
+
+/**
+ * @brief Append the crc32 of the message
+ */
+inline void seal(Bytes& msg) {
+  putLe32(msg, gwCrc32(0, msg.data(), msg.size()));
+}
+
+/**
+ * @return bool true if the message ends in the crc32 of the rest
+ */
+inline bool sealed(const Bytes& msg) {
+  if (msg.size() < 5) return false;
+  const uint8_t* p = msg.data() + msg.size() - 4;
+  uint32_t crc;
+  return getLe32(p, msg.data() + msg.size(), crc) && crc == gwCrc32(0, msg.data(), msg.size() - 4);
+}
+
+inline uint64_t macKey(const uint8_t* mac) {
+  uint64_t k = 0;
+  for (int i = 0; i < 6; i++) k = (k << 8) | mac[i];
+  return k;
+}
+
+/**
+ * @brief FNV-1a over buttons in MAC order: equal for a replica and the store's view of its site
+ */
+inline uint64_t digestAdd(uint64_t h, const FleetEntry& e) {
+  uint8_t b[16];
+  memcpy(b, e.mac, 6);
+  b[6] = e.scheme;
+  b[7] = e.has_v2;
+  memcpy(b + 8, &e.seed, 4);
+  memcpy(b + 12, &e.seed_v2, 4);
+  for (const uint8_t c : b) h = (h ^ c) * 0x100000001B3ull;
+  return h;
+}
+
+/**
+ * @brief Button record of a SNAPSHOT
+ */
+inline void putButton(Bytes& out, const FleetEntry& e) {
+  out.insert(out.end(), e.mac, e.mac + 6);
+  out.push_back(e.scheme);
+  out.push_back(e.has_v2);
+  putLe32(out, e.seed);
+  if (e.has_v2) putLe32(out, e.seed_v2);
+}
+
+inline bool getButton(const uint8_t*& p, const uint8_t* end, FleetEntry& e) {
+  e = FleetEntry();
+  if (!getBytes(p, end, e.mac, 6) || end - p < 2) return false;
+  e.scheme = *p++;
+  e.has_v2 = *p++ != 0;
+  return getLe32(p, end, e.seed) && (!e.has_v2 || getLe32(p, end, e.seed_v2));
+}
+
+/**
+ * @brief Apply an op to a set of buttons (store and replica alike)
+ */
+inline void applyOp(std::map<uint64_t, FleetEntry>& buttons, const SeedOp& op) {
+  const uint64_t key = macKey(op.mac);
+  if (op.type == OpType::ADD) {
+    FleetEntry& e = buttons[key];
+    e = FleetEntry();
+    memcpy(e.mac, op.mac, 6);
+    e.seed = op.seed;
+    return;
+  }
+  const auto it = buttons.find(key);
+  if (it == buttons.end()) {
+    return;  // Revoked before, or never on this site
+  }
+  if (op.type == OpType::REVOKE) {
+    buttons.erase(it);
+  } else if (op.scheme == ROLLING_CODE_SCHEME_V2) {
+    it->second.scheme = ROLLING_CODE_SCHEME_V2;
+    it->second.has_v2 = true;
+    it->second.seed_v2 = op.seed;
+  } else {
+    it->second.scheme = ROLLING_CODE_SCHEME_V1;  // Rolled back: the V2 seed stays for its last presses
+  }
+}
+
+
+/* ============= Central Store ============= */
+/**
+ * @brief Seed database with its op log: source of every replica's deltas
+ */
+class SeedStore {
+public:
+  /**
+   * @brief Number the op in its origin and log it for its button's site
+   * @return bool false if a REVOKE / SCHEME names a button the store doesn't have
+   */
+  bool append(SeedOp op) {
+    const uint64_t key = macKey(op.mac);
+    uint16_t site = op.site;
+    if (op.type != OpType::ADD) {
+      const auto it = where.find(key);
+      if (it == where.end()) return false;
+      site = it->second;
+    }
+    op.seq = ++head.seq[(int)op.origin];
+    log.push_back({ op, site });
+    applyOp(sites[site], op);
+    if (op.type == OpType::ADD) where[key] = site;
+    else if (op.type == OpType::REVOKE) where.erase(key);
+    return true;
+  }
+
+  /**
+   * @brief DELTA of `site` (REPLICA_ALL_SITES: every op) from `from` to the store's version
+   * @return Bytes empty if the store can't continue from `from` (it is ahead of the store)
+   */
+  Bytes delta(const uint16_t site, const VersionVector& from) const {
+    Bytes msg;
+    if (!head.covers(from)) {
+      return msg;
+    }
+    msg.push_back((uint8_t)MsgType::DELTA);
+    putVersion(msg, from);
+    putVersion(msg, head);
+    Bytes ops;
+    uint64_t count = 0;
+    for (const Logged& l : log) {
+      if (l.op.seq > from.seq[(int)l.op.origin] && (site == REPLICA_ALL_SITES || l.site == site)) {
+        putOp(ops, l.op);
+        count++;
+      }
+    }
+    putVarint(msg, count);
+    msg.insert(msg.end(), ops.begin(), ops.end());
+    seal(msg);
+    return msg;
+  }
+
+  /**
+   * @brief SNAPSHOT of `site`'s buttons at the store's version
+   */
+  Bytes snapshot(const uint16_t site) const {
+    Bytes msg;
+    msg.push_back((uint8_t)MsgType::SNAPSHOT);
+    putVersion(msg, head);
+    std::vector<const FleetEntry*> buttons;
+    forSite(site, [&](const FleetEntry& e) { buttons.push_back(&e); });
+    putVarint(msg, buttons.size());
+    for (const FleetEntry* e : buttons) putButton(msg, *e);
+    seal(msg);
+    return msg;
+  }
+
+  uint64_t digest(const uint16_t site) const {
+    uint64_t h = REPLICA_DIGEST_SEED;
+    forSite(site, [&](const FleetEntry& e) { h = digestAdd(h, e); });
+    return h;
+  }
+
+  size_t size(const uint16_t site) const {
+    size_t n = 0;
+    forSite(site, [&](const FleetEntry&) { n++; });
+    return n;
+  }
+
+  /**
+   * @return int Site of a button, -1 if it isn't deployed (never added, or revoked)
+   */
+  int siteOf(const uint8_t* mac) const {
+    const auto it = where.find(macKey(mac));
+    return it == where.end() ? -1 : it->second;
+  }
+
+  const VersionVector& version(void) const {
+    return head;
+  }
+
+  size_t ops(void) const {
+    return log.size();
+  }
+
+private:
+  struct Logged {
+    SeedOp op;
+    uint16_t site;
+  };
+
+  template<typename F>
+  void forSite(const uint16_t site, F f) const {
+    if (site != REPLICA_ALL_SITES) {
+      const auto it = sites.find(site);
+      if (it != sites.end()) {
+        for (const auto& b : it->second) f(b.second);
+      }
+      return;
+    }
+    // Every site, merged in MAC order like a replica of all of them holds it
+    std::map<uint64_t, const FleetEntry*> all;
+    for (const auto& s : sites) {
+      for (const auto& b : s.second) all[b.first] = &b.second;
+    }
+    for (const auto& b : all) f(*b.second);
+  }
+
+  VersionVector head;
+  std::vector<Logged> log;
+  std::map<uint16_t, std::map<uint64_t, FleetEntry>> sites;  // Deployed buttons per site, by MAC
+  std::unordered_map<uint64_t, uint16_t> where;               // Site of each deployed button
+};
+
+
+/* ============= Replica ============= */
+/**
+ * @brief A site's buttons and a verifier over them
+ */
+class SeedReplica {
+public:
+  explicit SeedReplica(const uint16_t site, const int32_t window_s = RC_VERIFY_WINDOW_S)
+    : site(site), window_s(window_s) {}
+
+  /**
+   * @brief Apply a DELTA or SNAPSHOT of SeedStore
+   * @return bool false if the message is corrupt, or a DELTA doesn't start at this
+   *         replica's version: nothing is applied, ask for a SNAPSHOT
+   */
+  bool apply(const Bytes& msg) {
+    if (!sealed(msg)) {
+      return false;
+    }
+    const uint8_t* p = msg.data() + 1;
+    const uint8_t* const end = msg.data() + msg.size() - 4;
+    VersionVector from, to;
+    uint64_t count;
+    if (msg[0] == (uint8_t)MsgType::DELTA) {
+      if (!getVersion(p, end, from) || from != vv || !getVersion(p, end, to) || !getVarint(p, end, count)) {
+        return false;
+      }
+      std::vector<SeedOp> ops(count);
+      for (SeedOp& op : ops) {
+        if (!getOp(p, end, op)) return false;
+      }
+      for (const SeedOp& op : ops) applyOp(buttons, op);
+      dirty |= count > 0;
+    } else if (msg[0] == (uint8_t)MsgType::SNAPSHOT) {
+      if (!getVersion(p, end, to) || !getVarint(p, end, count)) {
+        return false;
+      }
+      std::map<uint64_t, FleetEntry> fresh;
+      for (uint64_t i = 0; i < count; i++) {
+        FleetEntry e;
+        if (!getButton(p, end, e)) return false;
+        fresh[macKey(e.mac)] = e;
+      }
+      buttons.swap(fresh);
+      dirty = true;
+    } else {
+      return false;
+    }
+    vv = to;
+    return p == end;
+  }
+
+  /**
+   * @brief Window, search and replay check of a record against the site's buttons
+   * @details BAD means: not a button of this replica (escalate it).
+   */
+  RcVerdict verify(const gw_record_t& rec, const uint64_t now_unix, RcCheck& check) {
+    if (dirty) {
+      rebuild();
+    }
+    check.hit = RcCheck::NONE;
+    if (!verifier->window(rec, now_unix, check)) {
+      return check.verdict = RcVerdict::STALE;
+    }
+    verifier->search(rec, check);
+    if (check.hit == RcCheck::NONE || !check.synced) {
+      return check.verdict;
+    }
+    const uint32_t seed = index->table(check.scheme).seeds[check.hit];
+    uint32_t& last = last_accepted[((uint64_t)check.scheme << 32) | seed];
+    if (last && buttonClockDiff(rec.timestamp, last) < 0) {
+      return check.verdict = RcVerdict::REPLAY;
+    }
+    last = rec.timestamp;
+    return check.verdict;
+  }
+
+  /**
+   * @brief Button of a record verify() matched
+   */
+  const FleetEntry& button(const RcCheck& check) const {
+    return index->button(check.scheme, check.hit);
+  }
+
+  const VersionVector& version(void) const {
+    return vv;
+  }
+
+  uint64_t digest(void) const {
+    uint64_t h = REPLICA_DIGEST_SEED;
+    for (const auto& b : buttons) h = digestAdd(h, b.second);
+    return h;
+  }
+
+  size_t size(void) const {
+    return buttons.size();
+  }
+
+  /**
+   * @return bool true if the replica has this button (deployed here, not revoked)
+   */
+  bool has(const uint8_t* mac) const {
+    return buttons.count(macKey(mac)) != 0;
+  }
+
+  const uint16_t site;
+  uint64_t rebuilds = 0;  /**< Verifier rebuilds: syncs that changed the buttons */
+
+private:
+  void rebuild(void) {
+    std::vector<FleetEntry> fleet;
+    fleet.reserve(buttons.size());
+    for (const auto& b : buttons) fleet.push_back(b.second);
+    verifier.reset();
+    index.reset(new SeedIndex(std::move(fleet)));
+    verifier.reset(new RcVerifier(*index, window_s, index->dual() ? RcMigration::FALLBACK : RcMigration::OFF));
+    dirty = false;
+    rebuilds++;
+  }
+
+  int32_t window_s;
+  VersionVector vv;
+  std::map<uint64_t, FleetEntry> buttons;                  // By custom MAC
+  bool dirty = true;
+  std::unique_ptr<SeedIndex> index;
+  std::unique_ptr<RcVerifier> verifier;
+  std::unordered_map<uint64_t, uint32_t> last_accepted;   // (scheme << 32 | seed) -> timestamp word
+};
+
+}  // namespace replica
+
+#endif  // HOST_SEED_REPLICA_H
@@ -0,0 +1,168 @@
+/**
+ * @file    diag_log_decode.cpp
+ * @brief   Decoder of the button's flash diagnostic log (diag_log.h)
+ * @details Input: a `spiffs` partition image (esptool.py read_flash <offset> <size>), a
+ *          UART capture of a factory session (diag_log_store.h sends every page), or the
+ *          pages maint_client.py log saved. Pages are found by magic and CRC at any offset
+ *          (diag_log_pages.h) and decoded in seq order:
+ *            WAKE    wake number, cause, device clock, charge and the wake timeline (ms)
+ *            EVENT   event ring entries (diagnostics.h DiagEvent), BOOT with the reset reason
+ *            ENERGY  energy counters at each commit
+ *          Missing seqs inside the range are pages lost to a torn write or a flash error;
+ *          older pages were overwritten by the wrap-around.
+ *
+ *          Usage: diag_log_decode <file> [--summary] [--csv wakes.csv]
+ *            --summary  totals only
+ *            --csv      one line per wake: wake,cause,clock,synced,charge_uc,<phase ms>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+#include "diag_log_pages.h"
+#include "file_util.h"
+
+// As diagnostics.h (WakePhase, DiagEvent) and esp_system.h (esp_reset_reason_t)
+static const char* const PHASE_NAMES[] = { "setup", "clocks", "ble_start", "pins", "ble_wait", "ble", "adv_start",
+                                           "ieee_start", "ieee_stop", "adv_stop", "sleep" };
+static const char* const EVENT_NAMES[] = { "NONE", "BOOT", "FACTORY", "SOS", "ERROR", "CRASH", "MAINTENANCE", "SELFTEST",
+                                           "CANCEL", "STUCK_BUTTON" };
+static const char* const RESET_NAMES[] = { "unknown", "power-on", "ext", "sw", "panic", "int_wdt", "task_wdt", "wdt",
+                                           "deepsleep", "brownout", "sdio", "usb", "jtag", "efuse", "pwr_glitch", "cpu_lockup" };
+static const char* const CAUSE_NAMES[] = { "BOOT", "BUTTON", "TIMER" };
+#define PHASE_COUNT (int)(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]))
+#define EVENT_COUNT (int)(sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]))
+#define CAUSE_COUNT 3
+
+static const char* nameOf(const char* const* names, const int count, const int i) {
+  return i >= 0 && i < count ? names[i] : "?";
+}
+
+int main(int argc, char** argv) {
+  std::string input, csv_path;
+  bool summary = false, usage = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--summary") summary = true;
+    else if (a == "--csv" && i + 1 < argc) csv_path = argv[++i];
+    else if (a[0] != '-' && input.empty()) input = a;
+    else usage = true;
+  }
+  if (input.empty() || usage) {
+    fprintf(stderr, "Usage: %s <file> [--summary] [--csv wakes.csv]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> data;
+  if (!readFile(input, data)) {
+    fprintf(stderr, "[!] Can't read %s\n", input.c_str());
+    return 1;
+  }
+  const auto pages = findDiagLogPages(data);
+  if (pages.empty()) {
+    fprintf(stderr, "[!] No log pages in %s (%zu bytes)\n", input.c_str(), data.size());
+    return 1;
+  }
+
+  FILE* csv = nullptr;
+  if (!csv_path.empty()) {
+    csv = fopen(csv_path.c_str(), "w");
+    if (!csv) {
+      fprintf(stderr, "[!] Can't write %s\n", csv_path.c_str());
+      return 1;
+    }
+    fprintf(csv, "wake,cause,clock,synced,charge_uc");
+    for (int i = 0; i < PHASE_COUNT; i++) fprintf(csv, ",%s_ms", PHASE_NAMES[i]);
+    fprintf(csv, "\n");
+  }
+
+  uint64_t wakes[CAUSE_COUNT + 1] = {}, charge[CAUSE_COUNT + 1] = {}, events[EVENT_COUNT + 1] = {};
+  uint64_t missing = 0, bad_records = 0;
+  uint32_t prev_seq = 0;
+  diag_log_energy_t energy = {};
+  bool have_energy = false;
+  for (const auto& [seq, page] : pages) {
+    if (prev_seq && seq != prev_seq + 1) {
+      missing += seq - prev_seq - 1;
+      if (!summary) printf("[!] %u pages missing before seq %u\n", seq - prev_seq - 1, seq);
+    }
+    prev_seq = seq;
+
+    uint16_t offset = 0;
+    DiagLogRecord type;
+    const uint8_t* value;
+    uint8_t len;
+    while (diagLogNextRecord(page.data(), offset, type, value, len)) {
+      if (type == DiagLogRecord::WAKE) {
+        diag_log_wake_t w;
+        if (!diagLogParseWake(value, len, &w)) {
+          bad_records++;
+          continue;
+        }
+        const int cause = (int)w.cause < CAUSE_COUNT ? (int)w.cause : CAUSE_COUNT;
+        wakes[cause]++;
+        charge[cause] += w.charge_uc;
+        const bool synced = buttonClockSynced(w.clock);
+        if (!summary) {
+          printf("#%-7u %-6s clock=%u%s %6u uC ", w.wake, nameOf(CAUSE_NAMES, CAUSE_COUNT, (int)w.cause),
+                 w.clock & BUTTON_CLOCK_MASK, synced ? " (synced)" : "", w.charge_uc);
+          for (int i = 0; i < PHASE_COUNT; i++) {
+            if (w.phase_mask & (1u << i)) printf(" %s=%.1f", PHASE_NAMES[i], w.phase[i] * DIAG_LOG_PHASE_UNIT_US / 1000.0);
+          }
+          printf(" ms\n");
+        }
+        if (csv) {
+          fprintf(csv, "%u,%s,%u,%d,%u", w.wake, nameOf(CAUSE_NAMES, CAUSE_COUNT, (int)w.cause), w.clock & BUTTON_CLOCK_MASK,
+                  synced, w.charge_uc);
+          for (int i = 0; i < PHASE_COUNT; i++) {
+            if (w.phase_mask & (1u << i)) fprintf(csv, ",%.3f", w.phase[i] * DIAG_LOG_PHASE_UNIT_US / 1000.0);
+            else fprintf(csv, ",");
+          }
+          fprintf(csv, "\n");
+        }
+      } else if (type == DiagLogRecord::EVENT && len >= 6) {
+        const uint32_t wake = diagLogGet32(value);
+        const int ev = value[4] < EVENT_COUNT ? value[4] : EVENT_COUNT;
+        events[ev]++;
+        if (!summary) {
+          printf("#%-7u   event %s", wake, nameOf(EVENT_NAMES, EVENT_COUNT, value[4]));
+          if (ev == 1) printf(" (%s)", nameOf(RESET_NAMES, sizeof(RESET_NAMES) / sizeof(RESET_NAMES[0]), value[5]));
+          else if (value[5]) printf(" arg=0x%02X", value[5]);
+          printf("\n");
+        }
+      } else if (type == DiagLogRecord::ENERGY && len == sizeof(diag_log_energy_t)) {
+        memcpy(&energy, value, sizeof(energy));
+        have_energy = true;
+      } else {
+        bad_records++;
+      }
+    }
+  }
+  if (csv) fclose(csv);
+
+  if (!summary) printf("\n");
+  printf("[*] %zu pages, seq %u-%u", pages.size(), pages.begin()->first, pages.rbegin()->first);
+  if (missing) printf(", %llu missing", (unsigned long long)missing);
+  if (bad_records) printf(", %llu malformed records", (unsigned long long)bad_records);
+  printf("\n[*] Wakes:");
+  for (int c = 0; c < CAUSE_COUNT; c++) {
+    if (wakes[c]) printf(" %llu %s (%.0f uC mean)", (unsigned long long)wakes[c], CAUSE_NAMES[c], (double)charge[c] / wakes[c]);
+  }
+  printf("\n[*] Events:");
+  for (int e = 1; e <= EVENT_COUNT; e++) {
+    if (events[e]) printf(" %s %llu", e < EVENT_COUNT ? EVENT_NAMES[e] : "?", (unsigned long long)events[e]);
+  }
+  printf("\n");
+  if (have_energy) {
+    printf("[*] Energy at the last commit: %.3f C total, %u s active, %u s advertising; BLE %u PDUs %.3f C, 802.15.4 %u frames "
+           "(%u not sent) %.3f C\n",
+           energy.total_uc / 1e6, energy.active_ms / 1000, energy.adv_ms / 1000, energy.ble_frames, energy.ble_charge_uc / 1e6,
+           energy.ieee_frames, energy.ieee_failed, energy.ieee_charge_uc / 1e6);
+  }
+  return 0;
+}
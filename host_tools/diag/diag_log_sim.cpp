@@ -0,0 +1,393 @@
+/**
+ * @file    diag_log_sim.cpp
+ * @brief   Flash diagnostic log (diag_log.h) over years of wakes, power cuts and torn writes
+ * @details A button wakes for presses (SOS timeline, ~10 s awake) and for the hourly clock
+ *          calibration, and batches its records with the firmware's commit policy
+ *          (diag_log_store.h) on a NOR flash model: programming only clears bits, an erase
+ *          sets a 4 KB sector to 0xFF. Power cuts clear the RTC state (batch, head, seq);
+ *          half of them hit a commit and leave a torn page. Every record carries a unique
+ *          wake id in its clock field, so the decoded log can be checked against what the
+ *          button committed.
+ *
+ *          Checks (exit code 1 if one fails), for the min_spiffs.csv (128 KB) and default.csv
+ *          (1.4 MB) `spiffs` partitions, committing every wake and every 8 wakes:
+ *            recovery  after every power cut the log continues at the next seq, after the
+ *                      last valid page (a torn page is skipped, never overwritten)
+ *            history   every committed page still on flash decodes, in order, with the
+ *                      records as committed; the log holds the last (pages - 16) slots
+ *                      and only torn pages are missing
+ *            loss      a power cut loses at most the uncommitted wakes of the batch
+ *            wear      erase counts of all sectors within 1 of each other, plus one per
+ *                      torn page (a page torn at a sector start erases that sector again)
+ *
+ *          Usage: diag_log_sim [--days N] [--presses-per-day N] [--cuts-per-year N] [--seed N]
+ *                              [--image out.bin]
+ *          --image writes the 128 KB partition of the batched run, for diag_log_decode.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+#include "diag_log_pages.h"
+#include "file_util.h"
+
+// As diag_log_store.h / diagnostics.h
+#define SIM_CURRENT_ACTIVE_UA 15000
+#define SIM_SLEEP_UA 5
+#define SIM_CAL_WAKE_S 3600              /**< DEVICE_CLOCK_CAL_WAKE_S, jittered 0.5x - 1.5x */
+#define SIM_PAGE_PROGRAM_US 700          /**< Typical page program */
+#define SIM_SECTOR_ERASE_US 45000        /**< Typical 4 KB sector erase */
+#define SIM_PRESS_UC 155000              /**< SOS wake: 10 s beacon (dual_radio_sim) */
+#define SIM_TIMER_UC 450                 /**< Calibration wake: ~30 ms awake */
+
+/**
+ * @brief NOR flash in memory, with erase counts and a torn write on request
+ */
+class MemFlash : public DiagLogIo {
+public:
+  explicit MemFlash(const uint32_t size)
+    : mem(size, 0xFF), erases(size / DIAG_LOG_SECTOR, 0), erased_at(size / DIAG_LOG_SECTOR, 0) {}
+
+  bool read(uint32_t offset, void* buf, size_t len) override {
+    if (offset + len > mem.size()) return false;
+    memcpy(buf, mem.data() + offset, len);
+    return true;
+  }
+  bool write(uint32_t offset, const void* buf, size_t len) override {
+    if (offset + len > mem.size()) return false;
+    const size_t n = tear_after >= 0 ? std::min(len, (size_t)tear_after) : len;
+    for (size_t i = 0; i < n; i++) mem[offset + i] &= ((const uint8_t*)buf)[i];
+    programs++;
+    if (tear_after >= 0) {
+      tear_after = -1;
+      cut = true;
+      return false;
+    }
+    return true;
+  }
+  bool erase(uint32_t offset) override {
+    if (offset % DIAG_LOG_SECTOR || offset >= mem.size()) return false;
+    memset(mem.data() + offset, 0xFF, DIAG_LOG_SECTOR);
+    erases[offset / DIAG_LOG_SECTOR]++;
+    erased_at[offset / DIAG_LOG_SECTOR] = ++erase_serial;
+    return true;
+  }
+
+  std::vector<uint8_t> mem;
+  std::vector<uint32_t> erases;
+  std::vector<uint32_t> erased_at;  /**< Serial of the sector's last erase */
+  uint32_t erase_serial = 0;
+  uint64_t programs = 0;
+  int tear_after = -1;   /**< Next write stops after this many bytes (power cut) */
+  bool cut = false;
+};
+
+struct SimConfig {
+  uint32_t size;
+  uint8_t commit_wakes;
+  double days = 730;
+  double presses_per_day = 3;
+  double cuts_per_year = 6;
+  uint32_t seed = 1;
+};
+
+struct SimResult {
+  uint64_t wakes = 0, committed_wakes = 0, lost_wakes = 0, pages = 0, erases = 0, cuts = 0, torn = 0;
+  uint32_t max_lost = 0;                   /**< Most wakes lost by one cut */
+  uint32_t recover_bad = 0;                /**< Recoveries that didn't continue the log */
+  uint32_t history_missing = 0, history_order = 0, history_extra = 0, history_short = 0;
+  uint32_t erase_min = 0, erase_max = 0;
+  double history_days = 0;                 /**< Time span of the decoded log at the end */
+  double flash_uc_day = 0, wake_uc_day = 0;
+  double record_bytes = 0;                 /**< Record bytes batched (written pages carry them) */
+};
+
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-9s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+/**
+ * @brief One button over cfg.days
+ */
+static SimResult run(const SimConfig& cfg, std::vector<uint8_t>* image) {
+  std::mt19937_64 rng(cfg.seed);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  MemFlash flash(cfg.size);
+  SimResult r;
+
+  diag_log_t log;
+  diagLogInit(log, 0);
+  bool rtc_valid = false;                  /**< RTC state lost: recover at the next commit */
+  uint32_t wake_no = 0;                    /**< diag_data.wakes, reset by a power cut */
+  uint64_t energy_uc = 0;
+  std::vector<uint32_t> batch_ids;         /**< Wake ids in the batch */
+  struct Committed {
+    std::vector<uint32_t> ids;             /**< Wake ids of the page */
+    uint32_t sector, erased_at;            /**< On flash until that sector is erased again */
+  };
+  std::map<uint32_t, Committed> committed; /**< By seq */
+  std::map<uint32_t, double> wake_time;    /**< wake id -> day */
+  uint32_t last_valid_seq = 0, last_valid_head = 0;
+  uint32_t torn_since = 0;                 /**< Torn pages after the last valid one */
+  double flash_us = 0;
+
+  auto commit = [&]() -> bool {
+    if (log.count == 0) return true;
+    if (!rtc_valid) {
+      // diagLogOpen(): recover head and seq, keep the records batched since
+      const diag_log_t batch = log;
+      diagLogRecover(log, flash, cfg.size);
+      memcpy(log.batch, batch.batch, batch.used);
+      log.used = batch.used;
+      log.count = batch.count;
+      log.wakes = batch.wakes;
+      rtc_valid = true;
+      // Next seq; head after the last valid page, or after the torn pages that aren't blank
+      const uint32_t pages = (uint32_t)(cfg.size / DIAG_LOG_PAGE);
+      const uint32_t next = last_valid_seq ? (last_valid_head + 1) % pages : 0;
+      const bool head_ok = (log.head + pages - next) % pages <= torn_since;
+      if (log.seq != last_valid_seq + 1 || !head_ok) {
+        r.recover_bad++;
+      }
+    }
+    const uint32_t seq = log.seq, head = log.head;
+    const bool erase = head % DIAG_LOG_PAGES_PER_SECTOR == 0;
+    const diag_log_energy_t energy = { (uint32_t)energy_uc, 0, 0, 0, 0, 0, 0, 0 };
+    const bool ok = diagLogCommit(log, flash, energy);
+    flash_us += SIM_PAGE_PROGRAM_US + (erase ? SIM_SECTOR_ERASE_US : 0);
+    if (flash.cut) {
+      return false;
+    }
+    if (ok) {
+      const uint32_t sector = head / DIAG_LOG_PAGES_PER_SECTOR;
+      committed[seq] = { batch_ids, sector, flash.erased_at[sector] };
+      r.committed_wakes += batch_ids.size();
+      batch_ids.clear();
+      last_valid_seq = seq;
+      last_valid_head = head;
+      torn_since = 0;
+      r.pages++;
+    }
+    return ok;
+  };
+
+  auto powerCut = [&]() {
+    r.cuts++;
+    r.lost_wakes += batch_ids.size();
+    r.max_lost = std::max(r.max_lost, (uint32_t)batch_ids.size());
+    batch_ids.clear();
+    diagLogInit(log, 0);
+    rtc_valid = false;
+    wake_no = 0;
+  };
+
+  const double cut_p_wake = cfg.cuts_per_year / 365.0 / (cfg.presses_per_day + 86400.0 / SIM_CAL_WAKE_S);
+  double day = 0, next_press = -log1p(-uni(rng)) / cfg.presses_per_day, next_timer = 0;
+  bool boot = true;
+  uint32_t id = 0;
+  while (day < cfg.days) {
+    const bool press = next_press <= next_timer;
+    day = press ? next_press : next_timer;
+    if (press) next_press = day - log1p(-uni(rng)) / cfg.presses_per_day;
+    else next_timer = day + (0.5 + uni(rng)) * SIM_CAL_WAKE_S / 86400.0;
+
+    // One wake: records as diagLogWake() builds them
+    wake_no++;
+    id++;
+    r.wakes++;
+    wake_time[id] = day;
+    diag_log_wake_t w = {};
+    w.wake = wake_no;
+    w.clock = buttonClockWord(id, false);  // Unique wake id instead of the device clock
+    w.cause = boot ? DiagLogCause::BOOT : (press ? DiagLogCause::BUTTON : DiagLogCause::TIMER);
+    w.charge_uc = press || boot ? SIM_PRESS_UC : SIM_TIMER_UC;
+    energy_uc += w.charge_uc;
+    const int phases = press || boot ? 10 : 2;
+    for (int i = 0; i < phases; i++) {
+      w.phase_mask |= 1u << (phases == 2 ? i * 10 : i + (i >= 7));
+    }
+    for (int i = 0; i < DIAG_LOG_MAX_PHASES; i++) {
+      const uint32_t sleep_us = phases == 2 ? 30000 : 10000000;  // Calibration wake / SOS timeline
+      if (w.phase_mask & (1u << i)) w.phase[i] = diagLogPhaseUnits(i == 10 ? sleep_us : i * 1000 + 250);
+    }
+    uint8_t value[DIAG_LOG_WAKE_FIXED_LEN + 2 * DIAG_LOG_MAX_PHASES];
+    const uint8_t len = diagLogWakeValue(w, value);
+    std::vector<std::pair<uint8_t, uint8_t>> events;  // type, arg (diagnostics.h DiagEvent)
+    if (boot) events.push_back({ 1, 9 });              // BOOT, brownout
+    if (press) events.push_back({ 3, 0 });             // SOS
+    if (uni(rng) < 0.002) events.push_back({ 4, 1 });  // ERROR, BLE_INIT_FAILED
+    boot = false;
+
+    const bool cut_now = uni(rng) < cut_p_wake;
+    if (cut_now && uni(rng) < 0.5) {
+      flash.tear_after = (int)(uni(rng) * DIAG_LOG_PAGE);  // Cut during the next commit
+    }
+
+    auto add = [&](const DiagLogRecord type, const uint8_t* v, const uint8_t n) {
+      if (!diagLogFits(log, n)) commit();
+      if (!flash.cut) diagLogAppend(log, type, v, n);
+      r.record_bytes += 2 + n;
+    };
+    add(DiagLogRecord::WAKE, value, len);
+    if (!flash.cut) batch_ids.push_back(id);
+    for (const auto& [type, arg] : events) {
+      uint8_t ev[6];
+      diagLogPut32(ev, wake_no);
+      ev[4] = type;
+      ev[5] = arg;
+      if (!flash.cut) add(DiagLogRecord::EVENT, ev, sizeof(ev));
+    }
+    log.wakes++;
+    if (!flash.cut && log.wakes >= cfg.commit_wakes) {
+      commit();
+    }
+
+    if (flash.cut) {
+      // The torn page holds the batch, which is lost with the RTC state
+      r.torn++;
+      torn_since++;
+      flash.cut = false;
+      flash.tear_after = -1;
+      powerCut();
+      boot = true;
+    } else if (cut_now) {
+      flash.tear_after = -1;
+      powerCut();
+      boot = true;
+    }
+  }
+
+  // Decode the partition and compare with what was committed
+  const auto pages = findDiagLogPages(flash.mem);
+  const uint64_t retained = (cfg.size / DIAG_LOG_PAGE) - DIAG_LOG_PAGES_PER_SECTOR;  // Head sector may be erased
+  if (pages.size() + r.torn < std::min<uint64_t>(r.pages, retained)) r.history_short++;
+  uint32_t prev_id = 0;
+  for (const auto& [seq, page] : pages) {
+    const auto it = committed.find(seq);
+    std::vector<uint32_t> ids;
+    uint16_t offset = 0;
+    DiagLogRecord type;
+    const uint8_t* v;
+    uint8_t n;
+    while (diagLogNextRecord(page.data(), offset, type, v, n)) {
+      diag_log_wake_t w;
+      if (type == DiagLogRecord::WAKE && diagLogParseWake(v, n, &w)) ids.push_back(w.clock & BUTTON_CLOCK_MASK);
+    }
+    if (it == committed.end() || it->second.ids != ids) r.history_extra++;
+    for (const uint32_t i : ids) {
+      if (i <= prev_id) r.history_order++;
+      prev_id = i;
+    }
+  }
+  for (const auto& [seq, c] : committed) {
+    if (flash.erased_at[c.sector] == c.erased_at && !pages.count(seq)) r.history_missing++;
+  }
+  if (!pages.empty()) {
+    uint32_t first_id = 0;
+    for (const auto& [seq, page] : pages) {
+      uint16_t offset = 0;
+      DiagLogRecord type;
+      const uint8_t* v;
+      uint8_t n;
+      diag_log_wake_t w;
+      while (!first_id && diagLogNextRecord(page.data(), offset, type, v, n)) {
+        if (type == DiagLogRecord::WAKE && diagLogParseWake(v, n, &w)) first_id = w.clock & BUTTON_CLOCK_MASK;
+      }
+      if (first_id) break;
+    }
+    r.history_days = day - wake_time[first_id];
+  }
+
+  r.erase_min = *std::min_element(flash.erases.begin(), flash.erases.end());
+  r.erase_max = *std::max_element(flash.erases.begin(), flash.erases.end());
+  for (const uint32_t e : flash.erases) r.erases += e;
+  r.flash_uc_day = flash_us * SIM_CURRENT_ACTIVE_UA / 1e6 / cfg.days;
+  r.wake_uc_day = (double)energy_uc / cfg.days + SIM_SLEEP_UA * 86400.0;
+  if (image) *image = flash.mem;
+  return r;
+}
+
+int main(int argc, char** argv) {
+  SimConfig base;
+  std::string image_path;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--days" && i + 1 < argc) base.days = atof(argv[++i]);
+    else if (a == "--presses-per-day" && i + 1 < argc) base.presses_per_day = atof(argv[++i]);
+    else if (a == "--cuts-per-year" && i + 1 < argc) base.cuts_per_year = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) base.seed = (uint32_t)atoi(argv[++i]);
+    else if (a == "--image" && i + 1 < argc) image_path = argv[++i];
+    else {
+      fprintf(stderr, "Usage: %s [--days N] [--presses-per-day N] [--cuts-per-year N] [--seed N] [--image out.bin]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  struct Run {
+    const char* partition;
+    uint32_t size;
+    uint8_t commit_wakes;
+  };
+  const Run runs[] = { { "min_spiffs", 0x20000, 1 }, { "min_spiffs", 0x20000, 8 }, { "default", 0x160000, 1 }, { "default", 0x160000, 8 } };
+
+  printf("[*] %.0f days, %.1f presses/day + hourly clock wakes, %.0f power cuts/year (half during a commit)\n\n", base.days,
+         base.presses_per_day, base.cuts_per_year);
+  printf("  %-10s %6s %7s %8s %9s %9s %11s %12s %10s\n", "spiffs", "commit", "pages", "erases", "max/min", "history",
+         "flash uC/d", "% of budget", "lost/cut");
+  bool ok = true;
+  std::vector<std::string> failures;
+  for (const Run& run_cfg : runs) {
+    SimConfig cfg = base;
+    cfg.size = run_cfg.size;
+    cfg.commit_wakes = run_cfg.commit_wakes;
+    std::vector<uint8_t> image;
+    const bool keep = !image_path.empty() && run_cfg.size == 0x20000 && run_cfg.commit_wakes > 1;
+    const SimResult r = run(cfg, keep ? &image : nullptr);
+    if (keep && !writeFile(image_path, image)) {
+      fprintf(stderr, "[!] Can't write %s\n", image_path.c_str());
+      return 1;
+    }
+    char commit[16];
+    snprintf(commit, sizeof(commit), "%u wake%s", run_cfg.commit_wakes, run_cfg.commit_wakes > 1 ? "s" : "");
+    printf("  %-10s %6s %7llu %8llu %5u/%-3u %7.0f d %11.1f %11.3f%% %10u\n", run_cfg.partition, commit,
+           (unsigned long long)r.pages, (unsigned long long)r.erases, r.erase_max, r.erase_min, r.history_days, r.flash_uc_day,
+           r.flash_uc_day * 100.0 / r.wake_uc_day, r.max_lost);
+
+    char detail[200];
+    snprintf(detail, sizeof(detail), "%s/%s: %llu cuts (%llu torn pages), %u recoveries off", run_cfg.partition, commit,
+             (unsigned long long)r.cuts, (unsigned long long)r.torn, r.recover_bad);
+    if (r.recover_bad) failures.push_back(std::string("recovery  ") + detail);
+    snprintf(detail, sizeof(detail), "%s/%s: %u committed pages missing, %u out of order, %u not as committed%s",
+             run_cfg.partition, commit, r.history_missing, r.history_order, r.history_extra,
+             r.history_short ? ", fewer pages than the partition keeps" : "");
+    if (r.history_missing || r.history_order || r.history_extra || r.history_short) failures.push_back(std::string("history   ") + detail);
+    snprintf(detail, sizeof(detail), "%s/%s: a cut lost up to %u wakes", run_cfg.partition, commit, r.max_lost);
+    if (r.max_lost > run_cfg.commit_wakes) failures.push_back(std::string("loss      ") + detail);
+    snprintf(detail, sizeof(detail), "%s/%s: erases per sector %u-%u", run_cfg.partition, commit, r.erase_min, r.erase_max);
+    if (r.erase_max - r.erase_min > 1 + r.torn) failures.push_back(std::string("wear      ") + detail);
+  }
+  printf("\n");
+  ok &= check("recovery", failures.end() == std::find_if(failures.begin(), failures.end(),
+                                                         [](const std::string& f) { return f.rfind("recovery", 0) == 0; }),
+              "every power cut: next seq after the last valid page, torn pages skipped");
+  ok &= check("history", failures.end() == std::find_if(failures.begin(), failures.end(),
+                                                        [](const std::string& f) { return f.rfind("history", 0) == 0; }),
+              "committed pages still on flash decode in order, pages - 16 slots kept");
+  ok &= check("loss", failures.end() == std::find_if(failures.begin(), failures.end(),
+                                                     [](const std::string& f) { return f.rfind("loss", 0) == 0; }),
+              "a power cut loses at most the uncommitted batch");
+  ok &= check("wear", failures.end() == std::find_if(failures.begin(), failures.end(),
+                                                     [](const std::string& f) { return f.rfind("wear", 0) == 0; }),
+              "sector erase counts within 1 of each other (+1 per torn sector start)");
+  for (const std::string& f : failures) printf("    %s\n", f.c_str());
+  return ok ? 0 : 1;
+}
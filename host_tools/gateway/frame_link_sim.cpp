@@ -0,0 +1,251 @@
+/**
+ * @file    frame_link_sim.cpp
+ * @brief   Gateway frame parser over a pseudo terminal, fed by a corrupting stand-in gateway
+ * @details A writer thread plays the gateway: frames from the firmware's GwBatcher
+ *          (gateway_core.h) go into the master side of a pty pair in random chunk sizes.
+ *          The writer damages some of them on the way: flipped bits, dropped bytes,
+ *          truncated frames, and garbage between frames. The garbage includes fake sync
+ *          bytes and fake headers. The reader sets the slave side raw (like a real UART tty)
+ *          and parses it with frame_parser.h.
+ *
+ *          Scenarios (all must pass, exit code 1 otherwise):
+ *            clean        no corruption: every frame, no bytes skipped
+ *            corrupt      every intact frame delivered byte-exact, no damaged frame accepted
+ *            byte-wise    same, written one byte at a time (frames always split)
+ *            small-ring   same, with a one page ring (wraps every ~15 frames)
+ *
+ *          Usage: frame_link_sim [--frames N] [--corrupt P] [--garbage P] [--seed N]
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_parser.h"
+#include "gateway_core.h"
+
+using gwlink::FrameParser;
+using gwlink::FrameView;
+using gwlink::MirrorRing;
+
+struct SimConfig {
+  uint32_t frames = 20000;
+  double corrupt = 0.05;   /**< Share of frames damaged */
+  double garbage = 0.05;   /**< Share of frame gaps with garbage */
+  uint32_t seed = 1;
+};
+
+struct Scenario {
+  const char* name;
+  bool damage;
+  size_t max_chunk;        /**< Largest write() to the pty */
+  size_t ring;
+};
+
+/* ============= Stand-in gateway ============= */
+enum class Damage { BIT_FLIP, DROP, TRUNCATE, COUNT };
+
+/**
+ * @brief Byte stream of the stand-in gateway, plus the frames that went out intact (by seq)
+ */
+static std::vector<uint8_t> makeStream(const SimConfig& cfg, bool damage, std::mt19937& rng,
+                                       std::map<uint16_t, std::vector<uint8_t>>& intact, uint32_t& damaged) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  static GwBatcher batcher;
+  batcher = GwBatcher();
+  std::vector<uint8_t> stream;
+  damaged = 0;
+  for (uint32_t f = 0; f < cfg.frames; f++) {
+    const uint32_t count = rng() % (GW_BATCH_MAX_RECORDS + 1);
+    for (uint32_t r = 0; r < count; r++) {
+      gw_record_t rec = {};
+      for (uint8_t& b : rec.mac) b = (uint8_t)rng();
+      rec.addr_type = 0;
+      rec.rssi = (int8_t)(-40 - rng() % 50);
+      rec.code = rng();
+      rec.timestamp = rng();
+      batcher.add(rec, f);
+    }
+    const size_t len = batcher.finish(f);
+    std::vector<uint8_t> frame(batcher.data(), batcher.data() + len);
+    const uint16_t seq = (uint16_t)(frame[4] | (frame[5] << 8));
+
+    if (damage && uni(rng) < cfg.garbage) {
+      // Garbage, including sync pairs and believable headers
+      const size_t n = 1 + rng() % 64;
+      for (size_t i = 0; i < n; i++) {
+        const uint32_t kind = rng() % 8;
+        if (kind == 0) {
+          const uint8_t fake[] = { GW_FRAME_SYNC0, GW_FRAME_SYNC1, GW_FRAME_VERSION, (uint8_t)(rng() % 17) };
+          stream.insert(stream.end(), fake, fake + sizeof(fake));
+        } else if (kind == 1) {
+          stream.push_back(GW_FRAME_SYNC0);
+        } else {
+          stream.push_back((uint8_t)rng());
+        }
+      }
+    }
+
+    if (damage && uni(rng) < cfg.corrupt) {
+      damaged++;
+      switch (static_cast<Damage>(rng() % static_cast<int>(Damage::COUNT))) {
+        case Damage::BIT_FLIP:
+          frame[rng() % len] ^= (uint8_t)(1u << (rng() % 8));
+          break;
+        case Damage::DROP: {
+          const size_t at = rng() % len;
+          frame.erase(frame.begin() + at, frame.begin() + std::min(len, at + 1 + rng() % 8));
+          break;
+        }
+        default:
+          frame.resize(rng() % len);
+          break;
+      }
+    } else {
+      intact[seq] = frame;
+    }
+    stream.insert(stream.end(), frame.begin(), frame.end());
+  }
+  return stream;
+}
+
+/* ============= Link ============= */
+struct Result {
+  uint64_t delivered = 0;
+  uint64_t wrong = 0;        /**< Accepted frames that weren't sent intact, or differ */
+  gwlink::ParserStats stats;
+  bool timeout = false;
+};
+
+static bool openRawPty(int& master, int& slave) {
+  if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0) {
+    return false;
+  }
+  struct termios tio;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fcntl(slave, F_SETFL, fcntl(slave, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+static Result runLink(const std::vector<uint8_t>& stream, const Scenario& sc, const std::map<uint16_t, std::vector<uint8_t>>& intact,
+                      uint32_t seed) {
+  Result res;
+  int master, slave;
+  MirrorRing ring;
+  if (!openRawPty(master, slave) || !ring.init(sc.ring)) {
+    fprintf(stderr, "[!] Can't open a pty pair or map the ring\n");
+    res.timeout = true;
+    return res;
+  }
+
+  std::thread writer([&]() {
+    std::mt19937 rng(seed);
+    size_t pos = 0;
+    while (pos < stream.size()) {
+      const size_t n = std::min(stream.size() - pos, 1 + rng() % sc.max_chunk);
+      const ssize_t w = write(master, &stream[pos], n);
+      if (w < 0) {
+        break;
+      }
+      pos += (size_t)w;
+    }
+  });
+
+  FrameParser<> parser(ring);
+  size_t received = 0;
+  while (received < stream.size()) {
+    struct pollfd pfd = { slave, POLLIN, 0 };
+    if (poll(&pfd, 1, 2000) <= 0) {
+      res.timeout = true;
+      break;
+    }
+    const ssize_t n = ring.fill(slave);
+    if (n <= 0) {
+      continue;
+    }
+    received += (size_t)n;
+    FrameView view;
+    while (parser.next(view)) {
+      res.delivered++;
+      auto it = intact.find(view.seq);
+      const size_t body = (size_t)view.count * GW_RECORD_LEN;
+      if (it == intact.end() || it->second.size() != GW_FRAME_HEADER_LEN + body + GW_FRAME_CRC_LEN
+          || memcmp(it->second.data() + GW_FRAME_HEADER_LEN, view.records, body) != 0) {
+        res.wrong++;
+      }
+    }
+  }
+  writer.join();
+  close(master);
+  close(slave);
+  res.stats = parser.stats;
+  return res;
+}
+
+/* ============= Main ============= */
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-11s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--frames" && i + 1 < argc) cfg.frames = (uint32_t)atoi(argv[++i]);
+    else if (a == "--corrupt" && i + 1 < argc) cfg.corrupt = atof(argv[++i]);
+    else if (a == "--garbage" && i + 1 < argc) cfg.garbage = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Usage: %s [--frames N] [--corrupt P] [--garbage P] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (cfg.frames > 65536) {
+    fprintf(stderr, "[!] --frames: at most 65536 (16-bit sequence numbers identify the frames)\n");
+    return 2;
+  }
+
+  const Scenario scenarios[] = {
+    { "clean", false, 512, 1 << 16 },
+    { "corrupt", true, 512, 1 << 16 },
+    { "byte-wise", true, 1, 1 << 16 },
+    { "small-ring", true, 512, (size_t)sysconf(_SC_PAGESIZE) },
+  };
+
+  bool ok = true;
+  char detail[200];
+  for (const Scenario& sc : scenarios) {
+    std::mt19937 rng(cfg.seed);
+    std::map<uint16_t, std::vector<uint8_t>> intact;
+    uint32_t damaged = 0;
+    SimConfig run = cfg;
+    if (!strcmp(sc.name, "byte-wise")) {
+      run.frames = std::min(run.frames, 2000u);  // One write() per byte is slow
+    }
+    const std::vector<uint8_t> stream = makeStream(run, sc.damage, rng, intact, damaged);
+    const Result r = runLink(stream, sc, intact, cfg.seed);
+    snprintf(detail, sizeof(detail), "%zu/%zu intact frames, %u damaged, %llu wrong, %llu CRC errors, %llu bad headers, %llu bytes skipped%s",
+             (size_t)r.delivered - r.wrong, intact.size(), damaged, (unsigned long long)r.wrong,
+             (unsigned long long)r.stats.crc_errors, (unsigned long long)r.stats.bad_headers,
+             (unsigned long long)r.stats.skipped_bytes, r.timeout ? ", TIMEOUT" : "");
+    bool pass = !r.timeout && r.wrong == 0 && r.delivered == intact.size();
+    if (!sc.damage) {
+      pass = pass && r.stats.skipped_bytes == 0 && r.stats.seq_gaps == 0;
+    }
+    ok &= check(sc.name, pass, detail);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,463 @@
+/**
+ * @file    gateway_sim.cpp
+ * @brief   Gateway filter / dedup / batching against a simulated BLE controller
+ * @details A controller stand-in produces advertising reports the way the gateway's GAP
+ *          callback sees them: SOS buttons pressing (beacon every 40-80ms + 0-10ms advDelay
+ *          for the beacon time, some events missed) among other BLE devices (phones, tags,
+ *          iBeacons, adverts that look like a button but aren't). Reports go through the
+ *          firmware's gateway_core.h, frames come out at the UART baud rate and are decoded
+ *          again on the "host" side.
+ *
+ *          Checks (exit code 1 if one fails):
+ *            - every press with at least one received advert reaches the host
+ *            - no record of another device is forwarded
+ *            - every frame has a valid CRC and sequence numbers have no gaps
+ *            - no record waits longer than GW_BATCH_MAX_DELAY_MS in a batch
+ *            - the press time the host reconstructs from a v3 record (frame arrival - wait -
+ *              press age) is the real one, up to the age's restamp period and step
+ *            - the UART link is not saturated
+ *
+ *          Usage: gateway_sim [--buttons N] [--devices N] [--seconds S] [--press-rate P]
+ *                             [--rx P] [--baud N] [--seed N] [--out stream.bin] [--fleet fleet.csv]
+ *                             [--migrated F]
+ *          --out writes the UART byte stream, e.g. as input for the frame parser tests.
+ *          Buttons send real rolling codes (rolling_code.h) of SOS presses, timestamped by a
+ *          synced device clock (device_clock.h) that starts at SIM_CLOCK_START_UNIX and is
+ *          off by up to SIM_CLOCK_ERROR_S per button: --fleet writes their seeds, so
+ *          rc_verify can authenticate the --out stream with --now at the end of the capture
+ *          (SIM_CLOCK_START_UNIX + --seconds, printed).
+ *          --migrated makes the fleet dual-scheme (seeds of both rolling-code schemes, all
+ *          enrolled V1): a fraction F of the buttons runs ROLLING_CODE_SCHEME_V2 firmware, as
+ *          in the middle of a migration, for rc_verify --migration.
+ *          A button starts advertising SIM_WAKE_MIN_MS-SIM_WAKE_MAX_MS after its press (boot,
+ *          BLE start), and a v3 button renews its press age every SIM_AGE_RESTAMP_MS.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "button_events.h"
+#include "file_util.h"
+#include "fleet_file.h"
+#include "gateway_core.h"
+#include "rolling_code.h"
+
+#define SIM_MANUFACTURER_ID 0x0B5Eu            /**< Stand-in for MANUFACTURER_ID */
+#define SIM_PRODUCT_NAME "ESP32H2 SoS Button"  /**< Must match the button's PRODUCT_NAME */
+#define SIM_PRODUCT_KEY 0x12345678u            /**< Stand-in for PRODUCT_KEY (secrets.h) */
+#define SIM_BATCH_ID 0x0042u                   /**< Stand-in for BATCH_ID (secrets.h) */
+#define SIM_CLOCK_START_UNIX 1767225600u       /**< 2026-01-01 00:00:00 UTC: wall clock at t = 0 */
+#define SIM_CLOCK_ERROR_S 60                   /**< Device clock error, uniform +- */
+#define SIM_WAKE_MIN_MS 90                     /**< Press to the first advert */
+#define SIM_WAKE_MAX_MS 160
+#define SIM_AGE_RESTAMP_MS 100                 /**< As the button's ADV_AGE_RESTAMP_MS */
+
+struct SimConfig {
+  uint32_t buttons = 50;
+  uint32_t devices = 200;        /**< Other BLE devices in range */
+  double seconds = 600;
+  double press_rate = 0.01;      /**< Presses per button per second */
+  double rx = 0.7;               /**< Probability an advertising event is received */
+  uint32_t beacon_ms = 10000;
+  uint32_t baud = 2000000;
+  uint32_t seed = 1;
+  std::string out;
+  std::string fleet;
+  double migrated = 0;           /**< Fraction of buttons on ROLLING_CODE_SCHEME_V2 */
+};
+
+/* ============= Controller stand-in ============= */
+enum class Source { BUTTON, OTHER };
+
+struct Advertiser {
+  Source source;
+  uint8_t mac[6];
+  uint32_t layout;               /**< Button: 0 = v1 name + payload, 1 = v1 MANUFACTURER_ID + payload, 2 = v2, 3 = v3; other: kind */
+  uint64_t on_until_us = 0;      /**< Button: end of the current beacon */
+  uint64_t pressed_us = 0;       /**< Button: wake edge of the current press */
+  uint64_t adv_start_us = 0;     /**< Button: first advert of the current press */
+  uint32_t rc_seed = 0;          /**< Button: rolling code seed */
+  uint8_t scheme = ROLLING_CODE_SCHEME_V1;  /**< Button: rolling code scheme of its firmware */
+  int32_t clock_error_s = 0;     /**< Button: device clock minus wall clock */
+  uint32_t code = 0;
+  uint32_t timestamp = 0;
+};
+
+struct Report {
+  uint64_t t_us;
+  uint32_t advertiser;
+  bool operator>(const Report& o) const {
+    return t_us > o.t_us;
+  }
+};
+
+static void addField(std::vector<uint8_t>& adv, uint8_t type, const uint8_t* data, size_t len) {
+  adv.push_back((uint8_t)(len + 1));
+  adv.push_back(type);
+  adv.insert(adv.end(), data, data + len);
+}
+
+/**
+ * @brief Advert bytes of one advertising event at t_us
+ */
+static std::vector<uint8_t> advertData(const Advertiser& a, const uint64_t t_us, std::mt19937& rng) {
+  std::vector<uint8_t> adv;
+  uint8_t buf[31];
+  if (a.source == Source::BUTTON) {
+    uint8_t payload[2 + ROLLING_CODE_PAYLOAD_LEN] = { SIM_MANUFACTURER_ID & 0xFF, SIM_MANUFACTURER_ID >> 8 };
+    rolling_code::encodePayload(a.code, a.timestamp, payload + 2);
+    if (a.layout == 0) {
+      adv.resize(advBuildV1(SIM_PRODUCT_NAME, payload + 2, buf));
+      memcpy(adv.data(), buf, adv.size());
+    } else if (a.layout == 1) {
+      addField(adv, 0xFF, payload, 10);
+    } else if (a.layout == 2) {
+      const adv_beacon_t beacon = { ADV_FORMAT_V2, a.code, a.timestamp, advHint(a.rc_seed), 0, ADV_AGE_NONE };
+      adv.resize(advBuildV2(SIM_MANUFACTURER_ID, beacon, buf));
+      memcpy(adv.data(), buf, adv.size());
+    } else {
+      // Age of the last restamp before this event
+      const uint64_t restamp_us = SIM_AGE_RESTAMP_MS * 1000;
+      const uint64_t stamped_us = a.adv_start_us + (t_us - a.adv_start_us) / restamp_us * restamp_us;
+      const uint8_t age = advAge((uint32_t)((stamped_us - a.pressed_us) / 1000));
+      const adv_beacon_t beacon = { ADV_FORMAT_V3, a.code, a.timestamp, advHint(a.rc_seed), 0, age };
+      adv.resize(advBuildV3(SIM_MANUFACTURER_ID, beacon, buf));
+      memcpy(adv.data(), buf, adv.size());
+    }
+    return adv;
+  }
+  const uint8_t flags = 0x06;
+  addField(adv, 0x01, &flags, 1);
+  switch (a.layout) {
+    case 0:  // iBeacon
+      buf[0] = 0x4C; buf[1] = 0x00; buf[2] = 0x02; buf[3] = 0x15;
+      for (int i = 4; i < 25; i++) buf[i] = (uint8_t)rng();
+      addField(adv, 0xFF, buf, 25);
+      break;
+    case 1:  // Same length manufacturer data, no button name
+      for (int i = 0; i < 8; i++) buf[i] = (uint8_t)rng();
+      addField(adv, 0xFF, buf, 8);
+      break;
+    case 2:  // Our company ID: wrong payload length, or the v2 length with another version
+      buf[0] = SIM_MANUFACTURER_ID & 0xFF; buf[1] = SIM_MANUFACTURER_ID >> 8;
+      for (int i = 2; i < 14; i++) buf[i] = (uint8_t)rng();
+      buf[2] = (uint8_t)(0x30 | (buf[2] & 0x0F));
+      addField(adv, 0xFF, buf, rng() % 2 ? 6 : ADV_V2_MFG_LEN);
+      break;
+    case 3:  // Button name, no payload (e.g. a phone named like the product)
+      addField(adv, 0x09, (const uint8_t*)SIM_PRODUCT_NAME, strlen(SIM_PRODUCT_NAME));
+      break;
+    default:  // Other company, random length
+      buf[0] = (uint8_t)rng(); buf[1] = 0x01;
+      for (int i = 2; i < 12; i++) buf[i] = (uint8_t)rng();
+      addField(adv, 0xFF, buf, 2 + rng() % 10);
+      break;
+  }
+  return adv;
+}
+
+/* ============= Host side decoder ============= */
+struct Delivered {
+  uint64_t first_frame_us;
+  uint32_t records = 0;
+  uint8_t age = ADV_AGE_NONE;  /**< Of the first record */
+  uint16_t wait_ms = 0;
+};
+
+struct HostStats {
+  uint64_t frames = 0;
+  uint64_t heartbeats = 0;
+  uint64_t records = 0;
+  uint64_t crc_errors = 0;
+  uint64_t seq_gaps = 0;
+};
+
+/**
+ * @brief Reference decoder: frames one after the other, sync bytes expected at each start
+ */
+static void decodeStream(const std::vector<uint8_t>& stream, const std::vector<uint64_t>& frame_end_us,
+                         HostStats& stats, std::map<std::tuple<std::string, uint32_t, uint32_t>, Delivered>& presses) {
+  size_t pos = 0;
+  size_t index = 0;
+  uint16_t expect_seq = 0;
+  while (pos + GW_FRAME_HEADER_LEN + GW_FRAME_CRC_LEN <= stream.size()) {
+    const uint8_t* f = &stream[pos];
+    const size_t count = f[3];
+    const size_t len = GW_FRAME_HEADER_LEN + count * GW_RECORD_LEN + GW_FRAME_CRC_LEN;
+    if (pos + len > stream.size()) {
+      break;
+    }
+    const uint32_t crc = f[len - 4] | (f[len - 3] << 8) | (f[len - 2] << 16) | ((uint32_t)f[len - 1] << 24);
+    if (f[0] != GW_FRAME_SYNC0 || f[1] != GW_FRAME_SYNC1 || gwCrc32(0, f + 2, len - 6) != crc) {
+      stats.crc_errors++;
+      return;
+    }
+    const uint16_t seq = f[4] | (f[5] << 8);
+    stats.seq_gaps += seq != expect_seq;
+    expect_seq = seq + 1;
+    stats.frames++;
+    stats.heartbeats += count == 0;
+    for (size_t i = 0; i < count; i++) {
+      gw_record_t rec;
+      memcpy(&rec, f + GW_FRAME_HEADER_LEN + i * GW_RECORD_LEN, GW_RECORD_LEN);
+      const auto key = std::make_tuple(std::string((const char*)rec.mac, 6), (uint32_t)rec.code, (uint32_t)rec.timestamp);
+      auto it = presses.find(key);
+      if (it == presses.end()) {
+        presses[key] = { frame_end_us[index], 1, rec.age, rec.wait_ms };
+      } else {
+        it->second.records++;
+      }
+      stats.records++;
+    }
+    pos += len;
+    index++;
+  }
+}
+
+/* ============= Main ============= */
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-12s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)((v.size() - 1) * p / 100)];
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--buttons" && i + 1 < argc) cfg.buttons = (uint32_t)atoi(argv[++i]);
+    else if (a == "--devices" && i + 1 < argc) cfg.devices = (uint32_t)atoi(argv[++i]);
+    else if (a == "--seconds" && i + 1 < argc) cfg.seconds = atof(argv[++i]);
+    else if (a == "--press-rate" && i + 1 < argc) cfg.press_rate = atof(argv[++i]);
+    else if (a == "--rx" && i + 1 < argc) cfg.rx = atof(argv[++i]);
+    else if (a == "--baud" && i + 1 < argc) cfg.baud = (uint32_t)atoi(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else if (a == "--out" && i + 1 < argc) cfg.out = argv[++i];
+    else if (a == "--fleet" && i + 1 < argc) cfg.fleet = argv[++i];
+    else if (a == "--migrated" && i + 1 < argc) cfg.migrated = atof(argv[++i]);
+    else {
+      fprintf(stderr, "Usage: %s [--buttons N] [--devices N] [--seconds S] [--press-rate P] [--rx P] "
+                      "[--baud N] [--seed N] [--out stream.bin] [--fleet fleet.csv] [--migrated F]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(cfg.seed);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+  // Advertisers. Buttons: custom MAC distinct in bytes 0-3 (own seed), advertising address random
+  std::vector<Advertiser> advertisers;
+  std::vector<FleetEntry> fleet(cfg.buttons);
+  for (uint32_t i = 0; i < cfg.buttons + cfg.devices; i++) {
+    Advertiser a;
+    a.source = i < cfg.buttons ? Source::BUTTON : Source::OTHER;
+    for (uint8_t& b : a.mac) b = (uint8_t)rng();
+    a.layout = a.source == Source::BUTTON ? i % 4 : rng() % 5;
+    if (a.source == Source::BUTTON) {
+      const uint8_t custom_mac[6] = { 0x24, 0x6F, (uint8_t)(i >> 8), (uint8_t)i, 0x00, 0x01 };
+      memcpy(fleet[i].mac, custom_mac, 6);
+      fleet[i].seed = a.rc_seed = rolling_code::RollingCodeV1::seed(SIM_PRODUCT_KEY, SIM_BATCH_ID, custom_mac);
+      if (cfg.migrated > 0) {
+        fleet[i].has_v2 = true;
+        fleet[i].seed_v2 = rolling_code::RollingCodeV2::seed(SIM_PRODUCT_KEY, SIM_BATCH_ID, custom_mac);
+        if (uni(rng) < cfg.migrated) {
+          a.scheme = ROLLING_CODE_SCHEME_V2;
+          a.rc_seed = fleet[i].seed_v2;
+        }
+      }
+      a.clock_error_s = (int32_t)(rng() % (2 * SIM_CLOCK_ERROR_S + 1)) - SIM_CLOCK_ERROR_S;
+    }
+    advertisers.push_back(a);
+  }
+  if (!cfg.fleet.empty() && !writeFleet(cfg.fleet, fleet)) {
+    fprintf(stderr, "[!] Can't write %s\n", cfg.fleet.c_str());
+    return 1;
+  }
+
+  // Event queue: next advertising event per advertiser, next press per button
+  std::priority_queue<Report, std::vector<Report>, std::greater<Report>> events;
+  std::exponential_distribution<double> press_gap(cfg.press_rate);
+  std::vector<uint64_t> next_press(cfg.buttons);
+  for (uint32_t i = 0; i < cfg.buttons; i++) {
+    next_press[i] = (uint64_t)(press_gap(rng) * 1e6);
+    events.push({ next_press[i], i });
+  }
+  for (uint32_t i = cfg.buttons; i < advertisers.size(); i++) {
+    events.push({ (uint64_t)(uni(rng) * 1e6), i });
+  }
+
+  // Gateway
+  static GwDedup dedup;
+  static GwBatcher batcher;
+  std::vector<uint8_t> stream;
+  std::vector<uint64_t> frame_end_us;
+  uint64_t link_free_us = 0;       // UART busy until
+  uint64_t reports = 0, accepted = 0, forwarded = 0, raw_forward_bytes = 0, other_accepted = 0;
+  uint64_t wrong_source = 0;
+  std::vector<double> batch_wait_ms;
+  std::vector<uint64_t> batch_add_us;
+  std::map<std::tuple<std::string, uint32_t, uint32_t>, uint64_t> on_air;  // press -> first received advert
+  std::map<std::tuple<std::string, uint32_t, uint32_t>, uint64_t> pressed;  // v3 press -> wake edge
+  uint32_t loop_ms = 0;
+
+  auto sendFrame = [&](uint64_t now_us, uint32_t now_ms) {
+    const size_t len = batcher.finish(now_ms);
+    stream.insert(stream.end(), batcher.data(), batcher.data() + len);
+    const uint64_t start = std::max(link_free_us, now_us);
+    link_free_us = start + (uint64_t)len * 10 * 1000000 / cfg.baud;  // 8N1
+    frame_end_us.push_back(link_free_us);
+    for (uint64_t t : batch_add_us) batch_wait_ms.push_back((now_us - t) / 1000.0);
+    batch_add_us.clear();
+  };
+  // loop(): polls the batcher once per ms
+  auto runLoopUntil = [&](uint64_t t_us) {
+    while ((uint64_t)(loop_ms + 1) * 1000 <= t_us) {
+      loop_ms++;
+      if (batcher.due(loop_ms)) sendFrame((uint64_t)loop_ms * 1000, loop_ms);
+    }
+  };
+
+  const uint64_t end_us = (uint64_t)(cfg.seconds * 1e6);
+  while (!events.empty() && events.top().t_us < end_us) {
+    const Report ev = events.top();
+    events.pop();
+    Advertiser& a = advertisers[ev.advertiser];
+    runLoopUntil(ev.t_us);
+
+    if (a.source == Source::BUTTON) {
+      if (ev.t_us >= a.on_until_us) {
+        if (ev.t_us < next_press[ev.advertiser]) {
+          events.push({ next_press[ev.advertiser], ev.advertiser });
+          continue;
+        }
+        // New press: new rolling code + timestamp. The first advert is now, the press was earlier
+        a.adv_start_us = ev.t_us;
+        a.pressed_us = ev.t_us - (uint64_t)((SIM_WAKE_MIN_MS + uni(rng) * (SIM_WAKE_MAX_MS - SIM_WAKE_MIN_MS)) * 1000);
+        a.on_until_us = ev.t_us + (uint64_t)cfg.beacon_ms * 1000;
+        const uint32_t clock_s = SIM_CLOCK_START_UNIX - BUTTON_CLOCK_EPOCH_UNIX + (uint32_t)(ev.t_us / 1000000) + a.clock_error_s;
+        a.timestamp = buttonSchemeStamp(buttonEventStamp(buttonClockWord(clock_s, true), ButtonEvent::SOS), a.scheme);
+        a.code = rolling_code::schemeCode(a.scheme, a.rc_seed, a.timestamp);
+        next_press[ev.advertiser] = a.on_until_us + (uint64_t)(press_gap(rng) * 1e6);
+      }
+      events.push({ ev.t_us + 40000 + (uint64_t)(uni(rng) * 50000), ev.advertiser });  // interval + advDelay
+    } else {
+      events.push({ ev.t_us + 100000 + (uint64_t)(uni(rng) * 900000), ev.advertiser });
+    }
+    if (uni(rng) >= cfg.rx) {
+      continue;  // Event not received (channel, collision, range)
+    }
+
+    // GAP callback on the gateway
+    const std::vector<uint8_t> adv = advertData(a, ev.t_us, rng);
+    reports++;
+    raw_forward_bytes += 6 + 1 + 1 + adv.size() + 4;  // Generic scanner: mac, rssi, len, data, framing
+    adv_beacon_t beacon;
+    if (!gwParseAdvert(adv.data(), adv.size(), SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &beacon)) {
+      continue;
+    }
+    accepted++;
+    if (a.source != Source::BUTTON) {
+      other_accepted++;
+    } else {
+      on_air.emplace(std::make_tuple(std::string((const char*)a.mac, 6), a.code, a.timestamp), ev.t_us);
+      if (a.layout == 3) pressed.emplace(std::make_tuple(std::string((const char*)a.mac, 6), a.code, a.timestamp), a.pressed_us);
+    }
+    gw_record_t rec;
+    gwMakeRecord(&rec, a.mac, 0, (int8_t)(-40 - rng() % 50), beacon);
+    const uint32_t now_ms = (uint32_t)(ev.t_us / 1000);
+    if (!dedup.admit(rec, now_ms)) {
+      continue;
+    }
+    forwarded++;
+    wrong_source += a.source != Source::BUTTON;
+    batch_add_us.push_back(ev.t_us);
+    if (batcher.add(rec, now_ms)) sendFrame(ev.t_us, now_ms);
+  }
+  runLoopUntil(end_us + GW_BATCH_MAX_DELAY_MS * 1000);
+
+  if (!cfg.out.empty() && !writeFile(cfg.out, stream)) {
+    fprintf(stderr, "[!] Can't write %s\n", cfg.out.c_str());
+    return 1;
+  }
+
+  // Host side
+  HostStats host;
+  std::map<std::tuple<std::string, uint32_t, uint32_t>, Delivered> delivered;
+  decodeStream(stream, frame_end_us, host, delivered);
+  uint64_t missing = 0, age_off = 0;
+  std::vector<double> latency_ms, press_ms, press_error_ms;
+  for (const auto& p : on_air) {
+    auto it = delivered.find(p.first);
+    if (it == delivered.end()) {
+      missing++;
+    } else {
+      latency_ms.push_back((it->second.first_frame_us - p.second) / 1000.0);
+    }
+  }
+  // v3: press time on the host's clock = frame arrival - wait in the gateway - press age
+  for (const auto& p : pressed) {
+    auto it = delivered.find(p.first);
+    if (it == delivered.end() || it->second.age == ADV_AGE_NONE) {
+      age_off += it != delivered.end();
+      continue;
+    }
+    const Delivered& d = it->second;
+    const double age_ms = advAgeMs(d.age);
+    const double error_ms = ((double)d.first_frame_us - p.second) / 1000.0 - d.wait_ms - age_ms;
+    const double step_ms = std::max((double)ADV_AGE_UNIT_MS, age_ms / 32);
+    age_off += error_ms < -2 || error_ms > SIM_AGE_RESTAMP_MS + step_ms + 2;
+    press_ms.push_back((d.first_frame_us - p.second) / 1000.0);
+    press_error_ms.push_back(error_ms);
+  }
+
+  const double uart_bps = stream.size() * 10 / cfg.seconds;
+  const double raw_bps = raw_forward_bytes * 10 / cfg.seconds;
+  printf("[*] %u buttons, %u other devices, %.0fs: %llu reports, %llu button adverts, %llu records in %llu frames\n",
+         cfg.buttons, cfg.devices, cfg.seconds, (unsigned long long)reports, (unsigned long long)accepted,
+         (unsigned long long)forwarded, (unsigned long long)host.frames);
+  printf("[*] UART %.1f kbit/s (%.2f%% of %u baud), forwarding every report would be %.1f kbit/s\n",
+         uart_bps / 1000, 100 * uart_bps / cfg.baud, cfg.baud, raw_bps / 1000);
+  printf("[*] First advert to host latency p50 %.1f ms, p99 %.1f ms (batching + UART)\n", percentile(latency_ms, 50),
+         percentile(latency_ms, 99));
+  printf("[*] v3 press to host p50 %.1f ms, p99 %.1f ms; age + wait short of it by %.1f to %.1f ms (restamp, UART)\n",
+         percentile(press_ms, 50), percentile(press_ms, 99), percentile(press_error_ms, 0), percentile(press_error_ms, 100));
+  if (!cfg.out.empty()) {
+    const uint32_t end_unix = SIM_CLOCK_START_UNIX + (uint32_t)ceil(cfg.seconds);
+    printf("[*] %s: wall clock %u to %u, verify with rc_verify --now %u\n", cfg.out.c_str(), SIM_CLOCK_START_UNIX, end_unix,
+           end_unix);
+  }
+
+  bool ok = true;
+  char detail[160];
+  snprintf(detail, sizeof(detail), "%zu presses on air, %llu not delivered", on_air.size(), (unsigned long long)missing);
+  ok &= check("delivery", missing == 0, detail);
+  snprintf(detail, sizeof(detail), "%llu adverts of other devices accepted", (unsigned long long)(other_accepted + wrong_source));
+  ok &= check("filter", other_accepted == 0 && wrong_source == 0, detail);
+  snprintf(detail, sizeof(detail), "%llu frames (%llu heartbeats), %llu CRC errors, %llu sequence gaps",
+           (unsigned long long)host.frames, (unsigned long long)host.heartbeats, (unsigned long long)host.crc_errors,
+           (unsigned long long)host.seq_gaps);
+  ok &= check("framing", host.crc_errors == 0 && host.seq_gaps == 0 && host.records == forwarded, detail);
+  const double max_wait = batch_wait_ms.empty() ? 0 : *std::max_element(batch_wait_ms.begin(), batch_wait_ms.end());
+  snprintf(detail, sizeof(detail), "longest wait in a batch %.1f ms (limit %d ms)", max_wait, GW_BATCH_MAX_DELAY_MS);
+  ok &= check("batch-delay", max_wait <= GW_BATCH_MAX_DELAY_MS + 1, detail);
+  snprintf(detail, sizeof(detail), "%zu v3 presses, %llu reconstructed outside [-2, %d + step + 2] ms", pressed.size(),
+           (unsigned long long)age_off, SIM_AGE_RESTAMP_MS);
+  ok &= check("press-age", age_off == 0 && !press_ms.empty(), detail);
+  snprintf(detail, sizeof(detail), "%.2f%% of the link", 100 * uart_bps / cfg.baud);
+  ok &= check("uart-load", uart_bps < cfg.baud * 0.5, detail);
+  return ok ? 0 : 1;
+}
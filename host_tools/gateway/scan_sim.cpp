@@ -0,0 +1,268 @@
+/**
+ * @file    scan_sim.cpp
+ * @brief   Collision / detection simulator for the gateway scan scheduler
+ * @details Monte Carlo at PDU level: every advertising event of a press sends a 376us
+ *          ADV_IND on channels 37, 38 and 39 (1ms apart), every adv_interval + advDelay.
+ *          The interval is drawn per press between the configured min and max. The scanner
+ *          listens for `window` every `interval` on one channel, rotating. A PDU is received
+ *          if it lies completely inside a window on the right channel, doesn't overlap
+ *          another button's PDU on that channel, survives the background traffic (Poisson,
+ *          --load PDUs/s per channel), and survives the link (--link).
+ *
+ *          Checks (exit code 1 if one fails):
+ *            default     scanOptimize() parameters for the button's default configuration
+ *                        (40-80ms, 10s beacon) meet the target in simulation
+ *            fast        same for a 25-50ms profile
+ *            adapt       the buttons are reconfigured (100-150ms, 3s beacon): the
+ *                        ScanScheduler, running live on 20 simulated presses, ends up
+ *                        with parameters that meet the target for the new profile
+ *
+ *          Usage: scan_sim [--presses N] [--concurrent N] [--load N] [--link P]
+ *                          [--detect P] [--latency MS] [--quantile Q] [--seed N]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "scan_scheduler.h"
+
+struct SimConfig {
+  uint32_t presses = 20000;
+  uint32_t concurrent = 4;       /**< Presses overlapping in time (collisions between buttons) */
+  double load = 50;              /**< Background PDUs per second per channel */
+  double link = 0.85;            /**< PDU survives range / fading */
+  uint32_t seed = 1;
+  ScanTarget target;
+};
+
+struct Pattern {
+  const char* name;
+  float adv_min_ms;
+  float adv_max_ms;
+  float beacon_ms;
+};
+
+struct Pdu {
+  double t_ms;
+  uint32_t press;
+  uint8_t channel;     /**< 0..2 = 37..39 */
+  bool collided;
+};
+
+/* ============= Scanner ============= */
+struct Scanner {
+  double interval_ms;
+  double window_ms;
+  double phase_ms;     /**< Start of window 0 */
+
+  void set(const ScanParams& p, double now_ms) {
+    interval_ms = p.interval * SCAN_UNIT_US / 1000.0;
+    window_ms = p.window * SCAN_UNIT_US / 1000.0;
+    phase_ms = now_ms;
+  }
+
+  bool hears(double t_ms, uint8_t channel) const {
+    if (t_ms < phase_ms) {
+      return false;
+    }
+    const double k = floor((t_ms - phase_ms) / interval_ms);
+    const double offset = t_ms - phase_ms - k * interval_ms;
+    return offset + SCAN_PDU_MS <= window_ms && (uint64_t)k % 3 == channel;
+  }
+};
+
+/**
+ * @brief All PDUs of one press starting at t0
+ */
+static void pressPdus(const Pattern& pat, uint32_t press, double t0, std::mt19937& rng, std::vector<Pdu>& out) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  const double interval = pat.adv_min_ms + uni(rng) * (pat.adv_max_ms - pat.adv_min_ms);
+  for (double t = t0; t < t0 + pat.beacon_ms; t += interval + uni(rng) * SCAN_ADV_DELAY_MS) {
+    for (uint8_t ch = 0; ch < 3; ch++) {
+      out.push_back({ t + ch * 1.0, press, ch, false });
+    }
+  }
+}
+
+/* ============= Fixed parameter Monte Carlo ============= */
+struct McResult {
+  double detect;
+  double latency_prob;      /**< Detected within target.latency_ms */
+  double latency_q_ms;      /**< target.latency_quantile of the latency (undetected = infinite) */
+};
+
+static McResult monteCarlo(const Pattern& pat, const ScanParams& params, const SimConfig& cfg, std::mt19937& rng) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  const double p_background = exp(-cfg.load * 2 * SCAN_PDU_MS / 1000.0);  // No background PDU overlaps
+  std::vector<double> latency;
+  latency.reserve(cfg.presses);
+  std::vector<Pdu> pdus;
+  for (uint32_t base = 0; base < cfg.presses; base += cfg.concurrent) {
+    // A group of presses overlapping in time, scanner at a random phase
+    pdus.clear();
+    std::vector<double> t0(cfg.concurrent);
+    for (uint32_t i = 0; i < cfg.concurrent; i++) {
+      t0[i] = uni(rng) * pat.beacon_ms;
+      pressPdus(pat, i, t0[i], rng, pdus);
+    }
+    std::sort(pdus.begin(), pdus.end(), [](const Pdu& a, const Pdu& b) { return a.t_ms < b.t_ms; });
+    double last_end[3] = { -1e9, -1e9, -1e9 };
+    int last_index[3] = { -1, -1, -1 };
+    for (size_t i = 0; i < pdus.size(); i++) {
+      Pdu& p = pdus[i];
+      if (p.t_ms < last_end[p.channel]) {
+        p.collided = true;
+        pdus[last_index[p.channel]].collided = true;
+      }
+      last_end[p.channel] = std::max(last_end[p.channel], p.t_ms + SCAN_PDU_MS);
+      last_index[p.channel] = (int)i;
+    }
+    Scanner scanner;
+    scanner.set(params, -uni(rng) * params.interval * SCAN_UNIT_US / 1000.0);
+    std::vector<double> first(cfg.concurrent, INFINITY);
+    for (const Pdu& p : pdus) {
+      if (!p.collided && std::isinf(first[p.press]) && scanner.hears(p.t_ms, p.channel) && uni(rng) < cfg.link
+          && uni(rng) < p_background) {
+        first[p.press] = p.t_ms - t0[p.press];
+      }
+    }
+    latency.insert(latency.end(), first.begin(), first.end());
+  }
+  std::sort(latency.begin(), latency.end());
+  McResult r;
+  r.detect = (double)(std::lower_bound(latency.begin(), latency.end(), INFINITY) - latency.begin()) / latency.size();
+  r.latency_prob = (double)(std::upper_bound(latency.begin(), latency.end(), (double)cfg.target.latency_ms) - latency.begin()) / latency.size();
+  r.latency_q_ms = latency[(size_t)((latency.size() - 1) * cfg.target.latency_quantile)];
+  return r;
+}
+
+/* ============= Live scheduler ============= */
+/**
+ * @brief One press at a time, the scheduler reacting as on the gateway
+ */
+static void runLive(const Pattern& pat, uint32_t presses, ScanScheduler& sched, const SimConfig& cfg, std::mt19937& rng) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  const ScanParams track = scanEvaluate(sched.profile(), cfg.target, SCAN_TRACK_UNITS, SCAN_TRACK_UNITS);
+  double now = 0;
+  Scanner scanner;
+  scanner.set(sched.params(), now);
+  for (uint32_t n = 0; n < presses; n++) {
+    now += 5000 + uni(rng) * 60000;  // Next press
+    std::vector<Pdu> pdus;
+    pressPdus(pat, 0, now, rng, pdus);
+    const uint32_t code = rng();
+    gw_record_t rec = {};
+    rec.code = code;
+    rec.timestamp = (uint32_t)now;
+    ScanObservation obs;
+    for (const Pdu& p : pdus) {
+      if (!scanner.hears(p.t_ms, p.channel) || uni(rng) >= cfg.link) {
+        continue;
+      }
+      sched.onSighting(rec, (uint32_t)p.t_ms);
+      if (sched.poll((uint32_t)p.t_ms, &obs) == ScanEvent::TRACK_START) {
+        scanner.set(track, p.t_ms);
+      }
+    }
+    now = pdus.back().t_ms + SCAN_TRACK_IDLE_MS + 1;
+    if (sched.poll((uint32_t)now, &obs) == ScanEvent::TRACK_END) {
+      scanner.set(sched.update(obs), now);
+    }
+  }
+}
+
+/* ============= Main ============= */
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-8s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+static void printRow(const char* label, const ScanParams& p, const McResult& r) {
+  printf("    %-24s %8.1f %8.1f %6.1f%% %9.4f %9.4f %9.4f %9.0f\n", label, p.interval * SCAN_UNIT_US / 1000.0,
+         p.window * SCAN_UNIT_US / 1000.0, p.duty * 100, p.detect_prob, r.detect, r.latency_prob, r.latency_q_ms);
+}
+
+/**
+ * @brief Simulated result is at least the target, minus 3 sigma of the estimate
+ */
+static bool meets(const McResult& r, const SimConfig& cfg) {
+  const double n = cfg.presses;
+  const double t1 = cfg.target.detect_prob, t2 = cfg.target.latency_quantile;
+  return r.detect >= t1 - 3 * sqrt(t1 * (1 - t1) / n) && r.latency_prob >= t2 - 3 * sqrt(t2 * (1 - t2) / n);
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--presses" && i + 1 < argc) cfg.presses = (uint32_t)atoi(argv[++i]);
+    else if (a == "--concurrent" && i + 1 < argc) cfg.concurrent = (uint32_t)atoi(argv[++i]);
+    else if (a == "--load" && i + 1 < argc) cfg.load = atof(argv[++i]);
+    else if (a == "--link" && i + 1 < argc) cfg.link = atof(argv[++i]);
+    else if (a == "--detect" && i + 1 < argc) cfg.target.detect_prob = (float)atof(argv[++i]);
+    else if (a == "--latency" && i + 1 < argc) cfg.target.latency_ms = (float)atof(argv[++i]);
+    else if (a == "--quantile" && i + 1 < argc) cfg.target.latency_quantile = (float)atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Usage: %s [--presses N] [--concurrent N] [--load N] [--link P] [--detect P] "
+                      "[--latency MS] [--quantile Q] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (cfg.presses == 0 || cfg.concurrent == 0) {
+    fprintf(stderr, "[!] Need --presses >= 1 and --concurrent >= 1\n");
+    return 2;
+  }
+
+  std::mt19937 rng(cfg.seed);
+  printf("[*] Target: detect %.4f, %.0f%% within %.0f ms | model link %.2f, simulated link %.2f, %u concurrent presses, %.0f bg PDU/s/ch\n",
+         cfg.target.detect_prob, cfg.target.latency_quantile * 100, cfg.target.latency_ms, cfg.target.link_prob,
+         cfg.link, cfg.concurrent, cfg.load);
+  printf("    %-24s %8s %8s %7s %9s %9s %9s %9s\n", "profile / params", "int ms", "win ms", "duty", "model", "detect",
+         "in time", "q lat ms");
+
+  bool ok = true;
+  char detail[200];
+  const Pattern patterns[] = {
+    { "default", 40, 80, 10000 },   // CONFIG_DEFAULT_ADV_*_INTERVAL, CONFIG_DEFAULT_BEACON_TIME_MS
+    { "fast", 25, 50, 10000 },
+  };
+  for (const Pattern& pat : patterns) {
+    const ScanProfile profile = { pat.adv_max_ms, pat.beacon_ms };  // Plan for the slowest interval
+    ScanParams params;
+    const bool found = scanOptimize(profile, cfg.target, &params);
+    const McResult r = monteCarlo(pat, params, cfg, rng);
+    char label[64];
+    snprintf(label, sizeof(label), "%s %g-%gms %gs", pat.name, pat.adv_min_ms, pat.adv_max_ms, pat.beacon_ms / 1000);
+    printRow(label, params, r);
+    const McResult full = monteCarlo(pat, scanEvaluate(profile, cfg.target, SCAN_TRACK_UNITS, SCAN_TRACK_UNITS), cfg, rng);
+    printRow("  100% duty", scanEvaluate(profile, cfg.target, SCAN_TRACK_UNITS, SCAN_TRACK_UNITS), full);
+    snprintf(detail, sizeof(detail), "duty %.1f%%: detect %.4f, %.1f%% within %.0f ms", params.duty * 100, r.detect,
+             r.latency_prob * 100, cfg.target.latency_ms);
+    ok &= check(pat.name, found && meets(r, cfg), detail);
+  }
+
+  // Buttons reconfigured: slower interval, shorter beacon. The scheduler starts from the default.
+  {
+    const Pattern changed = { "adapt", 100, 150, 3000 };
+    ScanScheduler sched;
+    sched.begin({ patterns[0].adv_max_ms, patterns[0].beacon_ms }, cfg.target);
+    const ScanParams before = sched.params();
+    const McResult stale = monteCarlo(changed, before, cfg, rng);
+    printRow("adapt 100-150ms 3s, old", before, stale);
+    runLive(changed, 20, sched, cfg, rng);
+    const McResult r = monteCarlo(changed, sched.params(), cfg, rng);
+    printRow("  after 20 presses", sched.params(), r);
+    snprintf(detail, sizeof(detail), "estimated %.0f ms / %.1f s, %u re-optimizations: detect %.4f, %.1f%% within %.0f ms (old params: %.4f, %.1f%%)",
+             sched.profile().adv_interval_ms, sched.profile().beacon_ms / 1000, sched.reoptimized, r.detect,
+             r.latency_prob * 100, cfg.target.latency_ms, stale.detect, stale.latency_prob * 100);
+    ok &= check("adapt", sched.reoptimized > 0 && meets(r, cfg), detail);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file    hb_delta.cpp
+ * @brief   Build a compressed delta (HBD1) firmware update image
+ * @details Usage: hb_delta <running.bin> <new.bin> <out.hbd>
+ *          The result is decoded in place before it is written, so a delta that
+ *          doesn't reproduce new.bin exactly is never produced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "delta_encoder.h"
+#include "file_util.h"
+#include "ota_delta.h"
+
+int main(int argc, char** argv) {
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <running.bin> <new.bin> <out.hbd>\n", argv[0]);
+    return 2;
+  }
+  delta::Bytes base, target;
+  if (!readFile(argv[1], base) || !readFile(argv[2], target)) {
+    fprintf(stderr, "[!] Can't read input files\n");
+    return 1;
+  }
+
+  const delta::Bytes image = delta::makeImage(base, target);
+
+  DeltaHeader header = {};
+  header.parse(image.data(), image.size());
+  delta::MemoryIo io(base);
+  static DeltaDecoder decoder;
+  decoder.begin(&io, header);
+  decoder.feed(image.data() + OTA_DELTA_HEADER_LEN, image.size() - OTA_DELTA_HEADER_LEN);
+  if (decoder.finish() != DeltaStatus::OK || io.target != target) {
+    fprintf(stderr, "[!] Round trip check failed, not writing %s\n", argv[3]);
+    return 1;
+  }
+  if (!writeFile(argv[3], image)) {
+    fprintf(stderr, "[!] Can't write %s\n", argv[3]);
+    return 1;
+  }
+
+  printf("[✓] %s: %zu bytes (new image %zu bytes, %.1f%%)\n", argv[3], image.size(), target.size(),
+         100.0 * image.size() / target.size());
+  return 0;
+}
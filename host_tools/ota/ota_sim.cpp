@@ -0,0 +1,326 @@
+/**
+ * @file    ota_sim.cpp
+ * @brief   Simulated BLE transport for delta firmware updates
+ * @details Runs the firmware's DeltaDecoder (button_firmware/ota_delta.h) behind a model
+ *          of the OTA_DATA / OTA_CONTROL characteristics (ota_update.h): in-order chunks
+ *          only, go-back-N resend from `next_seq`, SHA-256 check at END.
+ *          The link drops and duplicates writes at the given rates.
+ *
+ *          Scenarios (all must pass, exit code 1 otherwise):
+ *            clean        update over a perfect link
+ *            lossy        update with --loss / --dup
+ *            corrupt      one flipped byte in the delta is rejected
+ *            wrong-base   a device running another image refuses BEGIN
+ *            oversize     an op length that wraps the 32 bit output count is refused, nothing
+ *                         is written past the header's target size
+ *            next-session an LZ match reaching behind the stream start decodes the same on a
+ *                         decoder that ran a session before as on a fresh one
+ *
+ *          Usage: ota_sim [old.bin new.bin] [--mtu N] [--window N] [--loss P] [--dup P] [--seed N]
+ *          Without images a synthetic pair (1MB, code-like, small change + shift) is used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "delta_encoder.h"
+#include "file_util.h"
+#include "ota_delta.h"
+
+using delta::Bytes;
+
+struct SimConfig {
+  uint32_t mtu = 247;            /**< Negotiated ATT MTU */
+  uint32_t window = 16;          /**< Writes in flight before reading the status */
+  double loss = 0.05;
+  double dup = 0.01;
+  uint32_t seed = 1;
+  double conn_interval_ms = 15;  /**< BLE connection interval */
+  uint32_t writes_per_event = 4; /**< Write without response PDUs per connection event */
+};
+
+/* ============= Device model ============= */
+enum class Result { OK, BEGIN_REFUSED, DECODE_ERROR, VERIFY_ERROR };
+
+/**
+ * @brief Mirror of the OTA state machine in ota_update.h, on memory instead of flash
+ */
+class SimDevice {
+public:
+  explicit SimDevice(const Bytes& running) : running(running), io(running) {}
+
+  bool begin(const uint8_t* header_bytes) {
+    if (!header.parse(header_bytes, OTA_DELTA_HEADER_LEN) || header.base_size > running.size()) {
+      return false;
+    }
+    const Sha256::Digest base_hash = Sha256::hash(running.data(), header.base_size);
+    if (memcmp(base_hash.data(), header.base_sha256, 32) != 0) {
+      return false;
+    }
+    io.target.clear();  // esp_ota_begin() + a new hash on the device
+    io.sha.reset();
+    decoder.begin(&io, header);
+    next_seq = 0;
+    failed = false;
+    return true;
+  }
+
+  void write(uint16_t seq, const uint8_t* data, size_t len) {
+    if (failed || seq != next_seq) {
+      return;
+    }
+    if (decoder.feed(data, len) != DeltaStatus::OK) {
+      failed = true;
+      return;
+    }
+    next_seq++;
+  }
+
+  Result end(void) {
+    if (failed || decoder.finish() != DeltaStatus::OK) {
+      return Result::DECODE_ERROR;
+    }
+    const Sha256::Digest digest = io.sha.finish();
+    return memcmp(digest.data(), header.target_sha256, 32) == 0 ? Result::OK : Result::VERIFY_ERROR;
+  }
+
+  const Bytes& running;
+  delta::MemoryIo io;
+  DeltaHeader header;
+  DeltaDecoder decoder;
+  uint16_t next_seq = 0;
+  bool failed = false;
+};
+
+/* ============= Link + client ============= */
+struct Stats {
+  uint32_t chunks = 0;
+  uint64_t writes = 0;        /**< Data writes sent (incl. resends) */
+  uint64_t status_reads = 0;
+  double seconds = 0;
+};
+
+/**
+ * @brief Send one update image through the simulated link (client side of maint_client.py ota)
+ */
+static Result transfer(SimDevice& device, const Bytes& image, const SimConfig& cfg, std::mt19937& rng, Stats& stats) {
+  if (!device.begin(image.data())) {
+    return Result::BEGIN_REFUSED;
+  }
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  const size_t chunk = cfg.mtu - 3 - 2;  // ATT header, sequence number
+  const size_t payload = image.size() - OTA_DELTA_HEADER_LEN;
+  stats.chunks = (uint32_t)((payload + chunk - 1) / chunk);
+
+  uint32_t base_seq = 0;
+  while (base_seq < stats.chunks && !device.failed) {
+    // Send a window, then read the status to learn where the device is
+    const uint32_t last = std::min(stats.chunks, base_seq + cfg.window);
+    for (uint32_t s = base_seq; s < last; s++) {
+      const size_t off = OTA_DELTA_HEADER_LEN + (size_t)s * chunk;
+      const size_t len = std::min(chunk, image.size() - off);
+      stats.writes++;
+      if (uni(rng) < cfg.loss) {
+        continue;
+      }
+      device.write((uint16_t)s, &image[off], len);
+      if (uni(rng) < cfg.dup) {
+        device.write((uint16_t)s, &image[off], len);
+      }
+    }
+    stats.status_reads++;
+    base_seq = device.next_seq;
+  }
+  stats.seconds = (double)stats.writes / cfg.writes_per_event * cfg.conn_interval_ms / 1000.0
+                  + (double)stats.status_reads * 2 * cfg.conn_interval_ms / 1000.0;
+  return device.end();
+}
+
+/* ============= Synthetic images ============= */
+/**
+ * @brief Code-like 1MB image: instruction words from a small vocabulary + absolute addresses
+ */
+static Bytes syntheticBase(std::mt19937& rng) {
+  std::uniform_int_distribution<uint32_t> pick(0, 255);
+  uint32_t vocab[256];
+  for (uint32_t& v : vocab) v = rng();
+  Bytes image;
+  while (image.size() < (1u << 20)) {
+    uint32_t word = vocab[pick(rng)];
+    if (pick(rng) < 24) {
+      word = 0x42000000 | (rng() & 0xFFFFC);  // address into the app
+    }
+    for (int i = 0; i < 4; i++) image.push_back((uint8_t)(word >> (8 * i)));
+  }
+  return image;
+}
+
+/**
+ * @brief New version: a function grows by 180 bytes, code after it moves and
+ *        every address pointing behind it is relocated
+ */
+static Bytes syntheticTarget(const Bytes& base, std::mt19937& rng) {
+  const uint32_t insert_at = 300000;
+  const uint32_t grow = 180;
+  Bytes target(base.begin(), base.begin() + insert_at);
+  for (uint32_t i = 0; i < grow; i++) target.push_back((uint8_t)rng());
+  target.insert(target.end(), base.begin() + insert_at, base.end());
+  for (size_t i = 0; i + 4 <= target.size(); i += 4) {
+    uint32_t w;
+    memcpy(&w, &target[i], 4);
+    if ((w & 0xFFF00000) == 0x42000000 && (w & 0xFFFFF) > insert_at) {
+      w += grow;
+      memcpy(&target[i], &w, 4);
+    }
+  }
+  memcpy(&target[900000], "v1.1.0-field", 12);  // version string
+  return target;
+}
+
+/**
+ * @brief Image with a hand made LZ payload, base and target hashes of the given images
+ */
+static Bytes craftImage(const Bytes& base, const Bytes& target, const Bytes& payload) {
+  Bytes image = delta::makeImage(base, target);
+  image.resize(OTA_DELTA_HEADER_LEN);
+  image.insert(image.end(), payload.begin(), payload.end());
+  return image;
+}
+
+/* ============= Main ============= */
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-11s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  std::string files[2];
+  int nfiles = 0;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--mtu" && i + 1 < argc) cfg.mtu = (uint32_t)atoi(argv[++i]);
+    else if (a == "--window" && i + 1 < argc) cfg.window = (uint32_t)atoi(argv[++i]);
+    else if (a == "--loss" && i + 1 < argc) cfg.loss = atof(argv[++i]);
+    else if (a == "--dup" && i + 1 < argc) cfg.dup = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else if (a[0] != '-' && nfiles < 2) files[nfiles++] = a;
+    else {
+      fprintf(stderr, "Usage: %s [old.bin new.bin] [--mtu N] [--window N] [--loss P] [--dup P] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (cfg.mtu < 23 || cfg.window == 0) {
+    fprintf(stderr, "[!] Need --mtu >= 23 and --window >= 1\n");
+    return 2;
+  }
+
+  std::mt19937 rng(cfg.seed);
+  Bytes base, target;
+  if (nfiles == 2) {
+    if (!readFile(files[0], base) || !readFile(files[1], target)) {
+      fprintf(stderr, "[!] Can't read input files\n");
+      return 1;
+    }
+  } else {
+    base = syntheticBase(rng);
+    target = syntheticTarget(base, rng);
+  }
+
+  const Bytes image = delta::makeImage(base, target);
+  printf("[*] Full image %zu bytes, delta %zu bytes (%.2f%%), MTU %u, window %u\n",
+         target.size(), image.size(), 100.0 * image.size() / target.size(), cfg.mtu, cfg.window);
+
+  bool ok = true;
+  char detail[160];
+
+  // 1. Perfect link
+  {
+    SimConfig clean = cfg;
+    clean.loss = clean.dup = 0;
+    SimDevice device(base);
+    Stats stats;
+    const Result r = transfer(device, image, clean, rng, stats);
+    snprintf(detail, sizeof(detail), "%u chunks, ~%.1fs (full image ~%.1fs)", stats.chunks, stats.seconds,
+             stats.seconds * target.size() / image.size());
+    ok &= check("clean", r == Result::OK && device.io.target == target, detail);
+  }
+
+  // 2. Lossy link
+  {
+    SimDevice device(base);
+    Stats stats;
+    const Result r = transfer(device, image, cfg, rng, stats);
+    snprintf(detail, sizeof(detail), "loss %.0f%% dup %.0f%%: %llu writes for %u chunks, %llu status reads, ~%.1fs",
+             cfg.loss * 100, cfg.dup * 100, (unsigned long long)stats.writes, stats.chunks,
+             (unsigned long long)stats.status_reads, stats.seconds);
+    ok &= check("lossy", r == Result::OK && device.io.target == target, detail);
+  }
+
+  // 3. Corrupted delta byte must never produce an accepted image
+  {
+    Bytes bad = image;
+    bad[OTA_DELTA_HEADER_LEN + (bad.size() - OTA_DELTA_HEADER_LEN) / 2] ^= 0x5A;
+    SimDevice device(base);
+    Stats stats;
+    const Result r = transfer(device, bad, cfg, rng, stats);
+    ok &= check("corrupt", r == Result::DECODE_ERROR || r == Result::VERIFY_ERROR,
+                r == Result::DECODE_ERROR ? "rejected by the decoder" : r == Result::VERIFY_ERROR ? "rejected by SHA-256" : "ACCEPTED");
+  }
+
+  // 4. Device running a different image (one byte off)
+  {
+    Bytes other = base;
+    other[other.size() / 3] ^= 0x01;
+    SimDevice device(other);
+    Stats stats;
+    const Result r = transfer(device, image, cfg, rng, stats);
+    ok &= check("wrong-base", r == Result::BEGIN_REFUSED, r == Result::BEGIN_REFUSED ? "BEGIN refused" : "BEGIN accepted");
+  }
+
+  // 5. COPY a sector, then ADD with a length that brings produced + length past 2^32
+  {
+    const uint32_t copied = OTA_OUT_BUFFER;
+    Bytes ops = { static_cast<uint8_t>(DeltaOp::COPY) };
+    delta::putSvarint(ops, 0);
+    delta::putVarint(ops, copied);
+    ops.push_back(static_cast<uint8_t>(DeltaOp::ADD));
+    delta::putVarint(ops, (uint32_t)(0x100000000ULL - copied + 16));
+    ops.insert(ops.end(), target.begin(), target.begin() + std::min<size_t>(target.size(), 3 * OTA_OUT_BUFFER));
+    const Bytes declared(target.begin(), target.begin() + std::min<size_t>(target.size(), 2 * OTA_OUT_BUFFER));
+    SimDevice device(base);
+    Stats stats;
+    SimConfig clean = cfg;
+    clean.loss = clean.dup = 0;
+    const Result r = transfer(device, craftImage(base, declared, delta::lzCompress(ops)), clean, rng, stats);
+    snprintf(detail, sizeof(detail), "%s, %zu bytes written, target size %zu", r == Result::DECODE_ERROR ? "refused by the decoder" : "NOT refused",
+             device.io.target.size(), declared.size());
+    ok &= check("oversize", r == Result::DECODE_ERROR && device.io.target.size() <= declared.size(), detail);
+  }
+
+  // 6. A match 100 bytes behind the stream start (zeros: two empty ADDs), then ADD "abcd".
+  // The decoder that ran the clean update before must not see that session's window
+  {
+    const Bytes small = { 'a', 'b', 'c', 'd' };
+    const Bytes payload = { 0x00, 0x64, 0x00, 0x60, static_cast<uint8_t>(DeltaOp::ADD), 0x04, 'a', 'b', 'c', 'd' };
+    const Bytes image_small = craftImage(base, small, payload);
+    SimConfig clean = cfg;
+    clean.loss = clean.dup = 0;
+    SimDevice device(base);
+    Stats stats;
+    const Result first = transfer(device, image, clean, rng, stats);
+    const Result r = transfer(device, image_small, clean, rng, stats);
+    SimDevice fresh(base);
+    const Result r_fresh = transfer(fresh, image_small, clean, rng, stats);
+    snprintf(detail, sizeof(detail), "after an update: %s, fresh decoder: %s",
+             r == Result::OK && device.io.target == small ? "decoded" : "DIFFERENT", r_fresh == Result::OK ? "decoded" : "FAILED");
+    ok &= check("next-session", first == Result::OK && r == Result::OK && device.io.target == small && r_fresh == Result::OK &&
+                                   fresh.io.target == small, detail);
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+/**
+ * @file    power_phases.cpp
+ * @brief   Charge per wake phase from a power analyzer capture and the firmware's wake timelines
+ * @details Imports a CSV current trace (power_trace.h), finds the wakes in it, pairs them
+ *          with the timelines of the same session and aligns each one, on the phase marker
+ *          (DIAG_MARKER_PIN) if the capture has its channel, on the current otherwise.
+ *          Prints a markdown table per wake kind (beacon, timer): duration, mean current,
+ *          charge and energy of boot, clocks (optimizeClocks), ble_setup, advertising and
+ *          sleep_entry, next to diagCloseWake()'s estimate, plus the sleep current between
+ *          wakes. Medians over the wakes, so a build's table is comparable with the next.
+ *
+ *          Usage: power_phases <trace.csv> <timeline> [options]
+ *            timeline           serial capture with `[DIAG] Wake #N timeline` lines (verbose
+ *                               build), or diag_log_decode --csv output
+ *            --align M          marker | current (default: marker if the trace has it)
+ *            --time-col C, --current-col C, --voltage-col C, --marker-col C
+ *                               header name (substring) or 0-based index; default: detected
+ *            --marker-bit N     bit of a D0-D7 string column (default 0)
+ *            --time-unit U, --current-unit U   s|ms|us, A|mA|uA when the header has none
+ *            --threshold-ua N   wake = current above the sleep floor + N (default 300)
+ *            --max-boot-ms N    longest boot before setup() (default 500)
+ *            --supply-v V       energy without a voltage column (default 3.0)
+ *            --label NAME       build name in the JSON lines (default: the trace file name)
+ *            --json F           one JSON object per kind and phase (JSON Lines)
+ *            --baseline F       compare: a phase whose median charge grew more than
+ *                               --tolerance (default 0.10) and 5 uC is a regression (exit 1)
+ *            --summary          tables only
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+#include "power_trace.h"
+
+// As diagnostics.h
+#define DIAG_CURRENT_ACTIVE_UA 15000
+#define DIAG_CURRENT_ADV_UA 16500
+#define DIAG_CURRENT_SLEEP_UA 5
+
+static const char* const PHASE_ORDER[] = { "boot", "clocks", "ble_setup", "advertising", "sleep_entry" };
+
+struct PhaseStats {
+  std::vector<double> ms, uc, uj, model_uc;
+};
+
+static double median(std::vector<double> v) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  const size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static int phaseRank(const std::string& name) {
+  for (int r = 0; r < (int)(sizeof(PHASE_ORDER) / sizeof(PHASE_ORDER[0])); r++) {
+    if (name == PHASE_ORDER[r]) return r;
+  }
+  return 100;
+}
+
+/**
+ * @brief Value of a key in one JSON Lines object (only what this tool writes)
+ */
+static std::string jsonField(const std::string& line, const std::string& key) {
+  const std::string tag = "\"" + key + "\":";
+  const size_t at = line.find(tag);
+  if (at == std::string::npos) {
+    return "";
+  }
+  size_t b = at + tag.size(), e;
+  if (line[b] == '"') {
+    e = line.find('"', ++b);
+  } else {
+    e = line.find_first_of(",}", b);
+  }
+  return e == std::string::npos ? "" : line.substr(b, e - b);
+}
+
+static bool unitScale(const std::string& u, const bool time, double& scale) {
+  const std::string l = powerLower(u);
+  const char* base = time ? "s" : "a";
+  if (l == base) scale = 1;
+  else if (l == std::string("m") + base) scale = 1e-3;
+  else if (l == std::string("u") + base) scale = 1e-6;
+  else return false;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::string trace_path, timeline_path, align, label, json_path, baseline_path;
+  TraceColumns cols;
+  double threshold_ua = 300, max_boot_ms = 500, supply_v = 3.0, tolerance = 0.10;
+  bool summary = false, usage = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    const bool has = i + 1 < argc;
+    if (a == "--align" && has) align = argv[++i];
+    else if (a == "--time-col" && has) cols.time = argv[++i];
+    else if (a == "--current-col" && has) cols.current = argv[++i];
+    else if (a == "--voltage-col" && has) cols.voltage = argv[++i];
+    else if (a == "--marker-col" && has) cols.marker = argv[++i];
+    else if (a == "--marker-bit" && has) cols.marker_bit = atoi(argv[++i]);
+    else if (a == "--time-unit" && has) usage |= !unitScale(argv[++i], true, cols.time_scale);
+    else if (a == "--current-unit" && has) usage |= !unitScale(argv[++i], false, cols.current_scale);
+    else if (a == "--threshold-ua" && has) threshold_ua = atof(argv[++i]);
+    else if (a == "--max-boot-ms" && has) max_boot_ms = atof(argv[++i]);
+    else if (a == "--supply-v" && has) supply_v = atof(argv[++i]);
+    else if (a == "--label" && has) label = argv[++i];
+    else if (a == "--json" && has) json_path = argv[++i];
+    else if (a == "--baseline" && has) baseline_path = argv[++i];
+    else if (a == "--tolerance" && has) tolerance = atof(argv[++i]);
+    else if (a == "--summary") summary = true;
+    else if (a[0] != '-' && trace_path.empty()) trace_path = a;
+    else if (a[0] != '-' && timeline_path.empty()) timeline_path = a;
+    else usage = true;
+  }
+  if (usage || timeline_path.empty() || (!align.empty() && align != "marker" && align != "current")) {
+    fprintf(stderr,
+            "Usage: %s <trace.csv> <timeline> [--align marker|current] [--time-col C] [--current-col C] [--voltage-col C]\n"
+            "          [--marker-col C] [--marker-bit N] [--time-unit s|ms|us] [--current-unit A|mA|uA] [--threshold-ua N]\n"
+            "          [--max-boot-ms N] [--supply-v V] [--label NAME] [--json F] [--baseline F] [--tolerance F] [--summary]\n",
+            argv[0]);
+    return 2;
+  }
+  if (label.empty()) label = trace_path.substr(trace_path.find_last_of('/') + 1);
+
+  std::vector<uint8_t> data;
+  if (!readFile(trace_path, data)) {
+    fprintf(stderr, "[!] Can't read %s\n", trace_path.c_str());
+    return 1;
+  }
+  PowerTrace trace;
+  std::string error;
+  if (!parseTraceCsv(std::string(data.begin(), data.end()), cols, trace, error)) {
+    fprintf(stderr, "[!] %s: %s\n", trace_path.c_str(), error.c_str());
+    return 1;
+  }
+  trace.integrate(supply_v);
+  if (!readFile(timeline_path, data)) {
+    fprintf(stderr, "[!] Can't read %s\n", timeline_path.c_str());
+    return 1;
+  }
+  const std::vector<WakeTimeline> timelines = parseTimelines(std::string(data.begin(), data.end()));
+  if (align.empty()) align = trace.marker.empty() ? "current" : "marker";
+  if (align == "marker" && trace.marker.empty()) {
+    fprintf(stderr, "[!] No marker column in %s (--marker-col, or --align current)\n", trace_path.c_str());
+    return 1;
+  }
+
+  const double floor_a = traceFloor(trace);
+  const std::vector<TraceWake> wakes = findWakes(trace, threshold_ua * 1e-6, 0.002, 0.001);
+  const std::vector<int> pair = pairWakes(wakes, timelines, max_boot_ms / 1000);
+  printf("[*] %s: %zu samples, %.1f s at %.0f kHz, sleep floor %.1f uA%s\n", trace_path.c_str(), trace.size(),
+         trace.t.back(), 1e-3 / trace.period(), floor_a * 1e6, trace.v.empty() ? "" : ", voltage column");
+  printf("[*] %zu wakes in the trace, %zu timelines in %s, %d paired; alignment on the %s\n", wakes.size(), timelines.size(),
+         timeline_path.c_str(), (int)std::count_if(pair.begin(), pair.end(), [](int j) { return j >= 0; }), align.c_str());
+
+  const ModelCurrents model = { DIAG_CURRENT_ACTIVE_UA, DIAG_CURRENT_ADV_UA, DIAG_CURRENT_SLEEP_UA };
+  std::map<std::string, std::map<std::string, PhaseStats>> stats;  // kind -> phase
+  std::map<std::string, std::vector<double>> totals;               // kind -> wake charge
+  std::map<std::string, int> kind_wakes;
+  int skipped = 0;
+  for (size_t k = 0; k < wakes.size(); k++) {
+    if (pair[k] < 0) {
+      skipped++;
+      continue;
+    }
+    const WakeTimeline& t = timelines[pair[k]];
+    const Alignment a = align == "marker" ? alignMarker(trace, wakes[k], t) : alignCurrent(trace, wakes[k], t, max_boot_ms / 1000);
+    if (!a.ok) {
+      if (align == "marker") printf("[!] Wake at %.3f s (#%u): not aligned, %d/%d marker edges\n", wakes[k].start, t.wake, a.matched, a.expected);
+      else printf("[!] Wake at %.3f s (#%u): not aligned, %d bring-up marks (2 needed)\n", wakes[k].start, t.wake, a.expected);
+      skipped++;
+      continue;
+    }
+    const char* kind = wakeKind(t);
+    const std::vector<PhaseCharge> phases = wakePhases(trace, wakes[k], t, a.lag, supply_v, model);
+    double total = 0;
+    for (const PhaseCharge& p : phases) {
+      PhaseStats& s = stats[kind][p.name];
+      s.ms.push_back((p.end - p.start) * 1e3);
+      s.uc.push_back(p.uc);
+      s.uj.push_back(p.uj);
+      s.model_uc.push_back(p.model_uc);
+      total += p.uc;
+    }
+    totals[kind].push_back(total);
+    kind_wakes[kind]++;
+    if (!summary) {
+      printf("    %8.3f s #%-6u %-6s ", wakes[k].start, t.wake, kind);
+      if (align == "marker") printf("%2d/%-2d edges %5.1f us |", a.matched, a.expected, a.rms_us);
+      else printf("fit %5.1f%%     |", a.fit_gain * 100);
+      for (const PhaseCharge& p : phases) printf(" %s %.2f ms %.0f uC", p.name.c_str(), (p.end - p.start) * 1e3, p.uc);
+      printf("\n");
+    }
+  }
+  if (skipped) printf("[!] %d wakes without a timeline or not aligned, left out\n", skipped);
+
+  // Sleep: between consecutive wakes
+  double sleep_s = 0, sleep_c = 0;
+  for (size_t k = 0; k + 1 < wakes.size(); k++) {
+    sleep_s += wakes[k + 1].start - wakes[k].end;
+    sleep_c += trace.chargeTo(wakes[k + 1].start) - trace.chargeTo(wakes[k].end);
+  }
+
+  // Tables
+  std::string json;
+  auto jsonLine = [&](const std::string& kind, const std::string& phase, const int n, const double ms, const double uc,
+                      const double uj) {
+    char line[256];
+    snprintf(line, sizeof(line), "{\"label\":\"%s\",\"kind\":\"%s\",\"phase\":\"%s\",\"wakes\":%d,\"ms\":%.3f,\"uc\":%.2f,\"uj\":%.2f}\n",
+             label.c_str(), kind.c_str(), phase.c_str(), n, ms, uc, uj);
+    json += line;
+  };
+  printf("\n| Wake | Phase | Wakes | Duration (ms) | Mean (mA) | Charge (uC) | Energy (uJ) | Share | Model (uC) |\n");
+  printf("|------|-------|------:|--------------:|----------:|------------:|------------:|------:|-----------:|\n");
+  double active_c = 0, active_s = 0, adv_c = 0, adv_s = 0;
+  int boot_n = 0;
+  for (const auto& [kind, phases] : stats) {
+    std::vector<std::pair<std::string, const PhaseStats*>> order;
+    for (const auto& [name, s] : phases) order.push_back({ name, &s });
+    std::sort(order.begin(), order.end(), [](const auto& x, const auto& y) {
+      return phaseRank(x.first) != phaseRank(y.first) ? phaseRank(x.first) < phaseRank(y.first) : x.first < y.first;
+    });
+    const double kind_total = median(totals[kind]);
+    double sum_ms = 0, sum_uc = 0, sum_uj = 0, sum_model = 0;
+    for (const auto& [name, s] : order) {
+      const double ms = median(s->ms), uc = median(s->uc), uj = median(s->uj), model_uc = median(s->model_uc);
+      printf("| %s | %s | %zu | %.2f | %.2f | %.0f | %.0f | %.1f%% | %.0f |\n", kind.c_str(), name.c_str(), s->uc.size(), ms,
+             ms > 0 ? uc / ms : 0, uc, uj, kind_total > 0 ? uc * 100 / kind_total : 0, model_uc);
+      jsonLine(kind, name, (int)s->uc.size(), ms, uc, uj);
+      sum_ms += ms;
+      sum_uc += uc;
+      sum_uj += uj;
+      sum_model += model_uc;
+      // Measured nominal currents: advertising, and the awake time the firmware counts as active
+      for (size_t w = 0; w < s->uc.size(); w++) {
+        if (name == "advertising") {
+          adv_c += s->uc[w];
+          adv_s += s->ms[w];
+        } else if (name != "boot") {
+          active_c += s->uc[w];
+          active_s += s->ms[w];
+        }
+      }
+      if (name == "boot") boot_n += (int)s->uc.size();
+    }
+    printf("| %s | **total** | %d | %.2f | %.2f | %.0f | %.0f | 100%% | %.0f |\n", kind.c_str(), kind_wakes[kind], sum_ms,
+           sum_ms > 0 ? sum_uc / sum_ms : 0, sum_uc, sum_uj, sum_model);
+  }
+  if (sleep_s > 0) {
+    printf("| sleep | between wakes | %zu | %.0f s | %.4f | %.0f per hour | | | %.0f per hour |\n", wakes.size() - 1, sleep_s,
+           sleep_c / sleep_s * 1e3, sleep_c / sleep_s * 3600e6, DIAG_CURRENT_SLEEP_UA * 3600.0);
+    jsonLine("sleep", "sleep", (int)wakes.size() - 1, sleep_s * 1e3, sleep_c / sleep_s * 3600e6, 0);
+  }
+
+  // diagnostics.h constants from this capture
+  printf("\n[*] Measured for diagnostics.h:");
+  if (active_s > 0) printf(" DIAG_CURRENT_ACTIVE_UA %.0f", active_c / active_s * 1e3);
+  if (adv_s > 0) printf(", DIAG_CURRENT_ADV_UA %.0f", adv_c / adv_s * 1e3);
+  if (sleep_s > 0) printf(", DIAG_CURRENT_SLEEP_UA %.1f", sleep_c / sleep_s * 1e6);
+  printf("\n");
+  if (boot_n && active_s > 0) {
+    // The firmware counts the boot from esp_timer 0 (app start); the ROM and bootloader part is not in its estimate
+    double boot_uc = 0, counted_uc = 0;
+    for (const auto& [kind, phases] : stats) {
+      const auto it = phases.find("boot");
+      if (it == phases.end()) continue;
+      const PhaseStats& s = it->second;
+      for (size_t w = 0; w < s.uc.size(); w++) {
+        boot_uc += s.uc[w];
+        counted_uc += s.model_uc[w] / DIAG_CURRENT_ACTIVE_UA * (active_c / active_s * 1e3);  // esp_timer part, measured current
+      }
+    }
+    printf("[*] Boot before the app (ROM, bootloader): %.0f uC per wake, not in diagCloseWake()'s estimate\n",
+           (boot_uc - counted_uc) / boot_n);
+  }
+
+  if (!json_path.empty()) {
+    if (!writeFile(json_path, std::vector<uint8_t>(json.begin(), json.end()))) {
+      fprintf(stderr, "[!] Can't write %s\n", json_path.c_str());
+      return 1;
+    }
+    printf("[✓] Results -> %s\n", json_path.c_str());
+  }
+
+  bool failed = false;
+  if (!baseline_path.empty()) {
+    if (!readFile(baseline_path, data)) {
+      fprintf(stderr, "[!] Can't read %s\n", baseline_path.c_str());
+      return 1;
+    }
+    const std::string base(data.begin(), data.end());
+    printf("\n[*] Against %s (tolerance %.0f%%)\n", baseline_path.c_str(), tolerance * 100);
+    for (size_t b = 0, e; b < json.size(); b = e + 1) {
+      e = json.find('\n', b);
+      const std::string line = json.substr(b, e - b);
+      const std::string kind = jsonField(line, "kind"), phase = jsonField(line, "phase");
+      const double uc = strtod(jsonField(line, "uc").c_str(), nullptr);
+      bool found = false;
+      for (size_t bb = 0, ee; bb < base.size() && !found; bb = ee + 1) {
+        ee = base.find('\n', bb);
+        if (ee == std::string::npos) ee = base.size();
+        const std::string old = base.substr(bb, ee - bb);
+        if (jsonField(old, "kind") != kind || jsonField(old, "phase") != phase) continue;
+        found = true;
+        const double old_uc = strtod(jsonField(old, "uc").c_str(), nullptr);
+        const bool regressed = uc > old_uc * (1 + tolerance) && uc - old_uc > 5;
+        failed |= regressed;
+        printf("[%s] %-6s %-12s %8.0f -> %8.0f uC%s (%+.1f%%, %s)\n", regressed ? "!" : "✓", kind.c_str(), phase.c_str(), old_uc,
+               uc, kind == "sleep" ? "/h" : "", old_uc > 0 ? (uc / old_uc - 1) * 100 : 0, jsonField(old, "label").c_str());
+      }
+      if (!found) printf("[*] %-6s %-12s not in the baseline\n", kind.c_str(), phase.c_str());
+    }
+  }
+  return failed ? 1 : 0;
+}
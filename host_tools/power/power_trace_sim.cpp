@@ -0,0 +1,284 @@
+/**
+ * @file    power_trace_sim.cpp
+ * @brief   Synthetic power analyzer session to check power_phases' import, alignment and attribution
+ * @details Builds a capture the way a bench session looks: beacon wakes (boot, clock setup,
+ *          BLE start in parallel with the local setup, advertising with three TX spikes per
+ *          event, sleep entry) and calibration timer wakes, with the deep sleep in between,
+ *          analyzer noise and the marker channel of DIAG_MARKER_PIN (diagnostics.h). The
+ *          capture starts after the session's first wake, as it does on the bench. The
+ *          firmware's side is written as it prints it: serial timeline lines (us) and the
+ *          flash log's CSV (256 us units, rounded up).
+ *
+ *          Checks (exit code 1 if one fails):
+ *            import    the trace written as a PPK2-style CSV (ms, uA, D0-D7) reads back
+ *            pairing   every complete wake gets its own timeline
+ *            marker    lag error against the truth: serial within 20 us, flash log within 300 us (plus a sample);
+ *                      charge per phase (over 50 uC) within 1%, 5% with the log's 256 us marks
+ *            current   no marker: beacon wakes' lag within 1 ms and charge within 2%, timer
+ *                      wakes (setup() is their only mark) left unaligned
+ *
+ *          Usage: power_trace_sim [--rate-khz N] [--beacon-s N] [--seed N] [--write DIR]
+ *          --write saves trace.csv, serial.log and wakes.csv to try power_phases on.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+#include "power_trace.h"
+
+// As diagnostics.h
+#define DIAG_CURRENT_ACTIVE_UA 15000
+#define DIAG_CURRENT_ADV_UA 16500
+#define DIAG_CURRENT_SLEEP_UA 5
+
+/** Current and marker levels the synthetic button draws */
+#define SIM_SLEEP_A 6e-6
+#define SIM_NOISE_AWAKE_A 0.3e-3
+#define SIM_NOISE_SLEEP_A 0.5e-6
+#define SIM_ADV_SPIKE_A 9e-3           /**< On top of the advertising base, per PDU */
+#define SIM_ADV_SPIKE_S 0.00035
+#define SIM_THRESHOLD_A 300e-6
+
+struct Segment {
+  double start, end, amps;
+};
+
+struct SimWake {
+  WakeTimeline truth;       /**< Exact esp_timer marks */
+  double edge, lag;         /**< Wake edge (s), trace time = esp_us / 1e6 + lag */
+  double sleep_entry;       /**< Trace time of esp_deep_sleep_start() */
+  double end;               /**< Current back at the floor */
+};
+
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-8s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  double rate_khz = 100, beacon_s = 3;
+  uint32_t seed = 1;
+  std::string write_dir;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--rate-khz" && i + 1 < argc) rate_khz = atof(argv[++i]);
+    else if (a == "--beacon-s" && i + 1 < argc) beacon_s = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else if (a == "--write" && i + 1 < argc) write_dir = argv[++i];
+    else {
+      fprintf(stderr, "Usage: %s [--rate-khz N] [--beacon-s N] [--seed N] [--write DIR]\n", argv[0]);
+      return 2;
+    }
+  }
+  std::mt19937_64 rng(seed);
+  auto uni = [&](const double lo, const double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+
+  // Session: wake 1 happens before the capture starts, then beacon and timer wakes alternate
+  std::vector<Segment> segs;
+  std::vector<std::pair<double, int>> marker_edges;  // time, level
+  std::vector<SimWake> wakes;
+  double t = -1.0;
+  for (int w = 0; w < 9; w++) {
+    SimWake s;
+    s.truth.wake = 41 + w;
+    const bool beacon = w % 2 == 0;
+    s.edge = t;
+    const double boot = uni(0.026, 0.036);
+    const double setup_us = std::round(uni(6000, 9000));
+    s.lag = s.edge + boot - setup_us * 1e-6;
+    double* us = s.truth.us;
+    us[MARK_SETUP] = setup_us;
+    segs.push_back({ s.edge, s.edge + boot * 0.6, 7e-3 });  // ROM, bootloader
+    segs.push_back({ s.edge + boot * 0.6, s.edge + boot, 10e-3 });
+    if (beacon) {
+      us[MARK_CLOCKS] = us[MARK_SETUP] + std::round(uni(350, 450));
+      us[2] = us[MARK_CLOCKS] + 80;                               // ble_start
+      us[3] = us[2] + std::round(uni(1500, 2500));                // pins
+      us[4] = us[3] + 300;                                        // ble_wait
+      us[5] = us[2] + std::round(uni(55000, 70000));              // ble
+      us[MARK_ADV_START] = us[5] + 400;
+      us[MARK_ADV_STOP] = us[MARK_ADV_START] + std::round(beacon_s * 1e6);
+      us[MARK_SLEEP] = us[MARK_ADV_STOP] + std::round(uni(4000, 6000));
+      auto at = [&](const int m) { return us[m] * 1e-6 + s.lag; };
+      segs.push_back({ at(MARK_SETUP), at(MARK_CLOCKS), 13e-3 });
+      segs.push_back({ at(MARK_CLOCKS), at(4), 11e-3 });
+      segs.push_back({ at(4), at(5), 17e-3 });                    // Waiting for the controller
+      segs.push_back({ at(5), at(MARK_ADV_START), 12e-3 });
+      segs.push_back({ at(MARK_ADV_START), at(MARK_ADV_STOP), 12.5e-3 });
+      for (double e = at(MARK_ADV_START) + 0.001; e + 3 * SIM_ADV_SPIKE_S < at(MARK_ADV_STOP); e += uni(0.040, 0.080) + uni(0, 0.010)) {
+        for (int ch = 0; ch < 3; ch++) segs.push_back({ e + ch * 0.0005, e + ch * 0.0005 + SIM_ADV_SPIKE_S, SIM_ADV_SPIKE_A });
+      }
+      segs.push_back({ at(MARK_ADV_STOP), at(MARK_SLEEP), 12e-3 });
+    } else {
+      us[MARK_SLEEP] = us[MARK_SETUP] + std::round(uni(20000, 30000));
+      segs.push_back({ us[MARK_SETUP] * 1e-6 + s.lag, us[MARK_SLEEP] * 1e-6 + s.lag, 12e-3 });
+    }
+    s.sleep_entry = us[MARK_SLEEP] * 1e-6 + s.lag;
+    s.end = s.sleep_entry + 0.0003;
+    segs.push_back({ s.sleep_entry, s.end, 6e-3 });  // Power down into deep sleep
+
+    // diagMarker(): high at setup, toggled at every mark, low at the sleep entry
+    std::vector<std::pair<double, int>> marks;
+    for (int m = 0; m < POWER_MARKS; m++) {
+      if (s.truth.has(m)) marks.push_back({ us[m] * 1e-6 + s.lag, m });
+    }
+    std::sort(marks.begin(), marks.end());
+    int level = 0;
+    for (const auto& [time, m] : marks) {
+      const int next = m == MARK_SETUP ? 1 : (m == MARK_SLEEP ? 0 : level ^ 1);
+      if (next != level) marker_edges.push_back({ time, next });
+      level = next;
+    }
+    wakes.push_back(s);
+    t = s.end + uni(1.0, 2.5);
+  }
+  const double duration = t;
+
+  // Samples from t = 0 (the capture starts after wake 1)
+  const double dt = 1.0 / (rate_khz * 1000);
+  const size_t n = (size_t)(duration / dt);
+  PowerTrace trace;
+  trace.t.resize(n);
+  trace.i.assign(n, SIM_SLEEP_A);
+  trace.marker.assign(n, 0);
+  for (size_t k = 0; k < n; k++) trace.t[k] = k * dt;
+  std::sort(segs.begin(), segs.end(), [](const Segment& a, const Segment& b) { return a.start < b.start; });
+  for (const Segment& sg : segs) {
+    const bool spike = sg.amps == SIM_ADV_SPIKE_A;
+    for (size_t k = (size_t)std::max(0.0, ceil(sg.start / dt)); k < n && k * dt < sg.end; k++) {
+      trace.i[k] = spike ? trace.i[k] + sg.amps : sg.amps;
+    }
+  }
+  size_t e = 0;
+  int level = 0;
+  std::sort(marker_edges.begin(), marker_edges.end());
+  std::normal_distribution<double> gauss(0, 1);
+  for (size_t k = 0; k < n; k++) {
+    while (e < marker_edges.size() && marker_edges[e].first <= trace.t[k]) level = marker_edges[e++].second;
+    trace.marker[k] = (uint8_t)level;
+    trace.i[k] += gauss(rng) * (trace.i[k] > 1e-3 ? SIM_NOISE_AWAKE_A : SIM_NOISE_SLEEP_A);
+  }
+
+  // Firmware side: serial timeline lines and the flash log's CSV
+  std::string serial = "[RTC] Memory validation failed - initializing\n", log_csv = "wake,cause,clock,synced,charge_uc";
+  for (int m = 0; m < POWER_MARKS; m++) log_csv += std::string(",") + POWER_MARK_NAMES[m] + "_ms";
+  log_csv += "\n";
+  for (const SimWake& s : wakes) {
+    char line[512];
+    int len = snprintf(line, sizeof(line), "[DIAG] Wake #%u timeline (us):", s.truth.wake);
+    for (int m = 0; m < MARK_SLEEP; m++) {
+      if (s.truth.has(m)) len += snprintf(line + len, sizeof(line) - len, " %s=%.0f", POWER_MARK_NAMES[m], s.truth.us[m]);
+    }
+    serial += std::string(line) + "\n[DIAG] BLE start 61234 us, 2100 us of it in parallel with the local setup\n";
+    len = snprintf(line, sizeof(line), "%u,%s,%u,0,0", s.truth.wake, s.truth.has(MARK_CLOCKS) ? "BUTTON" : "TIMER", 100 + s.truth.wake);
+    for (int m = 0; m < POWER_MARKS; m++) {
+      if (s.truth.has(m)) {
+        const double units = ceil(s.truth.us[m] / 256.0);
+        len += snprintf(line + len, sizeof(line) - len, ",%.3f", units * 256 / 1000.0);
+      } else {
+        len += snprintf(line + len, sizeof(line) - len, ",");
+      }
+    }
+    log_csv += std::string(line) + "\n";
+  }
+
+  // PPK2-style export: Timestamp(ms),Current(uA),D0-D7
+  std::string csv = "Timestamp(ms),Current(uA),D0-D7\n";
+  csv.reserve(n * 32);
+  for (size_t k = 0; k < n; k++) {
+    char line[64];
+    snprintf(line, sizeof(line), "%.3f,%.2f,%d0000000\n", trace.t[k] * 1e3, trace.i[k] * 1e6, trace.marker[k]);
+    csv += line;
+  }
+  if (!write_dir.empty()) {
+    const bool ok = writeFile(write_dir + "/trace.csv", std::vector<uint8_t>(csv.begin(), csv.end())) &&
+                    writeFile(write_dir + "/serial.log", std::vector<uint8_t>(serial.begin(), serial.end())) &&
+                    writeFile(write_dir + "/wakes.csv", std::vector<uint8_t>(log_csv.begin(), log_csv.end()));
+    if (!ok) {
+      fprintf(stderr, "[!] Can't write to %s\n", write_dir.c_str());
+      return 1;
+    }
+  }
+
+  printf("[*] %.1f s at %.0f kHz: %zu wakes (the first before the capture), %.1f s beacons\n\n", duration, rate_khz,
+         wakes.size(), beacon_s);
+  bool ok = true;
+
+  // Import: the CSV as the tool reads it
+  PowerTrace read;
+  std::string error;
+  const bool parsed = parseTraceCsv(csv, TraceColumns(), read, error);
+  double worst_i = 0;
+  size_t marker_diff = 0;
+  for (size_t k = 0; parsed && k < std::min(n, read.size()); k++) {
+    worst_i = std::max(worst_i, fabs(read.i[k] - trace.i[k]));
+    marker_diff += read.marker[k] != trace.marker[k];
+  }
+  char detail[256];
+  snprintf(detail, sizeof(detail), "%zu of %zu samples, worst current error %.3f uA, %zu marker samples off%s%s", read.size(), n,
+           worst_i * 1e6, marker_diff, parsed ? "" : ": ", error.c_str());
+  ok &= check("import", parsed && read.size() == n && worst_i < 0.01e-6 && marker_diff == 0, detail);
+  read.integrate(3.0);
+
+  // Pairing
+  const std::vector<TraceWake> found = findWakes(read, SIM_THRESHOLD_A, 0.002, 0.001);
+  struct Source {
+    const char* name;
+    std::vector<WakeTimeline> timelines;
+    double lag_tol, phase_tol;
+  };
+  const Source sources[] = { { "serial", parseTimelines(serial), 20e-6, 0.01 },
+                             { "flash log", parseTimelines(log_csv), 300e-6, 0.05 } };
+  int paired_ok = 0;
+  const std::vector<int> pair = pairWakes(found, sources[0].timelines, 0.5);
+  for (size_t k = 0; k < found.size(); k++) {
+    paired_ok += pair[k] >= 0 && sources[0].timelines[pair[k]].wake == wakes[k + 1].truth.wake;
+  }
+  snprintf(detail, sizeof(detail), "%zu wakes found, %d of %zu paired with their timeline (%zu timelines)", found.size(), paired_ok,
+           wakes.size() - 1, sources[0].timelines.size());
+  ok &= check("pairing", found.size() == wakes.size() - 1 && paired_ok == (int)wakes.size() - 1, detail);
+  if (found.size() != wakes.size() - 1) return 1;
+
+  // Alignment and charge per phase
+  const ModelCurrents model = { DIAG_CURRENT_ACTIVE_UA, DIAG_CURRENT_ADV_UA, DIAG_CURRENT_SLEEP_UA };
+  for (const Source& src : sources) {
+    for (const char* mode : { "marker", "current" }) {
+      const bool marker = mode[0] == 'm';
+      if (!marker && src.lag_tol > 100e-6) continue;  // Current alignment: the serial timeline is enough
+      double worst_lag = 0, worst_phase = 0, worst_wake = 0;
+      int aligned = 0, unexpected = 0;
+      for (size_t k = 0; k < found.size(); k++) {
+        const SimWake& s = wakes[k + 1];
+        const WakeTimeline& tl = src.timelines[k + 1];
+        const Alignment a = marker ? alignMarker(read, found[k], tl) : alignCurrent(read, found[k], tl, 0.5);
+        const bool single_mark = !marker && !tl.has(MARK_CLOCKS);  // Timer wakes: the current alone can't place them
+        if (a.ok == single_mark) unexpected++;
+        if (!a.ok) continue;
+        aligned++;
+        worst_lag = std::max(worst_lag, fabs(a.lag - s.lag));
+        const std::vector<PhaseCharge> got = wakePhases(read, found[k], tl, a.lag, 3.0, model);
+        const std::vector<PhaseCharge> truth = wakePhases(read, found[k], s.truth, s.lag, 3.0, model);
+        double got_total = 0, truth_total = 0;
+        for (size_t p = 0; p < got.size() && p < truth.size(); p++) {
+          if (truth[p].uc > 50) worst_phase = std::max(worst_phase, fabs(got[p].uc / truth[p].uc - 1));
+          got_total += got[p].uc;
+          truth_total += truth[p].uc;
+        }
+        worst_wake = std::max(worst_wake, fabs(got_total / truth_total - 1));
+      }
+      const bool pass = unexpected == 0 &&
+                        (marker ? worst_lag <= src.lag_tol + dt && worst_phase <= src.phase_tol : worst_lag <= 1e-3 && worst_wake <= 0.02);
+      snprintf(detail, sizeof(detail), "%-9s %d/%zu aligned, worst lag error %.1f us, worst phase %.2f%%, worst wake %.2f%%",
+               src.name, aligned, found.size(), worst_lag * 1e6, worst_phase * 100, worst_wake * 100);
+      ok &= check(mode, pass, detail);
+    }
+  }
+  if (!write_dir.empty()) printf("\n[*] %s/trace.csv, serial.log, wakes.csv written\n", write_dir.c_str());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/**
+ * @file    adv_airtime.cpp
+ * @brief   Beacon advert v1 vs v2 vs v3 (adv_format.h): airtime per press, channel load, codec checks
+ * @details Airtime table for the advert versions: advertising data and PDU bytes, time on
+ *          air of a PDU and of an advertising event (3 channels), per beacon window (interval
+ *          uniform in [--adv-min-ms, --adv-max-ms] + 0-10ms advDelay), TX charge per press,
+ *          and the share of PDUs lost to collisions when --buttons press at once (pure ALOHA
+ *          on each advertising channel, the PDUs of different buttons are unsynchronized).
+ *
+ *          Checks (exit code 1 if one fails):
+ *            roundtrip  random codes, timestamp words, health bits, hints and press ages
+ *                       encode and decode unchanged with the firmware's encoder and the
+ *                       gateway's decoder
+ *            reject     truncated adverts, a foreign manufacturer ID, an unknown version
+ *                       nibble, a version that doesn't match the length and a v1 payload
+ *                       under another name are not beacons
+ *            age        every ms up to 20 s codes to at most itself, less than a step below
+ *                       (4 ms, or 1/32), and monotonic; 15.9 s and older saturate
+ *            airtime    v2 takes less time on air than v1 and fits a legacy advert, v3 adds
+ *                       one byte (8 us)
+ *
+ *          Usage: adv_airtime [--beacon-ms N] [--adv-min-ms N] [--adv-max-ms N] [--buttons N] [--seed N]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+
+#include "adv_format.h"
+
+#define SIM_MANUFACTURER_ID 0x0B5Eu            /**< Stand-in for MANUFACTURER_ID */
+#define SIM_PRODUCT_NAME "ESP32H2 SoS Button"  /**< Must match the button's PRODUCT_NAME */
+#define SIM_CURRENT_ADV_UA 16500               /**< As diagnostics.h */
+#define SIM_ADV_CHANNELS 3
+#define SIM_ADV_DELAY_MS 5.0                   /**< Mean advDelay */
+#define SIM_ROUNDTRIPS 100000
+
+struct Airtime {
+  size_t adv_len;
+  uint32_t pdu_us;
+  double window_ms;    /**< Time on air per beacon window */
+  double charge_uc;    /**< TX charge per beacon window */
+  double collided;     /**< Share of PDUs overlapping another button's */
+};
+
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-9s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+static Airtime airtime(const size_t adv_len, const double events, const double interval_ms, const uint32_t buttons) {
+  Airtime a;
+  a.adv_len = adv_len;
+  a.pdu_us = advPduUs(adv_len);
+  a.window_ms = events * SIM_ADV_CHANNELS * a.pdu_us / 1000.0;
+  a.charge_uc = a.window_ms * SIM_CURRENT_ADV_UA / 1e6 * 1000.0;
+  // A PDU survives if no other button starts one on its channel within +-1 PDU
+  const double load = (double)(buttons - 1) * a.pdu_us / (interval_ms * 1000.0);
+  a.collided = 1.0 - exp(-2.0 * load);
+  return a;
+}
+
+static bool sameBeacon(const adv_beacon_t& a, const adv_beacon_t& b) {
+  return a.format == b.format && a.code == b.code && a.timestamp == b.timestamp && a.hint == b.hint
+         && a.health == b.health && a.age == b.age;
+}
+
+int main(int argc, char** argv) {
+  uint32_t beacon_ms = 10000, buttons = 20, seed = 1;
+  double adv_min_ms = 40, adv_max_ms = 80;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--beacon-ms" && i + 1 < argc) beacon_ms = (uint32_t)atoi(argv[++i]);
+    else if (a == "--adv-min-ms" && i + 1 < argc) adv_min_ms = atof(argv[++i]);
+    else if (a == "--adv-max-ms" && i + 1 < argc) adv_max_ms = atof(argv[++i]);
+    else if (a == "--buttons" && i + 1 < argc) buttons = (uint32_t)atoi(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) seed = (uint32_t)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Usage: %s [--beacon-ms N] [--adv-min-ms N] [--adv-max-ms N] [--buttons N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (buttons == 0 || adv_max_ms < adv_min_ms || adv_min_ms <= 0) {
+    fprintf(stderr, "[!] Bad arguments\n");
+    return 2;
+  }
+
+  /* ===== Airtime ===== */
+  const double interval_ms = (adv_min_ms + adv_max_ms) / 2 + SIM_ADV_DELAY_MS;
+  const double events = beacon_ms / interval_ms;
+  const Airtime v1 = airtime(advLen(ADV_FORMAT_V1, SIM_PRODUCT_NAME), events, interval_ms, buttons);
+  const Airtime v2 = airtime(advLen(ADV_FORMAT_V2, SIM_PRODUCT_NAME), events, interval_ms, buttons);
+  const Airtime v3 = airtime(advLen(ADV_FORMAT_V3, SIM_PRODUCT_NAME), events, interval_ms, buttons);
+
+  printf("[*] %u ms beacon, interval %.0f-%.0f ms + advDelay: %.1f events, %.0f PDUs; %u buttons at once\n", beacon_ms,
+         adv_min_ms, adv_max_ms, events, events * SIM_ADV_CHANNELS, buttons);
+  printf("  %-7s %8s %9s %8s %10s %12s %12s %10s\n", "format", "AD bytes", "PDU bytes", "us/PDU", "us/event", "ms/window",
+         "uC/window", "collided");
+  for (const auto& [name, a] : { std::make_pair("v1", v1), std::make_pair("v2", v2), std::make_pair("v3", v3) }) {
+    printf("  %-7s %8zu %9zu %8u %10u %12.1f %12.2f %9.2f%%\n", name, a.adv_len, ADV_PDU_OVERHEAD + a.adv_len, a.pdu_us,
+           a.pdu_us * SIM_ADV_CHANNELS, a.window_ms, a.charge_uc, a.collided * 100.0);
+  }
+  printf("  v2/v1 %8s %9s %8s %10s %11.0f%% %11.0f%% %9.0f%%\n", "", "", "", "", v2.window_ms * 100.0 / v1.window_ms,
+         v2.charge_uc * 100.0 / v1.charge_uc, v2.collided * 100.0 / v1.collided);
+  printf("  v3/v1 %8s %9s %8s %10s %11.0f%% %11.0f%% %9.0f%%\n", "", "", "", "", v3.window_ms * 100.0 / v1.window_ms,
+         v3.charge_uc * 100.0 / v1.charge_uc, v3.collided * 100.0 / v1.collided);
+
+  /* ===== Codec ===== */
+  std::mt19937 rng(seed);
+  uint32_t roundtrip_bad = 0;
+  for (uint32_t i = 0; i < SIM_ROUNDTRIPS; i++) {
+    uint8_t buf[ADV_MAX_LEN];
+    adv_beacon_t in = {}, out = {};
+    in.code = rng();
+    in.timestamp = rng();
+    in.age = ADV_AGE_NONE;
+    if (i % 3) {
+      in.format = i % 3 == 1 ? ADV_FORMAT_V2 : ADV_FORMAT_V3;
+      in.health = (uint8_t)(rng() & 0xF);
+      in.hint = advHint(rng());
+      if (in.format == ADV_FORMAT_V3) in.age = advAge(rng() % 20000);
+      const size_t len = in.format == ADV_FORMAT_V3 ? advBuildV3(SIM_MANUFACTURER_ID, in, buf) : advBuildV2(SIM_MANUFACTURER_ID, in, buf);
+      roundtrip_bad += !advDecode(buf, len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out) || !sameBeacon(in, out);
+    } else {
+      in.format = ADV_FORMAT_V1;
+      uint8_t payload[ADV_V1_PAYLOAD_LEN];
+      advPutBe32(payload, in.code);
+      advPutBe32(payload + 4, in.timestamp);
+      const size_t len = advBuildV1(SIM_PRODUCT_NAME, payload, buf);
+      roundtrip_bad += !advDecode(buf, len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out) || !sameBeacon(in, out);
+    }
+  }
+
+  uint32_t reject_bad = 0, rejects = 0;
+  {
+    adv_beacon_t in = { ADV_FORMAT_V2, 0x12345678u, 0x8ABCDEF0u, 0x5A, ADV_HEALTH_CRASH, ADV_AGE_NONE };
+    adv_beacon_t out;
+    uint8_t v2buf[ADV_MAX_LEN];
+    const size_t v2len = advBuildV2(SIM_MANUFACTURER_ID, in, v2buf);
+    for (size_t len = 0; len < v2len; len++, rejects++) {
+      reject_bad += advDecode(v2buf, len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    }
+    uint8_t buf[ADV_MAX_LEN];
+    memcpy(buf, v2buf, v2len);
+    buf[2] ^= 0x01;  // Foreign manufacturer ID
+    reject_bad += advDecode(buf, v2len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    memcpy(buf, v2buf, v2len);
+    buf[4] = (uint8_t)((4 << 4) | (buf[4] & 0xF));  // Unknown version
+    reject_bad += advDecode(buf, v2len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    buf[4] = (uint8_t)((ADV_FORMAT_V3 << 4) | (buf[4] & 0xF));  // v3 without its age byte
+    reject_bad += advDecode(buf, v2len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    in.format = ADV_FORMAT_V3;
+    in.age = advAge(150);
+    const size_t v3len = advBuildV3(SIM_MANUFACTURER_ID, in, buf);
+    buf[4] = (uint8_t)((ADV_FORMAT_V2 << 4) | (buf[4] & 0xF));  // v2 with a byte too many
+    reject_bad += advDecode(buf, v3len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    rejects += 4;
+
+    uint8_t payload[ADV_V1_PAYLOAD_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    const size_t v1len = advBuildV1(SIM_PRODUCT_NAME, payload, buf);
+    buf[2] ^= 0x20;  // Another product's name
+    reject_bad += advDecode(buf, v1len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    advBuildV1(SIM_PRODUCT_NAME, payload, buf);
+    for (size_t len = 0; len < v1len; len++, rejects++) {
+      reject_bad += advDecode(buf, len, SIM_MANUFACTURER_ID, SIM_PRODUCT_NAME, &out);
+    }
+    rejects++;
+  }
+
+  // Age code: floor of the ms, within a step, monotonic
+  uint32_t age_bad = 0;
+  uint8_t prev = 0;
+  for (uint32_t ms = 0; ms <= 20000; ms++) {
+    const uint8_t code = advAge(ms);
+    const uint32_t back = advAgeMs(code);
+    const uint32_t step = back / 32 > ADV_AGE_UNIT_MS ? back / 32 : ADV_AGE_UNIT_MS;
+    const bool saturated = code == ADV_AGE_MAX && ms >= advAgeMs(ADV_AGE_MAX);
+    age_bad += code < prev || code == ADV_AGE_NONE || back > ms || (!saturated && ms - back >= step);
+    prev = code;
+  }
+
+  printf("\n");
+  bool ok = true;
+  char detail[160];
+  snprintf(detail, sizeof(detail), "%u adverts (v1, v2, v3), %u changed or not decoded", SIM_ROUNDTRIPS, roundtrip_bad);
+  ok &= check("roundtrip", roundtrip_bad == 0, detail);
+  snprintf(detail, sizeof(detail), "%u malformed or foreign adverts, %u decoded", rejects, reject_bad);
+  ok &= check("reject", reject_bad == 0, detail);
+  snprintf(detail, sizeof(detail), "0-20000 ms, %u codes off; saturates at %u ms", age_bad, advAgeMs(ADV_AGE_MAX));
+  ok &= check("age", age_bad == 0, detail);
+  snprintf(detail, sizeof(detail), "v2 %u us per PDU vs v1 %u us, v3 %u us, %zu of %d bytes", v2.pdu_us, v1.pdu_us, v3.pdu_us,
+           v3.adv_len, ADV_MAX_LEN);
+  ok &= check("airtime", v2.pdu_us < v1.pdu_us && v3.pdu_us == v2.pdu_us + ADV_US_PER_BYTE && v3.adv_len <= ADV_MAX_LEN &&
+                             v1.adv_len <= ADV_MAX_LEN, detail);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file    dual_radio_sim.cpp
+ * @brief   BLE + IEEE 802.15.4 SOS window of the button, on one timeline
+ * @details Each press runs the button's beacon loop: BLE advertising events (3 PDUs,
+ *          interval + 0-10ms advDelay) for the beacon time, and the beacon loop polling every
+ *          ~10ms, where the firmware's Ieee802154Pacer (ieee802154_frame.h) decides when an
+ *          802.15.4 frame goes out. The radio is shared: a frame that would overlap a BLE
+ *          advertising event loses the arbitration, a frame that finds other 802.15.4
+ *          traffic on the channel fails CCA. Both are retried by the pacer.
+ *          Frames on air are built with ieee802154BuildFrame() and received by a stand-in
+ *          receiver using ieee802154ParseFrame().
+ *
+ *          Checks (exit code 1 if one fails):
+ *            payload     every received 802.15.4 frame decodes to the BLE payload and MAC of
+ *                        its press; damaged frames are rejected
+ *            coexist     no 802.15.4 frame on air during a BLE advertising event, and at least
+ *                        90% of the nominal frame rate gets through
+ *            accounting  the firmware's BLE PDU estimate (diagCloseWake()) is within 10% of
+ *                        the PDUs the simulation sent. It uses the mean interval, so it
+ *                        comes out a little low when the interval varies from press to press
+ *
+ *          Usage: dual_radio_sim [--presses N] [--beacon-ms N] [--adv-min-ms N] [--adv-max-ms N]
+ *                                [--ieee-interval-ms N] [--ble-rx P] [--ieee-rx P] [--load N]
+ *                                [--seed N] [--pcap out.pcap]
+ *          --pcap writes the 802.15.4 frames (with FCS), readable by ieee802154_rx and Wireshark.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "adv_format.h"
+#include "ieee802154_frame.h"
+#include "pcap_util.h"
+
+// As diagnostics.h
+#define SIM_CURRENT_ACTIVE_UA 15000
+#define SIM_CURRENT_ADV_UA 16500
+#define SIM_CURRENT_802154_TX_UA 20000
+#define SIM_BLE_ADV_PDU_US advPduUs(ADV_V2_LEN)  /**< BEACON_ADV_FORMAT (adv_format.h) */
+#define SIM_BLE_ADV_CHANNELS 3
+#define SIM_BLE_ADV_DELAY_US 5000
+
+#define SIM_BLE_PDU_SPACING_US 1000   /**< PDU start to PDU start within an advertising event */
+#define SIM_BLE_GUARD_US 300          /**< Radio reserved for BLE before / after an event */
+#define SIM_LOOP_MS 10                /**< Beacon loop: delay(10) */
+#define SIM_CCA_US 128                /**< 8 symbols */
+#define SIM_BG_FRAME_US 1500          /**< Mean other 802.15.4 frame (Zigbee / Thread) */
+
+struct SimConfig {
+  uint32_t presses = 2000;
+  uint32_t beacon_ms = 10000;
+  double adv_min_ms = 40;
+  double adv_max_ms = 80;
+  uint32_t ieee_interval_ms = 100;
+  double ble_rx = 0.7;           /**< A BLE advertising event reaches a gateway */
+  double ieee_rx = 0.7;          /**< An 802.15.4 frame reaches a site receiver */
+  double load = 20;              /**< Other 802.15.4 frames per second on the channel */
+  uint32_t seed = 1;
+  std::string pcap;
+};
+
+struct Interval {
+  uint64_t start_us;
+  uint64_t end_us;
+};
+
+struct PressResult {
+  uint32_t ble_pdus = 0;
+  uint32_t ieee_frames = 0;
+  uint32_t ieee_coexist = 0;     /**< Lost the radio to BLE */
+  uint32_t ieee_cca = 0;         /**< Channel busy */
+  uint32_t ieee_overlap = 0;     /**< On air during a BLE event (must stay 0) */
+  uint32_t decoded = 0;
+  uint32_t wrong = 0;            /**< Decoded to another payload / MAC, or damaged frame accepted */
+  double ble_first_ms = INFINITY;
+  double ieee_first_ms = INFINITY;
+};
+
+static bool overlaps(const std::vector<Interval>& busy, uint64_t start, uint64_t end) {
+  auto it = std::lower_bound(busy.begin(), busy.end(), start, [](const Interval& iv, uint64_t t) { return iv.end_us <= t; });
+  return it != busy.end() && it->start_us < end;
+}
+
+/**
+ * @brief One press: BLE window and 802.15.4 pacer on the same clock
+ */
+static PressResult runPress(const SimConfig& cfg, uint64_t t0_us, std::mt19937& rng, PcapWriter* pcap, uint8_t& seq) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  PressResult r;
+  const uint64_t window_us = (uint64_t)cfg.beacon_ms * 1000;
+
+  uint8_t mac[6];
+  for (uint8_t& b : mac) b = (uint8_t)rng();
+  uint8_t payload[IEEE802154_PAYLOAD_LEN];
+  for (uint8_t& b : payload) b = (uint8_t)rng();
+
+  // BLE: the controller's advertising events
+  std::vector<Interval> busy;
+  const double interval_ms = cfg.adv_min_ms + uni(rng) * (cfg.adv_max_ms - cfg.adv_min_ms);
+  for (double t = 0; t < window_us; t += (interval_ms + uni(rng) * 10.0) * 1000) {
+    const uint64_t start = (uint64_t)t;
+    busy.push_back({ start >= SIM_BLE_GUARD_US ? start - SIM_BLE_GUARD_US : 0,
+                     start + (SIM_BLE_ADV_CHANNELS - 1) * SIM_BLE_PDU_SPACING_US + SIM_BLE_ADV_PDU_US + SIM_BLE_GUARD_US });
+    r.ble_pdus += SIM_BLE_ADV_CHANNELS;
+    if (std::isinf(r.ble_first_ms) && uni(rng) < cfg.ble_rx) {
+      r.ble_first_ms = t / 1000.0;
+    }
+  }
+
+  // 802.15.4: beacon loop polls, the pacer decides
+  uint8_t frame[IEEE802154_PSDU_LEN];
+  ieee802154BuildFrame(frame, seq, mac, payload);
+  Ieee802154Pacer pacer;
+  uint64_t now_us = (uint64_t)(uni(rng) * 500);  // sos802154Begin() right after the advertising start
+  pacer.begin((uint32_t)(now_us / 1000), cfg.ieee_interval_ms, rng());
+  const double p_idle = exp(-cfg.load * SIM_BG_FRAME_US / 1e6);
+  bool pending = false, last_ok = false;
+  uint32_t start_ms = 0;
+  while (now_us < window_us) {
+    const uint32_t now_ms = (uint32_t)(now_us / 1000);
+    if (pending) {
+      pending = false;
+      pacer.sent(start_ms, last_ok, rng());
+    }
+    if (pacer.due(now_ms)) {
+      pending = true;
+      start_ms = now_ms;
+      const uint64_t tx_end = now_us + SIM_CCA_US + IEEE802154_FRAME_US;
+      if (overlaps(busy, now_us, tx_end)) {
+        last_ok = false;
+        r.ieee_coexist++;
+      } else if (uni(rng) >= p_idle) {
+        last_ok = false;
+        r.ieee_cca++;
+      } else {
+        last_ok = true;
+        r.ieee_frames++;
+        r.ieee_overlap += overlaps(busy, now_us + SIM_CCA_US, tx_end);
+        frame[2] = seq++;
+        const size_t body = IEEE802154_PSDU_LEN - IEEE802154_FCS_LEN;
+        const uint16_t fcs = ieee802154Fcs(frame, body);  // The radio appends it
+        frame[body] = fcs & 0xFF;
+        frame[body + 1] = fcs >> 8;
+        if (pcap) {
+          pcap->write(t0_us + now_us + SIM_CCA_US, frame, sizeof(frame));
+        }
+        // Stand-in receiver: intact frame, and a damaged copy
+        uint8_t got_mac[6], got_payload[IEEE802154_PAYLOAD_LEN];
+        if (ieee802154ParseFrame(frame, sizeof(frame), true, got_mac, nullptr, got_payload)) {
+          r.decoded++;
+          r.wrong += memcmp(got_mac, mac, 6) != 0 || memcmp(got_payload, payload, sizeof(payload)) != 0;
+        } else {
+          r.wrong++;
+        }
+        uint8_t damaged[IEEE802154_PSDU_LEN];
+        memcpy(damaged, frame, sizeof(damaged));
+        damaged[rng() % sizeof(damaged)] ^= (uint8_t)(1u << (rng() % 8));
+        r.wrong += ieee802154ParseFrame(damaged, sizeof(damaged), true, got_mac, nullptr, got_payload);
+        // Site receiver: link, and no other frame starting during ours
+        if (std::isinf(r.ieee_first_ms) && uni(rng) < cfg.ieee_rx && uni(rng) < exp(-cfg.load * IEEE802154_FRAME_US / 1e6)) {
+          r.ieee_first_ms = (now_us + SIM_CCA_US + IEEE802154_FRAME_US) / 1000.0;
+        }
+      }
+    }
+    now_us += SIM_LOOP_MS * 1000 + (uint64_t)(uni(rng) * 300);  // delay(10) + loop body
+  }
+  return r;
+}
+
+/* ============= Main ============= */
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-11s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  std::sort(v.begin(), v.end());
+  return v.empty() ? INFINITY : v[(size_t)((v.size() - 1) * p / 100)];
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--presses" && i + 1 < argc) cfg.presses = (uint32_t)atoi(argv[++i]);
+    else if (a == "--beacon-ms" && i + 1 < argc) cfg.beacon_ms = (uint32_t)atoi(argv[++i]);
+    else if (a == "--adv-min-ms" && i + 1 < argc) cfg.adv_min_ms = atof(argv[++i]);
+    else if (a == "--adv-max-ms" && i + 1 < argc) cfg.adv_max_ms = atof(argv[++i]);
+    else if (a == "--ieee-interval-ms" && i + 1 < argc) cfg.ieee_interval_ms = (uint32_t)atoi(argv[++i]);
+    else if (a == "--ble-rx" && i + 1 < argc) cfg.ble_rx = atof(argv[++i]);
+    else if (a == "--ieee-rx" && i + 1 < argc) cfg.ieee_rx = atof(argv[++i]);
+    else if (a == "--load" && i + 1 < argc) cfg.load = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else if (a == "--pcap" && i + 1 < argc) cfg.pcap = argv[++i];
+    else {
+      fprintf(stderr, "Usage: %s [--presses N] [--beacon-ms N] [--adv-min-ms N] [--adv-max-ms N] [--ieee-interval-ms N] "
+                      "[--ble-rx P] [--ieee-rx P] [--load N] [--seed N] [--pcap out.pcap]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (cfg.presses == 0 || cfg.ieee_interval_ms < 20 || cfg.adv_min_ms < 20 || cfg.adv_max_ms < cfg.adv_min_ms) {
+    fprintf(stderr, "[!] Need --presses >= 1, --ieee-interval-ms >= 20, 20 <= --adv-min-ms <= --adv-max-ms\n");
+    return 2;
+  }
+
+  PcapWriter pcap;
+  if (!cfg.pcap.empty() && !pcap.open(cfg.pcap, PCAP_LINKTYPE_IEEE802_15_4_WITHFCS)) {
+    fprintf(stderr, "[!] Can't write %s\n", cfg.pcap.c_str());
+    return 1;
+  }
+
+  std::mt19937 rng(cfg.seed);
+  PressResult total;
+  uint64_t ble_estimate = 0;
+  uint32_t ble_hits = 0, ieee_hits = 0, any_hits = 0;
+  std::vector<double> ble_latency, ieee_latency, any_latency;
+  uint8_t seq = 0;
+  const uint32_t adv_interval_us = (uint32_t)((cfg.adv_min_ms + cfg.adv_max_ms) / 2 * 1000);
+  for (uint32_t n = 0; n < cfg.presses; n++) {
+    const PressResult r = runPress(cfg, (uint64_t)n * 60000000, rng, cfg.pcap.empty() ? nullptr : &pcap, seq);
+    total.ble_pdus += r.ble_pdus;
+    total.ieee_frames += r.ieee_frames;
+    total.ieee_coexist += r.ieee_coexist;
+    total.ieee_cca += r.ieee_cca;
+    total.ieee_overlap += r.ieee_overlap;
+    total.decoded += r.decoded;
+    total.wrong += r.wrong;
+    // diagCloseWake(): advertising time / (interval + mean advDelay) x 3
+    ble_estimate += (uint64_t)cfg.beacon_ms * 1000 / (adv_interval_us + SIM_BLE_ADV_DELAY_US) * SIM_BLE_ADV_CHANNELS;
+    const double first = std::min(r.ble_first_ms, r.ieee_first_ms);
+    ble_hits += !std::isinf(r.ble_first_ms);
+    ieee_hits += !std::isinf(r.ieee_first_ms);
+    any_hits += !std::isinf(first);
+    ble_latency.push_back(r.ble_first_ms);
+    ieee_latency.push_back(r.ieee_first_ms);
+    any_latency.push_back(first);
+  }
+  if (!cfg.pcap.empty() && !pcap.close()) {
+    fprintf(stderr, "[!] Can't write %s\n", cfg.pcap.c_str());
+    return 1;
+  }
+
+  // Per press, as the firmware accounts it
+  const double presses = cfg.presses;
+  const double window_s = cfg.beacon_ms / 1000.0;
+  const double ble_airtime_ms = total.ble_pdus * SIM_BLE_ADV_PDU_US / 1000.0 / presses;
+  const double ieee_airtime_ms = total.ieee_frames * IEEE802154_FRAME_US / 1000.0 / presses;
+  const double base_mc = window_s * SIM_CURRENT_ACTIVE_UA / 1000.0;
+  const double ble_mc = window_s * (SIM_CURRENT_ADV_UA - SIM_CURRENT_ACTIVE_UA) / 1000.0;
+  const double ieee_mc = ieee_airtime_ms * SIM_CURRENT_802154_TX_UA / 1e6;
+  printf("[*] %u presses, %u ms window, BLE %.0f-%.0f ms, 802.15.4 every %u ms, %.0f other 802.15.4 frames/s\n",
+         cfg.presses, cfg.beacon_ms, cfg.adv_min_ms, cfg.adv_max_ms, cfg.ieee_interval_ms, cfg.load);
+  printf("    %-10s %10s %10s %12s %12s\n", "radio", "frames", "not sent", "airtime ms", "charge mC");
+  printf("    %-10s %10.1f %10s %12.1f %12.2f\n", "BLE", total.ble_pdus / presses, "-", ble_airtime_ms, ble_mc);
+  printf("    %-10s %10.1f %10.1f %12.1f %12.2f\n", "802.15.4", total.ieee_frames / presses,
+         (total.ieee_coexist + total.ieee_cca) / presses, ieee_airtime_ms, ieee_mc);
+  printf("    %-10s %10s %10s %12s %12.2f   (CPU active for the window)\n", "base", "", "", "", base_mc);
+  printf("[*] 802.15.4 adds %.1f%% to the charge of a press; not sent: %.1f%% lost to BLE, %.1f%% busy channel\n",
+         100 * ieee_mc / (base_mc + ble_mc),
+         100.0 * total.ieee_coexist / (total.ieee_frames + total.ieee_coexist + total.ieee_cca),
+         100.0 * total.ieee_cca / (total.ieee_frames + total.ieee_coexist + total.ieee_cca));
+  printf("    %-12s %9s %12s %12s\n", "heard by", "detected", "p50 ms", "p95 ms");
+  printf("    %-12s %8.2f%% %12.0f %12.0f\n", "BLE only", 100.0 * ble_hits / presses, percentile(ble_latency, 50), percentile(ble_latency, 95));
+  printf("    %-12s %8.2f%% %12.0f %12.0f\n", "802.15.4", 100.0 * ieee_hits / presses, percentile(ieee_latency, 50), percentile(ieee_latency, 95));
+  printf("    %-12s %8.2f%% %12.0f %12.0f\n", "either", 100.0 * any_hits / presses, percentile(any_latency, 50), percentile(any_latency, 95));
+
+  bool ok = true;
+  char detail[200];
+  snprintf(detail, sizeof(detail), "%u frames decoded to their press's BLE payload, %u wrong or damaged-and-accepted",
+           total.decoded, total.wrong);
+  ok &= check("payload", total.wrong == 0 && total.decoded == total.ieee_frames, detail);
+  const double nominal = cfg.beacon_ms / (cfg.ieee_interval_ms + IEEE802154_JITTER_MS / 2.0 + SIM_LOOP_MS / 2.0);
+  snprintf(detail, sizeof(detail), "%u frames during BLE events, %.1f frames per press (nominal %.1f)", total.ieee_overlap,
+           total.ieee_frames / presses, nominal);
+  ok &= check("coexist", total.ieee_overlap == 0 && total.ieee_frames / presses >= 0.9 * nominal, detail);
+  const double err = fabs((double)ble_estimate - total.ble_pdus) / total.ble_pdus;
+  snprintf(detail, sizeof(detail), "BLE PDUs estimated %.1f per press, sent %.1f (%.1f%% off)", ble_estimate / presses,
+           total.ble_pdus / presses, err * 100);
+  ok &= check("accounting", err < 0.1, detail);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file    ieee802154_rx.cpp
+ * @brief   Stand-in 802.15.4 SOS receiver: sniffer capture in, button records out
+ * @details Reads a pcap of raw 802.15.4 frames (link type 195 with FCS, or 230 without),
+ *          e.g. from a sniffer dongle on the site's Thread / Zigbee channel, or written by
+ *          dual_radio_sim. SOS frames are recognized with the firmware's
+ *          ieee802154ParseFrame(), everything else on the channel is skipped.
+ *          Repeats of one press are dropped like on the BLE gateway (GwDedup), and the
+ *          records can be written as gateway UART frames (GwBatcher): the host side then
+ *          reads BLE and 802.15.4 receivers the same way (frame_parser.h).
+ *
+ *          Usage: ieee802154_rx <capture.pcap | -> [--all] [--out stream.bin]
+ *            --all  print every SOS frame, not only the first of each press
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+#include "file_util.h"
+#include "gateway_core.h"
+#include "ieee802154_frame.h"
+#include "pcap_util.h"
+
+int main(int argc, char** argv) {
+  std::string input, out;
+  bool all = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--all") all = true;
+    else if (a == "--out" && i + 1 < argc) out = argv[++i];
+    else if (input.empty() && (a == "-" || a[0] != '-')) input = a;
+    else {
+      input.clear();
+      break;
+    }
+  }
+  if (input.empty()) {
+    fprintf(stderr, "Usage: %s <capture.pcap | -> [--all] [--out stream.bin]\n", argv[0]);
+    return 2;
+  }
+
+  FILE* f = input == "-" ? stdin : fopen(input.c_str(), "rb");
+  uint32_t linktype = 0;
+  std::vector<PcapPacket> packets;
+  const bool read_ok = f && readPcap(f, linktype, packets);
+  if (f && f != stdin) {
+    fclose(f);
+  }
+  if (!read_ok) {
+    fprintf(stderr, "[!] Can't read %s as a pcap capture\n", input.c_str());
+    return 1;
+  }
+  if (linktype != PCAP_LINKTYPE_IEEE802_15_4_WITHFCS && linktype != PCAP_LINKTYPE_IEEE802_15_4_NOFCS) {
+    fprintf(stderr, "[!] Link type %u: need raw 802.15.4 (195 with FCS, 230 without)\n", linktype);
+    return 1;
+  }
+  const bool has_fcs = linktype == PCAP_LINKTYPE_IEEE802_15_4_WITHFCS;
+
+  static GwDedup dedup;
+  static GwBatcher batcher;
+  std::vector<uint8_t> stream;
+  uint64_t sos = 0, presses = 0, other = 0;
+  uint32_t now_ms = 0;
+  for (const PcapPacket& p : packets) {
+    now_ms = (uint32_t)(p.t_us / 1000);
+    if (!out.empty() && batcher.due(now_ms)) {
+      const size_t len = batcher.finish(now_ms);
+      stream.insert(stream.end(), batcher.data(), batcher.data() + len);
+    }
+    uint8_t mac[6], seq, payload[IEEE802154_PAYLOAD_LEN];
+    if (!ieee802154ParseFrame(p.data.data(), p.data.size(), has_fcs, mac, &seq, payload)) {
+      other++;
+      continue;
+    }
+    sos++;
+    adv_beacon_t beacon;
+    advFromPayload(payload, &beacon);  // The 802.15.4 frame carries the v1 payload
+    gw_record_t rec;
+    gwMakeRecord(&rec, mac, 0, 0, beacon);  // No RSSI in a plain capture
+    const bool first = dedup.admit(rec, now_ms);
+    presses += first;
+    if (first || all) {
+      printf("[SOS] %10.3f s  %02X:%02X:%02X:%02X:%02X:%02X  seq=%-3u event=%-6s code=0x%08X timestamp=0x%08X%s\n",
+             p.t_us / 1e6, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], seq, buttonEventName(buttonEventOf(rec.timestamp)),
+             (uint32_t)rec.code, (uint32_t)rec.timestamp, first ? "" : "  (repeat)");
+    }
+    if (first && !out.empty() && batcher.add(rec, now_ms)) {
+      const size_t len = batcher.finish(now_ms);
+      stream.insert(stream.end(), batcher.data(), batcher.data() + len);
+    }
+  }
+  if (!out.empty()) {
+    const size_t len = batcher.finish(now_ms);
+    stream.insert(stream.end(), batcher.data(), batcher.data() + len);
+    if (!writeFile(out, stream)) {
+      fprintf(stderr, "[!] Can't write %s\n", out.c_str());
+      return 1;
+    }
+  }
+  printf("[*] %zu frames: %llu SOS frames (%llu records after dedup), %llu other\n", packets.size(),
+         (unsigned long long)sos, (unsigned long long)presses, (unsigned long long)other);
+  return 0;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file    tx_power_sim.cpp
+ * @brief   Closed-loop TX power (tx_power.h) against fixed levels: delivery and charge per press
+ * @details A button's presses over weeks. Each press is a 10 s beacon; SIM_PDUS of its PDUs
+ *          reach the scan window of the best gateway. Path loss to that gateway is per
+ *          scenario (and day), plus lognormal shadowing per press (body, doors) and Rayleigh
+ *          fading per PDU. A PDU above SIM_SENSITIVITY_DBM is heard; a press is delivered if
+ *          one of its PDUs is. The gateway forwards the first PDU heard and one more every
+ *          GW_DEDUP_WINDOW_MS (gateway_core.h); rc_verify --link-report keeps the best RSSI.
+ *          Every --report-days a maintenance visit sends the latest TX_POWER_REPORTS
+ *          delivered presses (maint_client.py link-report), with the default floor and margin.
+ *
+ *          Scenarios (path loss to the best gateway):
+ *            near       55 dB: the next room
+ *            mid        75 dB
+ *            edge       92 dB: at the edge of coverage at -12 dBm
+ *            moved      60 dB, moved to a far room (85 dB) on day 45
+ *            degrading  65 dB, rising to 88 dB from day 30 to day 60 (a gateway removed, furniture)
+ *
+ *          Charge per press: boot, then the beacon at DIAG_CURRENT_ACTIVE_UA plus the
+ *          advertising share. That share (DIAG_CURRENT_ADV_UA - DIAG_CURRENT_ACTIVE_UA at
+ *          -12 dBm) scales with an estimated TX current per level: the CPU, not the PA,
+ *          dominates a beacon, so lower levels save a few percent at most.
+ *
+ *          Checks (exit code 1 if one fails), closed loop:
+ *            delivery   per scenario, no more presses lost than at the fixed -12 dBm, and at
+ *                       the edge at least SIM_TARGET_DELIVERY from the first report (until
+ *                       then the button uses the configured -12 dBm)
+ *            energy     near a gateway, less charge per press than at the fixed -12 dBm
+ *            recovery   after the link got worse (moved, degrading), presses are delivered
+ *                       again from one report interval after the change
+ *
+ *          Usage: tx_power_sim [--days N] [--presses-per-day N] [--report-days N] [--seed N]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+#include "gateway_core.h"
+#include "tx_power.h"
+
+#define SIM_ACTIVE_UA 15000             /**< DIAG_CURRENT_ACTIVE_UA (diagnostics.h) */
+#define SIM_ADV_UA 16500                /**< DIAG_CURRENT_ADV_UA (diagnostics.h), at -12 dBm */
+#define SIM_BOOT_S 0.3                  /**< Wake to advertising */
+#define SIM_BEACON_S 10.0               /**< CONFIG_DEFAULT_BEACON_TIME_MS */
+#define SIM_PDUS 150                    /**< PDUs of a beacon inside the gateway's scan window */
+#define SIM_SENSITIVITY_DBM -97         /**< Gateway receiver sensitivity (1M PHY) */
+#define SIM_SHADOW_DB 5.0               /**< Shadowing per press, standard deviation */
+#define SIM_CONFIGURED_LEVEL 4          /**< CONFIG_DEFAULT_TX_POWER: -12 dBm */
+#define SIM_TARGET_DELIVERY 0.99
+
+/**
+ * @brief Estimated TX current per level (mA): ESP32-H2 datasheet points, interpolated
+ */
+static const double SIM_TX_MA[TX_POWER_LEVELS] = { 11, 11.5, 12, 12.5, 13, 14, 15, 16.5, 18, 21, 25, 30, 37, 46, 58, 68 };
+
+struct Scenario {
+  const char* name;
+  double loss_db, after_db;  /**< Path loss before / after the change */
+  double change_from, change_to;  /**< Days of the change (a step if equal), 0 = none */
+};
+
+static double lossOn(const Scenario& s, const double day) {
+  if (s.change_to <= 0 || day < s.change_from) return s.loss_db;
+  if (day >= s.change_to) return s.after_db;
+  return s.loss_db + (s.after_db - s.loss_db) * (day - s.change_from) / (s.change_to - s.change_from);
+}
+
+enum class Strategy { FIXED, FIXED_MAX, CLOSED_LOOP };
+
+struct RunResult {
+  uint32_t presses = 0, delivered = 0;
+  uint32_t reported = 0, reported_delivered = 0;  /**< From the first matched report */
+  uint32_t after = 0, after_delivered = 0;  /**< From one report interval after the change */
+  uint32_t probes = 0, reports = 0;
+  double charge_uc = 0, dbm_sum = 0;
+};
+
+static double pressChargeUc(const uint8_t level) {
+  const double adv_ua = (SIM_ADV_UA - SIM_ACTIVE_UA) * SIM_TX_MA[level] / SIM_TX_MA[SIM_CONFIGURED_LEVEL];
+  return SIM_ACTIVE_UA * SIM_BOOT_S + (SIM_ACTIVE_UA + adv_ua) * SIM_BEACON_S;
+}
+
+static RunResult run(const Scenario& s, const Strategy strategy, const int days, const int per_day, const int report_days,
+                     const uint32_t seed) {
+  std::mt19937 rng(seed);  // Same presses and channel for every strategy
+  std::normal_distribution<double> shadow(0, SIM_SHADOW_DB);
+  std::exponential_distribution<double> rayleigh(1.0);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  RunResult r;
+  tx_link_t link = {};
+  struct Heard {
+    uint32_t timestamp;
+    int8_t rssi;
+  };
+  std::vector<Heard> heard;  // Delivered presses, as in the verifier's link report
+  const double recovered_from = s.change_to > 0 ? s.change_to + report_days : INFINITY;
+
+  for (int day = 0; day < days; day++) {
+    for (int p = 0; p < per_day; p++) {
+      const double t = day + (p + uniform(rng)) / per_day;
+      const uint32_t timestamp = BUTTON_CLOCK_SYNCED_BIT | (uint32_t)(t * 86400);
+      uint8_t level = strategy == Strategy::FIXED ? SIM_CONFIGURED_LEVEL : TX_POWER_LEVELS - 1;
+      if (strategy == Strategy::CLOSED_LOOP) {
+        const tx_choice_t choice = txPowerChoose(link, SIM_CONFIGURED_LEVEL);
+        level = choice.level;
+        r.probes += choice.probe;
+        txPowerSent(link, timestamp, level);
+      }
+
+      // Channel: the mean of this press, Rayleigh fading per PDU; the gateway forwards one per dedup window
+      const double mean_dbm = TX_POWER_DBM[level] - lossOn(s, t) - shadow(rng);
+      int best = INT32_MIN;
+      double forwarded_ms = -INFINITY;
+      for (int pdu = 0; pdu < SIM_PDUS; pdu++) {
+        const double rx_dbm = mean_dbm + 10 * log10(rayleigh(rng));
+        const double now_ms = pdu * SIM_BEACON_S * 1000 / SIM_PDUS;
+        if (rx_dbm >= SIM_SENSITIVITY_DBM && now_ms - forwarded_ms >= GW_DEDUP_WINDOW_MS) {
+          forwarded_ms = now_ms;
+          best = std::max(best, (int)lround(rx_dbm));
+        }
+      }
+      const bool delivered = best != INT32_MIN;
+      if (delivered) heard.push_back({ timestamp, (int8_t)best });
+
+      r.presses++;
+      r.delivered += delivered;
+      r.charge_uc += pressChargeUc(level);
+      r.dbm_sum += TX_POWER_DBM[level];
+      if (r.reports > 0) {
+        r.reported++;
+        r.reported_delivered += delivered;
+      }
+      if (t >= recovered_from) {
+        r.after++;
+        r.after_delivered += delivered;
+      }
+    }
+
+    // Maintenance visit: the latest delivered presses
+    if (strategy == Strategy::CLOSED_LOOP && (day + 1) % report_days == 0) {
+      tx_feedback_t fb = { TX_POWER_DEFAULT_FLOOR_DBM, TX_POWER_DEFAULT_MARGIN_DB, TX_POWER_LEVELS - 1, 0, {} };
+      const size_t first = heard.size() > TX_POWER_REPORTS ? heard.size() - TX_POWER_REPORTS : 0;
+      for (size_t i = first; i < heard.size(); i++) {
+        fb.reports[fb.count++] = { heard[i].timestamp, heard[i].rssi };
+      }
+      r.reports += txPowerFeedbackValid(fb) && txPowerFeedback(link, fb) > 0;
+    }
+  }
+  return r;
+}
+
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-9s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int days = 120, per_day = 3, report_days = 14;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--days" && i + 1 < argc) days = atoi(argv[++i]);
+    else if (a == "--presses-per-day" && i + 1 < argc) per_day = atoi(argv[++i]);
+    else if (a == "--report-days" && i + 1 < argc) report_days = atoi(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else {
+      fprintf(stderr, "Usage: %s [--days N] [--presses-per-day N] [--report-days N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (days < 1 || per_day < 1 || report_days < 1) {
+    fprintf(stderr, "[!] --days, --presses-per-day and --report-days must be at least 1\n");
+    return 2;
+  }
+
+  const Scenario scenarios[] = {
+    { "near", 55, 55, 0, 0 },
+    { "mid", 75, 75, 0, 0 },
+    { "edge", 92, 92, 0, 0 },
+    { "moved", 60, 85, 45, 45 },
+    { "degrading", 65, 88, 30, 60 },
+  };
+  const char* names[] = { "fixed -12 dBm", "fixed +20 dBm", "closed loop" };
+
+  printf("[*] %d days, %d presses/day, a link report every %d days; floor %d dBm + margin %d dB, sensitivity %d dBm\n\n",
+         days, per_day, report_days, TX_POWER_DEFAULT_FLOOR_DBM, TX_POWER_DEFAULT_MARGIN_DB, SIM_SENSITIVITY_DBM);
+  printf("| Scenario | TX power | Delivered | Mean level | Charge per press | vs. fixed -12 dBm |\n");
+  printf("|----------|----------|----------:|-----------:|-----------------:|------------------:|\n");
+
+  bool ok = true;
+  char detail[200];
+  for (const Scenario& s : scenarios) {
+    RunResult results[3];
+    for (int k = 0; k < 3; k++) {
+      results[k] = run(s, (Strategy)k, days, per_day, report_days, seed);
+      const RunResult& x = results[k];
+      printf("| %s | %s | %.1f %% | %+.1f dBm | %.1f uAh | %+.1f %% |\n", s.name, names[k], 100.0 * x.delivered / x.presses,
+             x.dbm_sum / x.presses, x.charge_uc / x.presses / 3600, 100.0 * (x.charge_uc / results[0].charge_uc - 1));
+    }
+
+    const RunResult& fixed = results[0];
+    const RunResult& r = results[2];
+    printf("\n[*] %s: %u presses, %u probes, %u report(s) matched\n", s.name, r.presses, r.probes, r.reports);
+    const bool edge = strcmp(s.name, "edge") == 0;
+    snprintf(detail, sizeof(detail), "%u of %u presses delivered (fixed -12 dBm: %u); %u of %u from the first report",
+             r.delivered, r.presses, fixed.delivered, r.reported_delivered, r.reported);
+    ok &= check("delivery", r.delivered >= fixed.delivered &&
+                                (!edge || r.reported_delivered >= SIM_TARGET_DELIVERY * r.reported), detail);
+    if (strcmp(s.name, "near") == 0) {
+      snprintf(detail, sizeof(detail), "%.1f uAh per press (fixed -12 dBm: %.1f uAh)", r.charge_uc / r.presses / 3600,
+               fixed.charge_uc / fixed.presses / 3600);
+      ok &= check("energy", r.charge_uc < fixed.charge_uc, detail);
+    }
+    if (s.change_to > 0) {
+      snprintf(detail, sizeof(detail), "%u of %u presses delivered from day %.0f", r.after_delivered, r.after,
+               s.change_to + report_days);
+      ok &= check("recovery", r.after > 0 && r.after_delivered >= SIM_TARGET_DELIVERY * r.after, detail);
+    }
+    printf("\n");
+  }
+  return ok ? 0 : 1;
+}
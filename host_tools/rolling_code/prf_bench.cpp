@@ -0,0 +1,545 @@
+/**
+ * @file    prf_bench.cpp
+ * @brief   Rolling code PRF comparison: statistical quality, verifier throughput, on-target cost
+ * @details Candidates (rolling_code_prf.h): the current mixer of generateRollingCode(),
+ *          SipHash-2-4, ChaCha8 and AES-128-CMAC, all as (device key, timestamp word) -> u32.
+ *
+ *          Quality
+ *            - Avalanche: flip one input bit (timestamp, or the first 32 key bits), how often
+ *              does each output bit change. Mean and worst |p - 0.5| over the 32x32 matrix.
+ *            - Bit bias: ones frequency of each output bit over random keys and realistic
+ *              timestamps (microseconds since boot). Worst |p - 0.5|.
+ *            - Fleet collisions: codes of N devices for the same timestamp, pairs with equal
+ *              codes against the N^2 / 2^33 of an ideal 32-bit function. A collision is a
+ *              verifier matching a press to the wrong device.
+ *          Throughput: one received (code, timestamp) tested against every key of a fleet,
+ *          scalar and SIMD (GCC vectors, 8 / 4 keys per step; AES-NI for AES).
+ *          Key search: time to try every key against one captured advert at that rate.
+ *          On target: every operation of one code counted and priced for RV32IMAC
+ *          (rolling_code_prf.h), in cycles and microseconds at 96 MHz.
+ *
+ *          Known-answer tests (FIPS-197, RFC 4493, SipHash reference, RFC 8439) and
+ *          SIMD == scalar == counted are checked first. Exit code 1 on failure.
+ *
+ *          Usage: prf_bench [--fleet N] [--samples N] [--quick] [--markdown FILE]
+ *            --markdown  also write the comparison table (cmake --build <dir> --target prf_report
+ *                        regenerates rolling_code/PRF_RESULTS.md)
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "rolling_code_prf.h"
+
+using namespace prf;
+
+#define TARGET_MHZ 96  /**< ESP32-H2 CPU clock with BLE active */
+
+static bool all_ok = true;
+
+static void check(bool ok, const char* name, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+static void check(bool ok, const char* name, const char* fmt, ...) {
+  printf("[%s] %-11s ", ok ? "✓" : "!", name);
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  all_ok = all_ok && ok;
+}
+
+static inline uint64_t splitmix64(uint64_t& x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+
+/* ============= Device Keys ============= */
+/**
+ * @brief Key material of one device, for every candidate
+ */
+struct DeviceKey {
+  uint32_t k[4];   /**< 128-bit key; k[0] is also the mixer's 32-bit seed */
+  uint64_t k0, k1; /**< SipHash key halves */
+  AesCmacKey aes;  /**< Round keys + K2 (a verifier stores these per device) */
+};
+
+static DeviceKey makeKey(const uint32_t* k) {
+  DeviceKey d;
+  memcpy(d.k, k, sizeof(d.k));
+  d.k0 = k[0] | ((uint64_t)k[1] << 32);
+  d.k1 = k[2] | ((uint64_t)k[3] << 32);
+  aesCmacSetup(k, &d.aes);
+  return d;
+}
+
+static DeviceKey randomKey(uint64_t& rng) {
+  uint32_t k[4];
+  for (uint32_t& w : k) w = (uint32_t)splitmix64(rng);
+  return makeKey(k);
+}
+
+
+/* ============= Candidates ============= */
+enum Candidate { MIXER, SIPHASH, CHACHA8, AESCMAC, CANDIDATES };
+static const char* const candidate_names[CANDIDATES] = { "Current mixer", "SipHash-2-4", "ChaCha8", "AES-128-CMAC" };
+static const int candidate_key_bits[CANDIDATES] = { 32, 128, 128, 128 };
+
+static uint32_t code(Candidate c, const DeviceKey& d, uint32_t ts) {
+  switch (c) {
+    case MIXER: return mixer<uint32_t>(d.k[0], ts);
+    case SIPHASH: return (uint32_t)sipHashCode<uint64_t>(d.k0, d.k1, ts);
+    case CHACHA8: return chacha8Code<uint32_t>(d.k, ts);
+    default: return aesCmacCode<uint32_t>(d.aes.rk, d.aes.k2, ts);
+  }
+}
+
+/**
+ * @brief Code computed on the counting types (same value, and the operation tally)
+ */
+static uint32_t countedCode(Candidate c, const DeviceKey& d, uint32_t ts, OpTally* tally) {
+  op_tally = OpTally();
+  uint32_t out;
+  switch (c) {
+    case MIXER: out = mixer<OpCount32>(d.k[0], ts).v; break;
+    case SIPHASH: out = (uint32_t)sipHashCode<OpCount64>(d.k0, d.k1, OpCount64(ts)).v; break;
+    case CHACHA8: {
+      const OpCount32 k[4] = { d.k[0], d.k[1], d.k[2], d.k[3] };
+      out = chacha8Code<OpCount32>(k, ts).v;
+      break;
+    }
+    default: out = aesCmacCode<OpCount32>(d.aes.rk, d.aes.k2, ts).v; break;
+  }
+  *tally = op_tally;
+  return out;
+}
+
+
+/* ============= Known-Answer Tests ============= */
+static bool hexEq(const uint32_t* words, int n, const char* hex) {
+  char buf[80];
+  for (int i = 0; i < n; i++) snprintf(buf + 8 * i, 9, "%08x", words[i]);
+  return strcmp(buf, hex) == 0;
+}
+
+static void knownAnswers(void) {
+  // FIPS-197 C.1
+  const uint32_t key[4] = { 0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f };
+  const uint32_t pt[4] = { 0x00112233, 0x44556677, 0x8899aabb, 0xccddeeff };
+  uint32_t rk[44], ct[4];
+  aesExpandKey(key, rk);
+  aesEncrypt(rk, pt, ct);
+  check(hexEq(ct, 4, "69c4e0d86a7b0430d8cdb78070b4c55a"), "kat aes", "FIPS-197 C.1");
+
+  // RFC 4493: subkey K2 and the empty message (one padded block, like our 4-byte messages)
+  const uint32_t ckey[4] = { 0x2b7e1516, 0x28aed2a6, 0xabf71588, 0x09cf4f3c };
+  AesCmacKey ck;
+  aesCmacSetup(ckey, &ck);
+  const uint32_t empty[4] = { 0x80000000u ^ ck.k2[0], ck.k2[1], ck.k2[2], ck.k2[3] };
+  uint32_t tag[4];
+  aesEncrypt(ck.rk, empty, tag);
+  check(hexEq(ck.k2, 4, "f7ddac306ae266ccf90bc11ee46d513b") && hexEq(tag, 4, "bb1d6929e95937287fa37d129b756746"),
+        "kat cmac", "RFC 4493 K2 and empty message");
+
+  // SipHash-2-4 reference vectors: key 00..0f, messages 00 .. n-1
+  const uint64_t k0 = 0x0706050403020100ULL, k1 = 0x0F0E0D0C0B0A0908ULL;
+  const uint64_t h0 = sipHash24Short<uint64_t>(k0, k1, 0);
+  const uint64_t h4 = sipHash24Short<uint64_t>(k0, k1, 0x03020100ULL | (4ULL << 56));
+  check(h0 == 0x726FDB47DD0E0E31ULL && h4 == 0xCF2794E0277187B7ULL, "kat siphash", "reference vectors, 0 and 4 bytes");
+
+  // RFC 8439 2.3.2 (ChaCha20 block, same core as ChaCha8)
+  const uint32_t in[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, 0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c,
+                            0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c, 0x00000001, 0x09000000, 0x4a000000, 0x00000000 };
+  uint32_t out[4];
+  chachaBlock(in, 20, out, 4);
+  check(hexEq(out, 4, "e4e7f11015593bd11fdd0f50c47120a3"), "kat chacha", "RFC 8439 2.3.2 block");
+}
+
+
+/* ============= Quality ============= */
+struct Quality {
+  double aval_ts_mean, aval_ts_worst;
+  double aval_key_mean, aval_key_worst;
+  double bias_worst;
+  double collisions, collisions_expected;
+};
+
+/**
+ * @brief Avalanche matrix over `samples` random inputs
+ * @param key_bits true: flip the first 32 key bits, false: the timestamp bits
+ */
+static void avalanche(Candidate c, uint32_t samples, bool key_bits, double* mean, double* worst) {
+  static uint32_t flips[32][32];
+  memset(flips, 0, sizeof(flips));
+  uint64_t rng = 0xA5A5 + c * 7 + key_bits;
+  for (uint32_t s = 0; s < samples; s++) {
+    const DeviceKey d = randomKey(rng);
+    const uint32_t ts = (uint32_t)splitmix64(rng);
+    const uint32_t base = code(c, d, ts);
+    for (int i = 0; i < 32; i++) {
+      uint32_t diff;
+      if (key_bits) {
+        uint32_t k[4];
+        memcpy(k, d.k, sizeof(k));
+        k[0] ^= 1u << i;
+        diff = base ^ code(c, makeKey(k), ts);
+      } else {
+        diff = base ^ code(c, d, ts ^ (1u << i));
+      }
+      for (int o = 0; o < 32; o++) flips[i][o] += (diff >> o) & 1;
+    }
+  }
+  double sum = 0;
+  *worst = 0;
+  for (int i = 0; i < 32; i++) {
+    for (int o = 0; o < 32; o++) {
+      const double dev = fabs((double)flips[i][o] / samples - 0.5);
+      sum += dev;
+      *worst = std::max(*worst, dev);
+    }
+  }
+  *mean = sum / 1024;
+}
+
+static double bitBias(Candidate c, uint32_t samples) {
+  uint32_t ones[32] = {};
+  uint64_t rng = 0xB1A5 + c;
+  for (uint32_t s = 0; s < samples; s++) {
+    const DeviceKey d = randomKey(rng);
+    const uint32_t ts = (uint32_t)(splitmix64(rng) % 2000000);  // A wake's timestamp: < 2 s since boot
+    const uint32_t v = code(c, d, ts);
+    for (int o = 0; o < 32; o++) ones[o] += (v >> o) & 1;
+  }
+  double worst = 0;
+  for (int o = 0; o < 32; o++) worst = std::max(worst, fabs((double)ones[o] / samples - 0.5));
+  return worst;
+}
+
+static void fleetCollisions(Candidate c, uint32_t fleet, double* observed, double* expected) {
+  std::vector<uint32_t> codes(fleet);
+  uint64_t rng = 0xC011 + c;
+  const uint32_t ts = 123456;
+  for (uint32_t i = 0; i < fleet; i++) codes[i] = code(c, randomKey(rng), ts);
+  std::sort(codes.begin(), codes.end());
+  uint64_t pairs = 0;
+  for (size_t i = 0, j; i < codes.size(); i = j) {
+    for (j = i + 1; j < codes.size() && codes[j] == codes[i]; j++) {
+    }
+    pairs += (uint64_t)(j - i) * (j - i - 1) / 2;
+  }
+  *observed = (double)pairs;
+  *expected = (double)fleet * (fleet - 1) / 2 / 4294967296.0;
+}
+
+
+/* ============= Verifier Throughput ============= */
+/**
+ * @brief Fleet keys in the layouts the batch loops read
+ */
+struct Fleet {
+  uint32_t n;
+  std::vector<uint32_t> k[4];      /**< Structure of arrays: k[w][device] */
+  std::vector<uint64_t> k0, k1;
+  std::vector<AesCmacKey> aes;
+  struct AesNiKey {
+    alignas(16) uint8_t block[12][16];  /**< 11 round keys + K2, AES-NI byte order */
+  };
+  std::vector<AesNiKey> aes_ni;
+};
+
+static Fleet makeFleet(uint32_t n) {
+  Fleet f;
+  f.n = n;
+  uint64_t rng = 0xF1EE7;
+  for (int w = 0; w < 4; w++) f.k[w].resize(n);
+  f.k0.resize(n);
+  f.k1.resize(n);
+  f.aes.resize(n);
+  for (uint32_t i = 0; i < n; i++) {
+    const DeviceKey d = randomKey(rng);
+    for (int w = 0; w < 4; w++) f.k[w][i] = d.k[w];
+    f.k0[i] = d.k0;
+    f.k1[i] = d.k1;
+    f.aes[i] = d.aes;
+  }
+  f.aes_ni.resize(n);
+  for (uint32_t i = 0; i < n; i++) {
+    for (int r = 0; r < 12; r++) {
+      const uint32_t* w = r < 11 ? f.aes[i].rk + 4 * r : f.aes[i].k2;
+      for (int j = 0; j < 16; j++) f.aes_ni[i].block[r][j] = (uint8_t)(w[j / 4] >> (24 - 8 * (j % 4)));
+    }
+  }
+  return f;
+}
+
+static DeviceKey fleetKey(const Fleet& f, uint32_t i) {
+  DeviceKey d;
+  for (int w = 0; w < 4; w++) d.k[w] = f.k[w][i];
+  d.k0 = f.k0[i];
+  d.k1 = f.k1[i];
+  d.aes = f.aes[i];
+  return d;
+}
+
+// One key at a time: keep the compiler from vectorizing this loop on its own
+__attribute__((optimize("no-tree-vectorize"))) static uint32_t verifyScalar(Candidate c, const Fleet& f, uint32_t ts,
+                                                                             uint32_t target) {
+  uint32_t matches = 0;
+  switch (c) {
+    case MIXER:
+      for (uint32_t i = 0; i < f.n; i++) matches += mixer<uint32_t>(f.k[0][i], ts) == target;
+      break;
+    case SIPHASH:
+      for (uint32_t i = 0; i < f.n; i++) matches += (uint32_t)sipHashCode<uint64_t>(f.k0[i], f.k1[i], ts) == target;
+      break;
+    case CHACHA8:
+      for (uint32_t i = 0; i < f.n; i++) {
+        const uint32_t k[4] = { f.k[0][i], f.k[1][i], f.k[2][i], f.k[3][i] };
+        matches += chacha8Code<uint32_t>(k, ts) == target;
+      }
+      break;
+    default:
+      for (uint32_t i = 0; i < f.n; i++) matches += aesCmacCode<uint32_t>(f.aes[i].rk, f.aes[i].k2, ts) == target;
+      break;
+  }
+  return matches;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("aes,sse4.1"))) static uint32_t verifyAesNi(const Fleet& f, uint32_t ts, uint32_t target) {
+  const __m128i msg = _mm_set_epi32(0, 0, 0x80, (int)ts);  // Bytes: ts little endian, 0x80, zeros
+  uint32_t matches = 0;
+  for (uint32_t i = 0; i + 4 <= f.n; i += 4) {  // Four devices interleaved: the AES unit is pipelined
+    const __m128i* k[4];
+    for (int j = 0; j < 4; j++) k[j] = (const __m128i*)f.aes_ni[i + j].block;
+    __m128i s[4];
+    for (int j = 0; j < 4; j++) s[j] = _mm_xor_si128(_mm_xor_si128(msg, k[j][11]), k[j][0]);
+    for (int r = 1; r < 10; r++) {
+      for (int j = 0; j < 4; j++) s[j] = _mm_aesenc_si128(s[j], k[j][r]);
+    }
+    for (int j = 0; j < 4; j++) {
+      s[j] = _mm_aesenclast_si128(s[j], k[j][10]);
+      matches += __builtin_bswap32((uint32_t)_mm_cvtsi128_si32(s[j])) == target;
+    }
+  }
+  return matches;
+}
+#endif
+
+static uint32_t lanesSum(const u32x8& v) {
+  uint32_t sum = 0;
+  for (int j = 0; j < 8; j++) sum += v[j];
+  return sum;
+}
+
+/**
+ * @brief SIMD batch verification
+ * @return uint32_t Matches, or UINT32_MAX if there is no SIMD path on this machine
+ */
+static uint32_t verifySimd(Candidate c, const Fleet& f, uint32_t ts, uint32_t target) {
+  u32x8 acc = Word<u32x8>::of(0);
+  u64x4 acc64 = Word<u64x4>::of(0);
+  const uint32_t n8 = f.n & ~7u, n4 = f.n & ~3u;
+  switch (c) {
+    case MIXER: {
+      const u32x8 t = Word<u32x8>::of(ts);
+      for (uint32_t i = 0; i < n8; i += 8) {
+        u32x8 seed;
+        memcpy(&seed, &f.k[0][i], sizeof(seed));
+        acc -= (u32x8)(mixer<u32x8>(seed, t) == target);  // Lanes are -1 where equal
+      }
+      return lanesSum(acc);
+    }
+    case SIPHASH: {
+      const u64x4 t = Word<u64x4>::of(ts);
+      for (uint32_t i = 0; i < n4; i += 4) {
+        u64x4 k0, k1;
+        memcpy(&k0, &f.k0[i], sizeof(k0));
+        memcpy(&k1, &f.k1[i], sizeof(k1));
+        acc64 -= (u64x4)((sipHashCode<u64x4>(k0, k1, t) & 0xFFFFFFFFULL) == (uint64_t)target);
+      }
+      return (uint32_t)(acc64[0] + acc64[1] + acc64[2] + acc64[3]);
+    }
+    case CHACHA8: {
+      const u32x8 t = Word<u32x8>::of(ts);
+      for (uint32_t i = 0; i < n8; i += 8) {
+        u32x8 k[4];
+        for (int w = 0; w < 4; w++) memcpy(&k[w], &f.k[w][i], sizeof(k[w]));
+        acc -= (u32x8)(chacha8Code<u32x8>(k, t) == target);
+      }
+      return lanesSum(acc);
+    }
+    default:
+#if defined(__x86_64__)
+      if (__builtin_cpu_supports("aes")) {
+        return verifyAesNi(f, ts, target);
+      }
+#endif
+      return UINT32_MAX;
+  }
+}
+
+/**
+ * @brief Keys per second of a verification pass, repeated for at least `min_s`
+ */
+template <typename Fn>
+static double keysPerSecond(const Fleet& f, double min_s, Fn pass) {
+  const auto t0 = std::chrono::steady_clock::now();
+  uint64_t keys = 0;
+  double s = 0;
+  do {
+    pass();
+    keys += f.n;
+    s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (s < min_s);
+  return keys / s;
+}
+
+
+/* ============= Main ============= */
+struct Row {
+  Quality q;
+  double scalar_mps, simd_mps;  /**< Million keys per second, simd < 0: no SIMD path */
+  uint64_t cycles;
+};
+
+static std::string table(const Row* rows, uint32_t fleet, uint32_t samples) {
+  std::string t;
+  char line[512];
+  snprintf(line, sizeof(line),
+           "| PRF | Key | Avalanche, timestamp (mean / worst) | Avalanche, key (mean / worst) | Bit bias (worst) | "
+           "Collisions in %u devices (ideal) | Verify scalar | Verify SIMD | Key search, one core | On target (RV32, %d MHz) |\n"
+           "|-----|-----|-----|-----|-----|-----|-----|-----|-----|-----|\n",
+           fleet, TARGET_MHZ);
+  t += line;
+  for (int c = 0; c < CANDIDATES; c++) {
+    const Row& r = rows[c];
+    char simd[32];
+    if (r.simd_mps < 0) snprintf(simd, sizeof(simd), "n/a");
+    else snprintf(simd, sizeof(simd), "%.1f M keys/s", r.simd_mps);
+    // Recovering the key from one captured advert: every key tried at the verifier's best rate
+    char search[32];
+    const double search_s = pow(2.0, candidate_key_bits[c]) / (std::max(r.scalar_mps, r.simd_mps) * 1e6);
+    if (search_s < 1e5) snprintf(search, sizeof(search), "%.1f s", search_s);
+    else snprintf(search, sizeof(search), "%.0e years", search_s / 3.156e7);
+    snprintf(line, sizeof(line), "| %s | %d bit | %.4f / %.3f | %.4f / %.3f | %.4f | %.0f (%.1f) | %.1f M keys/s | %s | %s | %llu cycles, %.2f us |\n",
+             candidate_names[c], candidate_key_bits[c], r.q.aval_ts_mean, r.q.aval_ts_worst, r.q.aval_key_mean,
+             r.q.aval_key_worst, r.q.bias_worst, r.q.collisions, r.q.collisions_expected, r.scalar_mps, simd, search,
+             (unsigned long long)r.cycles, (double)r.cycles / TARGET_MHZ);
+    t += line;
+  }
+  // Deviations an ideal function shows from sampling noise alone (~1 and ~3.5 sigma over 1024 cells)
+  const double sigma = 0.5 / sqrt((double)samples);
+  snprintf(line, sizeof(line),
+           "\nIdeal function with these sample sizes: avalanche mean ~%.4f, worst ~%.3f (%u inputs); "
+           "bit bias worst ~%.4f (%u inputs).\n",
+           sigma * 0.798, sigma * 3.5, samples, 0.5 / sqrt(samples * 16.0) * 2.7, samples * 16);
+  t += line;
+  return t;
+}
+
+int main(int argc, char** argv) {
+  uint32_t fleet = 1000000, samples = 4096, verify_fleet = 1 << 16;
+  double min_s = 0.3;
+  std::string markdown;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--fleet" && i + 1 < argc) fleet = (uint32_t)atoi(argv[++i]);
+    else if (a == "--samples" && i + 1 < argc) samples = (uint32_t)atoi(argv[++i]);
+    else if (a == "--markdown" && i + 1 < argc) markdown = argv[++i];
+    else if (a == "--quick") {
+      fleet = 100000;
+      samples = 1024;
+      min_s = 0.05;
+    } else {
+      fprintf(stderr, "Usage: %s [--fleet N] [--samples N] [--quick] [--markdown FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  printf("[*] Known answers and consistency\n");
+  knownAnswers();
+  const Fleet f = makeFleet(verify_fleet);
+  const uint32_t ts = 0x0001E240;
+  Row rows[CANDIDATES];
+  for (int ci = 0; ci < CANDIDATES; ci++) {
+    const Candidate c = (Candidate)ci;
+    // Target: the code of one device in the fleet; every pass must find it
+    const uint32_t target = code(c, fleetKey(f, 4711), ts);
+    const uint32_t scalar = verifyScalar(c, f, ts, target);
+    const uint32_t simd = verifySimd(c, f, ts, target);
+    OpTally tally;
+    const uint32_t counted = countedCode(c, fleetKey(f, 4711), ts, &tally);
+    check(scalar >= 1 && (simd == UINT32_MAX || simd == scalar) && counted == target, "consistent",
+          "%-13s scalar %u match(es), SIMD %s, counted == scalar", candidate_names[c], scalar,
+          simd == UINT32_MAX ? "n/a" : std::to_string(simd).c_str());
+    rows[c].cycles = opCycles(tally);
+  }
+  if (!all_ok) {
+    printf("[!] Failed, no comparison\n");
+    return 1;
+  }
+
+  for (int ci = 0; ci < CANDIDATES; ci++) {
+    const Candidate c = (Candidate)ci;
+    printf("[*] %s\n", candidate_names[c]);
+    Row& r = rows[c];
+    avalanche(c, samples, false, &r.q.aval_ts_mean, &r.q.aval_ts_worst);
+    avalanche(c, samples, true, &r.q.aval_key_mean, &r.q.aval_key_worst);
+    r.q.bias_worst = bitBias(c, samples * 16);
+    fleetCollisions(c, fleet, &r.q.collisions, &r.q.collisions_expected);
+    const uint32_t target = code(c, fleetKey(f, 4711), ts);
+    volatile uint32_t sink = 0;
+    r.scalar_mps = keysPerSecond(f, min_s, [&] { sink = sink + verifyScalar(c, f, ts, target); }) / 1e6;
+    r.simd_mps = verifySimd(c, f, ts, target) == UINT32_MAX
+                     ? -1
+                     : keysPerSecond(f, min_s, [&] { sink = sink + verifySimd(c, f, ts, target); }) / 1e6;
+  }
+
+  // Key derivation of the current firmware: generateSeed() mixes MAC bytes 0-3 only
+  {
+    uint32_t seeds[256];
+    for (uint32_t i = 0; i < 256; i++) {
+      const uint8_t mac[6] = { 0x24, 0x6F, 0x28, 0x00, (uint8_t)(i >> 8), (uint8_t)i };  // Sequentially burned MACs
+      seeds[i] = (mac[0] << 24) | (mac[1] << 16) | (mac[2] << 8) | mac[3];
+    }
+    std::sort(seeds, seeds + 256);
+    const long distinct = std::unique(seeds, seeds + 256) - seeds;
+    printf("[!] generateSeed(): 256 sequential custom MACs give %ld distinct seed(s); any 128-bit candidate needs a\n"
+           "    per-device key derived from the full MAC (or provisioned), not the current seed\n",
+           distinct);
+  }
+
+  const std::string t = table(rows, fleet, samples);
+  printf("\n%s", t.c_str());
+  if (!markdown.empty()) {
+    FILE* out = fopen(markdown.c_str(), "w");
+    if (!out) {
+      fprintf(stderr, "[!] Can't write %s\n", markdown.c_str());
+      return 1;
+    }
+    fprintf(out,
+            "# Rolling code PRF comparison\n\n"
+            "Generated by `prf_bench` (host_tools/rolling_code/prf_bench.cpp). Regenerate with:\n\n"
+            "```bash\ncmake --build _gate_build --target prf_report\n```\n\n"
+            "Verification: one received code tested against %u device keys. Throughput is host dependent.\n"
+            "On-target cost: counted RV32IMAC instructions (no Zbb, multiply %d cycles, load %d cycles), "
+            "before key setup. AES figures are for software AES; the ESP32-H2 also has an AES peripheral.\n\n%s",
+            verify_fleet, PRF_RV32_MUL_CYCLES, PRF_RV32_LOAD_CYCLES, t.c_str());
+    fclose(out);
+    printf("[✓] Table written to %s\n", markdown.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,572 @@
+/**
+ * @file    rc_bench.cpp
+ * @brief   Verifier benchmark: fixed fleets and traffic mixes, per-stage latency, baseline compare
+ * @details Datasets are fleets of 10^4, 10^6 and 10^7 buttons (--sizes). Seeds are derived
+ *          exactly like generateSeed() (rolling_code.h) from a product key that depends on
+ *          --seed only, and from custom MACs spread over bytes 1-3 (SeedV1 ignores bytes
+ *          4-5, so sequential MACs would share a seed). Each dataset is written once as a
+ *          fleet file into --data-dir and reused, so every run verifies the same fleet.
+ *
+ *          Traffic mixes, --records gateway records each, as a frame stream (gateway_core.h):
+ *            quiet      single presses, one record per frame
+ *            surge      mass press: full frames, each press heard by two gateways
+ *            flood      90% forged codes with current timestamps (a full search each)
+ *            duplicate  each press 8 times (gateway repeats, overlapping gateways)
+ *            site       a site's day: buttons fixed at one of RC_BENCH_SITE_GATEWAYS gateways
+ *                       (half of them heard by the next one too), each press forwarded
+ *                       every GW_DEDUP_WINDOW_MS while on air, and RC_BENCH_SITE_REPRESS of
+ *                       the presses by a button that pressed a little earlier
+ *          Records are v1 (no device hint): a scan is the whole fleet.
+ *
+ *          Designs (rc_verifier.h): "scan" is the V1 fleet as it is today (RcMigration::OFF).
+ *          "dual" is the same fleet halfway through a scheme migration: every button has a
+ *          V2 seed and --migrated of them send V2, verified with RcMigration::FALLBACK. Its
+ *          search column against scan's is the cost of the migration, and the seeds the
+ *          fallback evaluated (forged codes are searched in both schemes) are reported.
+ *          "hot" is scan with the hot sets (RcOrder::HOT, rc_hot_set.h) searched first.
+ *          Every row has the mixer evaluations per record: the work the search order saves.
+ *
+ *          Measured per dataset: cold start (fleet file to a ready index), index and replay
+ *          state bytes, peak RSS. Per mix: records per second through the whole pipeline and
+ *          p50 / p99 / p99.9 / max of each stage (rc_verifier.h): parse (per frame), window,
+ *          search, replay check. Stage timers cost ~20 ns per record; they are in the
+ *          throughput too. A mix that takes less than RC_BENCH_MIN_S is run again (fresh
+ *          replay state) until it did; verdicts are counted on the first pass.
+ *
+ *          --json writes one JSON object per dataset and mix (JSON Lines). --baseline reads
+ *          such a file and compares: a throughput or search p50 more than --tolerance worse
+ *          than the baseline is a regression (exit code 1). Tail percentiles are in the file
+ *          but not compared: on a shared machine they move more than any code change would.
+ *          A genuine press that isn't accepted fails the run as well.
+ *
+ *          Usage: rc_bench [--sizes 1e4,1e6,1e7] [--records N] [--seed N] [--data-dir DIR]
+ *                          [--json results.jsonl] [--baseline results.jsonl] [--tolerance F]
+ *                          [--migrated F]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+#include "fleet_file.h"
+#include "frame_parser.h"
+#include "gateway_core.h"
+#include "rc_verifier.h"
+
+using gwlink::FrameParser;
+using gwlink::FrameView;
+using gwlink::MirrorRing;
+using Clock = std::chrono::steady_clock;
+
+#define RC_BENCH_PRODUCT_KEY 0x12345678u  /**< Stand-in for PRODUCT_KEY, mixed with --seed */
+#define RC_BENCH_BATCH_ID 0x0042u
+#define RC_BENCH_NOW_UNIX 1767225600u     /**< Verifier clock: 2026-01-01 00:00:00 UTC */
+#define RC_BENCH_SPREAD_S 120             /**< Press timestamps span this much around now */
+#define RC_BENCH_MAX_DEVICES (1u << 24)   /**< MAC bytes 1-3 */
+#define RC_BENCH_MIN_S 0.5                /**< A mix is repeated until it ran this long */
+#define RC_BENCH_SITE_GATEWAYS 16         /**< site mix: gateways of the site */
+#define RC_BENCH_SITE_PRESS_MS 1000       /**< site mix: one press somewhere on the site this often */
+#define RC_BENCH_SITE_BEACON_MS 10000     /**< site mix: a press is on air this long (BEACON_DURATION_MS) */
+#define RC_BENCH_SITE_REPRESS 0.5         /**< site mix: share of presses by a recent presser */
+#define RC_BENCH_SITE_RECENT 32           /**< site mix: ... one of the last this many */
+
+struct TrafficMix {
+  const char* name;
+  double forged;       /**< Share of records with a random code (current timestamp) */
+  uint32_t repeats;    /**< Records per genuine press */
+  uint32_t per_frame;  /**< Records per frame */
+  uint32_t gateways;   /**< Gateways the records come from (repeat r from gateway r % gateways) */
+};
+
+static const TrafficMix MIXES[] = {
+  { "quiet", 0.0, 1, 1, 1 },
+  { "surge", 0.0, 2, GW_BATCH_MAX_RECORDS, 2 },
+  { "flood", 0.9, 1, GW_BATCH_MAX_RECORDS, 1 },
+  { "duplicate", 0.0, 8, GW_BATCH_MAX_RECORDS, 2 },
+  { "site", 0.0, RC_BENCH_SITE_BEACON_MS / GW_DEDUP_WINDOW_MS, 1, RC_BENCH_SITE_GATEWAYS },
+};
+
+struct Percentiles {
+  double p50, p99, p999, max;
+};
+
+static Percentiles percentiles(std::vector<double>& ns) {
+  if (ns.empty()) {
+    return { 0, 0, 0, 0 };
+  }
+  std::sort(ns.begin(), ns.end());
+  const auto at = [&](double q) { return ns[std::min(ns.size() - 1, (size_t)(q * (double)ns.size()))]; };
+  return { at(0.5), at(0.99), at(0.999), ns.back() };
+}
+
+struct BenchResult {
+  std::string design = "scan";  /**< Verifier design (rc_verifier.h: linear seed search) */
+  uint32_t devices = 0;
+  uint32_t seeds = 0;
+  std::string mix;
+  uint64_t records = 0;
+  double records_per_s = 0;
+  Percentiles parse, window, search, replay;
+  uint64_t verdicts[(int)RcVerdict::COUNT] = {};
+  uint64_t genuine_rejected = 0;
+  uint64_t forged_accepted = 0;
+  double evals_per_record = 0;     /**< Mixer evaluations per searched record */
+  uint64_t fallbacks = 0;          /**< dual: searches of the other scheme */
+  double fallback_seeds_pct = 0;   /**< dual: seeds evaluated by them, % of the first searches */
+  double cold_start_ms = 0;
+  size_t index_bytes = 0;
+  long peak_rss_kb = 0;
+};
+
+/* ============= Datasets ============= */
+
+static uint32_t productKey(const uint32_t seed) {
+  return RC_BENCH_PRODUCT_KEY ^ (seed * 0x9E3779B9u);
+}
+
+static void benchMac(const uint32_t i, uint8_t* mac) {
+  const uint8_t m[6] = { 0x24, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i, 0x00, 0x01 };
+  memcpy(mac, m, 6);
+}
+
+/**
+ * @return std::string Path of the fleet file of this dataset, written if it doesn't exist yet
+ */
+static std::string dataset(const std::string& dir, const uint32_t devices, const uint32_t seed) {
+  const std::string path = dir + "/fleet_" + std::to_string(devices) + "_" + std::to_string(seed) + ".csv";
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    return path;
+  }
+  mkdir(dir.c_str(), 0755);
+  std::vector<FleetEntry> fleet(devices);
+  for (uint32_t i = 0; i < devices; i++) {
+    benchMac(i, fleet[i].mac);
+    fleet[i].seed = rolling_code::RollingCodeV1::seed(productKey(seed), RC_BENCH_BATCH_ID, fleet[i].mac);
+  }
+  const std::string tmp = path + ".tmp";
+  if (!writeFleet(tmp, fleet) || rename(tmp.c_str(), path.c_str()) != 0) {
+    fprintf(stderr, "[!] Can't write %s\n", path.c_str());
+    exit(1);
+  }
+  printf("[*] Wrote %s\n", path.c_str());
+  return path;
+}
+
+/**
+ * @brief The dataset halfway through a migration: V2 seeds for all, enrolled on V1
+ */
+static std::vector<FleetEntry> dualFleet(std::vector<FleetEntry> fleet, const uint32_t seed) {
+  for (FleetEntry& e : fleet) {
+    e.has_v2 = true;
+    e.seed_v2 = rolling_code::RollingCodeV2::seed(productKey(seed), RC_BENCH_BATCH_ID, e.mac);
+  }
+  return fleet;
+}
+
+/**
+ * @return bool true if the button runs V2 firmware (a fixed share of the fleet)
+ */
+static bool migratedButton(const FleetEntry& e, const double migrated) {
+  return ((e.seed * 0x9E3779B1u) >> 8) < (uint32_t)(migrated * (1u << 24));
+}
+
+/* ============= Traffic ============= */
+
+struct Traffic {
+  std::vector<uint8_t> stream;
+  std::vector<uint8_t> genuine;   /**< Per record, in stream order */
+  std::vector<uint16_t> gateway;  /**< Per record: the gateway that forwarded it */
+};
+
+/**
+ * @brief Code of a genuine press: V2 from a migrated button of a dual index, else V1
+ */
+static void genuineCode(const SeedIndex& index, const FleetEntry& button, const double migrated, gw_record_t& rec) {
+  if (index.dual() && migratedButton(button, migrated)) {
+    rec.timestamp = buttonSchemeStamp(rec.timestamp, ROLLING_CODE_SCHEME_V2);
+    rec.code = rolling_code::RollingCodeV2::code(button.seed_v2, rec.timestamp);
+  } else {
+    rec.code = rolling_code::RollingCodeV1::code(button.seed, rec.timestamp);
+  }
+}
+
+struct SiteRecord {
+  uint64_t t_ms;
+  uint16_t gateway;
+  uint32_t button;
+  uint32_t clock_s;
+};
+
+/**
+ * @brief Receptions of the site mix in time order: which button, when, through which gateway
+ */
+static std::vector<SiteRecord> siteRecords(const SeedIndex& index, const TrafficMix& mix, const uint64_t records,
+                                           const uint32_t first_s, std::mt19937& rng) {
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  const uint64_t presses = records / mix.repeats + 1;
+  const uint64_t on_air = RC_BENCH_SITE_BEACON_MS / RC_BENCH_SITE_PRESS_MS;
+  std::vector<SiteRecord> site;
+  std::vector<uint32_t> recent;
+  std::map<uint32_t, uint64_t> last_press;
+  for (uint64_t p = 0; p < presses; p++) {
+    // A button still on air doesn't press again (its next press would make the rest replays)
+    uint32_t b;
+    do {
+      b = !recent.empty() && uni(rng) < RC_BENCH_SITE_REPRESS ? recent[rng() % recent.size()]
+                                                               : (uint32_t)(rng() % index.buttons.size());
+    } while (last_press.count(b) && p - last_press[b] <= on_air);
+    last_press[b] = p;
+    if (recent.size() < RC_BENCH_SITE_RECENT) recent.push_back(b);
+    else recent[p % RC_BENCH_SITE_RECENT] = b;
+    const uint32_t clock_s = first_s + (uint32_t)(p * RC_BENCH_SPREAD_S / presses);
+    const uint16_t home = (uint16_t)(((b * 0x9E3779B1u) >> 16) % mix.gateways);
+    const uint32_t heard_by = 1 + ((b * 0x85EBCA6Bu) >> 31);
+    for (uint32_t g = 0; g < heard_by; g++) {
+      for (uint32_t r = 0; r < mix.repeats; r++) {
+        site.push_back({ p * RC_BENCH_SITE_PRESS_MS + r * GW_DEDUP_WINDOW_MS + rng() % 100,
+                         (uint16_t)((home + g) % mix.gateways), b, clock_s });
+      }
+    }
+  }
+  std::stable_sort(site.begin(), site.end(), [](const SiteRecord& a, const SiteRecord& b) { return a.t_ms < b.t_ms; });
+  site.resize(std::min<size_t>(site.size(), records));
+  return site;
+}
+
+/**
+ * @param migrated Share of buttons sending V2 (dual index only)
+ */
+static Traffic makeTraffic(const SeedIndex& index, const TrafficMix& mix, const uint64_t records, const uint32_t seed,
+                           const double migrated) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  static GwBatcher batcher;
+  batcher = GwBatcher();
+  Traffic t;
+  uint32_t in_frame = 0, now_ms = 0;
+  const uint32_t first_s = RC_BENCH_NOW_UNIX - BUTTON_CLOCK_EPOCH_UNIX - RC_BENCH_SPREAD_S / 2;
+  const auto push = [&](const gw_record_t& rec, bool genuine, uint16_t gateway) {
+    batcher.add(rec, now_ms);
+    t.genuine.push_back(genuine);
+    t.gateway.push_back(gateway);
+    if (++in_frame == mix.per_frame || t.genuine.size() == records) {
+      const size_t len = batcher.finish(now_ms++);
+      t.stream.insert(t.stream.end(), batcher.data(), batcher.data() + len);
+      in_frame = 0;
+    }
+  };
+  if (strcmp(mix.name, "site") == 0) {
+    for (const SiteRecord& s : siteRecords(index, mix, records, first_s, rng)) {
+      gw_record_t rec = {};
+      const uint32_t a = s.button * 0x9E3779B1u;  // A button's advertising address is static
+      const uint8_t mac[6] = { 0xC0, 0x5E, (uint8_t)(a >> 24), (uint8_t)(a >> 16), (uint8_t)(a >> 8), (uint8_t)a };
+      memcpy(rec.mac, mac, 6);
+      rec.format = ADV_FORMAT_V1;
+      rec.rssi = (int8_t)(-40 - (int)(rng() % 50));
+      rec.timestamp = buttonEventStamp(buttonClockWord(s.clock_s, true), ButtonEvent::SOS);
+      genuineCode(index, index.buttons[s.button], migrated, rec);
+      push(rec, true, s.gateway);
+    }
+    return t;
+  }
+  while (t.genuine.size() < records) {
+    // Timestamps rise with the record count: a button pressing twice is never a replay
+    const uint32_t clock_s = first_s + (uint32_t)(t.genuine.size() * RC_BENCH_SPREAD_S / records);
+    gw_record_t rec = {};
+    for (uint8_t& b : rec.mac) b = (uint8_t)rng();  // Advertising address: not the seed's MAC
+    rec.format = ADV_FORMAT_V1;  // No device hint: every search scans the whole fleet
+    rec.addr_type = 0;
+    rec.rssi = (int8_t)(-40 - (int)(rng() % 50));
+    rec.timestamp = buttonEventStamp(buttonClockWord(clock_s, true), ButtonEvent::SOS);
+    if (uni(rng) < mix.forged) {
+      rec.code = rng();
+      rec.timestamp = buttonSchemeStamp(rec.timestamp, index.dual() && uni(rng) < migrated ? ROLLING_CODE_SCHEME_V2
+                                                                                            : ROLLING_CODE_SCHEME_V1);
+      push(rec, false, 0);
+      continue;
+    }
+    genuineCode(index, index.buttons[rng() % index.buttons.size()], migrated, rec);
+    for (uint32_t r = 0; r < mix.repeats && t.genuine.size() < records; r++) {
+      rec.rssi = (int8_t)(-40 - (int)(rng() % 50));
+      push(rec, true, (uint16_t)(r % mix.gateways));
+    }
+  }
+  return t;
+}
+
+/* ============= Run ============= */
+
+static double nsSince(const Clock::time_point t0, const Clock::time_point t1) {
+  return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+static void runMix(RcVerifier& verifier, const Traffic& traffic, BenchResult& r) {
+  MirrorRing ring;
+  if (!ring.init(1 << 16)) {
+    fprintf(stderr, "[!] Can't map the ring\n");
+    exit(1);
+  }
+  FrameParser<> parser(ring);
+  std::vector<double> parse_ns, window_ns, search_ns, replay_ns;
+  uint64_t records = 0;
+  double seconds = 0;
+
+  // Short mixes (small fleets) are repeated: one pass of a few ms is all timer noise
+  for (uint32_t pass = 0; pass == 0 || seconds < RC_BENCH_MIN_S; pass++) {
+    verifier.reset();
+    size_t pos = 0, record = 0;
+    const auto start = Clock::now();
+    while (pos < traffic.stream.size()) {
+      const size_t len = std::min({ (size_t)4096, traffic.stream.size() - pos, ring.space() });
+      memcpy(ring.writePtr(), &traffic.stream[pos], len);
+      ring.commit(len);
+      pos += len;
+      FrameView view;
+      for (;;) {
+        const auto p0 = Clock::now();
+        if (!parser.next(view)) {
+          break;
+        }
+        parse_ns.push_back(nsSince(p0, Clock::now()));
+        for (uint8_t i = 0; i < view.count; i++, record++) {
+          const gw_record_t& rec = view.records[i];
+          RcCheck check;
+          const auto t0 = Clock::now();
+          const bool in_window = verifier.window(rec, RC_BENCH_NOW_UNIX, check);
+          const auto t1 = Clock::now();
+          window_ns.push_back(nsSince(t0, t1));
+          if (!in_window) {
+            check.verdict = RcVerdict::STALE;
+          } else {
+            verifier.search(rec, check, traffic.gateway[record]);
+            const auto t2 = Clock::now();
+            verifier.accept(rec, check, traffic.gateway[record]);
+            search_ns.push_back(nsSince(t1, t2));
+            replay_ns.push_back(nsSince(t2, Clock::now()));
+          }
+          if (pass == 0) {
+            r.verdicts[(int)check.verdict]++;
+            const bool accepted = check.verdict == RcVerdict::OK || check.verdict == RcVerdict::AMB;
+            r.genuine_rejected += traffic.genuine[record] && !accepted;
+            r.forged_accepted += !traffic.genuine[record] && accepted;
+          }
+        }
+      }
+    }
+    seconds += std::chrono::duration<double>(Clock::now() - start).count();
+    records += record;
+  }
+  r.records = traffic.genuine.size();
+  r.records_per_s = (double)records / seconds;
+  r.parse = percentiles(parse_ns);
+  r.window = percentiles(window_ns);
+  r.search = percentiles(search_ns);
+  r.replay = percentiles(replay_ns);
+  const RcSearchStats& searched = verifier.searchStats();  // Of the last pass: each pass starts from reset()
+  r.evals_per_record = searched.searches ? (double)searched.evaluations / (double)searched.searches : 0;
+  const RcMigrationStats& m = verifier.migration();
+  r.fallbacks = m.fallbacks;
+  r.fallback_seeds_pct = m.seeds_primary ? 100.0 * (double)m.seeds_fallback / (double)m.seeds_primary : 0;
+}
+
+/* ============= Results ============= */
+
+static std::string toJson(const BenchResult& r) {
+  char buf[1024];
+  snprintf(buf, sizeof(buf),
+           "{\"design\":\"%s\",\"devices\":%u,\"seeds\":%u,\"mix\":\"%s\",\"records\":%llu,\"records_per_s\":%.1f,"
+           "\"parse_p50_ns\":%.0f,\"parse_p99_ns\":%.0f,\"parse_p999_ns\":%.0f,\"parse_max_ns\":%.0f,"
+           "\"window_p50_ns\":%.0f,\"window_p99_ns\":%.0f,\"window_p999_ns\":%.0f,\"window_max_ns\":%.0f,"
+           "\"search_p50_ns\":%.0f,\"search_p99_ns\":%.0f,\"search_p999_ns\":%.0f,\"search_max_ns\":%.0f,"
+           "\"replay_p50_ns\":%.0f,\"replay_p99_ns\":%.0f,\"replay_p999_ns\":%.0f,\"replay_max_ns\":%.0f,"
+           "\"ok\":%llu,\"amb\":%llu,\"bad\":%llu,\"stale\":%llu,\"replay\":%llu,\"genuine_rejected\":%llu,"
+           "\"forged_accepted\":%llu,\"evals_per_record\":%.1f,\"fallbacks\":%llu,\"fallback_seeds_pct\":%.1f,\"cold_start_ms\":%.1f,"
+           "\"index_bytes\":%zu,\"peak_rss_kb\":%ld}",
+           r.design.c_str(), r.devices, r.seeds, r.mix.c_str(), (unsigned long long)r.records, r.records_per_s,
+           r.parse.p50, r.parse.p99, r.parse.p999, r.parse.max, r.window.p50, r.window.p99, r.window.p999, r.window.max,
+           r.search.p50, r.search.p99, r.search.p999, r.search.max, r.replay.p50, r.replay.p99, r.replay.p999, r.replay.max,
+           (unsigned long long)r.verdicts[(int)RcVerdict::OK], (unsigned long long)r.verdicts[(int)RcVerdict::AMB],
+           (unsigned long long)r.verdicts[(int)RcVerdict::BAD], (unsigned long long)r.verdicts[(int)RcVerdict::STALE],
+           (unsigned long long)r.verdicts[(int)RcVerdict::REPLAY], (unsigned long long)r.genuine_rejected,
+           (unsigned long long)r.forged_accepted, r.evals_per_record, (unsigned long long)r.fallbacks, r.fallback_seeds_pct, r.cold_start_ms,
+           r.index_bytes, r.peak_rss_kb);
+  return buf;
+}
+
+/**
+ * @brief Value of a key in one JSON Lines object (only what toJson() writes)
+ */
+static std::string jsonField(const std::string& line, const std::string& key) {
+  const std::string tag = "\"" + key + "\":";
+  const size_t at = line.find(tag);
+  if (at == std::string::npos) {
+    return "";
+  }
+  size_t b = at + tag.size(), e;
+  if (line[b] == '"') {
+    e = line.find('"', ++b);
+  } else {
+    e = line.find_first_of(",}", b);
+  }
+  return e == std::string::npos ? "" : line.substr(b, e - b);
+}
+
+/**
+ * @return bool true if `r` regressed against its baseline entry (missing entries don't)
+ */
+static bool compare(const BenchResult& r, const std::vector<std::string>& baseline, const double tolerance) {
+  for (const std::string& line : baseline) {
+    if (jsonField(line, "design") != r.design || jsonField(line, "mix") != r.mix ||
+        strtoul(jsonField(line, "devices").c_str(), nullptr, 10) != r.devices) {
+      continue;
+    }
+    const double base_rps = strtod(jsonField(line, "records_per_s").c_str(), nullptr);
+    const double base_p50 = strtod(jsonField(line, "search_p50_ns").c_str(), nullptr);
+    const double rps = base_rps > 0 ? r.records_per_s / base_rps : 1;
+    const double p50 = base_p50 > 0 ? r.search.p50 / base_p50 : 1;
+    const bool regressed = rps < 1 - tolerance || p50 > 1 + tolerance;
+    printf("[%s] %-5s %8u %-10s throughput x%.2f, search p50 x%.2f\n", regressed ? "!" : "✓", r.design.c_str(), r.devices,
+           r.mix.c_str(), rps, p50);
+    return regressed;
+  }
+  printf("[*] %-5s %8u %-10s not in the baseline\n", r.design.c_str(), r.devices, r.mix.c_str());
+  return false;
+}
+
+static long peakRssKb(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+int main(int argc, char** argv) {
+  std::vector<uint32_t> sizes = { 10000, 1000000, 10000000 };
+  uint64_t records = 1000;
+  uint32_t seed = 1;
+  double tolerance = 0.25, migrated = 0.5;
+  std::string data_dir = "rc_bench_data", json_path, baseline_path;
+  bool usage = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--sizes" && i + 1 < argc) {
+      sizes.clear();
+      for (char *s = argv[++i], *end; *s && !usage; s = *end == ',' ? end + 1 : end) {
+        sizes.push_back((uint32_t)strtod(s, &end));
+        usage = end == s;
+      }
+    }
+    else if (a == "--records" && i + 1 < argc) records = strtoull(argv[++i], nullptr, 0);
+    else if (a == "--seed" && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (a == "--data-dir" && i + 1 < argc) data_dir = argv[++i];
+    else if (a == "--json" && i + 1 < argc) json_path = argv[++i];
+    else if (a == "--baseline" && i + 1 < argc) baseline_path = argv[++i];
+    else if (a == "--tolerance" && i + 1 < argc) tolerance = atof(argv[++i]);
+    else if (a == "--migrated" && i + 1 < argc) migrated = atof(argv[++i]);
+    else usage = true;
+  }
+  for (const uint32_t n : sizes) usage |= n == 0 || n > RC_BENCH_MAX_DEVICES;
+  if (usage || records == 0 || migrated < 0 || migrated > 1) {
+    fprintf(stderr,
+            "Usage: %s [--sizes 1e4,1e6,1e7] [--records N] [--seed N] [--data-dir DIR] [--json results.jsonl]\n"
+            "          [--baseline results.jsonl] [--tolerance F] [--migrated F]\n",
+            argv[0]);
+    return 2;
+  }
+  std::vector<std::string> baseline;
+  if (!baseline_path.empty()) {
+    std::vector<uint8_t> data;
+    if (!readFile(baseline_path, data)) {
+      fprintf(stderr, "[!] Can't read %s\n", baseline_path.c_str());
+      return 1;
+    }
+    std::string text(data.begin(), data.end()), line;
+    for (size_t b = 0, e; b < text.size(); b = e + 1) {
+      e = text.find('\n', b);
+      if (e == std::string::npos) e = text.size();
+      if (e > b) baseline.push_back(text.substr(b, e - b));
+    }
+  }
+
+  printf("[*] %llu records per mix, dataset seed %u\n", (unsigned long long)records, seed);
+  std::vector<BenchResult> results;
+  bool failed = false;
+  for (const uint32_t devices : sizes) {
+    const std::string path = dataset(data_dir, devices, seed);
+    for (const char* const design : { "scan", "dual", "hot" }) {
+      const bool dual = strcmp(design, "dual") == 0;
+      // Cold start: fleet file to a ready verifier
+      const auto t0 = Clock::now();
+      std::vector<FleetEntry> fleet;
+      std::string error;
+      if (!readFleet(path, fleet, error) || fleet.size() != devices) {
+        fprintf(stderr, "[!] %s: %s\n", path.c_str(), error.empty() ? "wrong size, delete it" : error.c_str());
+        return 1;
+      }
+      const SeedIndex index(dual ? dualFleet(std::move(fleet), seed) : std::move(fleet));
+      RcVerifier verifier(index, RC_VERIFY_WINDOW_S, dual ? RcMigration::FALLBACK : RcMigration::OFF,
+                          strcmp(design, "hot") == 0 ? RcOrder::HOT : RcOrder::SCAN);
+      const double cold_start_ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+      printf("\n[*] %s: %u buttons, %zu distinct seeds", design, devices, index.v1.seeds.size());
+      if (dual) printf(" + %zu V2 (%.0f%% of the buttons send V2)", index.v2.seeds.size(), migrated * 100);
+      printf(": cold start %.1f ms, index %.1f MB + replay state %.1f MB\n", cold_start_ms, index.bytes() / 1048576.0,
+             verifier.bytes() / 1048576.0);
+      printf("    %-10s %11s | %-21s | %-21s | %-21s | %-11s | %s\n", "mix", "records/s", "parse p50/p99/max us",
+             "search p50/p99/max us", "replay p50/p99 us", "evals/rec", "verdicts");
+      for (const TrafficMix& mix : MIXES) {
+        const Traffic traffic = makeTraffic(index, mix, records, seed, migrated);
+        BenchResult r;
+        r.design = design;
+        r.devices = devices;
+        r.seeds = (uint32_t)(index.v1.seeds.size() + index.v2.seeds.size());
+        r.mix = mix.name;
+        r.cold_start_ms = cold_start_ms;
+        r.index_bytes = index.bytes() + verifier.bytes();
+        runMix(verifier, traffic, r);
+        r.peak_rss_kb = peakRssKb();
+        printf("    %-10s %11.0f | %6.2f %6.2f %7.2f | %6.1f %6.1f %7.1f | %6.3f %6.3f         | %11.1f | %llu OK %llu AMB %llu BAD",
+               r.mix.c_str(), r.records_per_s, r.parse.p50 / 1e3, r.parse.p99 / 1e3, r.parse.max / 1e3, r.search.p50 / 1e3,
+               r.search.p99 / 1e3, r.search.max / 1e3, r.replay.p50 / 1e3, r.replay.p99 / 1e3, r.evals_per_record,
+               (unsigned long long)r.verdicts[(int)RcVerdict::OK], (unsigned long long)r.verdicts[(int)RcVerdict::AMB],
+               (unsigned long long)r.verdicts[(int)RcVerdict::BAD]);
+        if (dual) printf(", fallback +%.0f%% seeds", r.fallback_seeds_pct);
+        printf("\n");
+        if (r.genuine_rejected) {
+          printf("[!] %s: %llu genuine records rejected\n", r.mix.c_str(), (unsigned long long)r.genuine_rejected);
+          failed = true;
+        }
+        if (r.forged_accepted) {
+          printf("[*] %s: %llu forged codes matched a seed (%.2f%% expected: seeds / 2^32)\n", r.mix.c_str(),
+                 (unsigned long long)r.forged_accepted, 100.0 * r.seeds / 4294967296.0);
+        }
+        results.push_back(r);
+      }
+    }
+  }
+  printf("\n[*] Peak RSS %.1f MB\n", peakRssKb() / 1024.0);
+
+  if (!json_path.empty()) {
+    std::string out;
+    for (const BenchResult& r : results) out += toJson(r) + "\n";
+    if (!writeFile(json_path, std::vector<uint8_t>(out.begin(), out.end()))) {
+      fprintf(stderr, "[!] Can't write %s\n", json_path.c_str());
+      return 1;
+    }
+    printf("[✓] Results -> %s\n", json_path.c_str());
+  }
+  if (!baseline.empty()) {
+    printf("\n[*] Against %s (tolerance %.0f%%)\n", baseline_path.c_str(), tolerance * 100);
+    for (const BenchResult& r : results) failed |= compare(r, baseline, tolerance);
+  }
+  return failed ? 1 : 0;
+}
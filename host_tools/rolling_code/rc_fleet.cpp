@@ -0,0 +1,77 @@
+/**
+ * @file    rc_fleet.cpp
+ * @brief   Fleet provisioning: seeds of a batch of buttons, for the verifier
+ * @details Buttons get sequential custom MACs from --mac on. Each seed is derived exactly
+ *          like generateSeed() does on the button (rolling_code.h). Written as a fleet
+ *          file (fleet_file.h) that rc_verify reads.
+ *
+ *          SeedV1 only uses MAC bytes 0-3: buttons whose MACs differ in bytes 4-5 only
+ *          share a seed, and a verifier can't tell them apart. The tool reports how many do.
+ *          SeedV2 (ROLLING_CODE_SCHEME_V2) uses all six.
+ *
+ *          --scheme is the scheme the batch is enrolled with (its firmware's
+ *          ROLLING_CODE_SCHEME). --dual writes the seeds of both schemes, for a fleet that
+ *          migrates in the field (rc_verifier.h): the verifier then accepts either.
+ *
+ *          Usage: rc_fleet --product-key K --batch-id B --mac AA:BB:CC:DD:EE:FF --count N
+ *                          [--scheme 1|2] [--dual] [--out fleet.csv]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "fleet_file.h"
+#include "rolling_code.h"
+
+int main(int argc, char** argv) {
+  uint32_t product_key = 0, count = 0;
+  uint16_t batch_id = 0;
+  uint8_t mac[6];
+  uint8_t scheme = ROLLING_CODE_SCHEME_V1;
+  bool have_key = false, have_batch = false, have_mac = false, dual = false;
+  std::string out = "fleet.csv";
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--product-key" && i + 1 < argc) { product_key = (uint32_t)strtoul(argv[++i], nullptr, 0); have_key = true; }
+    else if (a == "--batch-id" && i + 1 < argc) { batch_id = (uint16_t)strtoul(argv[++i], nullptr, 0); have_batch = true; }
+    else if (a == "--mac" && i + 1 < argc) have_mac = parseMac(argv[++i], mac);
+    else if (a == "--count" && i + 1 < argc) count = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (a == "--scheme" && i + 1 < argc) scheme = (uint8_t)strtoul(argv[++i], nullptr, 0);
+    else if (a == "--dual") dual = true;
+    else if (a == "--out" && i + 1 < argc) out = argv[++i];
+    else {
+      count = 0;
+      break;
+    }
+  }
+  if (!have_key || !have_batch || !have_mac || count == 0 ||
+      (scheme != ROLLING_CODE_SCHEME_V1 && scheme != ROLLING_CODE_SCHEME_V2)) {
+    fprintf(stderr, "Usage: %s --product-key K --batch-id B --mac AA:BB:CC:DD:EE:FF --count N [--scheme 1|2] [--dual] "
+                    "[--out fleet.csv]\n", argv[0]);
+    return 2;
+  }
+
+  const std::vector<FleetEntry> fleet = makeFleet(product_key, batch_id, mac, count, scheme, dual);
+  if (!writeFleet(out, fleet)) {
+    fprintf(stderr, "[!] Can't write %s\n", out.c_str());
+    return 1;
+  }
+
+  std::unordered_set<uint32_t> seeds, seeds_v2;
+  for (const FleetEntry& e : fleet) {
+    seeds.insert(e.seed);
+    if (e.has_v2) seeds_v2.insert(e.seed_v2);
+  }
+  printf("[✓] %u buttons, scheme V%u%s, %s .. %s -> %s\n", count, scheme, dual ? " (dual)" : "",
+         formatMac(fleet.front().mac).c_str(), formatMac(fleet.back().mac).c_str(), out.c_str());
+  if ((scheme == ROLLING_CODE_SCHEME_V1 || dual) && seeds.size() < fleet.size()) {
+    printf("[!] Only %zu distinct V1 seeds: buttons differing in MAC bytes 4-5 only share a seed (SeedV1)\n", seeds.size());
+  }
+  if (!seeds_v2.empty() && seeds_v2.size() < fleet.size()) {
+    printf("[!] Only %zu distinct V2 seeds\n", seeds_v2.size());
+  }
+  return 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * @file    rc_verify.cpp
+ * @brief   Rolling code verifier: gateway UART stream in, authenticated presses out
+ * @details Reads the byte stream of a gateway (gateway_core.h frames, e.g. gateway_sim
+ *          --out, ieee802154_rx --out, or a serial port) with frame_parser.h, and checks
+ *          every record against the fleet file (fleet_file.h).
+ *
+ *          Time window first: a button with a synced device clock (device_clock.h) sends
+ *          seconds since BUTTON_CLOCK_EPOCH_UNIX. If that is more than --window seconds
+ *          from the verifier's clock, the record is rejected without any seed search.
+ *          The default window covers a year of clock drift (host_tools/clock/clock_sim).
+ *
+ *          A record carries the BLE advertising address, not the custom MAC the seed was
+ *          derived from, so the verifier searches the fleet's seeds for the one whose code
+ *          for the record's timestamp word is the received code
+ *          (rolling_code::RollingCodeV1::find(), same header as the firmware). The stages
+ *          are in rc_verifier.h, shared with rc_bench.
+ *            [OK]     exactly one seed matches; buttons sharing that seed are listed
+ *            [AMB]    several distinct seeds match (a code collision in this fleet)
+ *            [BAD]    no seed matches: forged, corrupted or from another fleet
+ *            [STALE]  synced clock outside the window (no search)
+ *            [REPLAY] synced clock older than the last press accepted for that seed
+ *          Repeats of one press (same timestamp, e.g. from several gateways) are accepted.
+ *
+ *          Scheme migration: a fleet file with V2 seeds (fleet_file.h) turns on the
+ *          FALLBACK mode of rc_verifier.h. Each record is searched in its own scheme's
+ *          seeds first, the other scheme's only on a miss. The summary has the migration
+ *          progress (buttons per tracked scheme) and the extra seeds the fallback evaluated.
+ *
+ *          Search order: by default the seeds accepted recently from this gateway, then
+ *          those accepted recently anywhere (rc_hot_set.h), are tried before the fleet is
+ *          scanned: repeats of a press and buttons that press again are found in a few
+ *          mixer evaluations. The summary has the evaluations per record. One stream is
+ *          one gateway.
+ *
+ *          Latency: a v3 record carries the press age at the button (adv_format.h) and its
+ *          wait in the gateway (gateway_core.h). With the frame's arrival here and the time
+ *          to the verdict, the first accepted record of a press gives its press-to-alert
+ *          latency, written with --latency for latency_report.
+ *
+ *          Usage: rc_verify --fleet fleet.csv [stream.bin | -] [--window S] [--now UNIX] [--quiet]
+ *                           [--link-report out.csv] [--latency out.jsonl [--site NAME]
+ *                           [--firmware map.csv]] [--migration off|strict|fallback] [--search hot|scan]
+ *            --now          verifier clock for a recorded stream (default: the system clock)
+ *            --quiet        summary only. Exit code 1 if a record is rejected.
+ *            --link-report  best RSSI of every accepted press (all gateways), as
+ *                           mac,timestamp,rssi: the gateway feedback of the closed-loop TX
+ *                           power (tx_power.h, maint_client.py link-report)
+ *            --latency      one JSON line per accepted v3 press: device_ms (press age),
+ *                           gateway_ms (wait), verify_ms (arrival to verdict) and total_ms.
+ *                           From a live stream also the press, reception and verdict on
+ *                           this host's clock (*_unix_ms); a recorded file is "live":false
+ *            --site         site name for the latency lines (this receiver's location)
+ *            --firmware     CSV mac,firmware (custom MAC as in the fleet file): the firmware
+ *                           version of each button for the latency lines, else "unknown"
+ *            --migration    rc_verifier.h RcMigration (default: fallback if the fleet file
+ *                           has V2 seeds, else off)
+ *            --search       rc_verifier.h RcOrder: hot sets first (default), or scan every record
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fleet_file.h"
+#include "frame_parser.h"
+#include "rc_verifier.h"
+
+using gwlink::FrameParser;
+using gwlink::FrameView;
+using gwlink::MirrorRing;
+
+/**
+ * @brief Read the firmware map: mac,firmware per line, '#' comments
+ */
+static bool readFirmwareMap(const std::string& path, std::map<std::string, std::string>& firmware) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = 0;
+    char* comma = strchr(line, ',');
+    uint8_t mac[6];
+    if (line[0] == '#' || !comma) {
+      continue;
+    }
+    *comma = 0;
+    if (parseMac(line, mac) && comma[1]) {
+      firmware[formatMac(mac)] = comma + 1;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static uint64_t unixMs(void) {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+  std::string fleet_path, input = "-", link_path, latency_path, site = "default", firmware_path;
+  bool quiet = false, usage = false;
+  int32_t window_s = RC_VERIFY_WINDOW_S;
+  uint64_t fixed_now = 0;
+  std::string migration, order = "hot";
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--fleet" && i + 1 < argc) fleet_path = argv[++i];
+    else if (a == "--window" && i + 1 < argc) window_s = atoi(argv[++i]);
+    else if (a == "--now" && i + 1 < argc) fixed_now = strtoull(argv[++i], nullptr, 0);
+    else if (a == "--quiet") quiet = true;
+    else if (a == "--link-report" && i + 1 < argc) link_path = argv[++i];
+    else if (a == "--latency" && i + 1 < argc) latency_path = argv[++i];
+    else if (a == "--site" && i + 1 < argc) site = argv[++i];
+    else if (a == "--firmware" && i + 1 < argc) firmware_path = argv[++i];
+    else if (a == "--migration" && i + 1 < argc) migration = argv[++i];
+    else if (a == "--search" && i + 1 < argc) order = argv[++i];
+    else if (a == "-" || a[0] != '-') input = a;
+    else usage = true;
+  }
+  usage |= !migration.empty() && migration != "off" && migration != "strict" && migration != "fallback";
+  usage |= order != "hot" && order != "scan";
+  if (fleet_path.empty() || usage) {
+    fprintf(stderr,
+            "Usage: %s --fleet fleet.csv [stream.bin | -] [--window S] [--now UNIX] [--quiet] [--link-report out.csv]\n"
+            "       [--latency out.jsonl [--site NAME] [--firmware map.csv]] [--migration off|strict|fallback]\n"
+            "       [--search hot|scan]\n",
+            argv[0]);
+    return 2;
+  }
+
+  std::vector<FleetEntry> fleet;
+  std::string error;
+  if (!readFleet(fleet_path, fleet, error) || fleet.empty()) {
+    fprintf(stderr, "[!] Fleet: %s\n", error.empty() ? "no buttons" : error.c_str());
+    return 1;
+  }
+  const SeedIndex index(std::move(fleet));
+  std::map<std::string, std::string> firmware;
+  if (!firmware_path.empty() && !readFirmwareMap(firmware_path, firmware)) {
+    fprintf(stderr, "[!] Can't read %s\n", firmware_path.c_str());
+    return 1;
+  }
+  FILE* latency = nullptr;
+  if (!latency_path.empty() && !(latency = fopen(latency_path.c_str(), "w"))) {
+    fprintf(stderr, "[!] Can't write %s\n", latency_path.c_str());
+    return 1;
+  }
+
+  const int fd = input == "-" ? STDIN_FILENO : open(input.c_str(), O_RDONLY);
+  MirrorRing ring;
+  if (fd < 0 || !ring.init(1 << 16)) {
+    fprintf(stderr, "[!] Can't read %s\n", input.c_str());
+    return 1;
+  }
+  // A regular file is a recording: its arrival times are not the gateway's
+  struct stat st;
+  const bool live = fstat(fd, &st) == 0 && !S_ISREG(st.st_mode);
+
+  FrameParser<> parser(ring);
+  const RcMigration mode = migration == "strict"   ? RcMigration::STRICT
+                           : migration == "fallback" ? RcMigration::FALLBACK
+                           : migration == "off"      ? RcMigration::OFF
+                           : index.dual()            ? RcMigration::FALLBACK
+                                                     : RcMigration::OFF;
+  RcVerifier verifier(index, window_s, mode, order == "hot" ? RcOrder::HOT : RcOrder::SCAN);
+  uint64_t counts[(int)RcVerdict::COUNT] = {};
+  uint64_t unsynced = 0, unknown_event = 0;
+  double search_s = 0;
+  std::map<std::pair<uint32_t, uint32_t>, int8_t> best_rssi;  // (button, timestamp word) of accepted presses
+  uint64_t timed = 0, untimed = 0;
+  ssize_t got;
+  while ((got = ring.fill(fd)) > 0) {
+    const uint64_t arrival_ms = unixMs();
+    FrameView view;
+    while (parser.next(view)) {
+      for (uint8_t r = 0; r < view.count; r++) {
+        const gw_record_t& rec = view.records[r];
+        RcCheck check;
+        const uint64_t now = fixed_now ? fixed_now : (uint64_t)time(nullptr);
+        const auto t0 = std::chrono::steady_clock::now();
+        const RcVerdict verdict = verifier.verify(rec, now, check);
+        if (verdict != RcVerdict::STALE) {
+          search_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+        counts[(int)verdict]++;
+        unsynced += !check.synced;
+        if (verdict == RcVerdict::OK) {
+          const auto key = std::make_pair(index.buttonIndex(check.scheme, check.hit), rec.timestamp);
+          const auto it = best_rssi.find(key);
+          const bool first = it == best_rssi.end();
+          if (first || rec.rssi > it->second) best_rssi[key] = rec.rssi;
+          // The press's first record is the earliest reception
+          if (first && latency && rec.age == ADV_AGE_NONE) {
+            untimed++;
+          } else if (first && latency) {
+            const uint64_t verdict_ms = unixMs();
+            const std::string mac = formatMac(index.button(check.scheme, check.hit).mac);
+            const auto fw = firmware.find(mac);
+            const uint32_t device_ms = advAgeMs(rec.age), verify_ms = (uint32_t)(verdict_ms - arrival_ms);
+            fprintf(latency,
+                    "{\"site\":\"%s\",\"firmware\":\"%s\",\"mac\":\"%s\",\"timestamp\":%u,\"device_ms\":%u,"
+                    "\"gateway_ms\":%u,\"verify_ms\":%u,\"total_ms\":%u,\"live\":%s",
+                    site.c_str(), fw == firmware.end() ? "unknown" : fw->second.c_str(), mac.c_str(), rec.timestamp, device_ms,
+                    rec.wait_ms, verify_ms, device_ms + rec.wait_ms + verify_ms, live ? "true" : "false");
+            if (live) {
+              const uint64_t rx_ms = arrival_ms - rec.wait_ms;
+              fprintf(latency, ",\"press_unix_ms\":%llu,\"rx_unix_ms\":%llu,\"verdict_unix_ms\":%llu",
+                      (unsigned long long)(rx_ms - device_ms), (unsigned long long)rx_ms, (unsigned long long)verdict_ms);
+            }
+            fprintf(latency, "}\n");
+            timed++;
+          }
+        }
+
+        const ButtonEvent event = buttonEventOf(rec.timestamp);
+        unknown_event += check.hit != RcCheck::NONE && event == ButtonEvent::COUNT;
+        if (quiet) {
+          continue;
+        }
+        printf("[%s] %-6s adv %s code=%08X ts=%u", rcVerdictName(verdict), buttonEventName(event), formatMac(rec.mac).c_str(),
+               rec.code, rec.timestamp & BUTTON_CLOCK_MASK);
+        if (check.synced) printf(" age=%ds", check.age);
+        printf(" rssi=%d", rec.rssi);
+        if (rec.format >= ADV_FORMAT_V2) printf(" v%u hint=%02X", rec.format, rec.hint);
+        if (rec.age != ADV_AGE_NONE) printf(" pressed=%ums", advAgeMs(rec.age));
+        if (rec.health) printf(" health=0x%X", rec.health);
+        if (mode != RcMigration::OFF) printf(" scheme=V%u%s", check.scheme, check.fallback ? " (fallback)" : "");
+        if (check.hit != RcCheck::NONE) {
+          printf(" -> %s", formatMac(index.button(check.scheme, check.hit).mac).c_str());
+          const uint32_t sharing = index.sharing(check.scheme, check.hit) - 1;
+          if (sharing) printf(" (+%u sharing the seed)", sharing);
+        }
+        printf("\n");
+      }
+    }
+  }
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  if (latency) {
+    fclose(latency);
+  }
+  if (got < 0) {
+    fprintf(stderr, "[!] Read error on %s\n", input.c_str());
+    return 1;
+  }
+
+  if (!link_path.empty()) {
+    FILE* f = fopen(link_path.c_str(), "w");
+    if (!f) {
+      fprintf(stderr, "[!] Can't write %s\n", link_path.c_str());
+      return 1;
+    }
+    fprintf(f, "mac,timestamp,rssi\n");
+    for (const auto& [key, rssi] : best_rssi) {
+      fprintf(f, "%s,%u,%d\n", formatMac(index.buttons[key.first].mac).c_str(), key.second, rssi);
+    }
+    fclose(f);
+  }
+
+  const uint64_t ok = counts[(int)RcVerdict::OK], ambiguous = counts[(int)RcVerdict::AMB], bad = counts[(int)RcVerdict::BAD];
+  const uint64_t stale = counts[(int)RcVerdict::STALE], replay = counts[(int)RcVerdict::REPLAY];
+  const uint64_t records = ok + ambiguous + bad + stale + replay;
+  const uint64_t rejected = bad + stale + replay;
+  printf("[*] %zu buttons, %zu distinct seeds; %llu frames (%llu CRC errors, %llu lost)\n", index.buttons.size(),
+         index.v1.seeds.size(),
+         (unsigned long long)parser.stats.frames, (unsigned long long)parser.stats.crc_errors,
+         (unsigned long long)parser.stats.seq_gaps);
+  printf("[%s] %llu records: %llu OK, %llu ambiguous, %llu BAD, %llu stale (not searched), %llu replayed",
+         rejected ? "!" : "✓", (unsigned long long)records, (unsigned long long)ok, (unsigned long long)ambiguous,
+         (unsigned long long)bad, (unsigned long long)stale, (unsigned long long)replay);
+  if (unsynced) printf(", %llu without a synced clock", (unsigned long long)unsynced);
+  if (unknown_event) printf(", %llu with an unknown event type", (unsigned long long)unknown_event);
+  if (records > stale) printf("; %.2f us per search", search_s * 1e6 / (double)(records - stale));
+  printf("\n");
+  const RcSearchStats& searched = verifier.searchStats();
+  if (searched.searches) {
+    const double n = (double)searched.searches;
+    printf("[*] Search (%s): %.1f mixer evaluations per record; %.0f%% found in the gateway hot set, %.0f%% in the fleet "
+           "hot set, %.0f%% scanned\n",
+           rcOrderName(verifier.order), (double)searched.evaluations / n, 100.0 * (double)searched.gateway_hits / n,
+           100.0 * (double)searched.fleet_hits / n, 100.0 * (double)searched.scans / n);
+  }
+  if (mode != RcMigration::OFF) {
+    const RcMigrationStats& m = verifier.migration();
+    const RcMigrationProgress p = verifier.progress();
+    printf("[*] Migration (%s): %llu of %zu buttons on V2 (%llu confirmed by a press, %llu with a V2 seed), %llu on V1 "
+           "(%llu confirmed); %llu upgrades, %llu rollbacks seen\n",
+           rcMigrationName(mode), (unsigned long long)p.buttons[1], index.buttons.size(), (unsigned long long)p.confirmed[1],
+           (unsigned long long)p.with_v2, (unsigned long long)p.buttons[0], (unsigned long long)p.confirmed[0],
+           (unsigned long long)m.upgrades, (unsigned long long)m.rollbacks);
+    printf("[*] Accepted %llu V1 / %llu V2 records; %llu fallback searches (%llu found the seed), %.1f%% more seeds evaluated\n",
+           (unsigned long long)m.accepted[0], (unsigned long long)m.accepted[1], (unsigned long long)m.fallbacks,
+           (unsigned long long)m.fallback_hits,
+           m.seeds_primary ? 100.0 * (double)m.seeds_fallback / (double)m.seeds_primary : 0.0);
+  }
+  if (!latency_path.empty()) {
+    printf("[*] Latency of %llu presses to %s (site %s)%s", (unsigned long long)timed, latency_path.c_str(), site.c_str(),
+           live ? "" : ", recorded stream: no host clock times");
+    if (untimed) printf("; %llu without a press age (v1 / v2 adverts)", (unsigned long long)untimed);
+    printf("\n");
+  }
+  return rejected ? 1 : 0;
+}
@@ -0,0 +1,543 @@
+/**
+ * @file    replica_sim.cpp
+ * @brief   Site-local verification over partial seed replicas: gateway processes and a central store
+ * @details One process per site gateway host and the central store (this process), over
+ *          socket pairs, in lockstep rounds of one simulated second. The gateway host keeps
+ *          a partial replica of the site's buttons (seed_replica.h), synced every --sync
+ *          seconds. It verifies its records against the replica, and escalates the ones that
+ *          miss it (BAD) to the store, which verifies them against the whole fleet. The
+ *          store's WAN round trip is --rtt (not slept, added to the latency).
+ *
+ *          The seed database changes while the site runs, from a script both sides share:
+ *            provisioning  --buttons per site at the start, SIM_ADD_SHARE more to a random
+ *                          site every SIM_ADD_PERIOD_S
+ *            support       a random button revoked every 1 / SIM_REVOKE_RATE s (on average);
+ *                          it keeps pressing (lost, or not collected)
+ *            ota           every SIM_OTA_PERIOD_S, SIM_OTA_SHARE of a site's V1 buttons move to
+ *                          rolling-code scheme V2 and press with it from then on
+ *          Presses: --press-rate per button per second, SIM_REPEATS v3 records each.
+ *          --visitors of them by a button of another site, --forged records with a random
+ *          code.
+ *
+ *          Checks (exit code 1 if one fails):
+ *            replicas    after the last sync, every replica has its site's buttons as the
+ *                        store has them (digest) at the store's version vector
+ *            genuine     no record of a deployed button is rejected (local or escalated)
+ *            revocation  no record of a revoked button is accepted by a replica that synced
+ *                        after the revocation (within the sync lag it may be)
+ *
+ *          Usage: replica_sim [--gateways N] [--buttons N] [--seconds S] [--sync S]
+ *                             [--press-rate P] [--visitors F] [--forged F] [--rtt MS] [--seed N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "button_events.h"
+#include "gateway_core.h"
+#include "rolling_code.h"
+#include "seed_replica.h"
+
+using namespace replica;
+using Clock = std::chrono::steady_clock;
+
+#define SIM_PRODUCT_KEY 0x12345678u
+#define SIM_BATCH_ID 0x0042u
+#define SIM_START_UNIX 1767225600u     /**< 2026-01-01 00:00:00 UTC, round 0 */
+#define SIM_REPEATS 3                  /**< Records per press (gateway dedup re-forwards) */
+#define SIM_ADD_PERIOD_S 60
+#define SIM_ADD_SHARE 0.01             /**< New buttons per add, share of a site */
+#define SIM_REVOKE_RATE 0.1            /**< Revocations per second, fleet-wide */
+#define SIM_OTA_PERIOD_S 120
+#define SIM_OTA_SHARE 0.2              /**< Share of a site's V1 buttons per OTA wave */
+#define SIM_NEVER 0xFFFFFFFFu
+
+struct SimConfig {
+  uint32_t gateways = 8;
+  uint32_t buttons = 2000;       /**< Per site at the start */
+  uint32_t seconds = 900;
+  uint32_t sync_s = 30;
+  double press_rate = 0.002;     /**< Presses per button per second */
+  double visitors = 0.05;        /**< Share of presses by a button of another site */
+  double forged = 0.02;          /**< Share of records with a random code */
+  double rtt_ms = 40;            /**< WAN round trip to the store */
+  uint32_t seed = 1;
+};
+
+/* ============= Script ============= */
+/**
+ * @brief A button as the world sees it (the truth the checks compare against)
+ */
+struct SimButton {
+  uint8_t mac[6];
+  uint16_t site;
+  uint32_t seed;
+  uint32_t seed_v2;
+  uint32_t added;                 /**< Round */
+  uint32_t revoked = SIM_NEVER;
+  uint32_t migrated = SIM_NEVER;  /**< Round it moved to V2 */
+};
+
+struct ScriptOp {
+  uint32_t round;
+  SeedOp op;
+};
+
+struct Script {
+  std::vector<SimButton> buttons;
+  std::vector<std::vector<uint32_t>> by_site;  /**< Button indices per site */
+  std::vector<ScriptOp> ops;                   /**< In round order */
+};
+
+static uint32_t addButton(Script& s, const uint16_t site, const uint32_t round) {
+  const uint32_t n = (uint32_t)s.buttons.size();
+  SimButton b;
+  const uint8_t mac[6] = { 0x24, (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n, 0x00, 0x01 };  // SeedV1: bytes 0-3
+  memcpy(b.mac, mac, 6);
+  b.site = site;
+  b.seed = rolling_code::RollingCodeV1::seed(SIM_PRODUCT_KEY, SIM_BATCH_ID, b.mac);
+  b.seed_v2 = rolling_code::RollingCodeV2::seed(SIM_PRODUCT_KEY, SIM_BATCH_ID, b.mac);
+  b.added = round;
+  s.buttons.push_back(b);
+  s.by_site[site].push_back(n);
+  SeedOp op;
+  op.type = OpType::ADD;
+  op.origin = Origin::PROVISIONING;
+  memcpy(op.mac, b.mac, 6);
+  op.site = site;
+  op.seed = b.seed;
+  s.ops.push_back({ round, op });
+  return n;
+}
+
+static Script makeScript(const SimConfig& cfg) {
+  std::mt19937 rng(cfg.seed);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  Script s;
+  s.by_site.resize(cfg.gateways);
+  for (uint16_t site = 0; site < cfg.gateways; site++) {
+    for (uint32_t i = 0; i < cfg.buttons; i++) addButton(s, site, 0);
+  }
+  for (uint32_t t = 1; t < cfg.seconds; t++) {
+    if (t % SIM_ADD_PERIOD_S == 0) {
+      const uint16_t site = (uint16_t)(rng() % cfg.gateways);
+      for (uint32_t i = 0; i < (uint32_t)(cfg.buttons * SIM_ADD_SHARE); i++) addButton(s, site, t);
+    }
+    if (uni(rng) < SIM_REVOKE_RATE) {
+      SimButton& b = s.buttons[rng() % s.buttons.size()];
+      if (b.revoked == SIM_NEVER && b.added < t) {
+        b.revoked = t;
+        SeedOp op;
+        op.type = OpType::REVOKE;
+        op.origin = Origin::SUPPORT;
+        memcpy(op.mac, b.mac, 6);
+        s.ops.push_back({ t, op });
+      }
+    }
+    if (t % SIM_OTA_PERIOD_S == SIM_OTA_PERIOD_S / 2) {
+      const uint16_t site = (uint16_t)(rng() % cfg.gateways);
+      for (const uint32_t i : s.by_site[site]) {
+        SimButton& b = s.buttons[i];
+        if (b.revoked != SIM_NEVER || b.migrated != SIM_NEVER || b.added >= t || uni(rng) >= SIM_OTA_SHARE) continue;
+        b.migrated = t;
+        SeedOp op;
+        op.type = OpType::SCHEME;
+        op.origin = Origin::OTA;
+        memcpy(op.mac, b.mac, 6);
+        op.scheme = ROLLING_CODE_SCHEME_V2;
+        op.seed = b.seed_v2;
+        s.ops.push_back({ t, op });
+      }
+    }
+  }
+  return s;
+}
+
+/* ============= Messages ============= */
+enum class Msg : uint8_t { GO, DONE, SYNC, SNAPSHOT_REQ, SYNC_REPLY, VERIFY, VERDICT, REPORT };
+
+#define SIM_MSG_HEADER 5  /**< type u8 | length u32 */
+
+static void sendMsg(const int fd, const Msg type, const Bytes& payload) {
+  Bytes out;
+  out.push_back((uint8_t)type);
+  putLe32(out, (uint32_t)payload.size());
+  out.insert(out.end(), payload.begin(), payload.end());
+  for (size_t done = 0; done < out.size();) {
+    const ssize_t n = write(fd, out.data() + done, out.size() - done);
+    if (n <= 0) {
+      perror("write");
+      exit(1);
+    }
+    done += (size_t)n;
+  }
+}
+
+static bool readAll(const int fd, uint8_t* p, size_t len) {
+  while (len) {
+    const ssize_t n = read(fd, p, len);
+    if (n <= 0) return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static Msg recvMsg(const int fd, Bytes& payload) {
+  uint8_t header[SIM_MSG_HEADER];
+  if (!readAll(fd, header, sizeof(header))) {
+    fprintf(stderr, "[!] Peer closed the connection\n");
+    exit(1);
+  }
+  const uint8_t* p = header + 1;
+  uint32_t len;
+  getLe32(p, header + sizeof(header), len);
+  payload.resize(len);
+  if (!readAll(fd, payload.data(), len)) {
+    fprintf(stderr, "[!] Short message\n");
+    exit(1);
+  }
+  return (Msg)header[0];
+}
+
+static Msg expect(const int fd, const Msg type, Bytes& payload) {
+  const Msg got = recvMsg(fd, payload);
+  if (got != type) {
+    fprintf(stderr, "[!] Message %u instead of %u\n", (unsigned)got, (unsigned)type);
+    exit(1);
+  }
+  return got;
+}
+
+/* ============= Gateway Host ============= */
+/**
+ * @brief What a gateway host reports at the end (sent as raw bytes: same binary)
+ */
+struct GatewayReport {
+  uint64_t records = 0;
+  uint64_t local_ok = 0;             /**< Accepted by the replica */
+  uint64_t local_rejected = 0;       /**< STALE / REPLAY in the replica (not escalated) */
+  uint64_t escalated = 0;
+  uint64_t escalated_ok = 0;
+  uint64_t genuine = 0;              /**< Records of deployed buttons */
+  uint64_t genuine_rejected = 0;
+  uint64_t forged = 0;
+  uint64_t forged_accepted = 0;
+  uint64_t revoked = 0;              /**< Records of revoked buttons */
+  uint64_t revoked_lag = 0;          /**< ... accepted, revocation not synced yet */
+  uint64_t revoked_synced = 0;       /**< ... accepted although the replica had the revocation */
+  uint64_t sync_bytes = 0;           /**< Requests and replies */
+  uint64_t snapshots = 0;
+  uint64_t deltas = 0;
+  uint64_t rebuilds = 0;
+  uint64_t replica_buttons = 0;
+  uint64_t digest = 0;
+  VersionVector version;
+  double local_us = 0;               /**< Sum of the local verification times */
+  double escalated_us = 0;           /**< Sum of the escalation round trips (without --rtt) */
+};
+
+static void syncReplica(const int fd, SeedReplica& replica, GatewayReport& rep) {
+  Bytes req, reply;
+  const bool first = replica.version() == VersionVector();
+  if (!first) putVersion(req, replica.version());
+  sendMsg(fd, first ? Msg::SNAPSHOT_REQ : Msg::SYNC, req);
+  expect(fd, Msg::SYNC_REPLY, reply);
+  rep.sync_bytes += 2 * SIM_MSG_HEADER + req.size() + reply.size();
+  bool ok = replica.apply(reply);
+  (reply[0] == (uint8_t)MsgType::SNAPSHOT ? rep.snapshots : rep.deltas)++;
+  if (!ok) {
+    // A delta that doesn't continue this replica: start over from a snapshot
+    sendMsg(fd, Msg::SNAPSHOT_REQ, Bytes());
+    expect(fd, Msg::SYNC_REPLY, reply);
+    rep.sync_bytes += 2 * SIM_MSG_HEADER + reply.size();
+    rep.snapshots++;
+    ok = replica.apply(reply);
+  }
+  if (!ok) {
+    fprintf(stderr, "[!] Site %u: sync failed\n", replica.site);
+    exit(1);
+  }
+}
+
+static int gatewayHost(const SimConfig& cfg, const Script& script, const uint16_t site, const int fd) {
+  std::mt19937 rng(cfg.seed * 7919u + site);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+  SeedReplica replica(site);
+  GatewayReport rep;
+  uint32_t last_sync = 0;
+  Bytes msg;
+  for (uint32_t t = 0; t < cfg.seconds; t++) {
+    expect(fd, Msg::GO, msg);
+    if (t % cfg.sync_s == 0) {
+      syncReplica(fd, replica, rep);
+      last_sync = t;
+    }
+    const uint64_t now_unix = SIM_START_UNIX + t;
+    const uint32_t clock_s = (uint32_t)(now_unix - BUTTON_CLOCK_EPOCH_UNIX);
+    std::poisson_distribution<uint32_t> presses(cfg.press_rate * (double)script.by_site[site].size());
+    for (uint32_t n = presses(rng); n > 0; n--) {
+      gw_record_t rec = {};
+      rec.format = ADV_FORMAT_V3;
+      rec.age = ADV_AGE_NONE;
+      rec.rssi = (int8_t)(-40 - (int)(rng() % 50));
+      rec.timestamp = buttonEventStamp(buttonClockWord(clock_s, true), ButtonEvent::SOS);
+      const SimButton* b = nullptr;
+      if (uni(rng) < cfg.forged) {
+        rec.code = rng();
+        rec.hint = (uint8_t)rng();
+      } else {
+        const uint16_t from = uni(rng) < cfg.visitors ? (uint16_t)((site + 1 + rng() % (cfg.gateways - 1)) % cfg.gateways) : site;
+        const std::vector<uint32_t>& pool = script.by_site[from];
+        b = &script.buttons[pool[rng() % pool.size()]];
+        if (b->added > t) continue;  // Not provisioned yet
+        const uint8_t scheme = b->migrated <= t ? ROLLING_CODE_SCHEME_V2 : ROLLING_CODE_SCHEME_V1;
+        const uint32_t seed = scheme == ROLLING_CODE_SCHEME_V2 ? b->seed_v2 : b->seed;
+        rec.timestamp = buttonSchemeStamp(rec.timestamp, scheme);
+        rec.code = rolling_code::schemeCode(scheme, seed, rec.timestamp);
+        rec.hint = advHint(seed);
+      }
+      if (b) memcpy(rec.mac, b->mac, 6);
+      for (uint32_t r = 0; r < SIM_REPEATS; r++) {
+        rep.records++;
+        RcCheck check;
+        const auto t0 = Clock::now();
+        RcVerdict verdict = replica.verify(rec, now_unix, check);
+        rep.local_us += std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+        bool local = true;
+        if (verdict == RcVerdict::BAD) {
+          // Not a button of this replica: the store decides
+          const auto e0 = Clock::now();
+          sendMsg(fd, Msg::VERIFY, Bytes((const uint8_t*)&rec, (const uint8_t*)&rec + sizeof(rec)));
+          expect(fd, Msg::VERDICT, msg);
+          rep.escalated_us += std::chrono::duration<double, std::micro>(Clock::now() - e0).count();
+          rep.escalated++;
+          verdict = (RcVerdict)msg[0];
+          local = false;
+        }
+        const bool accepted = verdict == RcVerdict::OK || verdict == RcVerdict::AMB;
+        rep.local_ok += local && accepted;
+        rep.local_rejected += local && !accepted;
+        rep.escalated_ok += !local && accepted;
+        if (!b) {
+          rep.forged++;
+          rep.forged_accepted += accepted;
+        } else if (b->revoked <= t) {
+          rep.revoked++;
+          if (accepted && b->revoked <= last_sync) rep.revoked_synced++;
+          else if (accepted) rep.revoked_lag++;
+        } else {
+          rep.genuine++;
+          rep.genuine_rejected += !accepted;
+        }
+      }
+    }
+    sendMsg(fd, Msg::DONE, Bytes());
+  }
+  // Last sync, then the report
+  expect(fd, Msg::GO, msg);
+  syncReplica(fd, replica, rep);
+  rep.rebuilds = replica.rebuilds;
+  rep.replica_buttons = replica.size();
+  rep.digest = replica.digest();
+  rep.version = replica.version();
+  sendMsg(fd, Msg::REPORT, Bytes((const uint8_t*)&rep, (const uint8_t*)&rep + sizeof(rep)));
+  return 0;
+}
+
+/* ============= Central Store ============= */
+static bool check(const char* name, bool ok, const std::string& detail) {
+  printf("[%s] %-11s %s\n", ok ? "✓" : "!", name, detail.c_str());
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    if (a == "--gateways" && i + 1 < argc) cfg.gateways = (uint32_t)atoi(argv[++i]);
+    else if (a == "--buttons" && i + 1 < argc) cfg.buttons = (uint32_t)atoi(argv[++i]);
+    else if (a == "--seconds" && i + 1 < argc) cfg.seconds = (uint32_t)atoi(argv[++i]);
+    else if (a == "--sync" && i + 1 < argc) cfg.sync_s = (uint32_t)atoi(argv[++i]);
+    else if (a == "--press-rate" && i + 1 < argc) cfg.press_rate = atof(argv[++i]);
+    else if (a == "--visitors" && i + 1 < argc) cfg.visitors = atof(argv[++i]);
+    else if (a == "--forged" && i + 1 < argc) cfg.forged = atof(argv[++i]);
+    else if (a == "--rtt" && i + 1 < argc) cfg.rtt_ms = atof(argv[++i]);
+    else if (a == "--seed" && i + 1 < argc) cfg.seed = (uint32_t)atoi(argv[++i]);
+    else cfg.gateways = 0;
+  }
+  if (cfg.gateways < 2 || cfg.gateways >= REPLICA_ALL_SITES || cfg.buttons == 0 || cfg.seconds == 0 || cfg.sync_s == 0) {
+    fprintf(stderr, "Usage: %s [--gateways N] [--buttons N] [--seconds S] [--sync S] [--press-rate P] [--visitors F]\n"
+                    "          [--forged F] [--rtt MS] [--seed N]\n", argv[0]);
+    return 2;
+  }
+
+  // Both sides get the script with fork(): the store applies it, the sites press by it
+  const Script script = makeScript(cfg);
+  std::vector<int> fds(cfg.gateways);
+  std::vector<pid_t> pids(cfg.gateways);
+  for (uint16_t site = 0; site < cfg.gateways; site++) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      perror("socketpair");
+      return 1;
+    }
+    fflush(stdout);
+    pids[site] = fork();
+    if (pids[site] < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (pids[site] == 0) {
+      close(sv[0]);
+      for (uint16_t s = 0; s < site; s++) close(fds[s]);
+      _exit(gatewayHost(cfg, script, site, sv[1]));
+    }
+    close(sv[1]);
+    fds[site] = sv[0];
+  }
+
+  printf("[*] %u gateway processes x %u buttons, %u s, sync every %u s, WAN round trip %.0f ms\n", cfg.gateways, cfg.buttons,
+         cfg.seconds, cfg.sync_s, cfg.rtt_ms);
+  SeedStore store;
+  SeedReplica central(REPLICA_ALL_SITES);  // The store's verifier: every deployed button
+  std::vector<GatewayReport> reports(cfg.gateways);
+  uint64_t delta_bytes = 0, snapshot_equiv = 0, ops_count[REPLICA_ORIGINS] = {};
+  double central_us = 0;
+  size_t next_op = 0;
+  Bytes msg;
+  for (uint32_t t = 0; t <= cfg.seconds; t++) {
+    // The database changes between rounds
+    bool changed = false;
+    for (; next_op < script.ops.size() && script.ops[next_op].round <= t; next_op++) {
+      changed |= store.append(script.ops[next_op].op);
+      ops_count[(int)script.ops[next_op].op.origin]++;
+    }
+    if (changed && !central.apply(store.delta(REPLICA_ALL_SITES, central.version()))) {
+      fprintf(stderr, "[!] Central replica out of step\n");
+      return 1;
+    }
+    for (const int fd : fds) sendMsg(fd, Msg::GO, Bytes());
+    // Serve until every site is done with the round (or has reported, after the last)
+    const Msg until = t == cfg.seconds ? Msg::REPORT : Msg::DONE;
+    std::vector<bool> done(cfg.gateways, false);
+    for (uint32_t pending = cfg.gateways; pending > 0;) {
+      std::vector<struct pollfd> pfds;
+      for (const int fd : fds) pfds.push_back({ fd, POLLIN, 0 });
+      if (poll(pfds.data(), pfds.size(), -1) < 0) {
+        perror("poll");
+        return 1;
+      }
+      for (uint16_t site = 0; site < cfg.gateways; site++) {
+        if (!(pfds[site].revents & (POLLIN | POLLHUP)) || done[site]) continue;
+        const Msg type = recvMsg(fds[site], msg);
+        if (type == until) {
+          if (type == Msg::REPORT && msg.size() == sizeof(GatewayReport)) memcpy(&reports[site], msg.data(), msg.size());
+          done[site] = true;
+          pending--;
+        } else if (type == Msg::SYNC || type == Msg::SNAPSHOT_REQ) {
+          VersionVector from;
+          const uint8_t* p = msg.data();
+          Bytes reply;
+          if (type == Msg::SYNC && getVersion(p, msg.data() + msg.size(), from)) {
+            reply = store.delta(site, from);
+          }
+          const Bytes snapshot = store.snapshot(site);
+          snapshot_equiv += snapshot.size();
+          if (reply.empty()) reply = snapshot;
+          else delta_bytes += reply.size();
+          sendMsg(fds[site], Msg::SYNC_REPLY, reply);
+        } else if (type == Msg::VERIFY && msg.size() == sizeof(gw_record_t)) {
+          gw_record_t rec;
+          memcpy(&rec, msg.data(), sizeof(rec));
+          RcCheck check;
+          const auto t0 = Clock::now();
+          const RcVerdict verdict = central.verify(rec, SIM_START_UNIX + t, check);
+          central_us += std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+          sendMsg(fds[site], Msg::VERDICT, Bytes(1, (uint8_t)verdict));
+        } else {
+          fprintf(stderr, "[!] Site %u: unexpected message %u\n", site, (unsigned)type);
+          return 1;
+        }
+      }
+    }
+  }
+  bool children_ok = true;
+  for (uint16_t site = 0; site < cfg.gateways; site++) {
+    int status = 0;
+    close(fds[site]);
+    waitpid(pids[site], &status, 0);
+    children_ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  printf("[*] Store: %zu ops (%llu adds, %llu revocations, %llu scheme changes), %zu buttons deployed at the end\n",
+         store.ops(), (unsigned long long)ops_count[(int)Origin::PROVISIONING],
+         (unsigned long long)ops_count[(int)Origin::SUPPORT], (unsigned long long)ops_count[(int)Origin::OTA],
+         store.size(REPLICA_ALL_SITES));
+  printf("    %-4s %8s %8s %7s %10s %9s %9s %8s %9s\n", "site", "buttons", "records", "local%", "escalated", "accepted",
+         "sync KB", "deltas", "rebuilds");
+  GatewayReport sum;
+  bool replicas_ok = children_ok;
+  for (uint16_t site = 0; site < cfg.gateways; site++) {
+    const GatewayReport& r = reports[site];
+    printf("    %-4u %8llu %8llu %6.1f%% %10llu %9llu %9.1f %8llu %9llu\n", site, (unsigned long long)r.replica_buttons,
+           (unsigned long long)r.records, r.records ? 100.0 * (double)(r.local_ok + r.local_rejected) / (double)r.records : 0,
+           (unsigned long long)r.escalated, (unsigned long long)r.escalated_ok, r.sync_bytes / 1024.0,
+           (unsigned long long)r.deltas, (unsigned long long)r.rebuilds);
+    replicas_ok &= r.digest == store.digest(site) && r.version == store.version() && r.replica_buttons == store.size(site);
+    sum.records += r.records;
+    sum.local_ok += r.local_ok;
+    sum.local_rejected += r.local_rejected;
+    sum.escalated += r.escalated;
+    sum.escalated_ok += r.escalated_ok;
+    sum.genuine += r.genuine;
+    sum.genuine_rejected += r.genuine_rejected;
+    sum.forged += r.forged;
+    sum.forged_accepted += r.forged_accepted;
+    sum.revoked += r.revoked;
+    sum.revoked_lag += r.revoked_lag;
+    sum.revoked_synced += r.revoked_synced;
+    sum.sync_bytes += r.sync_bytes;
+    sum.local_us += r.local_us;
+    sum.escalated_us += r.escalated_us;
+  }
+
+  char buf[256];
+  bool ok = true;
+  snprintf(buf, sizeof(buf), "%u replicas equal to the store's view of their site after the last sync (digest, version vector)",
+           cfg.gateways);
+  ok &= check("replicas", replicas_ok, buf);
+  snprintf(buf, sizeof(buf), "%llu of %llu records of deployed buttons rejected; %llu accepted by the store after a local miss",
+           (unsigned long long)sum.genuine_rejected, (unsigned long long)sum.genuine, (unsigned long long)sum.escalated_ok);
+  ok &= check("genuine", sum.genuine_rejected == 0, buf);
+  snprintf(buf, sizeof(buf), "%llu records of revoked buttons: %llu accepted after the replica had the revocation, %llu in the "
+           "sync lag", (unsigned long long)sum.revoked, (unsigned long long)sum.revoked_synced,
+           (unsigned long long)sum.revoked_lag);
+  ok &= check("revocation", sum.revoked_synced == 0, buf);
+  printf("[*] forged      %llu records, %llu accepted (a 32-bit code against the hint's seeds)\n",
+         (unsigned long long)sum.forged, (unsigned long long)sum.forged_accepted);
+
+  const double local_share = sum.records ? (double)(sum.local_ok + sum.local_rejected) / (double)sum.records : 0;
+  const double escalate_kb = (double)sum.escalated * (2 * SIM_MSG_HEADER + sizeof(gw_record_t) + 1) / 1024.0;
+  const double central_kb = (double)sum.records * (2 * SIM_MSG_HEADER + sizeof(gw_record_t) + 1) / 1024.0;
+  printf("[*] WAN         %.1f KB with replicas (escalations %.1f KB, syncs %.1f KB) vs %.1f KB with every record sent to "
+         "the store\n", escalate_kb + sum.sync_bytes / 1024.0, escalate_kb, sum.sync_bytes / 1024.0, central_kb);
+  printf("[*] deltas      %.1f KB sent as deltas vs %.1f KB if every sync were a snapshot\n", delta_bytes / 1024.0,
+         snapshot_equiv / 1024.0);
+  printf("[*] latency     %.1f%% of records verified at the site in %.1f us (mean); escalated ones wait the round trip "
+         "%.0f ms + %.0f us (store %.1f us)\n",
+         100 * local_share, sum.records > sum.escalated ? sum.local_us / (double)(sum.records - sum.escalated) : 0, cfg.rtt_ms,
+         sum.escalated ? sum.escalated_us / (double)sum.escalated : 0,
+         sum.escalated ? central_us / (double)sum.escalated : 0);
+  return ok ? 0 : 1;
+}
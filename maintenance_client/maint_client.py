@@ -0,0 +1,477 @@
+#!/usr/bin/env python3
+"""
+Maintenance mode client for the ESP32-H2 SoS button.
+
+Connects to a button in maintenance mode (5 presses within 3 s while it beacons),
+reads the diagnostics dump and the flash diagnostic log, reads/writes the authenticated field configuration and
+sends firmware updates as compressed deltas (built with host_tools/hb_delta).
+See button_firmware/maintenance.h, diag_log.h, field_config.h and ota_update.h for the formats.
+
+Authenticated writes use the button's own device key: the factory station saves it to
+device_keys.csv (mac,key) in the unit's first factory session, see maint_auth.h.
+Update headers are signed offline (ota-sign) with the key whose public half is
+OTA_SIGNING_PUBLIC_KEY in the firmware's secrets.h.
+
+Requires: pip install bleak (ota-sign: pip install cryptography)
+"""
+
+import argparse
+import asyncio
+import csv
+import hashlib
+import hmac
+import os
+import struct
+import sys
+import time
+import zlib
+
+from bleak import BleakClient, BleakScanner
+
+SERVICE_UUID = "4d41494e-0000-4a45-4e4e-594645520000"
+CHAR_DUMP_UUID = "4d41494e-000f-4a45-4e4e-594645520000"
+CHAR_CHALLENGE_UUID = "4d41494e-0010-4a45-4e4e-594645520000"
+CHAR_CONFIG_UUID = "4d41494e-0011-4a45-4e4e-594645520000"
+CHAR_OTA_CONTROL_UUID = "4d41494e-0012-4a45-4e4e-594645520000"
+CHAR_OTA_DATA_UUID = "4d41494e-0013-4a45-4e4e-594645520000"
+CHAR_CLOCK_UUID = "4d41494e-0014-4a45-4e4e-594645520000"
+CHAR_LINK_UUID = "4d41494e-0015-4a45-4e4e-594645520000"
+CHAR_LOG_UUID = "4d41494e-0016-4a45-4e4e-594645520000"
+
+DEVICE_STATES = ["UNINITIALIZED", "FACTORY_MODE", "NORMAL_MODE", "MAINTENANCE_MODE", "ERROR"]
+WAKE_PHASES = ["setup", "clocks", "ble_start", "pins", "ble_wait", "ble", "adv_start", "ieee_start", "ieee_stop",
+               "adv_stop", "sleep"]
+RADIOS = ["BLE", "802.15.4"]
+EVENT_TYPES = ["NONE", "BOOT", "FACTORY", "SOS", "ERROR", "CRASH", "MAINTENANCE", "SELFTEST", "CANCEL", "STUCK_BUTTON"]
+BUTTONS = ["SOS", "CANCEL"]  # STUCK_BUTTON arg bits
+BUTTON_GPIOS = {9: "SOS", 10: "CANCEL"}
+TX_POWER_DBM = [-24, -21, -18, -15, -12, -9, -6, -3, 0, 3, 6, 9, 12, 15, 18, 20]
+
+CONFIG_RECORD_VERSION = 1
+CONFIG_FORMAT = "<BBHHBBII"  # + uint32 crc
+IEEE_INTERVAL_UNIT_MS = 10
+CONFIG_AUTH_DOMAIN = b"HBCFG"
+AUTH_TAG_LEN = 16
+AUTH_KEY_LEN = 16  # MAINT_AUTH_KEY_LEN
+
+CLOCK_AUTH_DOMAIN = b"HBCLK"
+
+LINK_AUTH_DOMAIN = b"HBLNK"
+LINK_FORMAT = "<BBbBBBHIIB"  # tx_link_t (tx_power.h), + TX_POWER_HISTORY x (timestamp u32, level u8)
+LINK_HISTORY = 8
+LINK_REPORTS = 8  # TX_POWER_REPORTS
+LINK_DEFAULT_FLOOR_DBM = -90  # TX_POWER_DEFAULT_FLOOR_DBM
+LINK_DEFAULT_MARGIN_DB = 12  # TX_POWER_DEFAULT_MARGIN_DB
+CLOCK_EPOCH_UNIX = 1704067200  # BUTTON_CLOCK_EPOCH_UNIX, button_events.h
+
+LOG_PAGE = 256  # DIAG_LOG_PAGE, diag_log.h
+LOG_MAGIC = 0x4C444248  # DIAG_LOG_MAGIC
+
+OTA_AUTH_DOMAIN = b"HBOTA"
+OTA_HEADER_LEN = 76
+OTA_SIGNATURE_LEN = 64  # ECDSA P-256 r|s over SHA-256(header)
+OTA_BEGIN, OTA_END, OTA_ABORT = 1, 2, 3
+OTA_STATES = ["IDLE", "RECEIVING", "DONE", "FAILED"]
+OTA_ERRORS = ["NONE", "AUTH", "HEADER", "BASE", "PARTITION", "DECODE", "VERIFY", "STATE", "SIGNATURE"]
+
+
+# ============= Dump decoding =============
+def decode_rtc(data):
+    magic, _seed, counter, initialized, state, last_error = struct.unpack("<IIIBii", data[:21])
+    state_name = DEVICE_STATES[state] if 0 <= state < len(DEVICE_STATES) else str(state)
+    print(f"[RTC]      magic=0x{magic:08X} counter={counter} initialized={bool(initialized)} "
+          f"state={state_name} last_error={last_error}")
+
+
+def decode_energy(data):
+    total_uc, last_uc, active_ms, adv_ms = struct.unpack("<QIII", data[:20])
+    print(f"[ENERGY]   total={total_uc / 1e6:.3f} C ({total_uc / 3.6e6:.3f} mAh) last_wake={last_uc} uC "
+          f"active={active_ms} ms adv={adv_ms} ms")
+    for i, name in enumerate(RADIOS):
+        if len(data) < 20 + 16 * (i + 1):
+            break
+        frames, failed, airtime_ms, charge_uc = struct.unpack_from("<IIII", data, 20 + 16 * i)
+        print(f"[RADIO]    {name:<8} frames={frames} not_sent={failed} airtime={airtime_ms} ms "
+              f"charge={charge_uc / 1e6:.3f} C")
+
+
+def decode_timeline(data):
+    wakes = struct.unpack_from("<I", data, 0)[0]
+    phases = struct.unpack_from(f"<{len(WAKE_PHASES)}I", data, 4)
+    marks = " ".join(f"{n}={t}" for n, t in zip(WAKE_PHASES, phases) if t)
+    print(f"[TIMELINE] wake #{wakes}: {marks} (us)")
+    t = dict(zip(WAKE_PHASES, phases))
+    if t["ble_start"] and t["ble"]:
+        # diagBleOverlap(): BLE start time that ran in parallel with the local setup
+        overlap = min(t["ble_wait"], t["ble"]) - t["ble_start"] if t["ble_wait"] else 0
+        print(f"           BLE start {t['ble'] - t['ble_start']} us, {overlap} us of it in parallel with the local setup")
+
+
+def decode_events(data):
+    head, count = struct.unpack_from("<HH", data, 0)
+    size = (len(data) - 4) // 8
+    print(f"[EVENTS]   {count} event(s), oldest first:")
+    for i in range(count):
+        slot = (head - count + i) % size
+        wake, etype, arg, _ = struct.unpack_from("<IBBH", data, 4 + slot * 8)
+        name = EVENT_TYPES[etype] if etype < len(EVENT_TYPES) else str(etype)
+        if name == "STUCK_BUTTON":
+            stuck = "+".join(b for i, b in enumerate(BUTTONS) if arg >> i & 1) or "released"
+            print(f"           wake #{wake:<6} {name:<12} {stuck}")
+            continue
+        print(f"           wake #{wake:<6} {name:<12} arg={arg}")
+
+
+def decode_crash(data):
+    magic, pc, cause, ra, bt, build, reset, flags, _ = struct.unpack("<IIIII4sBBH", data[:28])
+    if magic != 0xC4A5D00D:
+        print("[CRASH]    none")
+        return
+    # Same line format as the factory session, so symbolize_crash.sh can read this output too
+    print(f"[CRASH] pc=0x{pc:08X} cause=0x{cause:08X} ra=0x{ra:08X} bt=0x{bt:08X} "
+          f"build={build.hex()} reset={reset} flags=0x{flags:02X}")
+
+
+def decode_health(data):
+    stuck_mask, backoff_s, episode_wake, episodes, checks = struct.unpack("<IIIHH", data[:16])
+    if not stuck_mask:
+        print(f"[HEALTH]   buttons ok, {episodes} stuck episode(s) since RTC init")
+        return
+    stuck = ", ".join(name for gpio, name in BUTTON_GPIOS.items() if stuck_mask >> gpio & 1) or f"0x{stuck_mask:X}"
+    print(f"[HEALTH]   STUCK: {stuck} since wake #{episode_wake}, {checks} timer check(s), "
+          f"next in {backoff_s} s (episode {episodes})")
+
+
+def decode_link(data):
+    valid, loss, floor, margin, max_level, last_level, reports, presses, report_press, _ = \
+        struct.unpack_from(LINK_FORMAT, data, 0)
+    if not valid:
+        print(f"[LINK]     no gateway report yet, configured TX power ({presses} presses)")
+        return
+    print(f"[LINK]     path loss {loss} dB, floor {floor} dBm + margin {margin} dB, max {TX_POWER_DBM[max_level]} dBm; "
+          f"last press {TX_POWER_DBM[last_level]} dBm; {reports} report(s), last {presses - report_press} presses ago")
+
+
+DECODERS = {1: decode_rtc, 2: decode_energy, 3: decode_timeline, 4: decode_events, 5: decode_crash, 6: decode_health,
+            7: decode_link}
+
+
+def decode_dump(dump):
+    print(f"[DUMP]     version {dump[0]}, {len(dump)} bytes")
+    offset = 1
+    while offset + 2 <= len(dump):
+        rtype, length = dump[offset], dump[offset + 1]
+        value = dump[offset + 2:offset + 2 + length]
+        DECODERS.get(rtype, lambda d: print(f"[?]        type {rtype}: {d.hex()}"))(value)
+        offset += 2 + length
+
+
+# ============= Configuration =============
+def decode_config(data):
+    version, tx, adv_min, adv_max, ieee_ch, ieee_iv, beacon_ms, factory_ms, crc = struct.unpack("<BBHHBBIII", data)
+    ieee = f"ch {ieee_ch} every {ieee_iv * IEEE_INTERVAL_UNIT_MS} ms" if ieee_ch else "off"
+    print(f"[CONFIG]   version={version} beacon={beacon_ms} ms factory_wait={factory_ms} ms "
+          f"adv={adv_min * 0.625:.1f}-{adv_max * 0.625:.1f} ms tx={TX_POWER_DBM[tx]} dBm 802.15.4={ieee} crc=0x{crc:08X}")
+    return dict(beacon_ms=beacon_ms, factory_ms=factory_ms, adv_min=adv_min, adv_max=adv_max, tx=tx,
+                ieee_channel=ieee_ch, ieee_interval=ieee_iv)
+
+
+def encode_config(cfg):
+    body = struct.pack(CONFIG_FORMAT, CONFIG_RECORD_VERSION, cfg["tx"], cfg["adv_min"], cfg["adv_max"],
+                       cfg["ieee_channel"], cfg["ieee_interval"], cfg["beacon_ms"], cfg["factory_ms"])
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def auth_tag(domain, payload, challenge, key):
+    """Same as maintAuthVerify() in the firmware (maint_auth.h)."""
+    return hmac.new(key, domain + challenge + payload, hashlib.sha256).digest()[:AUTH_TAG_LEN]
+
+
+def load_device_key(args):
+    """The button's device key: --device-key, or its latest row in the station's device_keys.csv."""
+    if args.device_key:
+        key = bytes.fromhex(args.device_key)
+    else:
+        if not os.path.isfile(args.keys):
+            sys.exit(f"[!] {args.keys} not found (factory_station/station.py --keys)")
+        with open(args.keys) as f:
+            rows = [row for row in csv.DictReader(f) if row["mac"].upper() == args.mac.upper()]
+        if not rows:
+            sys.exit(f"[!] No device key for {args.mac} in {args.keys}")
+        key = bytes.fromhex(rows[-1]["key"])  # A re-flashed unit draws a new key: the latest row is the one in use
+    if len(key) != AUTH_KEY_LEN:
+        sys.exit(f"[!] A device key is {AUTH_KEY_LEN} bytes")
+    return key
+
+
+# ============= Device clock =============
+async def read_clock(client):
+    """Device clock (device_clock.h): seconds since CLOCK_EPOCH_UNIX if synced, else since power-on."""
+    seconds, synced = struct.unpack("<IB", bytes(await client.read_gatt_char(CHAR_CLOCK_UUID)))
+    if synced:
+        offset = CLOCK_EPOCH_UNIX + seconds - int(time.time())
+        print(f"[CLOCK]    synced, {offset:+d} s from this computer")
+    else:
+        print(f"[CLOCK]    not synced, {seconds} s since power-on")
+    return seconds, synced
+
+
+async def sync_clock(client, key):
+    challenge = bytes(await client.read_gatt_char(CHAR_CHALLENGE_UUID))
+    payload = struct.pack("<I", int(time.time()))
+    await client.write_gatt_char(CHAR_CLOCK_UUID, payload + auth_tag(CLOCK_AUTH_DOMAIN, payload, challenge, key),
+                                 response=True)
+    _, synced = await read_clock(client)
+    print("[✓] Clock synced" if synced else "[!] Clock sync rejected by the device")
+
+
+# ============= Closed-loop TX power =============
+def read_link_reports(path, mac):
+    """Latest LINK_REPORTS presses of one button from rc_verify --link-report (mac,timestamp,rssi)."""
+    with open(path) as f:
+        rows = [row for row in csv.DictReader(f) if not mac or row["mac"].upper() == mac.upper()]
+    rows.sort(key=lambda row: int(row["timestamp"]) & 0x07FFFFFF)  # BUTTON_CLOCK_MASK: seconds
+    return [(int(row["timestamp"]), int(row["rssi"])) for row in rows[-LINK_REPORTS:]]
+
+
+async def send_link_report(client, reports, floor_dbm, margin_db, max_dbm, key):
+    """Gateway RSSI of recent presses -> the button's TX power estimate (tx_power.h)."""
+    padded = reports + [(0, 0)] * (LINK_REPORTS - len(reports))
+    payload = struct.pack("<bBBB", floor_dbm, margin_db, TX_POWER_DBM.index(max_dbm), len(reports))
+    payload += b"".join(struct.pack("<Ib", ts, rssi) for ts, rssi in padded)
+    challenge = bytes(await client.read_gatt_char(CHAR_CHALLENGE_UUID))
+    await client.write_gatt_char(CHAR_LINK_UUID, payload + auth_tag(LINK_AUTH_DOMAIN, payload, challenge, key),
+                                 response=True)
+    link = bytes(await client.read_gatt_char(CHAR_LINK_UUID))
+    decode_link(link)
+    valid, _, floor, margin = struct.unpack_from("<BBbB", link, 0)
+    applied = floor == floor_dbm and margin == margin_db and (valid or not reports)
+    print(f"[✓] {len(reports)} report(s) sent" if applied else "[!] Link report rejected by the device")
+
+
+# ============= Diagnostic log =============
+async def read_log(client, path):
+    """Read LOG until it returns nothing: valid pages, oldest first. Saved as read, for host_tools/diag_log_decode."""
+    pages = []
+    while True:
+        value = bytes(await client.read_gatt_char(CHAR_LOG_UUID))
+        if not value:
+            break
+        pages += [value[i:i + LOG_PAGE] for i in range(0, len(value) - LOG_PAGE + 1, LOG_PAGE)]
+        print(f"\r[*] {len(pages)} pages", end="", flush=True)
+    print()
+    if not pages:
+        print("[!] The log is empty")
+        return
+    seqs = [struct.unpack_from("<I", page, 8)[0] for page in pages
+            if struct.unpack_from("<I", page, 0)[0] == LOG_MAGIC]
+    with open(path, "wb") as f:
+        f.write(b"".join(pages))
+    print(f"[✓] {len(pages)} pages (seq {min(seqs)}-{max(seqs)}) saved to {path}")
+
+
+# ============= Firmware update =============
+async def read_ota_status(client):
+    state, error, next_seq, produced = struct.unpack("<BBHI", bytes(await client.read_gatt_char(CHAR_OTA_CONTROL_UUID)))
+    return OTA_STATES[state], OTA_ERRORS[error], next_seq, produced
+
+
+def check_delta_image(image):
+    if len(image) < OTA_HEADER_LEN or image[:4] != b"HBD1":
+        sys.exit("[!] Not a delta image (build it with host_tools/hb_delta)")
+
+
+def ota_sign(image_path, key_path, output):
+    """Sign the update header (base/target hashes and sizes) with the release key, raw r|s as the firmware reads it."""
+    from cryptography.hazmat.primitives import hashes, serialization
+    from cryptography.hazmat.primitives.asymmetric import ec
+    from cryptography.hazmat.primitives.asymmetric.utils import decode_dss_signature
+
+    with open(image_path, "rb") as f:
+        image = f.read()
+    check_delta_image(image)
+    with open(key_path, "rb") as f:
+        key = serialization.load_pem_private_key(f.read(), password=None)
+    if not isinstance(key, ec.EllipticCurvePrivateKey) or key.curve.name != "secp256r1":
+        sys.exit("[!] The signing key must be an ECDSA P-256 key")
+    r, s = decode_dss_signature(key.sign(image[:OTA_HEADER_LEN], ec.ECDSA(hashes.SHA256())))
+    with open(output, "wb") as f:
+        f.write(r.to_bytes(32, "big") + s.to_bytes(32, "big"))
+    print(f"[✓] Header signed, signature saved to {output}")
+
+
+async def ota_update(client, image, signature, key, window):
+    """BEGIN, stream the delta (go-back-N on the device's next_seq), END."""
+    check_delta_image(image)
+    if len(signature) != OTA_SIGNATURE_LEN:
+        sys.exit(f"[!] A header signature is {OTA_SIGNATURE_LEN} bytes (ota-sign)")
+    header, payload = image[:OTA_HEADER_LEN], image[OTA_HEADER_LEN:]
+    target_size = struct.unpack_from("<I", header, 40)[0]
+
+    challenge = bytes(await client.read_gatt_char(CHAR_CHALLENGE_UUID))
+    tag = auth_tag(OTA_AUTH_DOMAIN, header, challenge, key)
+    await client.write_gatt_char(CHAR_OTA_CONTROL_UUID, bytes([OTA_BEGIN]) + header + tag + signature, response=True)
+    state, error, _, _ = await read_ota_status(client)
+    if state != "RECEIVING":
+        sys.exit(f"[!] Update refused: {error}")
+
+    chunk = client.mtu_size - 3 - 2
+    chunks = [payload[i:i + chunk] for i in range(0, len(payload), chunk)]
+    print(f"[*] Sending {len(payload)} bytes in {len(chunks)} chunks of {chunk} bytes")
+    base = 0
+    while base < len(chunks):
+        for seq in range(base, min(len(chunks), base + window)):
+            await client.write_gatt_char(CHAR_OTA_DATA_UUID, struct.pack("<H", seq) + chunks[seq], response=False)
+        state, error, base, produced = await read_ota_status(client)
+        if state != "RECEIVING":
+            sys.exit(f"[!] Update failed: {error}")
+        print(f"\r[*] {base}/{len(chunks)} chunks, {produced}/{target_size} bytes written", end="", flush=True)
+    print()
+
+    await client.write_gatt_char(CHAR_OTA_CONTROL_UUID, bytes([OTA_END]), response=True)
+    state, error, _, _ = await read_ota_status(client)
+    if state != "DONE":
+        sys.exit(f"[!] Update failed: {error}")
+    print("[✓] Image verified, the button restarts into it after disconnecting")
+
+
+# ============= BLE =============
+async def find_device(address):
+    if address:
+        return address
+    print("[*] Scanning for a button in maintenance mode ...")
+    device = await BleakScanner.find_device_by_filter(
+        lambda d, adv: SERVICE_UUID in [u.lower() for u in adv.service_uuids], timeout=20.0)
+    if device is None:
+        sys.exit("[!] No button in maintenance mode found")
+    print(f"[✓] Found {device.address}")
+    return device.address
+
+
+async def run(args):
+    address = await find_device(args.address)
+    async with BleakClient(address) as client:
+        if args.command == "dump":
+            decode_dump(bytes(await client.read_gatt_char(CHAR_DUMP_UUID)))
+            return
+
+        if args.command == "log":
+            await read_log(client, args.output)
+            return
+
+        if args.command == "clock-get":
+            await read_clock(client)
+            return
+
+        if args.command == "link-get":
+            decode_link(bytes(await client.read_gatt_char(CHAR_LINK_UUID)))
+            return
+
+        if args.command == "link-report":
+            key = load_device_key(args)
+            reports = read_link_reports(args.reports, args.mac) if args.reports else []
+            print(f"[*] {len(reports)} press(es) of this button in {args.reports}" if args.reports else "[*] Settings only")
+            await send_link_report(client, reports, args.floor_dbm, args.margin_db, args.max_dbm, key)
+            return
+
+        if args.command == "clock-sync":
+            await sync_clock(client, load_device_key(args))
+            return
+
+        if args.command == "ota":
+            key = load_device_key(args)
+            with open(args.image, "rb") as f:
+                image = f.read()
+            with open(args.signature or args.image + ".sig", "rb") as f:
+                signature = f.read()
+            await ota_update(client, image, signature, key, args.window)
+            return
+
+        current = decode_config(bytes(await client.read_gatt_char(CHAR_CONFIG_UUID)))
+        if args.command == "config-get":
+            return
+
+        key = load_device_key(args)
+        cfg = dict(current)
+        if args.beacon_ms is not None:
+            cfg["beacon_ms"] = args.beacon_ms
+        if args.factory_ms is not None:
+            cfg["factory_ms"] = args.factory_ms
+        if args.adv_min_ms is not None:
+            cfg["adv_min"] = round(args.adv_min_ms / 0.625)
+        if args.adv_max_ms is not None:
+            cfg["adv_max"] = round(args.adv_max_ms / 0.625)
+        if args.tx_dbm is not None:
+            cfg["tx"] = TX_POWER_DBM.index(args.tx_dbm)
+        if args.ieee_channel is not None:
+            cfg["ieee_channel"] = args.ieee_channel
+            if args.ieee_channel and not cfg["ieee_interval"]:
+                cfg["ieee_interval"] = 100 // IEEE_INTERVAL_UNIT_MS
+            elif not args.ieee_channel:
+                cfg["ieee_interval"] = 0
+        if args.ieee_interval_ms is not None and cfg["ieee_channel"]:
+            cfg["ieee_interval"] = round(args.ieee_interval_ms / IEEE_INTERVAL_UNIT_MS)
+
+        record = encode_config(cfg)
+        challenge = bytes(await client.read_gatt_char(CHAR_CHALLENGE_UUID))
+        await client.write_gatt_char(CHAR_CONFIG_UUID, record + auth_tag(CONFIG_AUTH_DOMAIN, record, challenge, key),
+                                     response=True)
+        applied = decode_config(bytes(await client.read_gatt_char(CHAR_CONFIG_UUID)))
+        print("[✓] Configuration applied" if applied == cfg else "[!] Configuration rejected by the device")
+
+
+def add_key_args(parser, mac_help="Custom MAC burned in eFuse, to look up the device key"):
+    parser.add_argument("--keys", default="../factory_station/device_keys.csv",
+                        help="Device keys saved by the factory station (mac,key)")
+    who = parser.add_mutually_exclusive_group(required=True)
+    who.add_argument("--mac", help=mac_help)
+    who.add_argument("--device-key", help="Device key (32 hex digits)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SoS button maintenance mode client")
+    parser.add_argument("--address", help="BLE address (default: scan for the maintenance service)")
+    sub = parser.add_subparsers(dest="command", required=True)
+    sub.add_parser("dump", help="Read and decode the diagnostics dump")
+    log = sub.add_parser("log", help="Read the flash diagnostic log (decode with host_tools/diag_log_decode)")
+    log.add_argument("output", nargs="?", default="diag_log.bin", help="File the pages are saved to")
+    sub.add_parser("config-get", help="Read the active field configuration")
+    cfg = sub.add_parser("config-set", help="Write the field configuration (authenticated)")
+    add_key_args(cfg)
+    cfg.add_argument("--beacon-ms", type=int)
+    cfg.add_argument("--factory-ms", type=int)
+    cfg.add_argument("--adv-min-ms", type=float)
+    cfg.add_argument("--adv-max-ms", type=float)
+    cfg.add_argument("--tx-dbm", type=int, choices=TX_POWER_DBM)
+    cfg.add_argument("--ieee-channel", type=int, choices=[0] + list(range(11, 27)),
+                     help="802.15.4 SOS transport channel, 0 = off")
+    cfg.add_argument("--ieee-interval-ms", type=int, help="802.15.4 frame interval (20-1000 ms)")
+    sub.add_parser("clock-get", help="Read the device clock")
+    clk = sub.add_parser("clock-sync", help="Set the device clock to this computer's time (authenticated)")
+    add_key_args(clk)
+    sub.add_parser("link-get", help="Read the closed-loop TX power estimate")
+    link = sub.add_parser("link-report", help="Send gateway RSSI of recent presses for the TX power (authenticated)")
+    link.add_argument("--reports", help="rc_verify --link-report output (mac,timestamp,rssi); none: settings only")
+    link.add_argument("--floor-dbm", type=int, default=LINK_DEFAULT_FLOOR_DBM, help="Gateway RSSI the margin counts from")
+    link.add_argument("--margin-db", type=int, default=LINK_DEFAULT_MARGIN_DB, help="Link margin (3-40 dB)")
+    link.add_argument("--max-dbm", type=int, default=TX_POWER_DBM[-1], choices=TX_POWER_DBM, help="Highest TX power")
+    add_key_args(link, "Custom MAC burned in eFuse: looks up the device key, selects the reports "
+                       "(with --device-key the reports aren't filtered)")
+    ota = sub.add_parser("ota", help="Send a firmware update (delta image from host_tools/hb_delta)")
+    ota.add_argument("image", help="Delta image (.hbd)")
+    ota.add_argument("--signature", help="Header signature from ota-sign (default: <image>.sig)")
+    add_key_args(ota)
+    ota.add_argument("--window", type=int, default=16, help="Chunks sent before reading the status")
+    sign = sub.add_parser("ota-sign", help="Sign a delta image's header with the release key (offline)")
+    sign.add_argument("image", help="Delta image (.hbd)")
+    sign.add_argument("--key", required=True, help="ECDSA P-256 private key (PEM), see secrets_template.h")
+    sign.add_argument("--output", help="Signature file (default: <image>.sig)")
+    args = parser.parse_args()
+    if args.command == "ota-sign":
+        ota_sign(args.image, args.key, args.output or args.image + ".sig")
+        return
+    asyncio.run(run(args))
+
+
+if __name__ == "__main__":
+    main()